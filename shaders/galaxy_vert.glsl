@@ -1,24 +1,42 @@
 attribute vec4 in_Position;
 attribute vec4 in_TexCoord0;
-//attribute float in_ColorIndex;
-//attribute float in_Alpha;
 
 uniform sampler2D colorTex;
 
+// galaxy scale, size and orientation
+uniform mat3 m;
+// rotation which keeps the sprites facing the viewer
+uniform mat3 viewMat;
+// position of the galaxy relative to the viewer
+uniform vec3 offset;
+// size of the sprites of level 0
+uniform float size;
+uniform float spriteScaleFactor;
+// brightness of the galaxy times its corrections, per unit of blob brightness
+uniform float brightness;
+
 varying vec4 color;
 varying vec2 texCoord;
 
 void main(void)
 {
-    // we pass color index as short int
-    // reusing gl_MultiTexCoord0.z
+    // in_Position.w is the sprite level, sprites are smaller for every level
+    float spriteSize = size * pow(spriteScaleFactor, in_Position.w);
+    vec3 p = m * in_Position.xyz;
+
+    // Sprites fade out as they get closer, and are hidden once they cover
+    // a tenth of the field
+    float screenFrac = spriteSize / length(p + offset);
+    float a = brightness * in_TexCoord0.w * (0.1 - screenFrac);
+
+    // in_TexCoord0.z is the color index
     // we use 255 only because we have 256 color indices
     float t = in_TexCoord0.z / 255.0; // [0, 255] -> [0, 1]
-    // we pass alpha values as as short int
-    // reusing gl_MultiTexCoord0.w
-    // we use 65535 for better precision
-    float a = in_TexCoord0.w / 65535.0; // [0, 65535] -> [0, 1]
-    color = vec4(texture2D(colorTex, vec2(t, 0.0)).rgb, a);
+    color = vec4(texture2D(colorTex, vec2(t, 0.0)).rgb, min(1.0, a));
     texCoord = in_TexCoord0.st;
-    set_vp(in_Position);
+
+    vec3 corner = viewMat * vec3(in_TexCoord0.st * 2.0 - 1.0, 0.0) * spriteSize;
+    if (screenFrac >= 0.1)
+        corner = vec3(0.0);
+    set_vp(vec4(p + corner, 1.0));
 }
@@ -946,6 +946,7 @@ void Body::addLocation(Location* loc)
         locations = new vector<Location*>();
     locations->push_back(loc);
     loc->setParentBody(this);
+    locationIndex = nullptr;
 }
 
 
@@ -987,12 +988,23 @@ void Body::computeLocations()
         return;
     Geometry* g = GetGeometryManager()->find(geometry);
     if (!g)
+    {
+        // Try again once a model being loaded in the background is ready
+        if (GetGeometryManager()->getState(geometry) == ResourceLoading)
+            locationsComputed = false;
         return;
+    }
 
     // TODO: Implement separate radius and bounding radius so that this hack is
     // not necessary.
     double boundingRadius = 2.0;
 
+    // Cast the rays for all locations at once, so that the geometry can
+    // trace them in parallel.
+    vector<Ray3d> rays;
+    vector<float> altitudes;
+    rays.reserve(locations->size());
+    altitudes.reserve(locations->size());
     for (const auto location : *locations)
     {
         Vector3f v = location->getPosition();
@@ -1001,14 +1013,36 @@ void Body::computeLocations()
             v.normalize();
         v *= (float) boundingRadius;
 
-        Ray3d ray(v.cast<double>(), -v.cast<double>());
-        double t = 0.0;
-        if (g->pick(ray, t))
+        rays.emplace_back(v.cast<double>(), -v.cast<double>());
+        altitudes.push_back(alt);
+    }
+
+    vector<double> distances;
+    g->pick(rays, distances);
+
+    for (size_t i = 0; i < locations->size(); i++)
+    {
+        double t = distances[i];
+        if (t >= 0.0)
         {
-            v *= (float) ((1.0 - t) * radius + alt);
-            location->setPosition(v);
+            Vector3f v = rays[i].origin.cast<float>();
+            v *= (float) ((1.0 - t) * radius + altitudes[i]);
+            (*locations)[i]->setPosition(v);
         }
     }
+    locationIndex = nullptr;
+}
+
+
+const LocationIndex* Body::getLocationIndex() const
+{
+    if (locations == nullptr)
+        return nullptr;
+
+    if (locationIndex == nullptr)
+        locationIndex.reset(new LocationIndex(*locations));
+
+    return locationIndex.get();
 }
 
 
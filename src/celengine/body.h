@@ -14,6 +14,7 @@
 #include <celengine/surface.h>
 #include <celengine/star.h>
 #include <celengine/location.h>
+#include <celengine/locationindex.h>
 #include <celengine/timeline.h>
 #include <celephem/rotation.h>
 #include <celephem/orbit.h>
@@ -321,6 +322,7 @@ class Body : public AstroObject
     void addLocation(Location*);
     Location* findLocation(const std::string&, bool i18n = false) const;
     void computeLocations();
+    const LocationIndex* getLocationIndex() const;
 
     bool isVisible() const { return visible; }
     void setVisible(bool _visible);
@@ -415,6 +417,9 @@ class Body : public AstroObject
 
     std::vector<Location*>* locations{ nullptr };
     mutable bool locationsComputed{ false };
+    // Built when first needed, and rebuilt when locations are added or
+    // moved
+    mutable std::unique_ptr<LocationIndex> locationIndex;
 
     std::list<ReferenceMark*>* referenceMarks{ nullptr };
 
@@ -101,13 +101,13 @@ DeepSkyObject* DSODatabase::find(const string& name) const
 }
 
 
-vector<string> DSODatabase::getCompletion(const string& name) const
+vector<string> DSODatabase::getCompletion(const string& name, size_t maxResults) const
 {
     vector<string> completion;
 
     // only named DSOs are supported by completion.
     if (!name.empty() && namesDB != nullptr)
-        return namesDB->getCompletion(name);
+        return namesDB->getCompletion(name, true, maxResults);
     else
         return completion;
 }
@@ -119,14 +119,9 @@ string DSODatabase::getDSOName(const DeepSkyObject* const & dso, bool i18n) cons
 
     if (namesDB != nullptr)
     {
-        DSONameDatabase::NumberIndex::const_iterator iter   = namesDB->getFirstNameIter(catalogNumber);
-        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
-        {
-            if (i18n && iter->second != _(iter->second.c_str()))
-                return _(iter->second.c_str());
-            else
-                return iter->second;
-        }
+        const char* name = namesDB->getFirstName(catalogNumber);
+        if (name != nullptr)
+            return i18n ? _(name) : name;
     }
 
     return "";
@@ -139,16 +134,13 @@ string DSODatabase::getDSONameList(const DeepSkyObject* const & dso, const unsig
 
     auto catalogNumber   = dso->getIndex();
 
-    DSONameDatabase::NumberIndex::const_iterator iter  = namesDB->getFirstNameIter(catalogNumber);
-
     unsigned int count = 0;
-    while (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber && count < maxNames)
+    for (const auto& name : namesDB->getNamesByCatalogNumber(catalogNumber, maxNames))
     {
         if (count != 0)
             dsoNames   += " / ";
 
-        dsoNames   += iter->second;
-        ++iter;
+        dsoNames   += name;
         ++count;
     }
 
@@ -364,6 +356,8 @@ void DSODatabase::finish()
     buildOctree();
     buildIndexes();
     calcAvgAbsMag();
+    if (namesDB != nullptr)
+        namesDB->freeze();
     /*
     // Put AbsMag = avgAbsMag for Add-ons without AbsMag entry
     for (int i = 0; i < nDSOs; ++i)
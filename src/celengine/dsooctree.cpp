@@ -102,21 +102,24 @@ void DSOOctree::processVisibleObjects(DSOHandler&    processor,
     // Process the objects in this node
     double dimmest     = minDistance > 0.0 ? astro::appToAbsMag((double) limitingFactor, minDistance) : 1000.0;
 
-    for (unsigned int i=0; i<nObjects; ++i)
     {
+        OctreeCandidateBuffer<DeepSkyObject*, double> candidates(processor);
+        for (unsigned int i=0; i<nObjects; ++i)
+        {
 #ifdef OCTREE_DEBUG
-        if (stats != nullptr)
-            stats->objects++;
+            if (stats != nullptr)
+                stats->objects++;
 #endif
-        DeepSkyObject* _obj = _firstObject[i];
-        float  absMag      = _obj->getAbsoluteMagnitude();
-        if (absMag < dimmest)
-        {
-            double distance    = (obsPosition - _obj->getPosition()).norm() - _obj->getBoundingSphereRadius();
-            float appMag = (float) ((distance >= 32.6167) ? astro::absToAppMag((double) absMag, distance) : absMag);
+            DeepSkyObject* const& _obj = _firstObject[i];
+            float  absMag      = _obj->getAbsoluteMagnitude();
+            if (absMag < dimmest)
+            {
+                double distance    = (obsPosition - _obj->getPosition()).norm() - _obj->getBoundingSphereRadius();
+                float appMag = (float) ((distance >= 32.6167) ? astro::absToAppMag((double) absMag, distance) : absMag);
 
-            if ( appMag < limitingFactor)
-                processor.process(_obj, distance, absMag);
+                if ( appMag < limitingFactor)
+                    candidates.add(_obj, distance, absMag);
+            }
         }
     }
 
@@ -170,16 +173,19 @@ void DSOOctree::processCloseObjects(DSOHandler&    processor,
     double radiusSquared    = boundingRadius * boundingRadius;    //
 
     // Check all the objects in the node.
-    for (unsigned int i=0; i<nObjects; ++i)
     {
-        DeepSkyObject* _obj = _firstObject[i];        //
-
-        if ((obsPosition - _obj->getPosition()).squaredNorm() < radiusSquared)    //
+        OctreeCandidateBuffer<DeepSkyObject*, double> candidates(processor);
+        for (unsigned int i=0; i<nObjects; ++i)
         {
-            float  absMag      = _obj->getAbsoluteMagnitude();
-            double distance    = (obsPosition - _obj->getPosition()).norm() - _obj->getBoundingSphereRadius();
+            DeepSkyObject* const& _obj = _firstObject[i];        //
 
-            processor.process(_obj, distance, absMag);
+            if ((obsPosition - _obj->getPosition()).squaredNorm() < radiusSquared)    //
+            {
+                float  absMag      = _obj->getAbsoluteMagnitude();
+                double distance    = (obsPosition - _obj->getPosition()).norm() - _obj->getBoundingSphereRadius();
+
+                candidates.add(_obj, distance, absMag);
+            }
         }
     }
 
@@ -186,3 +186,9 @@ void DSORenderer::process(DeepSkyObject* const &dso,
         }
     }     // labels enabled
 }
+
+void DSORenderer::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        DSORenderer::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+}
@@ -22,6 +22,7 @@ class DSORenderer : public ObjectRenderer<DeepSkyObject*, double>
     DSORenderer();
 
     void process(DeepSkyObject* const &, double, float);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
  public:
     Eigen::Vector3d     obsPos;
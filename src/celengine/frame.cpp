@@ -16,6 +16,7 @@
 #include <celengine/deepskyobj.h>
 #include <celengine/location.h>
 #include <celengine/frame.h>
+#include <celephem/threadcache.h>
 
 using namespace Eigen;
 using namespace std;
@@ -443,53 +444,84 @@ BodyMeanEquatorFrame::nestingDepth(unsigned int depth,
 
 /*** CachingFrame ***/
 
+namespace
+{
+struct CachedFrameState
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    uint64_t id{ 0 };
+    double time{ 0.0 };
+    Quaterniond orientation;
+    Vector3d angularVelocity;
+    bool orientationValid{ false };
+    bool angularVelocityValid{ false };
+};
+
+typedef ThreadCache<CachedFrameState> FrameStateCache;
+}
+
+
 CachingFrame::CachingFrame(Selection _center) :
     ReferenceFrame(_center),
-    lastTime(-1.0e50),
-    lastOrientation(Quaterniond::Identity()),
-    lastAngularVelocity(0.0, 0.0, 0.0),
-    orientationCacheValid(false),
-    angularVelocityCacheValid(false)
+    cacheId(FrameStateCache::newId())
+{
+}
+
+
+CachingFrame::CachingFrame(const CachingFrame& other) :
+    ReferenceFrame(other),
+    cacheId(FrameStateCache::newId())
 {
 }
 
 
+CachingFrame::~CachingFrame()
+{
+    FrameStateCache::releaseId(cacheId);
+}
+
+
+// The cache entry may be updated by nested evaluations of the frame while
+// computing the orientation, so it's only updated once the result is known.
 Quaterniond
 CachingFrame::getOrientation(double tjd) const
 {
-    if (tjd != lastTime)
-    {
-        lastTime = tjd;
-        lastOrientation = computeOrientation(tjd);
-        orientationCacheValid = true;
-        angularVelocityCacheValid = false;
-    }
-    else if (!orientationCacheValid)
+    CachedFrameState& state = FrameStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == tjd && state.orientationValid)
+        return state.orientation;
+
+    Quaterniond q = computeOrientation(tjd);
+    if (state.id != cacheId || state.time != tjd)
     {
-        lastOrientation = computeOrientation(tjd);
-        orientationCacheValid = true;
+        state.id = cacheId;
+        state.time = tjd;
+        state.angularVelocityValid = false;
     }
+    state.orientation = q;
+    state.orientationValid = true;
 
-    return lastOrientation;
+    return q;
 }
 
 
 Vector3d CachingFrame::getAngularVelocity(double tjd) const
 {
-    if (tjd != lastTime)
-    {
-        lastTime = tjd;
-        lastAngularVelocity = computeAngularVelocity(tjd);
-        orientationCacheValid = false;
-        angularVelocityCacheValid = true;
-    }
-    else if (!angularVelocityCacheValid)
+    CachedFrameState& state = FrameStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == tjd && state.angularVelocityValid)
+        return state.angularVelocity;
+
+    Vector3d w = computeAngularVelocity(tjd);
+    if (state.id != cacheId || state.time != tjd)
     {
-        lastAngularVelocity = computeAngularVelocity(tjd);
-        angularVelocityCacheValid = true;
+        state.id = cacheId;
+        state.time = tjd;
+        state.orientationValid = false;
     }
+    state.angularVelocity = w;
+    state.angularVelocityValid = true;
 
-    return lastAngularVelocity;
+    return w;
 }
 
 
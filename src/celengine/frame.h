@@ -12,6 +12,7 @@
 #define _CELENGINE_FRAME_H_
 
 #include <celengine/astro.h>
+#include <cstdint>
 #include <celengine/selection.h>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
@@ -64,7 +65,8 @@ class ReferenceFrame
 
 
 /*! Base class for complex frames where there may be some benefit
- *  to caching the last calculated orientation.
+ *  to caching the last calculated orientation. Each thread caches the
+ *  orientations it computed separately.
  */
 class CachingFrame : public ReferenceFrame
 {
@@ -74,7 +76,9 @@ class CachingFrame : public ReferenceFrame
     SHARED_TYPES(CachingFrame)
 
     CachingFrame(Selection _center);
-    virtual ~CachingFrame() {};
+    CachingFrame(const CachingFrame&);
+    CachingFrame& operator=(const CachingFrame&) = delete;
+    virtual ~CachingFrame();
 
     Eigen::Quaterniond getOrientation(double tjd) const;
     Eigen::Vector3d getAngularVelocity(double tjd) const;
@@ -82,11 +86,8 @@ class CachingFrame : public ReferenceFrame
     virtual Eigen::Vector3d computeAngularVelocity(double tjd) const;
 
  private:
-    mutable double lastTime;
-    mutable Eigen::Quaterniond lastOrientation;
-    mutable Eigen::Vector3d lastAngularVelocity;
-    mutable bool orientationCacheValid;
-    mutable bool angularVelocityCacheValid;
+    // Identifies the frame in the per-thread caches
+    const uint64_t cacheId;
 };
 
 
@@ -0,0 +1,149 @@
+// framereadback.cpp
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Asynchronous read back of rendered frames.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstring>
+#include "framereadback.h"
+
+using namespace celestia;
+
+
+static bool pixelBuffersSupported()
+{
+#ifdef GL_ES
+    return gl::checkVersion(30);
+#else
+    return gl::checkVersion(gl::GL_2_1);
+#endif
+}
+
+static const void* mapPackBuffer(GLsizeiptr size)
+{
+#ifdef GL_ES
+    return glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+#else
+    return glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+#endif
+}
+
+static void setFrameSize(CapturedFrame& frame,
+                         int width, int height,
+                         Renderer::PixelFormat format)
+{
+    frame.width = width;
+    frame.height = height;
+    frame.format = format;
+    // Rows are padded to the default GL_PACK_ALIGNMENT of 4
+    frame.rowStride = (width * frame.bytesPerPixel() + 3) & ~0x3;
+    frame.pixels.resize((size_t) frame.rowStride * height);
+}
+
+
+FrameReadback::FrameReadback(const Renderer* _renderer, unsigned int _latency) :
+    renderer(_renderer),
+    latency(_latency),
+    usePixelBuffers(_latency > 0 && pixelBuffersSupported())
+{
+}
+
+FrameReadback::~FrameReadback()
+{
+    for (const auto& read : pending)
+    {
+        if (read.buffer.id != 0)
+            glDeleteBuffers(1, &read.buffer.id);
+    }
+    for (const auto& buffer : freeBuffers)
+        glDeleteBuffers(1, &buffer.id);
+}
+
+bool FrameReadback::read(int x, int y, int width, int height,
+                         Renderer::PixelFormat format, bool back)
+{
+    PendingRead read;
+    read.buffer = { 0, 0 };
+    setFrameSize(read.frame, width, height, format);
+
+    if (!usePixelBuffers)
+    {
+        if (!renderer->captureFrame(x, y, width, height, format,
+                                    read.frame.pixels.data(), back))
+        {
+            return false;
+        }
+        pending.push_back(std::move(read));
+        return true;
+    }
+
+    // Only the frame size is kept, the pixels go to the buffer
+    auto size = (GLsizeiptr) read.frame.pixels.size();
+    read.frame.pixels = std::vector<unsigned char>();
+
+    if (!freeBuffers.empty())
+    {
+        read.buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    else
+    {
+        glGenBuffers(1, &read.buffer.id);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer.id);
+    if (read.buffer.size < size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        read.buffer.size = size;
+    }
+
+    // With a pack buffer bound, the pointer passed to glReadPixels is an
+    // offset into the buffer.
+    bool ok = renderer->captureFrame(x, y, width, height, format, nullptr, back);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (!ok)
+    {
+        freeBuffers.push_back(read.buffer);
+        return false;
+    }
+
+    pending.push_back(std::move(read));
+    return true;
+}
+
+bool FrameReadback::retrieve(CapturedFrame& frame)
+{
+    if (pending.empty())
+        return false;
+
+    PendingRead read = std::move(pending.front());
+    pending.pop_front();
+
+    if (read.buffer.id == 0)
+    {
+        frame = std::move(read.frame);
+        return true;
+    }
+
+    setFrameSize(frame, read.frame.width, read.frame.height, read.frame.format);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer.id);
+    const void* data = mapPackBuffer((GLsizeiptr) frame.pixels.size());
+    if (data != nullptr)
+    {
+        std::memcpy(frame.pixels.data(), data, frame.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    freeBuffers.push_back(read.buffer);
+
+    return data != nullptr;
+}
@@ -0,0 +1,87 @@
+// framereadback.h
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Asynchronous read back of rendered frames.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "glsupport.h"
+#include "render.h"
+
+struct CapturedFrame
+{
+    int width{ 0 };
+    int height{ 0 };
+    int rowStride{ 0 };
+    Renderer::PixelFormat format{ Renderer::PixelFormat::RGB };
+    // Rows are stored bottom up, as returned by glReadPixels
+    std::vector<unsigned char> pixels;
+
+    int bytesPerPixel() const
+    {
+        return format == Renderer::PixelFormat::RGBA ? 4 : 3;
+    }
+};
+
+// glReadPixels into client memory waits until the GPU has finished
+// rendering the frame. FrameReadback instead reads into a ring of pixel
+// pack buffers and only maps a buffer once latency more frames have been
+// read, by which time the transfer has normally completed. With a latency
+// of zero, or when pixel buffers aren't supported, frames are read
+// synchronously.
+//
+// All the methods must be called with the GL context current.
+class FrameReadback
+{
+ public:
+    FrameReadback(const Renderer* renderer, unsigned int latency);
+    ~FrameReadback();
+
+    FrameReadback(const FrameReadback&) = delete;
+    FrameReadback& operator=(const FrameReadback&) = delete;
+
+    // Start reading a rectangle of the back or front buffer.
+    bool read(int x, int y, int width, int height,
+              Renderer::PixelFormat format, bool back);
+
+    // Copy the oldest pending frame into frame, reusing its pixel storage,
+    // and waiting for the transfer to complete if it hasn't yet. Returns
+    // false if the pixels couldn't be read.
+    bool retrieve(CapturedFrame& frame);
+
+    bool hasPendingFrame() const { return !pending.empty(); }
+
+    // True once latency frames have been read after the oldest pending one
+    bool hasReadyFrame() const
+    {
+        return pending.size() > (usePixelBuffers ? latency : 0);
+    }
+
+ private:
+    struct PixelBuffer
+    {
+        GLuint id;
+        GLsizeiptr size;
+    };
+
+    struct PendingRead
+    {
+        PixelBuffer buffer;
+        // Pixels read synchronously, when pixel buffers aren't used
+        CapturedFrame frame;
+    };
+
+    const Renderer* renderer;
+    unsigned int latency;
+    bool usePixelBuffers;
+    std::vector<PixelBuffer> freeBuffers;
+    std::deque<PendingRead> pending;
+};
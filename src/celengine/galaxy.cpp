@@ -13,6 +13,7 @@
 #include "galaxy.h"
 #include "vecgl.h"
 #include "texture.h"
+#include "vertexobject.h"
 #include <celmath/mathlib.h>
 #include <celmath/perlin.h>
 #include <celmath/intersect.h>
@@ -21,12 +22,14 @@
 #include <celcompat/filesystem.h>
 #include <fstream>
 #include <algorithm>
+#include <map>
 #include <random>
 #include <cassert>
 
 using namespace Eigen;
 using namespace std;
 using namespace celmath;
+using namespace celgl;
 using namespace celestia;
 
 static int width = 128, height = 128;
@@ -37,6 +40,7 @@ static bool formsInitialized = false;
 static GalacticForm** spiralForms     = nullptr;
 static GalacticForm** ellipticalForms = nullptr;
 static GalacticForm*  irregularForm   = nullptr;
+static map<fs::path, GalacticForm*> customForms;
 
 static Texture* galaxyTex = nullptr;
 static Texture* colorTex  = nullptr;
@@ -57,6 +61,8 @@ class GalacticForm
 public:
     BlobVector* blobs;
     Vector3f scale;
+    // Sprites of the blobs, uploaded when the form is first drawn
+    VertexObject vo{ GL_ARRAY_BUFFER, 0, GL_STATIC_DRAW };
 };
 
 struct GalaxyTypeName
@@ -170,7 +176,12 @@ void Galaxy::setType(const string& typeStr)
 
     if (customTmpName != nullptr)
     {
-        form = buildGalacticForms(fs::path("models") / *customTmpName);
+        // Galaxies with the same template share its form
+        fs::path filename = fs::path("models") / *customTmpName;
+        auto iter = customForms.find(filename);
+        if (iter == customForms.end())
+            iter = customForms.emplace(filename, buildGalacticForms(filename)).first;
+        form = iter->second;
     }
     else
     {
@@ -287,30 +298,78 @@ void Galaxy::render(const Vector3f& offset,
     }
 }
 
+// Ratio of the sizes of the sprites of successive levels; the first sprite
+// is level 0, then each level has twice as many sprites as the previous one.
+static const float SpriteScaleFactor = 1.0f / 1.55f;
+
 struct GalaxyVertex
 {
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-    Vector4f position;
-    Matrix<GLushort, 4, 1> texCoord; // texCoord.x = x, texCoord.y = y, texCoord.z = color index, texCoord.w = alpha
+    Vector3f position;
+    float level;                     // read with position as in_Position.w
+    Matrix<GLushort, 4, 1> texCoord; // texCoord.x = x, texCoord.y = y, texCoord.z = color index, texCoord.w = brightness
 };
 
-typedef vector<GalaxyVertex, aligned_allocator<GalaxyVertex>> AlignedGalaxyVertices;
+// Blob brightnesses, up to 255, are stored with 8 fractional bits, as dim
+// blobs are a large part of the light of a galaxy
+static const float BrightnessScale = 256.0f;
 
-static void draw(const AlignedGalaxyVertices& v, size_t count, const GLushort *indices)
+// Upload the blobs of a form as a quad each. Their position, size and
+// alpha are computed by the shader.
+static void initGalaxyData(VertexObject& vo, const BlobVector* points)
 {
-    glVertexAttribPointer(CelestiaGLProgram::VertexCoordAttributeIndex,
-                          4, GL_FLOAT, GL_FALSE,
-                          sizeof(GalaxyVertex), v[0].position.data());
-    glVertexAttribPointer(CelestiaGLProgram::TextureCoord0AttributeIndex,
-                          4, GL_UNSIGNED_SHORT, GL_FALSE,
-                          sizeof(GalaxyVertex), v[0].texCoord.data());
-    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, indices);
+    static const GLushort corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    vector<GalaxyVertex> vertices;
+    vertices.reserve(points->size() * 4);
+
+    float level = 0.0f;
+    size_t pow2 = 1;
+    for (size_t i = 0; i < points->size(); i++)
+    {
+        if ((i & pow2) != 0)
+        {
+            pow2 <<= 1;
+            level += 1.0f;
+        }
+
+        const Blob& b = (*points)[i];
+        Vector3f position = b.position.head(3);
+        auto color = (GLushort) b.colorIndex;
+        auto brightness = (GLushort) (min(b.brightness, 255.0f) * BrightnessScale + 0.5f);
+        for (const auto& corner : corners)
+            vertices.push_back({ position, level, { corner[0], corner[1], color, brightness } });
+    }
+
+    vo.allocate(vertices.size() * sizeof(GalaxyVertex), vertices.data());
+    vo.setVertices(4, GL_FLOAT, false, sizeof(GalaxyVertex), offsetof(GalaxyVertex, position));
+    vo.setTextureCoords(4, GL_UNSIGNED_SHORT, false, sizeof(GalaxyVertex), offsetof(GalaxyVertex, texCoord));
 }
 
-static AlignedGalaxyVertices g_vertices;
-static GLushort *g_indices = nullptr;
-constexpr const size_t maxPoints = 8192; // 256k buffer
+// Bind the indices of the two triangles of each quad, shared by all the
+// forms, so that the shader runs once per corner rather than once per
+// triangle vertex.
+static void bindGalaxyIndices(size_t nBlobs)
+{
+    static GLuint indexBuffer = 0;
+    static size_t nIndexedBlobs = 0;
+
+    if (indexBuffer == 0)
+        glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    if (nBlobs <= nIndexedBlobs)
+        return;
+
+    vector<GLuint> indices;
+    indices.reserve(nBlobs * 6);
+    for (GLuint i = 0; i < (GLuint) nBlobs * 4; i += 4)
+    {
+        for (GLuint corner : { 0, 1, 2, 0, 2, 3 })
+            indices.push_back(i + corner);
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                 indices.data(), GL_STATIC_DRAW);
+    nIndexedBlobs = nBlobs;
+}
 
 void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
                                       const Quaternionf& viewerOrientation,
@@ -361,27 +420,26 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
     colorTex->bind();
 
     Matrix3f viewMat = viewerOrientation.conjugate().toRotationMatrix();
-    Vector4f v0(Vector4f::Zero());
-    Vector4f v1(Vector4f::Zero());
-    Vector4f v2(Vector4f::Zero());
-    Vector4f v3(Vector4f::Zero());
-    v0.head(3) = viewMat * Vector3f(-1, -1, 0) * size;
-    v1.head(3) = viewMat * Vector3f( 1, -1, 0) * size;
-    v2.head(3) = viewMat * Vector3f( 1,  1, 0) * size;
-    v3.head(3) = viewMat * Vector3f(-1,  1, 0) * size;
 
     Quaternionf orientation = getOrientation().conjugate();
     Matrix3f mScale = form->scale.asDiagonal() * size;
     Matrix3f mLinear = orientation.toRotationMatrix() * mScale;
 
-    Matrix4f m = Matrix4f::Identity();
-    m.topLeftCorner(3,3) = mLinear;
-    m.block<3,1>(0, 3) = offset;
-
-    int pow2 = 1;
+    // The sprites are drawn from the biggest to the smallest, and the
+    // smallest levels are skipped when their sprites are too small to be
+    // seen.
+    auto nPoints = (unsigned int) (form->blobs->size() * clamp(getDetail()));
+    unsigned int count = 1;
+    for (float spriteSize = size * SpriteScaleFactor;
+         count < nPoints && spriteSize >= minimumFeatureSize;
+         spriteSize *= SpriteScaleFactor)
+    {
+        count *= 2;
+    }
+    count = min(count, nPoints);
+    if (count == 0)
+        return;
 
-    BlobVector* points = form->blobs;
-    unsigned int nPoints = (unsigned int) (points->size() * clamp(getDetail()));
     // corrections to avoid excessive brightening if viewed e.g. edge-on
 
     float brightness_corr = 1.0f;
@@ -402,80 +460,27 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
             brightness_corr = 0.45f;
     }
 
-
-    Matrix4f mv = vecgl::translate(*ms.modelview, Vector3f(-offset));
-
     const float btot = ((type > SBc) && (type < Irr)) ? 2.5f : 5.0f;
-    const float spriteScaleFactor = 1.0f / 1.55f;
-
-    glEnableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
-    glEnableVertexAttribArray(CelestiaGLProgram::TextureCoord0AttributeIndex);
-
-    if (g_vertices.empty())
-        g_vertices.reserve(maxPoints);
-    if (g_indices == nullptr)
-        g_indices = new GLushort[(maxPoints / 4 + 1) * 6];
-
-    GLushort j = 0;
 
     prog->use();
-    prog->setMVPMatrices(*ms.projection, mv);
+    prog->setMVPMatrices(*ms.projection, *ms.modelview);
     prog->samplerParam("galaxyTex") = 0;
     prog->samplerParam("colorTex") = 1;
+    prog->mat3Param("m") = mLinear;
+    prog->mat3Param("viewMat") = viewMat;
+    prog->vec3Param("offset") = offset;
+    prog->floatParam("size") = size;
+    prog->floatParam("spriteScaleFactor") = SpriteScaleFactor;
+    prog->floatParam("brightness") = (4.0f * lightGain + 1.0f) * btot * brightness_corr * brightness / (255.0f * BrightnessScale);
+
+    form->vo.bind();
+    if (!form->vo.initialized())
+        initGalaxyData(form->vo, form->blobs);
+    bindGalaxyIndices(form->blobs->size());
+    form->vo.drawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_INT);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    form->vo.unbind();
 
-    size_t vertex = 0, index = 0;
-    for (unsigned int i = 0; i < nPoints; ++i)
-    {
-        if ((i & pow2) != 0)
-        {
-            pow2 <<= 1;
-            size *= spriteScaleFactor;
-            v0 *= spriteScaleFactor;
-            v1 *= spriteScaleFactor;
-            v2 *= spriteScaleFactor;
-            v3 *= spriteScaleFactor;
-            if (size < minimumFeatureSize)
-                break;
-        }
-
-        const Blob& b  = (*points)[i];
-        Vector4f    p  = m * b.position;
-        float       br = b.brightness / 255.0f;
-
-        float screenFrac = size / p.norm();
-        if (screenFrac < 0.1f)
-        {
-            float a = (4.0f * lightGain + 1.0f) * btot * (0.1f - screenFrac) * brightness_corr * brightness * br;
-            GLushort alpha = (GLushort) (min(1.0f, a) * 65535.99f);
-            GLushort color = (GLushort) b.colorIndex;
-            g_vertices[vertex++] = { p + v0, { 0, 0, color, alpha } };
-            g_vertices[vertex++] = { p + v1, { 1, 0, color, alpha } };
-            g_vertices[vertex++] = { p + v2, { 1, 1, color, alpha } };
-            g_vertices[vertex++] = { p + v3, { 0, 1, color, alpha } };
-
-            g_indices[index++] = j;
-            g_indices[index++] = j + 1;
-            g_indices[index++] = j + 2;
-            g_indices[index++] = j;
-            g_indices[index++] = j + 2;
-            g_indices[index++] = j + 3;
-            j += 4;
-
-            if (vertex + 4 > maxPoints)
-            {
-                draw(g_vertices, index, g_indices);
-                index = 0;
-                vertex = 0;
-                j = 0;
-            }
-        }
-    }
-
-    if (index > 0)
-        draw(g_vertices, index, g_indices);
-
-    glDisableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
-    glDisableVertexAttribArray(CelestiaGLProgram::TextureCoord0AttributeIndex);
     glActiveTexture(GL_TEXTURE0);
 }
 
@@ -13,6 +13,7 @@
 
 #include <celmodel/material.h>
 #include <celmath/ray.h>
+#include <vector>
 
 class RenderContext;
 
@@ -33,6 +34,18 @@ public:
      */
     virtual bool pick(const celmath::Ray3d& r, double& distance) const = 0;
 
+    /*! Find the closest intersections between a batch of rays and
+     *  the model. distances[i] is set to the distance along ray i,
+     *  or to a negative value if the ray misses the model.
+     */
+    virtual void pick(const std::vector<celmath::Ray3d>& rays,
+                      std::vector<double>& distances) const
+    {
+        distances.assign(rays.size(), -1.0);
+        for (size_t i = 0; i < rays.size(); i++)
+            pick(rays[i], distances[i]);
+    }
+
     virtual bool isOpaque() const = 0;
 
     virtual bool isNormalized() const
@@ -53,6 +66,14 @@ public:
     virtual void loadTextures()
     {
     }
+
+    /*! Return the approximate amount of memory used by the geometry
+     *  data, in bytes.
+     */
+    virtual size_t getMemoryUsage() const
+    {
+        return 0;
+    }
 };
 
 #endif // _CELENGINE_GEOMETRY_H_
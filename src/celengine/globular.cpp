@@ -456,6 +456,7 @@ void Globular::renderGlobularPointSprites(
      * distance from center or resolution increases sufficiently.
      */
 
+    VertexObject& vo = form->vo;
     vo.bind();
     if (!vo.initialized())
     {
@@ -31,6 +31,8 @@ struct GlobularForm
 {
     std::vector<GBlob>* gblobs;
     Eigen::Vector3f scale;
+    // Sprites of the stars, shared by the globulars with this form
+    celgl::VertexObject vo{ GL_ARRAY_BUFFER, 0, GL_STATIC_DRAW };
 };
 
 class Globular : public DeepSkyObject
@@ -90,8 +92,6 @@ class Globular : public DeepSkyObject
     float         r_c{ R_c_ref };
     float         c{ C_ref };
     float         tidalRadius{ 0.0f };
-
-    celgl::VertexObject vo{ GL_ARRAY_BUFFER, 0, GL_STATIC_DRAW };
 };
 
 #endif // _GLOBULAR_H_
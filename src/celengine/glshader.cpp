@@ -230,6 +230,34 @@ GLProgram::link()
 }
 
 
+bool
+GLProgram::getBinary(GLenum& format, vector<char>& binary) const
+{
+    GLint length = 0;
+#ifdef GL_ES
+    if (!celestia::gl::OES_get_program_binary)
+        return false;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+#else
+    if (!celestia::gl::ARB_get_program_binary)
+        return false;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+#endif
+    if (length <= 0)
+        return false;
+
+    binary.resize(length);
+#ifdef GL_ES
+    glGetProgramBinaryOES(id, length, &length, &format, binary.data());
+#else
+    glGetProgramBinary(id, length, &length, &format, binary.data());
+#endif
+    binary.resize(length);
+
+    return length > 0;
+}
+
+
 //************* GLShaderLoader ************
 
 GLShaderStatus
@@ -374,6 +402,33 @@ GLShaderLoader::CreateProgram(const string& vsSource,
 }
 
 
+GLShaderStatus
+GLShaderLoader::CreateProgram(GLenum binaryFormat,
+                              const vector<char>& binary,
+                              GLProgram** progOut)
+{
+    GLuint progid = glCreateProgram();
+#ifdef GL_ES
+    glProgramBinaryOES(progid, binaryFormat, binary.data(), binary.size());
+#else
+    glProgramBinary(progid, binaryFormat, binary.data(), binary.size());
+#endif
+
+    // The driver rejects the binaries of other drivers or versions
+    GLint linkSuccess;
+    glGetProgramiv(progid, GL_LINK_STATUS, &linkSuccess);
+    if (linkSuccess != GL_TRUE)
+    {
+        glDeleteProgram(progid);
+        return ShaderStatus_LinkError;
+    }
+
+    *progOut = new GLProgram(progid);
+
+    return ShaderStatus_OK;
+}
+
+
 const string
 GetInfoLog(GLuint obj)
 {
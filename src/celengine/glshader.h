@@ -78,6 +78,9 @@ class GLProgram
     void use() const;
     GLuint getID() const { return id; }
 
+    //! Get the binary of the linked program, if the driver supports it
+    bool getBinary(GLenum& format, std::vector<char>& binary) const;
+
  private:
     GLuint id;
 
@@ -184,6 +187,9 @@ class GLShaderLoader
     static GLShaderStatus CreateProgram(const std::string& vsSource,
                                         const std::string& fsSource,
                                         GLProgram**);
+    static GLShaderStatus CreateProgram(GLenum binaryFormat,
+                                        const std::vector<char>& binary,
+                                        GLProgram**);
 };
 
 
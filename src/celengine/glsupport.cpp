@@ -7,9 +7,11 @@ namespace gl
 
 #ifdef GL_ES
 bool OES_vertex_array_object        = false;
+bool OES_get_program_binary         = false;
 #else
 bool ARB_vertex_array_object        = false;
 bool EXT_framebuffer_object         = false;
+bool ARB_get_program_binary         = false;
 #endif
 bool ARB_shader_texture_lod         = false;
 bool EXT_texture_compression_s3tc   = false;
@@ -29,9 +31,11 @@ bool init() noexcept
 {
 #ifdef GL_ES
     OES_vertex_array_object        = has_extension("GL_OES_vertex_array_object");
+    OES_get_program_binary         = has_extension("GL_OES_get_program_binary");
 #else
     ARB_vertex_array_object        = has_extension("GL_ARB_vertex_array_object");
     EXT_framebuffer_object         = has_extension("GL_EXT_framebuffer_object");
+    ARB_get_program_binary         = has_extension("GL_ARB_get_program_binary");
 #endif
     ARB_shader_texture_lod         = has_extension("GL_ARB_shader_texture_lod");
     EXT_texture_compression_s3tc   = has_extension("GL_EXT_texture_compression_s3tc");
@@ -38,9 +38,11 @@ extern bool EXT_texture_compression_s3tc;
 extern bool EXT_texture_filter_anisotropic;
 #ifdef GL_ES
 extern bool OES_vertex_array_object;
+extern bool OES_get_program_binary;
 #else
 extern bool ARB_vertex_array_object;
 extern bool EXT_framebuffer_object;
+extern bool ARB_get_program_binary;
 #endif
 extern GLint maxPointSize;
 extern GLfloat maxLineWidth;
@@ -0,0 +1,157 @@
+// locationindex.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Spatial index of the locations on the surface of a body.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Geometry>
+#include "location.h"
+#include "locationindex.h"
+
+using namespace Eigen;
+using namespace std;
+
+// Maximum number of locations in a leaf node
+static const unsigned int MaxLeafSize = 16;
+
+
+static float EffectiveSize(const Location* location)
+{
+    float size = location->getImportance();
+    return size < 0.0f ? location->getSize() : size;
+}
+
+
+LocationIndex::LocationIndex(const vector<Location*>& _locations) :
+    locations(_locations)
+{
+    if (!locations.empty())
+        build(0, (unsigned int) locations.size());
+}
+
+
+/*! Split the locations at the median of their positions along the axis
+ *  over which they are the most spread out.
+ */
+void LocationIndex::build(unsigned int first, unsigned int count)
+{
+    auto begin = locations.begin() + first;
+    auto end = begin + count;
+
+    AlignedBox<double, 3> bounds;
+    Node node;
+    node.maxSize = 0.0f;
+    node.featureTypes = 0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+        bounds.extend((*iter)->getPosition().cast<double>());
+        node.maxSize = max(node.maxSize, EffectiveSize(*iter));
+        node.featureTypes |= (*iter)->getFeatureType();
+    }
+
+    node.center = bounds.center();
+    node.radius = 0.0;
+    for (auto iter = begin; iter != end; ++iter)
+        node.radius = max(node.radius, ((*iter)->getPosition().cast<double>() - node.center).norm());
+
+    unsigned int nodeIndex = (unsigned int) nodes.size();
+    if (count <= MaxLeafSize)
+    {
+        node.first = first;
+        node.count = count;
+        nodes.push_back(node);
+        return;
+    }
+
+    node.first = 0;
+    node.count = 0;
+    nodes.push_back(node);
+
+    int axis;
+    bounds.sizes().maxCoeff(&axis);
+    unsigned int half = count / 2;
+    nth_element(begin, begin + half, end,
+                [axis](const Location* a, const Location* b)
+                { return a->getPosition()[axis] < b->getPosition()[axis]; });
+
+    build(first, half);
+    nodes[nodeIndex].first = (unsigned int) nodes.size();
+    build(first + half, count - half);
+}
+
+
+// Return true if none of the locations in the node can pass the tests of
+// the query.
+bool LocationIndex::isCulled(const Node& node, const Query& query) const
+{
+    if ((node.featureTypes & query.featureFilter) == 0)
+        return true;
+
+    Vector3d toCenter = node.center - query.cameraPosition;
+    double distance = toCenter.norm();
+    double nearest = distance - node.radius;
+
+    // Too small on screen
+    if (nearest > 0.0 && node.maxSize / (nearest * query.pixelSize) <= query.minFeatureSize)
+        return true;
+
+    // Behind the camera
+    if (toCenter.dot(query.viewNormal) + node.radius <= 0.0)
+        return true;
+
+    // Hidden by the occluding sphere: the label positions must all lie
+    // within the cone tangent to the sphere, farther than the points where
+    // the cone touches it.
+    double cameraDistance = query.cameraPosition.norm();
+    if (query.occluderRadius <= 0.0 || cameraDistance <= query.occluderRadius)
+        return false;
+
+    double scale = 1.0 + query.labelOffset;
+    Vector3d labelCenter = node.center * scale;
+    double labelRadius = node.radius * scale;
+    Vector3d toLabelCenter = labelCenter - query.cameraPosition;
+    double labelDistance = toLabelCenter.norm();
+    double tangentDistance = sqrt(cameraDistance * cameraDistance - query.occluderRadius * query.occluderRadius);
+    if (labelDistance - labelRadius < tangentDistance)
+        return false;
+
+    double coneAngle = asin(query.occluderRadius / cameraDistance);
+    double cosAngle = -toLabelCenter.dot(query.cameraPosition) / (labelDistance * cameraDistance);
+    double angle = acos(max(-1.0, min(cosAngle, 1.0)));
+    return angle + asin(min(labelRadius / labelDistance, 1.0)) <= coneAngle;
+}
+
+
+void LocationIndex::findVisible(unsigned int nodeIndex, const Query& query,
+                                vector<Location*>& result) const
+{
+    const Node& node = nodes[nodeIndex];
+    if (isCulled(node, query))
+        return;
+
+    if (node.count != 0)
+    {
+        result.insert(result.end(),
+                      locations.begin() + node.first,
+                      locations.begin() + node.first + node.count);
+    }
+    else
+    {
+        findVisible(nodeIndex + 1, query, result);
+        findVisible(node.first, query, result);
+    }
+}
+
+
+void LocationIndex::findVisible(const Query& query, vector<Location*>& result) const
+{
+    if (!nodes.empty())
+        findVisible(0, query, result);
+}
@@ -0,0 +1,75 @@
+// locationindex.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Spatial index of the locations on the surface of a body.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+class Location;
+
+/*! A binary tree of bounding spheres over the locations of a body, each
+ *  node recording the largest size and the feature types of the locations
+ *  below it. Used to skip the groups of locations which are too small on
+ *  screen, filtered out, behind the camera, or hidden by the body when
+ *  labelling them.
+ */
+class LocationIndex
+{
+ public:
+    explicit LocationIndex(const std::vector<Location*>& locations);
+
+    struct Query
+    {
+        // Camera position and view direction in the body frame
+        Eigen::Vector3d cameraPosition;
+        Eigen::Vector3d viewNormal;
+        // Angular size of a pixel
+        double pixelSize;
+        // Minimum size of a location on screen in pixels
+        float minFeatureSize;
+        uint64_t featureFilter;
+        // Radius of a sphere centered on the body which hides the
+        // locations behind it, or zero. Label positions are offset from
+        // the locations by labelOffset times their distance to the center.
+        double occluderRadius;
+        double labelOffset;
+    };
+
+    /*! Append to result the locations which may pass the size, filter
+     *  and visibility tests of the query. All the locations which pass
+     *  them are returned, but some of those returned may fail them.
+     */
+    void findVisible(const Query& query, std::vector<Location*>& result) const;
+
+ private:
+    struct Node
+    {
+        Eigen::Vector3d center;
+        double radius;
+        float maxSize;
+        uint64_t featureTypes;
+        // For leaves, the range of locations in the location list; for
+        // inner nodes, count is zero and first is the index of the right
+        // child. The left child always follows its parent.
+        unsigned int first;
+        unsigned int count;
+    };
+
+    void build(unsigned int first, unsigned int count);
+    bool isCulled(const Node& node, const Query& query) const;
+    void findVisible(unsigned int nodeIndex, const Query& query,
+                     std::vector<Location*>& result) const;
+
+    std::vector<Node> nodes;
+    std::vector<Location*> locations;
+};
@@ -12,6 +12,8 @@
 #include <cassert>
 #include <iostream>
 #include <algorithm>
+#include <tuple>
+#include <vector>
 #include <celmath/mathlib.h>
 #include "glsupport.h"
 #include "lodspheremesh.h"
@@ -38,6 +40,9 @@ static float* cosTheta = nullptr;
 //     tex coords - 2 floats * MAX_SPHERE_MESH_TEXTURES
 constexpr const int MaxVertexSize = 3 + 3 + 3 + MAX_SPHERE_MESH_TEXTURES * 2;
 
+// Size of the patches kept in vertex buffers while they're not drawn
+constexpr const size_t PatchCacheSize = 32 * 1024 * 1024;
+
 // TODO: figure out how to use std eigen's methods instead
 static Vector3f intersect3(const Frustum::PlaneType& p0,
                            const Frustum::PlaneType& p1,
@@ -121,6 +126,58 @@ LODSphereMesh::~LODSphereMesh()
 {
     delete[] vertices;
     delete[] indices;
+
+    for (const auto& patch : patches)
+        glDeleteBuffers(1, &patch.second.vbo);
+    for (const auto& indexBuffer : indexBuffers)
+        glDeleteBuffers(1, &indexBuffer.second);
+}
+
+
+bool LODSphereMesh::PatchKey::operator<(const PatchKey& other) const
+{
+    auto t0 = std::tie(phi0, theta0, extent, step, tangents, nTexCoordSets);
+    auto t1 = std::tie(other.phi0, other.theta0, other.extent, other.step, other.tangents, other.nTexCoordSets);
+    if (t0 != t1)
+        return t0 < t1;
+
+    return lexicographical_compare(texCoords[0], texCoords[nTexCoordSets],
+                                   other.texCoords[0], other.texCoords[nTexCoordSets]);
+}
+
+
+void LODSphereMesh::nextFrame()
+{
+    frame++;
+    stats.patchesDrawn = 0;
+    stats.uploads = 0;
+    stats.uploadedBytes = 0;
+
+    if (stats.cachedBytes <= PatchCacheSize)
+        return;
+
+    // Delete the least recently used patches, but not the ones drawn in
+    // the last frame which are likely to be drawn again.
+    vector<map<PatchKey, Patch>::iterator> unused;
+    for (auto iter = patches.begin(); iter != patches.end(); ++iter)
+    {
+        if (iter->second.lastUsed + 1 < frame)
+            unused.push_back(iter);
+    }
+    sort(unused.begin(), unused.end(),
+         [](const map<PatchKey, Patch>::iterator& i0, const map<PatchKey, Patch>::iterator& i1)
+         {
+             return i0->second.lastUsed < i1->second.lastUsed;
+         });
+
+    for (auto iter : unused)
+    {
+        if (stats.cachedBytes <= PatchCacheSize)
+            break;
+        glDeleteBuffers(1, &iter->second.vbo);
+        stats.cachedBytes -= iter->second.size;
+        patches.erase(iter);
+    }
 }
 
 
@@ -234,71 +291,6 @@ void LODSphereMesh::render(unsigned int attributes,
             glActiveTexture(GL_TEXTURE0 + i);
     }
 
-    if (!vertexBuffersInitialized)
-    {
-        // TODO: assumes that the same context is used every time we
-        // render.  Valid now, but not necessarily in the future.  Still,
-        // would only cause problems if we rendered in two different contexts
-        // and only one had vertex buffer objects.
-        while(glGetError() != GL_NO_ERROR);
-        glGenBuffers(NUM_SPHERE_VERTEX_BUFFERS, vertexBuffers);
-        if (glGetError() != GL_NO_ERROR)
-            return;
-        vertexBuffersInitialized = true;
-        for (auto vertexBuffer : vertexBuffers)
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-            glBufferData(GL_ARRAY_BUFFER,
-                         maxVertices * MaxVertexSize * sizeof(float),
-                         nullptr,
-                         GL_STREAM_DRAW);
-        }
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        glGenBuffers(1, &indexBuffer);
-    }
-
-    currentVB = 0;
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[currentVB]);
-
-    // Set up the mesh vertices
-    int nRings = phiExtent / ri.step;
-    int nSlices = thetaExtent / ri.step;
-
-    int n2 = 0;
-    for (i = 0; i < nRings; i++)
-    {
-        if (i > 0)
-        {
-            indices[n2 + 0] = i * (nSlices + 1) + 0;
-            n2++;
-        }
-        for (int j = 0; j <= nSlices; j++)
-        {
-            indices[n2 + 0] = i * (nSlices + 1) + j;
-            indices[n2 + 1] = (i + 1) * (nSlices + 1) + j;
-            n2 += 2;
-        }
-        if (i < nRings - 1)
-        {
-            indices[n2] = (i + 1) * (nSlices + 1) + nSlices;
-            n2++;
-        }
-    }
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 nIndices * sizeof(indices[0]),
-                 indices,
-                 GL_DYNAMIC_DRAW);
-
-    // Compute the size of a vertex
-    vertexSize = 3;
-    if ((attributes & Tangents) != 0)
-        vertexSize += 3;
-    for (i = 0; i < nTextures; i++)
-        vertexSize += 2;
-
     glEnableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
     if ((attributes & Normals) != 0)
         glEnableVertexAttribArray(CelestiaGLProgram::NormalAttributeIndex);
@@ -461,42 +453,12 @@ void LODSphereMesh::renderSection(int phi0, int theta0, int extent,
                                   const RenderInfo& ri)
 
 {
-    auto stride = (GLsizei) (vertexSize * sizeof(float));
-    int texCoordOffset = ((ri.attributes & Tangents) != 0) ? 6 : 3;
-    float* vertexBase = nullptr;
-
-    glVertexAttribPointer(CelestiaGLProgram::VertexCoordAttributeIndex,
-                          3, GL_FLOAT, GL_FALSE,
-                          stride, vertexBase + 0);
-    if ((ri.attributes & Normals) != 0)
-    {
-        glVertexAttribPointer(CelestiaGLProgram::NormalAttributeIndex,
-                              3, GL_FLOAT, GL_FALSE,
-                              stride, vertexBase);
-    }
-
-    for (int tc = 0; tc < nTexturesUsed; tc++)
-    {
-        glVertexAttribPointer(CelestiaGLProgram::TextureCoord0AttributeIndex + tc,
-                              2, GL_FLOAT, GL_FALSE,
-                              stride, vertexBase + (tc * 2) + texCoordOffset);
-    }
-
-    if ((ri.attributes & Tangents) != 0)
-    {
-        glVertexAttribPointer(CelestiaGLProgram::TangentAttributeIndex,
-                              3, GL_FLOAT, GL_FALSE,
-                              stride, vertexBase + 3); // 3 == tangentOffset
-    }
-
     // assert(ri.step >= minStep);
     // assert(phi0 + extent <= maxDivisions);
     // assert(theta0 + extent / 2 < maxDivisions);
     // assert(isPow2(extent));
     int thetaExtent = extent;
     int phiExtent = extent / 2;
-    int theta1 = theta0 + thetaExtent;
-    int phi1 = phi0 + phiExtent;
 
     float du[MAX_SPHERE_MESH_TEXTURES];
     float dv[MAX_SPHERE_MESH_TEXTURES];
@@ -557,73 +519,168 @@ void LODSphereMesh::renderSection(int phi0, int theta0, int extent,
         }
     }
 
+    // Use the same texture coordinates for the textures mapped the same
+    // way, usually all of them unless some are split into tiles
+    PatchKey key;
+    key.phi0 = phi0;
+    key.theta0 = theta0;
+    key.extent = extent;
+    key.step = ri.step;
+    key.tangents = (ri.attributes & Tangents) != 0;
+    key.nTexCoordSets = 0;
+    int texCoordSets[MAX_SPHERE_MESH_TEXTURES];
+    for (int tex = 0; tex < nTexturesUsed; tex++)
+    {
+        float texCoords[4] = { u0[tex], v0[tex], du[tex], dv[tex] };
+        int set = 0;
+        while (set < key.nTexCoordSets && !equal(texCoords, texCoords + 4, key.texCoords[set]))
+            set++;
+        if (set == key.nTexCoordSets)
+        {
+            copy(texCoords, texCoords + 4, key.texCoords[set]);
+            key.nTexCoordSets++;
+        }
+        texCoordSets[tex] = set;
+    }
+
+    auto iter = patches.find(key);
+    if (iter == patches.end())
+        iter = patches.emplace(key, createPatch(key)).first;
+    iter->second.lastUsed = frame;
+
+    int texCoordOffset = key.tangents ? 6 : 3;
+    int vertexSize = texCoordOffset + key.nTexCoordSets * 2;
+    auto stride = (GLsizei) (vertexSize * sizeof(float));
+    float* vertexBase = nullptr;
+
+    glBindBuffer(GL_ARRAY_BUFFER, iter->second.vbo);
+    glVertexAttribPointer(CelestiaGLProgram::VertexCoordAttributeIndex,
+                          3, GL_FLOAT, GL_FALSE,
+                          stride, vertexBase + 0);
+    if ((ri.attributes & Normals) != 0)
+    {
+        glVertexAttribPointer(CelestiaGLProgram::NormalAttributeIndex,
+                              3, GL_FLOAT, GL_FALSE,
+                              stride, vertexBase);
+    }
+
+    for (int tc = 0; tc < nTexturesUsed; tc++)
+    {
+        glVertexAttribPointer(CelestiaGLProgram::TextureCoord0AttributeIndex + tc,
+                              2, GL_FLOAT, GL_FALSE,
+                              stride, vertexBase + (texCoordSets[tc] * 2) + texCoordOffset);
+    }
+
+    if (key.tangents)
+    {
+        glVertexAttribPointer(CelestiaGLProgram::TangentAttributeIndex,
+                              3, GL_FLOAT, GL_FALSE,
+                              stride, vertexBase + 3); // 3 == tangentOffset
+    }
+
+    int nRings = phiExtent / ri.step;
+    int nSlices = thetaExtent / ri.step;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, getIndexBuffer(nRings, nSlices));
+    glDrawElements(GL_TRIANGLE_STRIP,
+                   nRings * (nSlices + 2) * 2 - 2,
+                   GL_UNSIGNED_SHORT,
+                   nullptr);
+    stats.patchesDrawn++;
+}
+
+
+LODSphereMesh::Patch LODSphereMesh::createPatch(const PatchKey& key)
+{
+    int thetaExtent = key.extent;
+    int phiExtent = key.extent / 2;
+    int theta1 = key.theta0 + thetaExtent;
+    int phi1 = key.phi0 + phiExtent;
+
     int vindex = 0;
-    for (int phi = phi0; phi <= phi1; phi += ri.step)
+    for (int phi = key.phi0; phi <= phi1; phi += key.step)
     {
         float cphi = cosPhi[phi];
         float sphi = sinPhi[phi];
 
-        if ((ri.attributes & Tangents) != 0)
+        for (int theta = key.theta0; theta <= theta1; theta += key.step)
         {
-            for (int theta = theta0; theta <= theta1; theta += ri.step)
-            {
-                float ctheta = cosTheta[theta];
-                float stheta = sinTheta[theta];
+            float ctheta = cosTheta[theta];
+            float stheta = sinTheta[theta];
 
-                vertices[vindex]      = cphi * ctheta;
-                vertices[vindex + 1]  = sphi;
-                vertices[vindex + 2]  = cphi * stheta;
+            vertices[vindex]      = cphi * ctheta;
+            vertices[vindex + 1]  = sphi;
+            vertices[vindex + 2]  = cphi * stheta;
+            vindex += 3;
 
+            if (key.tangents)
+            {
                 // Compute the tangent--required for bump mapping
-                vertices[vindex + 3] = stheta;
-                vertices[vindex + 4] = 0.0f;
-                vertices[vindex + 5] = -ctheta;
-
-                vindex += 6;
-
-                for (int tex = 0; tex < nTexturesUsed; tex++)
-                {
-                    vertices[vindex]     = u0[tex] - theta * du[tex];
-                    vertices[vindex + 1] = v0[tex] - phi * dv[tex];
-                    vindex += 2;
-                }
+                vertices[vindex]     = stheta;
+                vertices[vindex + 1] = 0.0f;
+                vertices[vindex + 2] = -ctheta;
+                vindex += 3;
             }
-        }
-        else
-        {
-            for (int theta = theta0; theta <= theta1; theta += ri.step)
+
+            for (int set = 0; set < key.nTexCoordSets; set++)
             {
-                float ctheta = cosTheta[theta];
-                float stheta = sinTheta[theta];
+                const float* texCoords = key.texCoords[set];
+                vertices[vindex]     = texCoords[0] - theta * texCoords[2];
+                vertices[vindex + 1] = texCoords[1] - phi * texCoords[3];
+                vindex += 2;
+            }
+        }
+    }
 
-                vertices[vindex]      = cphi * ctheta;
-                vertices[vindex + 1]  = sphi;
-                vertices[vindex + 2]  = cphi * stheta;
+    Patch patch;
+    patch.size = vindex * sizeof(float);
+    glGenBuffers(1, &patch.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, patch.vbo);
+    glBufferData(GL_ARRAY_BUFFER, patch.size, vertices, GL_STATIC_DRAW);
 
-                vindex += 3;
+    stats.uploads++;
+    stats.uploadedBytes += patch.size;
+    stats.cachedBytes += patch.size;
 
-                for (int tex = 0; tex < nTexturesUsed; tex++)
-                {
-                    vertices[vindex]     = u0[tex] - theta * du[tex];
-                    vertices[vindex + 1] = v0[tex] - phi * dv[tex];
-                    vindex += 2;
-                }
-            }
+    return patch;
+}
+
+
+GLuint LODSphereMesh::getIndexBuffer(int nRings, int nSlices)
+{
+    GLuint& indexBuffer = indexBuffers[make_pair(nRings, nSlices)];
+    if (indexBuffer != 0)
+        return indexBuffer;
+
+    int n2 = 0;
+    for (int i = 0; i < nRings; i++)
+    {
+        if (i > 0)
+        {
+            indices[n2 + 0] = i * (nSlices + 1) + 0;
+            n2++;
+        }
+        for (int j = 0; j <= nSlices; j++)
+        {
+            indices[n2 + 0] = i * (nSlices + 1) + j;
+            indices[n2 + 1] = (i + 1) * (nSlices + 1) + j;
+            n2 += 2;
+        }
+        if (i < nRings - 1)
+        {
+            indices[n2] = (i + 1) * (nSlices + 1) + nSlices;
+            n2++;
         }
     }
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vindex * sizeof(float), vertices);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 n2 * sizeof(indices[0]),
+                 indices,
+                 GL_STATIC_DRAW);
 
-    int nRings = phiExtent / ri.step;
-    int nSlices = thetaExtent / ri.step;
-    glDrawElements(GL_TRIANGLE_STRIP,
-                   nRings * (nSlices + 2) * 2 - 2,
-                   GL_UNSIGNED_SHORT,
-                   nullptr);
+    stats.uploads++;
+    stats.uploadedBytes += n2 * sizeof(indices[0]);
 
-    // Cycle through the vertex buffers
-    currentVB++;
-    if (currentVB == NUM_SPHERE_VERTEX_BUFFERS)
-        currentVB = 0;
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[currentVB]);
+    return indexBuffer;
 }
@@ -17,10 +17,12 @@
 #endif
 #include <Eigen/Geometry>
 #include <celmath/frustum.h>
+#include <cstddef>
+#include <map>
+#include <utility>
 
 
 #define MAX_SPHERE_MESH_TEXTURES 6
-#define NUM_SPHERE_VERTEX_BUFFERS 2
 
 class LODSphereMesh
 {
@@ -42,6 +44,22 @@ public:
         Tangents   = 0x02,
     };
 
+    struct Stats
+    {
+        size_t patchesDrawn{ 0 };
+        size_t uploads{ 0 };
+        size_t uploadedBytes{ 0 };  // vertex and index data
+        size_t cachedBytes{ 0 };    // not reset by nextFrame()
+    };
+
+    //! Counters of the work done since the last call to nextFrame()
+    const Stats& getStats() const { return stats; }
+
+    /*! Start a new frame: the counters are reset and the least recently
+     *  used patches are deleted if the cache is over its budget.
+     */
+    void nextFrame();
+
  private:
     struct RenderInfo
     {
@@ -67,10 +85,36 @@ public:
 
     void renderSection(int phi0, int theta0, int extent, const RenderInfo&);
 
-    float* vertices{ nullptr };
+    // Patches of the sphere are cached in vertex buffers, with the
+    // positions, the tangents if needed and the texture coordinates of
+    // each distinct tile mapping. The texture coordinates of a patch only
+    // change when the textures are split differently, so drawing the
+    // same patches again doesn't upload anything.
+    struct PatchKey
+    {
+        int phi0;
+        int theta0;
+        int extent;
+        int step;
+        bool tangents;
+        int nTexCoordSets;
+        float texCoords[MAX_SPHERE_MESH_TEXTURES][4]{}; // u0, v0, du, dv
 
+        bool operator<(const PatchKey&) const;
+    };
+
+    struct Patch
+    {
+        GLuint vbo{ 0 };
+        size_t size{ 0 };
+        unsigned int lastUsed{ 0 };
+    };
+
+    Patch createPatch(const PatchKey&);
+    GLuint getIndexBuffer(int nRings, int nSlices);
+
+    float* vertices{ nullptr };
     int maxVertices{ 0 };
-    int vertexSize{ 0 };
 
     int nIndices{ 0 };
     unsigned short* indices{ nullptr };
@@ -79,10 +123,11 @@ public:
     Texture* textures[MAX_SPHERE_MESH_TEXTURES]{};
     unsigned int subtextures[MAX_SPHERE_MESH_TEXTURES]{};
 
-    bool vertexBuffersInitialized{ false };
-    GLuint currentVB{ 0 };
-    GLuint vertexBuffers[NUM_SPHERE_VERTEX_BUFFERS];
-    GLuint indexBuffer{ 0 };
+    std::map<PatchKey, Patch> patches;
+    // Triangle strips of the patches, by number of rings and slices
+    std::map<std::pair<int, int>, GLuint> indexBuffers;
+    unsigned int frame{ 0 };
+    Stats stats;
 };
 
 #endif // CELENGINE_LODSPHEREMESH_H_
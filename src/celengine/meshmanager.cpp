@@ -214,6 +214,21 @@ Geometry* GeometryInfo::load(const fs::path& resolvedFilename)
 }
 
 
+// Loading a model doesn't involve OpenGL, so the whole work is done on the
+// loader thread.
+bool GeometryInfo::prepare(const fs::path& name)
+{
+    resource = load(name);
+    return resource != nullptr;
+}
+
+
+Geometry* GeometryInfo::finish(const fs::path& /*unused*/)
+{
+    return resource;
+}
+
+
 struct NoiseMeshParameters
 {
     Vector3f size;
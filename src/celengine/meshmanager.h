@@ -52,6 +52,12 @@ class GeometryInfo : public ResourceInfo<Geometry>
 
     virtual fs::path resolve(const fs::path&);
     virtual Geometry* load(const fs::path&);
+    virtual bool prepare(const fs::path&);
+    virtual Geometry* finish(const fs::path&);
+    virtual size_t getMemoryUsage() const
+    {
+        return resource != nullptr ? resource->getMemoryUsage() : 0;
+    }
 };
 
 inline bool operator<(const GeometryInfo& g0, const GeometryInfo& g1)
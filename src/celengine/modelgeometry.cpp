@@ -65,6 +65,23 @@ ModelGeometry::pick(const Ray3d& r, double& distance) const
 }
 
 
+void
+ModelGeometry::pick(const vector<Ray3d>& rays, vector<double>& distances) const
+{
+    vector<Vector3d> origins;
+    vector<Vector3d> directions;
+    origins.reserve(rays.size());
+    directions.reserve(rays.size());
+    for (const auto& r : rays)
+    {
+        origins.push_back(r.origin);
+        directions.push_back(r.direction);
+    }
+
+    m_model->pick(origins, directions, distances);
+}
+
+
 /*! Render the model; the time parameter is ignored right now
  *  since this class doesn't currently support animation.
  */
@@ -202,6 +219,22 @@ ModelGeometry::isNormalized() const
 }
 
 
+size_t
+ModelGeometry::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < m_model->getMeshCount(); i++)
+    {
+        const Mesh* mesh = m_model->getMesh(i);
+        bytes += (size_t) mesh->getVertexCount() * mesh->getVertexStride();
+        for (unsigned int j = 0; j < mesh->getGroupCount(); j++)
+            bytes += mesh->getGroup(j)->nIndices * sizeof(Mesh::index32);
+    }
+
+    return bytes;
+}
+
+
 bool
 ModelGeometry::usesTextureType(Material::TextureSemantic t) const
 {
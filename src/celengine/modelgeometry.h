@@ -50,6 +50,8 @@ class ModelGeometry : public Geometry
      *  distance unmodified.
      */
     virtual bool pick(const celmath::Ray3d& r, double& distance) const;
+    virtual void pick(const std::vector<celmath::Ray3d>& rays,
+                      std::vector<double>& distances) const;
 
     //! Render the model in the current OpenGL context
     virtual void render(RenderContext&, double t = 0.0);
@@ -57,6 +59,7 @@ class ModelGeometry : public Geometry
     virtual bool usesTextureType(cmod::Material::TextureSemantic) const;
     virtual bool isOpaque() const;
     virtual bool isNormalized() const;
+    virtual size_t getMemoryUsage() const;
 
     void loadTextures();
 
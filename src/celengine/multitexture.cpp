@@ -62,12 +62,12 @@ void MultiResTexture::setTexture(const string& source,
 }
 
 
-Texture* MultiResTexture::find(unsigned int resolution)
+Texture* MultiResTexture::find(unsigned int resolution, float priority)
 {
     TextureManager* texMan = GetTextureManager();
 
-    Texture* res = texMan->find(tex[resolution]);
-    if (res != nullptr)
+    Texture* res = texMan->find(tex[resolution], priority);
+    if (res != nullptr || texMan->getState(tex[resolution]) == ResourceLoading)
         return res;
 
     // Preferred resolution isn't available; try the second choice
@@ -92,13 +92,13 @@ Texture* MultiResTexture::find(unsigned int resolution)
     }
 
     tex[resolution] = tex[secondChoice];
-    res = texMan->find(tex[resolution]);
-    if (res != nullptr)
+    res = texMan->find(tex[resolution], priority);
+    if (res != nullptr || texMan->getState(tex[resolution]) == ResourceLoading)
         return res;
 
     tex[resolution] = tex[lastResort];
 
-    return texMan->find(tex[resolution]);
+    return texMan->find(tex[resolution], priority);
 }
 
 
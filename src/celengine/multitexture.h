@@ -39,7 +39,10 @@ class MultiResTexture
                     const fs::path& path,
                     float bumpHeight,
                     unsigned int flags);
-    Texture* find(unsigned int resolution);
+    // Find the texture for the preferred resolution, falling back to the
+    // others if it can't be loaded. The priority is passed on to the
+    // texture manager for asynchronous loading.
+    Texture* find(unsigned int resolution, float priority = 0.0f);
 
     bool isValid() const;
 
@@ -1,9 +1,41 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <celutil/debug.h>
 #include "name.h"
 
+// Fold a name the way CompareIgnoringCasePredicate compares names
+static void FoldName(const char* name, size_t length, std::string& folded)
+{
+    folded.resize(length);
+    for (size_t i = 0; i < length; i++)
+        folded[i] = (char) toupper((unsigned char) name[i]);
+}
+
+// FNV-1a
+static uint64_t HashName(const char* name, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 uint32_t NameDatabase::getNameCount() const
 {
-    return nameIndex.size();
+    if (!frozen)
+        return nameIndex.size();
+
+    auto count = (uint32_t) frozenNames.size();
+    for (const auto& entry : nameIndex)
+    {
+        if (findFrozenName(entry.first) == std::string::npos)
+            count++;
+    }
+    return count;
 }
 
 void NameDatabase::add(const AstroCatalog::IndexNumber catalogNumber, const std::string& name, bool /*replaceGreek*/)
@@ -26,44 +58,160 @@ void NameDatabase::add(const AstroCatalog::IndexNumber catalogNumber, const std:
 void NameDatabase::erase(const AstroCatalog::IndexNumber catalogNumber)
 {
     numberIndex.erase(catalogNumber);
+    if (frozen)
+        erasedNumbers.insert(catalogNumber);
 }
 
-AstroCatalog::IndexNumber NameDatabase::getCatalogNumberByName(const std::string& name) const
+void NameDatabase::freeze()
 {
-    NameIndex::const_iterator iter = nameIndex.find(name);
+    NameIndex allNames;
+    NumberIndex allNumbers;
+    if (frozen)
+    {
+        // Merge the tables with the names modified since they were built
+        for (const auto& frozenName : frozenNames)
+            allNames.emplace(std::string(names, frozenName.name, frozenName.length), frozenName.catalogNumber);
+        for (const auto& entry : nameIndex)
+            allNames[entry.first] = entry.second;
+        for (const auto& frozenNumber : frozenNumbers)
+        {
+            if (erasedNumbers.count(frozenNumber.catalogNumber) == 0)
+                allNumbers.emplace(frozenNumber.catalogNumber, std::string(names, frozenNumber.name, frozenNumber.length));
+        }
+        allNumbers.insert(numberIndex.begin(), numberIndex.end());
+    }
+    else
+    {
+        allNames.swap(nameIndex);
+        allNumbers.swap(numberIndex);
+    }
+    nameIndex.clear();
+    numberIndex.clear();
+    erasedNumbers.clear();
+
+    names.clear();
+    foldedNames.clear();
+    frozenNames.clear();
+    frozenNumbers.clear();
+    frozenNames.reserve(allNames.size());
+    frozenNumbers.reserve(allNumbers.size());
 
-    if (iter == nameIndex.end())
+    std::string folded;
+    for (const auto& entry : allNames)
     {
-        iter = nameIndex.find(ReplaceGreekLetterAbbr(name));
-        if (iter == nameIndex.end())
-            return AstroCatalog::InvalidIndex;
+        const std::string& name = entry.first;
+        FoldName(name.data(), name.length(), folded);
+        frozenNames.push_back({ (uint32_t) foldedNames.length(), (uint32_t) names.length(), (uint32_t) name.length(), entry.second });
+        names.append(name.c_str(), name.length() + 1);
+        foldedNames += folded;
     }
-    return iter->second;
+    NameIndex().swap(allNames);
+
+    // The map is ordered by toupper() of signed chars, sort by the bytes
+    sort(frozenNames.begin(), frozenNames.end(),
+         [this](const FrozenName& n0, const FrozenName& n1)
+         {
+             return foldedNames.compare(n0.key, n0.length, foldedNames, n1.key, n1.length) < 0;
+         });
+
+    size_t tableSize = 16;
+    while (tableSize < frozenNames.size() * 2)
+        tableSize *= 2;
+    hashTable.assign(tableSize, 0);
+    for (uint32_t i = 0; i < frozenNames.size(); i++)
+    {
+        const FrozenName& frozenName = frozenNames[i];
+        size_t slot = HashName(foldedNames.data() + frozenName.key, frozenName.length) & (tableSize - 1);
+        while (hashTable[slot] != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        hashTable[slot] = i + 1;
+    }
+    frozen = true;
+
+    // Names of catalog numbers are usually the same as the ones in the
+    // name table, with the same case, and then the string is shared.
+    for (const auto& entry : allNumbers)
+    {
+        const std::string& name = entry.second;
+        size_t index = findFrozenName(name);
+        if (index != std::string::npos &&
+            names.compare(frozenNames[index].name, frozenNames[index].length, name) == 0)
+        {
+            frozenNumbers.push_back({ entry.first, frozenNames[index].name, frozenNames[index].length });
+        }
+        else
+        {
+            frozenNumbers.push_back({ entry.first, (uint32_t) names.length(), (uint32_t) name.length() });
+            names.append(name.c_str(), name.length() + 1);
+        }
+    }
+    names.shrink_to_fit();
+
+    completionIndex.clear();
+    for (uint32_t i = 0; i < frozenNames.size(); i++)
+        completionIndex.add(names.substr(frozenNames[i].name, frozenNames[i].length), i);
+    completionIndex.build();
 }
 
-// Return the first name matching the catalog number or end()
-// if there are no matching names.  The first name *should* be the
-// proper name of the OBJ, if one exists. This requires the
-// OBJ name database file to have the proper names listed before
-// other designations.  Also, the STL implementation must
-// preserve this order when inserting the names into the multimap
-// (not certain whether or not this behavior is in the STL spec.
-// but it works on the implementations I've tried so far.)
-std::string NameDatabase::getNameByCatalogNumber(const AstroCatalog::IndexNumber catalogNumber) const
+// Return the index in frozenNames of the name or npos
+size_t NameDatabase::findFrozenName(const std::string& name) const
 {
-    if (catalogNumber == AstroCatalog::InvalidIndex)
-        return "";
+    if (!frozen)
+        return std::string::npos;
 
-    NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
+    std::string folded;
+    FoldName(name.data(), name.length(), folded);
+    size_t mask = hashTable.size() - 1;
+    for (size_t slot = HashName(folded.data(), folded.length()) & mask; hashTable[slot] != 0; slot = (slot + 1) & mask)
+    {
+        size_t index = hashTable[slot] - 1;
+        const FrozenName& frozenName = frozenNames[index];
+        if (frozenName.length == folded.length() &&
+            foldedNames.compare(frozenName.key, frozenName.length, folded) == 0)
+        {
+            return index;
+        }
+    }
 
-    if (iter != numberIndex.end() && iter->first == catalogNumber)
+    return std::string::npos;
+}
+
+// Return the first frozen name of the catalog number or the end of the
+// table. Erased names are ignored.
+std::vector<NameDatabase::FrozenNumber>::const_iterator NameDatabase::findFrozenNumber(const AstroCatalog::IndexNumber catalogNumber) const
+{
+    if (erasedNumbers.count(catalogNumber) != 0)
+        return frozenNumbers.end();
+
+    auto iter = std::lower_bound(frozenNumbers.begin(), frozenNumbers.end(), catalogNumber,
+                                 [](const FrozenNumber& n, AstroCatalog::IndexNumber number) { return n.catalogNumber < number; });
+    if (iter != frozenNumbers.end() && iter->catalogNumber != catalogNumber)
+        return frozenNumbers.end();
+    return iter;
+}
+
+AstroCatalog::IndexNumber NameDatabase::findCatalogNumber(const std::string& name) const
+{
+    NameIndex::const_iterator iter = nameIndex.find(name);
+    if (iter != nameIndex.end())
         return iter->second;
 
-    return "";
+    size_t index = findFrozenName(name);
+    if (index != std::string::npos)
+        return frozenNames[index].catalogNumber;
+
+    return AstroCatalog::InvalidIndex;
 }
 
+AstroCatalog::IndexNumber NameDatabase::getCatalogNumberByName(const std::string& name) const
+{
+    AstroCatalog::IndexNumber catalogNumber = findCatalogNumber(name);
+    if (catalogNumber == AstroCatalog::InvalidIndex)
+        catalogNumber = findCatalogNumber(ReplaceGreekLetterAbbr(name));
+    return catalogNumber;
+}
 
-// Return the first name matching the catalog number or end()
+// Return the first name matching the catalog number or an empty string
 // if there are no matching names.  The first name *should* be the
 // proper name of the OBJ, if one exists. This requires the
 // OBJ name database file to have the proper names listed before
@@ -71,50 +219,96 @@ std::string NameDatabase::getNameByCatalogNumber(const AstroCatalog::IndexNumber
 // preserve this order when inserting the names into the multimap
 // (not certain whether or not this behavior is in the STL spec.
 // but it works on the implementations I've tried so far.)
-NameDatabase::NumberIndex::const_iterator NameDatabase::getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const
+std::string NameDatabase::getNameByCatalogNumber(const AstroCatalog::IndexNumber catalogNumber) const
 {
-    NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
-
-    if (iter == numberIndex.end() || iter->first != catalogNumber)
-        return getFinalNameIter();
-    else
-        return iter;
-}
+    if (catalogNumber == AstroCatalog::InvalidIndex)
+        return "";
 
-NameDatabase::NumberIndex::const_iterator NameDatabase::getFinalNameIter() const
-{
-    return numberIndex.end();
+    const char* name = getFirstName(catalogNumber);
+    return name != nullptr ? name : "";
 }
 
-std::vector<std::string> NameDatabase::getCompletion(const std::string& name, bool greek) const
+const char* NameDatabase::getFirstName(const AstroCatalog::IndexNumber catalogNumber) const
 {
-    if (greek)
+    if (frozen)
     {
-        auto compList = getGreekCompletion(name);
-        compList.push_back(name);
-        return getCompletion(compList);
+        auto iter = findFrozenNumber(catalogNumber);
+        if (iter != frozenNumbers.end())
+            return names.c_str() + iter->name;
     }
 
-    std::vector<std::string> completion;
-    int name_length = UTF8Length(name);
+    NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
+    if (iter != numberIndex.end() && iter->first == catalogNumber)
+        return iter->second.c_str();
+
+    return nullptr;
+}
 
-    for (NameIndex::const_iterator iter = nameIndex.begin(); iter != nameIndex.end(); ++iter)
+std::vector<std::string> NameDatabase::getNamesByCatalogNumber(const AstroCatalog::IndexNumber catalogNumber, unsigned int maxNames) const
+{
+    std::vector<std::string> result;
+    if (frozen)
     {
-        if (!UTF8StringCompare(iter->first, name, name_length, true))
+        for (auto iter = findFrozenNumber(catalogNumber);
+             iter != frozenNumbers.end() && iter->catalogNumber == catalogNumber && result.size() < maxNames;
+             ++iter)
         {
-            completion.push_back(iter->first);
+            result.emplace_back(names, iter->name, iter->length);
         }
     }
-    return completion;
+
+    for (NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
+         iter != numberIndex.end() && iter->first == catalogNumber && result.size() < maxNames;
+         ++iter)
+    {
+        result.push_back(iter->second);
+    }
+
+    return result;
 }
 
-std::vector<std::string> NameDatabase::getCompletion(const std::vector<std::string> &list) const
+std::vector<std::string> NameDatabase::getCompletion(const std::string& name, bool greek, size_t maxResults) const
+{
+    std::vector<std::string> compList;
+    if (greek)
+        compList = getGreekCompletion(name);
+    compList.push_back(name);
+    return getCompletion(compList, maxResults);
+}
+
+std::vector<std::string> NameDatabase::getCompletion(const std::vector<std::string> &list, size_t maxResults) const
 {
     std::vector<std::string> completion;
+    if (frozen)
+    {
+        std::vector<PrefixIndex::Value> values;
+        completionIndex.find(list, values, maxResults);
+        completion.reserve(values.size());
+        for (auto value : values)
+            completion.emplace_back(names, frozenNames[value].name, frozenNames[value].length);
+        if (nameIndex.empty())
+            return completion;
+    }
+
+    std::vector<int> lengths;
     for (const auto &n : list)
+        lengths.push_back(UTF8Length(n));
+
+    for (const auto &entry : nameIndex)
     {
-        for (const auto &nn : getCompletion(n, false))
-            completion.emplace_back(nn);
+        // Names also in the tables were already found
+        if (frozen && findFrozenName(entry.first) != std::string::npos)
+            continue;
+
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            if (!UTF8StringCompare(entry.first, list[i], lengths[i], true))
+            {
+                completion.push_back(entry.first);
+                break;
+            }
+        }
     }
+    RankCompletion(completion, maxResults);
     return completion;
 }
@@ -15,14 +15,23 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 #include <celutil/debug.h>
+#include <celutil/prefixindex.h>
 #include <celutil/util.h>
 #include <celutil/utf8.h>
 #include <celengine/astroobj.h>
 
 // TODO: this can be "detemplatized" by creating e.g. a global-scope enum InvalidCatalogNumber since there
 // lies the one and only need for type genericity.
+//
+// While catalogs are loading, names are kept in maps. freeze() then moves
+// them into compact tables: the names are stored once in a single buffer,
+// referred to by arrays sorted by case-folded name and by catalog number,
+// and exact lookups go through a hash table of the folded names. Names
+// added or erased afterwards, e.g. by scripts, are kept in the maps on top
+// of the tables until freeze() is called again.
 class NameDatabase
 {
  public:
@@ -40,17 +49,60 @@ class NameDatabase
     // delete all names associated with the specified catalog number
     void erase(const AstroCatalog::IndexNumber);
 
+    // Move the names into the compact tables and index them for
+    // getCompletion(). Names in the maps are completed by searching them
+    // all, so this should be called once the catalogs are loaded.
+    void freeze();
+
     AstroCatalog::IndexNumber getCatalogNumberByName(const std::string&) const;
     std::string getNameByCatalogNumber(const AstroCatalog::IndexNumber) const;
 
-    NumberIndex::const_iterator getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const;
-    NumberIndex::const_iterator getFinalNameIter() const;
+    // Return the first name of the catalog number, or nullptr if it has no
+    // names. The pointer is valid until the database is modified.
+    const char* getFirstName(const AstroCatalog::IndexNumber) const;
+    // Return at most maxNames names of the catalog number, in the order
+    // they were added.
+    std::vector<std::string> getNamesByCatalogNumber(const AstroCatalog::IndexNumber, unsigned int maxNames) const;
 
-    std::vector<std::string> getCompletion(const std::string& name, bool greek = true) const;
-    std::vector<std::string> getCompletion(const std::vector<std::string> &list) const;
+    // Names starting with name, or with the names of the Greek letters
+    // it may abbreviate, shortest first. At most maxResults names are
+    // returned, or all of them if it's zero.
+    std::vector<std::string> getCompletion(const std::string& name, bool greek = true, size_t maxResults = 0) const;
+    std::vector<std::string> getCompletion(const std::vector<std::string> &list, size_t maxResults = 0) const;
 
  protected:
     NameIndex   nameIndex;
     NumberIndex numberIndex;
-};
 
+ private:
+    struct FrozenName
+    {
+        uint32_t key;       // offset of the folded name in foldedNames
+        uint32_t name;      // offset of the name in names
+        uint32_t length;
+        AstroCatalog::IndexNumber catalogNumber;
+    };
+
+    struct FrozenNumber
+    {
+        AstroCatalog::IndexNumber catalogNumber;
+        uint32_t name;
+        uint32_t length;
+    };
+
+    AstroCatalog::IndexNumber findCatalogNumber(const std::string&) const;
+    size_t findFrozenName(const std::string&) const;
+    std::vector<FrozenNumber>::const_iterator findFrozenNumber(const AstroCatalog::IndexNumber) const;
+
+    bool frozen{ false };
+    // Names, each followed by a null character
+    std::string names;
+    // Names folded like CompareIgnoringCasePredicate does, one after the other
+    std::string foldedNames;
+    std::vector<FrozenName> frozenNames;         // sorted by folded name
+    std::vector<FrozenNumber> frozenNumbers;     // sorted by catalog number
+    std::vector<uint32_t> hashTable;             // index in frozenNames + 1, or 0
+    // Catalog numbers whose names in the tables were erased
+    std::set<AstroCatalog::IndexNumber> erasedNumbers;
+    PrefixIndex completionIndex;
+};
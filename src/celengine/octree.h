@@ -16,6 +16,7 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <celengine/observer.h>
+#include <cstddef>
 #include <vector>
 
 // The DynamicOctree and StaticOctree template arguments are:
@@ -38,7 +39,68 @@ template <class OBJ, class PREC> class OctreeProcessor
     OctreeProcessor()          {};
     virtual ~OctreeProcessor() {};
 
+    // A single object accepted by an octree traversal
+    struct Candidate
+    {
+        const OBJ* obj;
+        PREC       distance;
+        float      appMag;
+    };
+
     virtual void process(const OBJ& obj, PREC distance, float appMag) = 0;
+
+    // The octree traversals hand over the accepted objects of a node in a
+    // single call.  The default implementation simply forwards every
+    // candidate to process(); processors in hot paths override this with a
+    // loop that calls their own process() non-virtually.
+    virtual void processBatch(const Candidate* candidates, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+    }
+};
+
+
+// Fixed size buffer used by the octree traversals to collect the candidates
+// of a node before passing them to OctreeProcessor::processBatch().
+template <class OBJ, class PREC> class OctreeCandidateBuffer
+{
+ public:
+    typedef typename OctreeProcessor<OBJ, PREC>::Candidate Candidate;
+
+    OctreeCandidateBuffer(OctreeProcessor<OBJ, PREC>& _processor) :
+        processor(_processor)
+    {
+    }
+
+    ~OctreeCandidateBuffer()
+    {
+        flush();
+    }
+
+    void add(const OBJ& obj, PREC distance, float appMag)
+    {
+        Candidate& c = candidates[count];
+        c.obj = &obj;
+        c.distance = distance;
+        c.appMag = appMag;
+        if (++count == Capacity)
+            flush();
+    }
+
+    void flush()
+    {
+        if (count > 0)
+            processor.processBatch(candidates, count);
+        count = 0;
+    }
+
+ private:
+    enum { Capacity = 64 };
+
+    OctreeProcessor<OBJ, PREC>& processor;
+    Candidate candidates[Capacity];
+    size_t count { 0 };
 };
 
 
@@ -147,6 +209,18 @@ template <class OBJ, class PREC> class StaticOctree
 
     void computeStatistics(std::vector<OctreeLevelStatistics>& stats, unsigned int level = 0);
 
+    // Node accessors, used to serialize a compiled octree into a flat node
+    // table and to rebuild it from one without going through DynamicOctree.
+    const PointType& getCellCenterPos()   const { return cellCenterPos; }
+    float            getExclusionFactor() const { return exclusionFactor; }
+    OBJ*             getFirstObject()     const { return _firstObject; }
+    unsigned int     getObjectCount()     const { return nObjects; }
+    StaticOctree*    getChild(int i)      const { return _children != nullptr ? _children[i] : nullptr; }
+    bool             hasChildren()        const { return _children != nullptr; }
+
+    // Takes ownership of an array of eight child nodes
+    void setChildren(StaticOctree** children);
+
  private:
     static const PREC SQRT3;
 
@@ -359,6 +433,20 @@ inline StaticOctree<OBJ, PREC>::~StaticOctree()
 }
 
 
+template <class OBJ, class PREC>
+inline void StaticOctree<OBJ, PREC>::setChildren(StaticOctree** children)
+{
+    if (_children != nullptr)
+    {
+        for (int i = 0; i < 8; ++i)
+            delete _children[i];
+
+        delete[] _children;
+    }
+    _children = children;
+}
+
+
 template <class OBJ, class PREC>
 inline int StaticOctree<OBJ, PREC>::countChildren() const
 {
@@ -0,0 +1,195 @@
+// orbitpathcache.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Cache of the sampled paths of orbits.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <limits>
+#include <celephem/orbit.h>
+#include "orbitpathcache.h"
+#include "orbitsampler.h"
+
+using namespace Eigen;
+using namespace std;
+
+
+// Paths are only retired when there are more than this many in the cache
+static const unsigned int OrbitCacheCullThreshold = 200;
+// Age in frames at which a path may be retired
+static const uint32_t OrbitCacheRetireAge = 16;
+
+// Extra time sampled on both sides of the window, in orbital periods
+static const double WindowSlack = 0.2;
+// Samples are kept up to this many window lengths before and after the
+// window, so that moving back and forth in time or showing different
+// times in several views doesn't resample the path.
+static const double KeptWindows = 1.5;
+
+// Greatest distance between the cubic through two samples and the orbit,
+// relative to the distance from the orbit center. Orbits a thousand pixels
+// across are then drawn within a tenth of a pixel.
+static const double RelativeTolerance = 1.0e-4;
+// Limit on the subdivision of an interval between two samples
+static const int MaxRefinementDepth = 6;
+
+
+// Append the samples needed between s0 and s1 for the cubic through them
+// to follow the orbit.
+static void RefineInterval(const Orbit* orbit,
+                           const CurvePlotSample& s0,
+                           const CurvePlotSample& s1,
+                           int depth,
+                           vector<CurvePlotSample>& refined,
+                           uint64_t& sampleCount)
+{
+    if (depth == MaxRefinementDepth)
+        return;
+
+    // Midpoint of the cubic Hermite curve through the samples
+    double dt = s1.t - s0.t;
+    Vector3d interpolated = (s0.position + s1.position) * 0.5 +
+                            (s0.velocity - s1.velocity) * (dt * 0.125);
+
+    CurvePlotSample mid;
+    mid.t = s0.t + dt * 0.5;
+    mid.position = orbit->positionAtTime(mid.t);
+    sampleCount++;
+
+    double tolerance = RelativeTolerance * max(s0.position.norm(), s1.position.norm());
+    if ((mid.position - interpolated).norm() <= tolerance)
+        return;
+
+    mid.velocity = orbit->velocityAtTime(mid.t);
+    RefineInterval(orbit, s0, mid, depth + 1, refined, sampleCount);
+    refined.push_back(mid);
+    RefineInterval(orbit, mid, s1, depth + 1, refined, sampleCount);
+}
+
+
+CurvePlot* OrbitPathCache::getPath(const Orbit* orbit,
+                                   double t,
+                                   double windowStart,
+                                   double windowEnd,
+                                   uint32_t frame)
+{
+    auto iter = paths.find(orbit);
+    if (iter == paths.end())
+    {
+        retireUnusedPaths(frame);
+
+        auto* plot = new CurvePlot();
+        plot->setLastUsed(frame);
+        paths[orbit].reset(plot);
+
+        // Trajectories which aren't periodic are sampled once
+        if (!orbit->isPeriodic())
+        {
+            double begin = 0.0, end = 0.0;
+            orbit->getValidRange(begin, end);
+            double startTime = begin != end ? begin : t;
+            samplePath(plot, orbit, startTime, startTime + orbit->getPeriod(), false);
+            return plot;
+        }
+    }
+    else
+    {
+        iter->second->setLastUsed(frame);
+        if (!orbit->isPeriodic())
+            return iter->second.get();
+    }
+
+    // 'Periodic' orbits are generally not strictly periodic because of
+    // perturbations from other bodies, so the path follows the window
+    // instead of being sampled over a single period.
+    CurvePlot* plot = paths[orbit].get();
+    double slack = orbit->getPeriod() * WindowSlack;
+    double newWindowStart = windowStart - slack;
+    double newWindowEnd = windowEnd + slack;
+
+    if (plot->empty() ||
+        newWindowEnd < plot->startTime() ||
+        newWindowStart > plot->endTime())
+    {
+        // None of the samples are in the new window, and the gap could be
+        // arbitrarily long, so start over.
+        plot->removeSamplesBefore(numeric_limits<double>::infinity());
+        samplePath(plot, orbit, newWindowStart, newWindowEnd, false);
+        return plot;
+    }
+
+    if (windowStart < plot->startTime())
+        samplePath(plot, orbit, newWindowStart, plot->startTime(), true);
+    if (windowEnd > plot->endTime())
+        samplePath(plot, orbit, plot->endTime(), newWindowEnd, false);
+
+    double windowLength = newWindowEnd - newWindowStart;
+    plot->removeSamplesBefore(newWindowStart - windowLength * KeptWindows);
+    plot->removeSamplesAfter(newWindowEnd + windowLength * KeptWindows);
+
+    return plot;
+}
+
+
+void OrbitPathCache::clear()
+{
+    paths.clear();
+}
+
+
+// Sample the orbit between startTime and endTime and add the samples to
+// the end of the plot, or to its beginning if backward is true. Samples
+// at the times of the first or last sample of the plot are ignored by
+// CurvePlot::addSample().
+void OrbitPathCache::samplePath(CurvePlot* plot,
+                                const Orbit* orbit,
+                                double startTime,
+                                double endTime,
+                                bool backward)
+{
+    OrbitSampler sampler;
+    orbit->sample(startTime, endTime, sampler);
+    sampleCount += sampler.samples.size();
+
+    samples.clear();
+    for (size_t i = 0; i < sampler.samples.size(); i++)
+    {
+        if (i > 0)
+            RefineInterval(orbit, sampler.samples[i - 1], sampler.samples[i], 0, samples, sampleCount);
+        samples.push_back(sampler.samples[i]);
+    }
+
+    if (backward)
+    {
+        for (auto iter = samples.rbegin(); iter != samples.rend(); ++iter)
+            plot->addSample(*iter);
+    }
+    else
+    {
+        for (const auto& sample : samples)
+            plot->addSample(sample);
+    }
+}
+
+
+// If the cache is full, first try and eliminate some old paths
+void OrbitPathCache::retireUnusedPaths(uint32_t frame)
+{
+    // Check for old paths at most once per frame
+    if (paths.size() <= OrbitCacheCullThreshold || lastRetireFrame == frame)
+        return;
+
+    for (auto iter = paths.begin(); iter != paths.end();)
+    {
+        if (frame - iter->second->lastUsed() > OrbitCacheRetireAge)
+            iter = paths.erase(iter);
+        else
+            ++iter;
+    }
+    lastRetireFrame = frame;
+}
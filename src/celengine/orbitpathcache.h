@@ -0,0 +1,65 @@
+// orbitpathcache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Cache of the sampled paths of orbits.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include "curveplot.h"
+
+class Orbit;
+
+/*! The sampled paths of the orbits drawn by the renderer. Paths of periodic
+ *  orbits cover a window of time around the current time; as the window
+ *  moves, samples are added at the ends of the path instead of sampling it
+ *  again, and samples are only dropped once they're far from the window.
+ *  Views showing different times can thus share the paths. Samples are
+ *  added between the ones produced by the orbit where the cubic curve
+ *  through them strays from the orbit.
+ */
+class OrbitPathCache
+{
+ public:
+    OrbitPathCache() = default;
+    ~OrbitPathCache() = default;
+
+    OrbitPathCache(const OrbitPathCache&) = delete;
+    OrbitPathCache& operator=(const OrbitPathCache&) = delete;
+
+    /*! Return the path of orbit at time t. For periodic orbits the path
+     *  covers at least [ windowStart, windowEnd ]; aperiodic orbits are
+     *  sampled once over their valid range, or one period from t if the
+     *  range is unbounded. frame is used to retire unused paths.
+     */
+    CurvePlot* getPath(const Orbit* orbit,
+                       double t,
+                       double windowStart,
+                       double windowEnd,
+                       uint32_t frame);
+
+    void clear();
+
+    unsigned int size() const { return (unsigned int) paths.size(); }
+
+    // Number of orbit samples computed since the cache was created
+    uint64_t getSampleCount() const { return sampleCount; }
+
+ private:
+    void samplePath(CurvePlot* plot, const Orbit* orbit, double startTime, double endTime, bool backward);
+    void retireUnusedPaths(uint32_t frame);
+
+    std::map<const Orbit*, std::unique_ptr<CurvePlot>> paths;
+    std::vector<CurvePlotSample> samples;
+    uint32_t lastRetireFrame{ 0 };
+    uint64_t sampleCount{ 0 };
+};
@@ -201,3 +201,9 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
         }
     }
 }
+
+void PointStarRenderer::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        PointStarRenderer::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+}
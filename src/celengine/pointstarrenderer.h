@@ -41,6 +41,7 @@ class PointStarRenderer : public ObjectRenderer<Star, float>
 
     PointStarRenderer();
     void process(const Star &star, float distance, float appMag);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
     Eigen::Vector3d obsPos;
     std::vector<RenderListEntry>* renderList    { nullptr };
@@ -60,7 +60,6 @@ std::ofstream hdrlog;
 #include "framebuffer.h"
 #include "pointstarvertexbuffer.h"
 #include "pointstarrenderer.h"
-#include "orbitsampler.h"
 #include "asterismrenderer.h"
 #include "boundariesrenderer.h"
 #include "rendcontext.h"
@@ -73,6 +72,7 @@ std::ofstream hdrlog;
 #include <celutil/debug.h>
 #include <celutil/utf8.h>
 #include <celutil/util.h>
+#include <celutil/threadpool.h>
 #include <celutil/timer.h>
 #include <celttf/truetypefont.h>
 #include "glsupport.h"
@@ -156,10 +156,14 @@ static const int MaxSkyRings = 32;
 static const int MaxSkySlices = 180;
 static const int MinSkySlices = 30;
 
-// Size at which the orbit cache will be flushed of old orbit paths
-static const unsigned int OrbitCacheCullThreshold = 200;
-// Age in frames at which unused orbit paths may be eliminated from the cache
-static const uint32_t OrbitCacheRetireAge = 16;
+// Time in seconds spent each frame on creating the textures and models
+// loaded in the background
+static const double TextureUploadTimeBudget = 0.004;
+static const double GeometryUploadTimeBudget = 0.002;
+
+// Minimum number of children of a frame tree for which their visibility is
+// computed in parallel
+static const unsigned int ParallelRenderListThreshold = 64;
 
 Color Renderer::StarLabelColor          (0.471f, 0.356f, 0.682f);
 Color Renderer::PlanetLabelColor        (0.407f, 0.333f, 0.964f);
@@ -260,7 +264,6 @@ Renderer::Renderer() :
     glareVertexBuffer(nullptr),
     textureResolution(medres),
     frameCount(0),
-    lastOrbitCacheFlush(0),
     minOrbitSize(MinOrbitSizeForLabel),
     distanceLimit(1.0e6f),
     minFeatureSize(MinFeatureSizeForLabel),
@@ -1171,84 +1174,6 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
     else
         orbit = orbitPath.star->getOrbit();
 
-    CurvePlot* cachedOrbit = nullptr;
-    OrbitCache::iterator cached = orbitCache.find(orbit);
-    if (cached != orbitCache.end())
-    {
-        cachedOrbit = cached->second;
-        cachedOrbit->setLastUsed(frameCount);
-    }
-
-    // If it's not in the cache already
-    if (cachedOrbit == nullptr)
-    {
-        double startTime = t;
-        int nSamples = detailOptions.orbitPathSamplePoints;
-
-        // Adjust the number of samples used for aperiodic orbits--these aren't
-        // true orbits, but are sampled trajectories, generally of spacecraft.
-        // Better control is really needed--some sort of adaptive sampling would
-        // be ideal.
-        if (!orbit->isPeriodic())
-        {
-            double begin = 0.0, end = 0.0;
-            orbit->getValidRange(begin, end);
-
-            if (begin != end)
-            {
-                startTime = begin;
-                nSamples = (int) (orbit->getPeriod() * 100.0);
-                nSamples = max(min(nSamples, 1000), 100);
-            }
-            else
-            {
-                // If the orbit is aperiodic and doesn't have a
-                // finite duration, we don't render it. A compromise
-                // would be to pick some time window centered at the
-                // current time, but we'd have to pick some arbitrary
-                // duration.
-                nSamples = 0;
-            }
-        }
-        else
-        {
-            startTime = t - orbit->getPeriod();
-        }
-
-        cachedOrbit = new CurvePlot();
-        cachedOrbit->setLastUsed(frameCount);
-
-        OrbitSampler sampler;
-        orbit->sample(startTime,
-                      startTime + orbit->getPeriod(),
-                      sampler);
-        sampler.insertForward(cachedOrbit);
-
-        // If the orbit cache is full, first try and eliminate some old orbits
-        if (orbitCache.size() > OrbitCacheCullThreshold)
-        {
-            // Check for old orbits at most once per frame
-            if (lastOrbitCacheFlush != frameCount)
-            {
-                for (auto iter = orbitCache.begin(); iter != orbitCache.end();)
-                {
-                    // Tricky code to eliminate a node in the orbit cache without screwing
-                    // up the iterator. Should work in all STL implementations.
-                    if (frameCount - iter->second->lastUsed() > OrbitCacheRetireAge)
-                        orbitCache.erase(iter++);
-                    else
-                        ++iter;
-                }
-                lastOrbitCacheFlush = frameCount;
-            }
-        }
-
-        orbitCache[orbit] = cachedOrbit;
-    }
-
-    if (cachedOrbit->empty())
-        return;
-
     //*** Orbit rendering parameters
 
     // The 'window' is the interval of time for which the orbit will be drawn.
@@ -1268,58 +1193,18 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
     // The default value is 0.0.
     const double LinearFadeFraction = detailOptions.linearFadeFraction;
 
-    // Extra size of the internal sample cache.
-    const double WindowSlack        = 0.2;
-
     //***
 
-    // 'Periodic' orbits are generally not strictly periodic because of perturbations
-    // from other bodies. Here we update the trajectory samples to make sure that the
-    // orbit covers a time range centered at the current time and covering a full revolution.
-    if (orbit->isPeriodic())
-    {
-        double period = orbit->getPeriod();
-        double endTime = t + period * OrbitWindowEnd;
-        double startTime = endTime - period * OrbitPeriodsShown;
-
-        double currentWindowStart = cachedOrbit->startTime();
-        double currentWindowEnd = cachedOrbit->endTime();
-        double newWindowStart = startTime - period * WindowSlack;
-        double newWindowEnd = endTime + period * WindowSlack;
+    // The window of a periodic orbit, where its path is drawn. Paths of
+    // other orbits are drawn whole, or up to the current time.
+    double period = orbit->getPeriod();
+    double windowEnd = t + period * OrbitWindowEnd;
+    double windowStart = windowEnd - period * OrbitPeriodsShown;
+    double windowDuration = windowEnd - windowStart;
 
-        if (startTime < currentWindowStart)
-        {
-            // Remove samples at the end of the time window
-            cachedOrbit->removeSamplesAfter(newWindowEnd);
-
-            // Trim the first sample (because it will be duplicated when we sample the orbit.)
-            cachedOrbit->removeSamplesBefore(cachedOrbit->startTime() * (1.0 + 1.0e-15));
-
-            // Add the new samples
-            OrbitSampler sampler;
-            orbit->sample(newWindowStart, min(currentWindowStart, newWindowEnd), sampler);
-            sampler.insertBackward(cachedOrbit);
-#if DEBUG_ORBIT_CACHE
-            clog << "new sample count: " << cachedOrbit->sampleCount() << endl;
-#endif
-        }
-        else if (endTime > currentWindowEnd)
-        {
-            // Remove samples at the beginning of the time window
-            cachedOrbit->removeSamplesBefore(newWindowStart);
-
-            // Trim the last sample (because it will be duplicated when we sample the orbit.)
-            cachedOrbit->removeSamplesAfter(cachedOrbit->endTime() * (1.0 - 1.0e-15));
-
-            // Add the new samples
-            OrbitSampler sampler;
-            orbit->sample(max(currentWindowEnd, newWindowStart), newWindowEnd, sampler);
-            sampler.insertForward(cachedOrbit);
-#if DEBUG_ORBIT_CACHE
-            clog << "new sample count: " << cachedOrbit->sampleCount() << endl;
-#endif
-        }
-    }
+    CurvePlot* cachedOrbit = orbitPathCache.getPath(orbit, t, windowStart, windowEnd, frameCount);
+    if (cachedOrbit->empty())
+        return;
 
     // We perform vertex tranformations on the CPU because double precision is necessary to
     // render orbits properly. Start by computing the modelview matrix, to transform orbit
@@ -1365,11 +1250,6 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
     }
     if (orbit->isPeriodic())
     {
-        double period = orbit->getPeriod();
-        double windowEnd = t + period * OrbitWindowEnd;
-        double windowStart = windowEnd - period * OrbitPeriodsShown;
-        double windowDuration = windowEnd - windowStart;
-
         if (LinearFadeFraction == 0.0f || (renderFlags & ShowFadingOrbits) == 0)
         {
             cachedOrbit->render(modelview,
@@ -1640,6 +1520,24 @@ void Renderer::draw(const Observer& observer,
     frameCount++;
     settingsChanged = false;
 
+    // Create the textures and models loaded in the background since the
+    // last frame
+    GetTextureManager()->finishLoads(TextureUploadTimeBudget);
+    GetGeometryManager()->finishLoads(GeometryUploadTimeBudget);
+
+    // Unload the textures, models and sphere patches which haven't been
+    // used recently when over their memory budgets
+    GetTextureManager()->nextFrame();
+    GetGeometryManager()->nextFrame();
+    const LODSphereMesh::Stats& sphereStats = g_lodSphere->getStats();
+    if (sphereStats.uploads > 0)
+    {
+        DPRINTF(LOG_LEVEL_DEBUG, "Sphere patches: %zu drawn, %zu uploaded (%zu bytes), %zu bytes cached\n",
+                sphereStats.patchesDrawn, sphereStats.uploads,
+                sphereStats.uploadedBytes, sphereStats.cachedBytes);
+    }
+    g_lodSphere->nextFrame();
+
     // Compute the size of a pixel
     setFieldOfView(radToDeg(observer.getFOV()));
     pixelSize = calcPixelSize(fov, (float) windowHeight);
@@ -2453,7 +2351,26 @@ Renderer::locationsToAnnotations(const Body& body,
 
     Matrix3d bodyMatrix = bodyOrientation.conjugate().toRotationMatrix();
 
-    for (const auto location : *locations)
+    // Only consider the groups of locations which may be large enough on
+    // screen, in front of the camera and not hidden by the body. Locations
+    // on irregular bodies are projected out to the bounding sphere before
+    // the visibility test, so the body is only used as an occluder when
+    // it is an ellipsoid seen from outside.
+    LocationIndex::Query query;
+    query.cameraPosition = viewRayOrigin;
+    query.viewNormal = bodyOrientation * viewNormal;
+    query.pixelSize = pixelSize;
+    query.minFeatureSize = minFeatureSize;
+    query.featureFilter = locationFilter;
+    query.occluderRadius = 0.0;
+    query.labelOffset = labelOffset;
+    if (body.isEllipsoid() && viewRayOrigin.norm() > boundingRadius)
+        query.occluderRadius = semiAxes.minCoeff();
+
+    visibleLocations.clear();
+    body.getLocationIndex()->findVisible(query, visibleLocations);
+
+    for (const auto location : visibleLocations)
     {
         auto featureType = location->getFeatureType();
         if ((featureType & locationFilter) != 0)
@@ -2784,26 +2701,35 @@ void Renderer::renderObject(const Vector3f& pos,
 
     // Get the object's geometry; nullptr indicates that object is an
     // ellipsoid.
+    // Resources loaded asynchronously are requested with the on screen
+    // size of the object as priority.
     Geometry* geometry = nullptr;
     if (obj.geometry != InvalidResource)
     {
         // This is a model loaded from a file
-        geometry = GetGeometryManager()->find(obj.geometry);
+        geometry = GetGeometryManager()->find(obj.geometry, discSizeInPixels);
+
+        // Don't draw an ellipsoid in place of a model that is still loading
+        if (geometry == nullptr &&
+            GetGeometryManager()->getState(obj.geometry) == ResourceLoading)
+        {
+            return;
+        }
     }
 
     // Get the textures . . .
     if (obj.surface->baseTexture.tex[textureResolution] != InvalidResource)
-        ri.baseTex = obj.surface->baseTexture.find(textureResolution);
+        ri.baseTex = obj.surface->baseTexture.find(textureResolution, discSizeInPixels);
     if ((obj.surface->appearanceFlags & Surface::ApplyBumpMap) != 0 &&
         obj.surface->bumpTexture.tex[textureResolution] != InvalidResource)
-        ri.bumpTex = obj.surface->bumpTexture.find(textureResolution);
+        ri.bumpTex = obj.surface->bumpTexture.find(textureResolution, discSizeInPixels);
     if ((obj.surface->appearanceFlags & Surface::ApplyNightMap) != 0 &&
         (renderFlags & ShowNightMaps) != 0)
-        ri.nightTex = obj.surface->nightTexture.find(textureResolution);
+        ri.nightTex = obj.surface->nightTexture.find(textureResolution, discSizeInPixels);
     if ((obj.surface->appearanceFlags & Surface::SeparateSpecularMap) != 0)
-        ri.glossTex = obj.surface->specularTexture.find(textureResolution);
+        ri.glossTex = obj.surface->specularTexture.find(textureResolution, discSizeInPixels);
     if ((obj.surface->appearanceFlags & Surface::ApplyOverlay) != 0)
-        ri.overlayTex = obj.surface->overlayTexture.find(textureResolution);
+        ri.overlayTex = obj.surface->overlayTexture.find(textureResolution, discSizeInPixels);
 
     // Scaling will be nonuniform for nonspherical planets. As long as the
     // deviation from spherical isn't too large, the nonuniform scale factor
@@ -2925,9 +2851,9 @@ void Renderer::renderObject(const Vector3f& pos,
         if ((renderFlags & ShowCloudMaps) != 0)
         {
             if (atmosphere->cloudTexture.tex[textureResolution] != InvalidResource)
-                cloudTex = atmosphere->cloudTexture.find(textureResolution);
+                cloudTex = atmosphere->cloudTexture.find(textureResolution, discSizeInPixels);
             if (atmosphere->cloudNormalMap.tex[textureResolution] != InvalidResource)
-                cloudNormalMap = atmosphere->cloudNormalMap.find(textureResolution);
+                cloudNormalMap = atmosphere->cloudNormalMap.find(textureResolution, discSizeInPixels);
         }
         if (atmosphere->cloudSpeed != 0.0f)
             cloudTexOffset = (float) (-pfmod(now * atmosphere->cloudSpeed / (2 * PI), 1.0));
@@ -3110,7 +3036,7 @@ void Renderer::renderObject(const Vector3f& pos,
     {
         if (lit && (renderFlags & ShowRingShadows) != 0)
         {
-            Texture* ringsTex = obj.rings->texture.find(textureResolution);
+            Texture* ringsTex = obj.rings->texture.find(textureResolution, discSizeInPixels);
             if (ringsTex != nullptr)
                 ringsTex->bind();
         }
@@ -4053,84 +3979,80 @@ void Renderer::addRenderListEntries(RenderListEntry& rle,
 }
 
 
-void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
-                                const Frustum& viewFrustum,
-                                const Vector3d& viewPlaneNormal,
-                                const Vector3d& frameCenter,
-                                const FrameTree* tree,
-                                const Observer& observer,
-                                double now)
+// Compute the position of the body of a timeline phase and decide whether
+// it must be rendered, lights other objects, or has a frame subtree which
+// must be traversed. This doesn't modify the renderer, so that it can run
+// in parallel for the children of a frame tree.
+void Renderer::computeBodyVisibility(BodyVisibility& vis,
+                                     const TimelinePhase& phase,
+                                     const Vector3d& astrocentricObserverPos,
+                                     const Frustum& viewFrustum,
+                                     const Vector3d& viewPlaneNormal,
+                                     const Vector3d& frameCenter,
+                                     int labelClassMask,
+                                     double now) const
 {
-    int labelClassMask = translateLabelModeToClassMask(labelMode);
-
-    Matrix3f viewMat = observer.getOrientationf().toRotationMatrix();
-    Vector3f viewMatZ = viewMat.row(2);
     double invCosViewAngle = 1.0 / cosViewConeAngle;
     double sinViewAngle = sqrt(1.0 - square(cosViewConeAngle));
 
-    unsigned int nChildren = tree != nullptr ? tree->childCount() : 0;
-    for (unsigned int i = 0; i < nChildren; i++)
-    {
-        auto phase = tree->getChild(i);
+    vis.body = nullptr;
+    vis.isSecondaryIlluminator = false;
+    vis.isRendered = false;
+    vis.isLabeled = false;
+    vis.traverseSubtree = false;
 
-        // No need to do anything if the phase isn't active now
-        if (!phase->includes(now))
-            continue;
+    // No need to do anything if the phase isn't active now
+    if (!phase.includes(now))
+        return;
 
-        Body* body = phase->body();
+    Body* body = phase.body();
+    vis.body = body;
 
-        // pos_s: sun-relative position of object
-        // pos_v: viewer-relative position of object
+    // pos_s: sun-relative position of object
+    // pos_v: viewer-relative position of object
 
-        // Get the position of the body relative to the sun.
-        Vector3d p = phase->orbit()->positionAtTime(now);
-        auto frame = phase->orbitFrame();
-        Vector3d pos_s = frameCenter + frame->getOrientation(now).conjugate() * p;
+    // Get the position of the body relative to the sun.
+    Vector3d p = phase.orbit()->positionAtTime(now);
+    auto frame = phase.orbitFrame();
+    Vector3d pos_s = frameCenter + frame->getOrientation(now).conjugate() * p;
 
-        // We now have the positions of the observer and the planet relative
-        // to the sun.  From these, compute the position of the body
-        // relative to the observer.
-        Vector3d pos_v = pos_s - astrocentricObserverPos;
+    // We now have the positions of the observer and the planet relative
+    // to the sun.  From these, compute the position of the body
+    // relative to the observer.
+    Vector3d pos_v = pos_s - astrocentricObserverPos;
+    vis.pos_s = pos_s;
+    vis.pos_v = pos_v;
 
-        // dist_vn: distance along view normal from the viewer to the
-        // projection of the object's center.
-        double dist_vn = viewPlaneNormal.dot(pos_v);
+    // dist_vn: distance along view normal from the viewer to the
+    // projection of the object's center.
+    double dist_vn = viewPlaneNormal.dot(pos_v);
 
-        // Vector from object center to its projection on the view normal.
-        Vector3d toViewNormal = pos_v - dist_vn * viewPlaneNormal;
+    // Vector from object center to its projection on the view normal.
+    Vector3d toViewNormal = pos_v - dist_vn * viewPlaneNormal;
 
-        float cullingRadius = body->getCullingRadius();
+    float cullingRadius = body->getCullingRadius();
 
-        // The result of the planetshine test can be reused for the view cone
-        // test, but only when the object's light influence sphere is larger
-        // than the geometry. This is not
-        bool viewConeTestFailed = false;
-        if (body->isSecondaryIlluminator())
+    // The result of the planetshine test can be reused for the view cone
+    // test, but only when the object's light influence sphere is larger
+    // than the geometry. This is not
+    bool viewConeTestFailed = false;
+    if (body->isSecondaryIlluminator())
+    {
+        float influenceRadius = body->getBoundingRadius() + (body->getRadius() * PLANETSHINE_DISTANCE_LIMIT_FACTOR);
+        if (dist_vn > -influenceRadius)
         {
-            float influenceRadius = body->getBoundingRadius() + (body->getRadius() * PLANETSHINE_DISTANCE_LIMIT_FACTOR);
-            if (dist_vn > -influenceRadius)
+            double maxPerpDist = (influenceRadius + dist_vn * sinViewAngle) * invCosViewAngle;
+            double perpDistSq = toViewNormal.squaredNorm();
+            if (perpDistSq < maxPerpDist * maxPerpDist)
             {
-                double maxPerpDist = (influenceRadius + dist_vn * sinViewAngle) * invCosViewAngle;
-                double perpDistSq = toViewNormal.squaredNorm();
-                if (perpDistSq < maxPerpDist * maxPerpDist)
+                if ((body->getRadius() / (float) pos_v.norm()) / pixelSize > PLANETSHINE_PIXEL_SIZE_LIMIT)
                 {
-                    if ((body->getRadius() / (float) pos_v.norm()) / pixelSize > PLANETSHINE_PIXEL_SIZE_LIMIT)
-                    {
-                        // add to planetshine list if larger than 1/10 pixel
+                    // add to planetshine list if larger than 1/10 pixel
 #if DEBUG_SECONDARY_ILLUMINATION
-                        clog << "Planetshine: " << body->getName()
-                             << ", " << body->getRadius() / (float) pos_v.length() / pixelSize << endl;
+                    clog << "Planetshine: " << body->getName()
+                         << ", " << body->getRadius() / (float) pos_v.length() / pixelSize << endl;
 #endif
-                        SecondaryIlluminator illum;
-                        illum.body = body;
-                        illum.position_v = pos_v;
-                        illum.radius = body->getRadius();
-                        secondaryIlluminators.push_back(illum);
-                    }
-                }
-                else
-                {
-                    viewConeTestFailed = influenceRadius > cullingRadius;
+                    vis.isSecondaryIlluminator = true;
                 }
             }
             else
@@ -4138,143 +4060,231 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
                 viewConeTestFailed = influenceRadius > cullingRadius;
             }
         }
-
-        bool insideViewCone = false;
-        if (!viewConeTestFailed)
+        else
         {
-            float radius = body->getCullingRadius();
-            if (dist_vn > -radius)
-            {
-                double maxPerpDist = (radius + dist_vn * sinViewAngle) * invCosViewAngle;
-                double perpDistSq = toViewNormal.squaredNorm();
-                insideViewCone = perpDistSq < maxPerpDist * maxPerpDist;
-            }
+            viewConeTestFailed = influenceRadius > cullingRadius;
         }
+    }
 
-        if (insideViewCone)
+    bool insideViewCone = false;
+    if (!viewConeTestFailed)
+    {
+        float radius = body->getCullingRadius();
+        if (dist_vn > -radius)
         {
-            // Calculate the distance to the viewer
-            double dist_v = pos_v.norm();
-
-            // Calculate the size of the planet/moon disc in pixels
-            float discSize = (body->getCullingRadius() / (float) dist_v) / pixelSize;
-
-            // Compute the apparent magnitude; instead of summing the reflected
-            // light from all nearby stars, we just consider the one with the
-            // highest apparent brightness.
-            float appMag = 100.0f;
-            for (unsigned int li = 0; li < lightSourceList.size(); li++)
-            {
-                Vector3d sunPos = pos_v - lightSourceList[li].position;
-                appMag = min(appMag, body->getApparentMagnitude(lightSourceList[li].luminosity, sunPos, pos_v));
-            }
+            double maxPerpDist = (radius + dist_vn * sinViewAngle) * invCosViewAngle;
+            double perpDistSq = toViewNormal.squaredNorm();
+            insideViewCone = perpDistSq < maxPerpDist * maxPerpDist;
+        }
+    }
 
-            bool visibleAsPoint = appMag < faintestPlanetMag && body->isVisibleAsPoint();
-            bool isLabeled = (body->getOrbitClassification() & labelClassMask) != 0;
+    if (insideViewCone)
+    {
+        // Calculate the distance to the viewer
+        double dist_v = pos_v.norm();
 
-            if ((discSize > 1 || visibleAsPoint || isLabeled) && isBodyVisible(body, bodyVisibilityMask))
-            {
-                RenderListEntry rle;
+        // Calculate the size of the planet/moon disc in pixels
+        float discSize = (body->getCullingRadius() / (float) dist_v) / pixelSize;
 
-                rle.position = pos_v.cast<float>();
-                rle.distance = (float) dist_v;
-                rle.centerZ = pos_v.cast<float>().dot(viewMatZ);
-                rle.appMag   = appMag;
-                rle.discSizeInPixels = body->getRadius() / ((float) dist_v * pixelSize);
+        // Compute the apparent magnitude; instead of summing the reflected
+        // light from all nearby stars, we just consider the one with the
+        // highest apparent brightness.
+        float appMag = 100.0f;
+        for (unsigned int li = 0; li < lightSourceList.size(); li++)
+        {
+            Vector3d sunPos = pos_v - lightSourceList[li].position;
+            appMag = min(appMag, body->getApparentMagnitude(lightSourceList[li].luminosity, sunPos, pos_v));
+        }
 
-                // TODO: Remove this. It's only used in two places: for calculating comet tail
-                // length, and for calculating sky brightness to adjust the limiting magnitude.
-                // In both cases, it's the wrong quantity to use (e.g. for objects with orbits
-                // defined relative to the SSB.)
-                rle.sun = -pos_s.cast<float>();
+        bool visibleAsPoint = appMag < faintestPlanetMag && body->isVisibleAsPoint();
+        bool isLabeled = (body->getOrbitClassification() & labelClassMask) != 0;
 
-                addRenderListEntries(rle, *body, isLabeled);
-            }
+        if ((discSize > 1 || visibleAsPoint || isLabeled) && isBodyVisible(body, bodyVisibilityMask))
+        {
+            vis.isRendered = true;
+            vis.isLabeled = isLabeled;
+            vis.appMag = appMag;
         }
+    }
 
-        const FrameTree* subtree = body->getFrameTree();
-        if (subtree != nullptr)
+    const FrameTree* subtree = body->getFrameTree();
+    if (subtree != nullptr)
+    {
+        double dist_v = pos_v.norm();
+        bool traverseSubtree = false;
+
+        // There are two different tests available to determine whether we can reject
+        // the object's subtree. If the subtree contains no light reflecting objects,
+        // then render the subtree only when:
+        //    - the subtree bounding sphere intersects the view frustum, and
+        //    - the subtree contains an object bright or large enough to be visible.
+        // Otherwise, render the subtree when any of the above conditions are
+        // true or when a subtree object could potentially illuminate something
+        // in the view cone.
+        auto minPossibleDistance = (float) (dist_v - subtree->boundingSphereRadius());
+        float brightestPossible = 0.0;
+        float largestPossible = 0.0;
+
+        // If the viewer is not within the subtree bounding sphere, see if we can cull it because
+        // it contains no objects brighter than the limiting magnitude and no objects that will
+        // be larger than one pixel in size.
+        if (minPossibleDistance > 1.0f)
         {
-            double dist_v = pos_v.norm();
-            bool traverseSubtree = false;
+            // Figure out the magnitude of the brightest possible object in the subtree.
 
-            // There are two different tests available to determine whether we can reject
-            // the object's subtree. If the subtree contains no light reflecting objects,
-            // then render the subtree only when:
-            //    - the subtree bounding sphere intersects the view frustum, and
-            //    - the subtree contains an object bright or large enough to be visible.
-            // Otherwise, render the subtree when any of the above conditions are
-            // true or when a subtree object could potentially illuminate something
-            // in the view cone.
-            auto minPossibleDistance = (float) (dist_v - subtree->boundingSphereRadius());
-            float brightestPossible = 0.0;
-            float largestPossible = 0.0;
-
-            // If the viewer is not within the subtree bounding sphere, see if we can cull it because
-            // it contains no objects brighter than the limiting magnitude and no objects that will
-            // be larger than one pixel in size.
-            if (minPossibleDistance > 1.0f)
+            // Compute the luminosity from reflected light of the largest object in the subtree
+            float lum = 0.0f;
+            for (unsigned int li = 0; li < lightSourceList.size(); li++)
             {
-                // Figure out the magnitude of the brightest possible object in the subtree.
-
-                // Compute the luminosity from reflected light of the largest object in the subtree
-                float lum = 0.0f;
-                for (unsigned int li = 0; li < lightSourceList.size(); li++)
-                {
-                    Vector3d sunPos = pos_v - lightSourceList[li].position;
-                    lum += luminosityAtOpposition(lightSourceList[li].luminosity, (float) sunPos.norm(), (float) subtree->maxChildRadius());
-                }
-                brightestPossible = astro::lumToAppMag(lum, astro::kilometersToLightYears(minPossibleDistance));
-                largestPossible = (float) subtree->maxChildRadius() / (float) minPossibleDistance / pixelSize;
+                Vector3d sunPos = pos_v - lightSourceList[li].position;
+                lum += luminosityAtOpposition(lightSourceList[li].luminosity, (float) sunPos.norm(), (float) subtree->maxChildRadius());
             }
-            else
+            brightestPossible = astro::lumToAppMag(lum, astro::kilometersToLightYears(minPossibleDistance));
+            largestPossible = (float) subtree->maxChildRadius() / (float) minPossibleDistance / pixelSize;
+        }
+        else
+        {
+            // Viewer is within the bounding sphere, so the object could be very close.
+            // Assume that an object in the subree could be very bright or large,
+            // so no culling will occur.
+            brightestPossible = -100.0f;
+            largestPossible = 100.0f;
+        }
+
+        if (brightestPossible < faintestPlanetMag || largestPossible > 1.0f)
+        {
+            // See if the object or any of its children are within the view frustum
+            if (viewFrustum.testSphere(pos_v.cast<float>(), (float) subtree->boundingSphereRadius()) != Frustum::Outside)
             {
-                // Viewer is within the bounding sphere, so the object could be very close.
-                // Assume that an object in the subree could be very bright or large,
-                // so no culling will occur.
-                brightestPossible = -100.0f;
-                largestPossible = 100.0f;
+                traverseSubtree = true;
             }
+        }
 
-            if (brightestPossible < faintestPlanetMag || largestPossible > 1.0f)
+        // If the subtree contains secondary illuminators, do one last check if it hasn't
+        // already been determined if we need to traverse the subtree: see if something
+        // in the subtree could possibly contribute significant illumination to an
+        // object in the view cone.
+        if (subtree->containsSecondaryIlluminators() &&
+            !traverseSubtree                         &&
+            largestPossible > PLANETSHINE_PIXEL_SIZE_LIMIT)
+        {
+            auto influenceRadius = (float) (subtree->boundingSphereRadius() +
+                (subtree->maxChildRadius() * PLANETSHINE_DISTANCE_LIMIT_FACTOR));
+            if (dist_vn > -influenceRadius)
             {
-                // See if the object or any of its children are within the view frustum
-                if (viewFrustum.testSphere(pos_v.cast<float>(), (float) subtree->boundingSphereRadius()) != Frustum::Outside)
-                {
+                double maxPerpDist = (influenceRadius + dist_vn * sinViewAngle) * invCosViewAngle;
+                double perpDistSq = toViewNormal.squaredNorm();
+                if (perpDistSq < maxPerpDist * maxPerpDist)
                     traverseSubtree = true;
-                }
             }
+        }
 
-            // If the subtree contains secondary illuminators, do one last check if it hasn't
-            // already been determined if we need to traverse the subtree: see if something
-            // in the subtree could possibly contribute significant illumination to an
-            // object in the view cone.
-            if (subtree->containsSecondaryIlluminators() &&
-                !traverseSubtree                         &&
-                largestPossible > PLANETSHINE_PIXEL_SIZE_LIMIT)
-            {
-                auto influenceRadius = (float) (subtree->boundingSphereRadius() +
-                    (subtree->maxChildRadius() * PLANETSHINE_DISTANCE_LIMIT_FACTOR));
-                if (dist_vn > -influenceRadius)
-                {
-                    double maxPerpDist = (influenceRadius + dist_vn * sinViewAngle) * invCosViewAngle;
-                    double perpDistSq = toViewNormal.squaredNorm();
-                    if (perpDistSq < maxPerpDist * maxPerpDist)
-                        traverseSubtree = true;
-                }
-            }
+        vis.traverseSubtree = traverseSubtree;
+    }
+}
 
-            if (traverseSubtree)
-            {
-                buildRenderLists(astrocentricObserverPos,
-                                 viewFrustum,
-                                 viewPlaneNormal,
-                                 pos_s,
-                                 subtree,
-                                 observer,
-                                 now);
-            }
-        } // end subtree traverse
+
+// Add the render list entries and secondary illuminator for a body whose
+// visibility has been computed, then descend into its frame subtree.
+void Renderer::addBodyToRenderLists(const BodyVisibility& vis,
+                                    const Vector3d& astrocentricObserverPos,
+                                    const Frustum& viewFrustum,
+                                    const Vector3d& viewPlaneNormal,
+                                    const Vector3f& viewMatZ,
+                                    const Observer& observer,
+                                    double now)
+{
+    Body* body = vis.body;
+    if (body == nullptr)
+        return;
+
+    if (vis.isSecondaryIlluminator)
+    {
+        SecondaryIlluminator illum;
+        illum.body = body;
+        illum.position_v = vis.pos_v;
+        illum.radius = body->getRadius();
+        secondaryIlluminators.push_back(illum);
+    }
+
+    if (vis.isRendered)
+    {
+        double dist_v = vis.pos_v.norm();
+        RenderListEntry rle;
+
+        rle.position = vis.pos_v.cast<float>();
+        rle.distance = (float) dist_v;
+        rle.centerZ = vis.pos_v.cast<float>().dot(viewMatZ);
+        rle.appMag   = vis.appMag;
+        rle.discSizeInPixels = body->getRadius() / ((float) dist_v * pixelSize);
+
+        // TODO: Remove this. It's only used in two places: for calculating comet tail
+        // length, and for calculating sky brightness to adjust the limiting magnitude.
+        // In both cases, it's the wrong quantity to use (e.g. for objects with orbits
+        // defined relative to the SSB.)
+        rle.sun = -vis.pos_s.cast<float>();
+
+        addRenderListEntries(rle, *body, vis.isLabeled);
+    }
+
+    if (vis.traverseSubtree)
+    {
+        buildRenderLists(astrocentricObserverPos,
+                         viewFrustum,
+                         viewPlaneNormal,
+                         vis.pos_s,
+                         body->getFrameTree(),
+                         observer,
+                         now);
+    }
+}
+
+
+void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
+                                const Frustum& viewFrustum,
+                                const Vector3d& viewPlaneNormal,
+                                const Vector3d& frameCenter,
+                                const FrameTree* tree,
+                                const Observer& observer,
+                                double now)
+{
+    int labelClassMask = translateLabelModeToClassMask(labelMode);
+
+    Matrix3f viewMat = observer.getOrientationf().toRotationMatrix();
+    Vector3f viewMatZ = viewMat.row(2);
+
+    unsigned int nChildren = tree != nullptr ? tree->childCount() : 0;
+    if (nChildren < ParallelRenderListThreshold)
+    {
+        BodyVisibility vis;
+        for (unsigned int i = 0; i < nChildren; i++)
+        {
+            computeBodyVisibility(vis, *tree->getChild(i),
+                                  astrocentricObserverPos, viewFrustum, viewPlaneNormal,
+                                  frameCenter, labelClassMask, now);
+            addBodyToRenderLists(vis, astrocentricObserverPos, viewFrustum, viewPlaneNormal,
+                                 viewMatZ, observer, now);
+        }
+        return;
+    }
+
+    // With many children, e.g. the asteroids orbiting the Sun, evaluate
+    // their orbits and visibility in parallel, then build the lists in
+    // the order of the children so that the result doesn't depend on
+    // the scheduling. The vector is local as the subtrees are traversed
+    // recursively while adding the entries.
+    vector<BodyVisibility> visibility(nChildren);
+    GetThreadPool()->parallelFor(nChildren, [&](size_t i)
+    {
+        computeBodyVisibility(visibility[i], *tree->getChild((unsigned int) i),
+                              astrocentricObserverPos, viewFrustum, viewPlaneNormal,
+                              frameCenter, labelClassMask, now);
+    });
+
+    for (const auto& vis : visibility)
+    {
+        addBodyToRenderLists(vis, astrocentricObserverPos, viewFrustum, viewPlaneNormal,
+                             viewMatZ, observer, now);
     }
 }
 
@@ -4660,17 +4670,29 @@ void Renderer::renderPointStars(const StarDatabase& starDB,
     m_starProcStats.height = 0;
     m_starProcStats.objects = 0;
 #endif
-    starDB.findVisibleStars(starRenderer,
+    // Cull the stars in parallel, then feed the visible ones to the star
+    // renderer in octree order. The culling cache makes this nearly free
+    // while the observer doesn't move far on interstellar scales.
+    visibleStars.clear();
+    starDB.findVisibleStars(visibleStars,
                             obsPos.cast<float>(),
                             observer.getOrientationf(),
                             degToRad(fov),
                             getAspectRatio(),
                             faintestMagNight,
+                            GetThreadPool(),
+                            &starCullingCache,
 #ifdef OCTREE_DEBUG
                             &m_starProcStats);
 #else
                             nullptr);
 #endif
+    for (const auto& visibleStar : visibleStars)
+    {
+        starRenderer.process(*starDB.getStar(visibleStar.index),
+                             visibleStar.distance,
+                             visibleStar.appMag);
+    }
 
     starRenderer.starVertexBuffer->render();
     starRenderer.glareVertexBuffer->render();
@@ -5261,7 +5283,7 @@ void Renderer::loadTextures(Body* body)
 
 void Renderer::invalidateOrbitCache()
 {
-    orbitCache.clear();
+    orbitPathCache.clear();
 }
 
 
@@ -5707,6 +5729,12 @@ Renderer::getVertexObject(VOType owner, GLenum type, GLsizeiptr size, GLenum str
     return *m_VertexObjects[i];
 }
 
+const LODSphereMesh::Stats&
+Renderer::getSphereMeshStats() const
+{
+    return g_lodSphere->getStats();
+}
+
 FramebufferObject*
 Renderer::getShadowFBO(int index) const
 {
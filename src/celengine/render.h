@@ -21,6 +21,8 @@
 #include <celengine/starcolors.h>
 #include <celengine/rendcontext.h>
 #include <celengine/renderlistentry.h>
+#include "lodspheremesh.h"
+#include "orbitpathcache.h"
 #include "vertexobject.h"
 
 #ifdef USE_GLCONTEXT
@@ -28,6 +30,7 @@ class GLContext;
 #endif
 class RendererWatcher;
 class FrameTree;
+class TimelinePhase;
 class ReferenceMark;
 class CurvePlot;
 class Rect;
@@ -426,6 +429,9 @@ class Renderer
 
     ShaderManager& getShaderManager() const { return *shaderManager; }
 
+    //! Planet surface patches drawn and uploaded in the last frame
+    const LODSphereMesh::Stats& getSphereMeshStats() const;
+
     celgl::VertexObject& getVertexObject(VOType, GLenum, GLsizeiptr, GLenum);
 
     // Callbacks for renderables; these belong in a special renderer interface
@@ -551,6 +557,19 @@ class Renderer
         float farZ;
     };
 
+    // Result of the visibility tests for a child of a frame tree
+    struct BodyVisibility
+    {
+        Body* body;
+        Eigen::Vector3d pos_s;
+        Eigen::Vector3d pos_v;
+        float appMag;
+        bool isSecondaryIlluminator;
+        bool isRendered;
+        bool isLabeled;
+        bool traverseSubtree;
+    };
+
  private:
     void setFieldOfView(float);
     void renderPointStars(const StarDatabase& starDB,
@@ -582,6 +601,21 @@ class Renderer
                           const FrameTree* tree,
                           const Observer& observer,
                           double now);
+    void computeBodyVisibility(BodyVisibility& vis,
+                               const TimelinePhase& phase,
+                               const Eigen::Vector3d& astrocentricObserverPos,
+                               const celmath::Frustum& viewFrustum,
+                               const Eigen::Vector3d& viewPlaneNormal,
+                               const Eigen::Vector3d& frameCenter,
+                               int labelClassMask,
+                               double now) const;
+    void addBodyToRenderLists(const BodyVisibility& vis,
+                              const Eigen::Vector3d& astrocentricObserverPos,
+                              const celmath::Frustum& viewFrustum,
+                              const Eigen::Vector3d& viewPlaneNormal,
+                              const Eigen::Vector3f& viewMatZ,
+                              const Observer& observer,
+                              double now);
     void buildOrbitLists(const Eigen::Vector3d& astrocentricObserverPos,
                          const Eigen::Quaterniond& observerOrientation,
                          const celmath::Frustum& viewFrustum,
@@ -818,6 +852,8 @@ class Renderer
     PointStarVertexBuffer* pointStarVertexBuffer;
     PointStarVertexBuffer* glareVertexBuffer;
     std::vector<RenderListEntry> renderList;
+    std::vector<VisibleStar> visibleStars;
+    StarCullingCache starCullingCache;
     std::vector<SecondaryIlluminator> secondaryIlluminators;
     std::vector<DepthBufferPartition> depthPartitions;
     std::vector<Particle> glareParticles;
@@ -828,6 +864,7 @@ class Renderer
     std::vector<OrbitPathListEntry> orbitPathList;
     LightingState::EclipseShadowVector eclipseShadows[MaxLights];
     std::vector<const Star*> nearStars;
+    std::vector<Location*> visibleLocations;
 
     std::vector<LightSource> lightSourceList;
 
@@ -859,9 +896,8 @@ class Renderer
     State m_GLState { false, false, false, false, false };
 
  private:
-    typedef std::map<const Orbit*, CurvePlot*> OrbitCache;
-    OrbitCache orbitCache;
-    uint32_t lastOrbitCacheFlush;
+    // Shared by all the views drawn by this renderer
+    OrbitPathCache orbitPathCache;
 
     float minOrbitSize;
     float distanceLimit;
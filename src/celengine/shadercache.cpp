@@ -0,0 +1,237 @@
+// shadercache.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Cache of compiled shader programs on disk.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <celutil/debug.h>
+#include "glsupport.h"
+#include "shadercache.h"
+
+using namespace std;
+
+
+static const char ProgramFileMagic[8] = { 'C', 'E', 'L', 'P', 'R', 'O', 'G', '1' };
+static const char* PropertiesFileName = "shaders.txt";
+
+// FNV-1a
+static uint64_t HashString(const string& s, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for (char c : s)
+    {
+        hash ^= (unsigned char) c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static string PropertiesLine(const ShaderProperties& props)
+{
+    return fmt::sprintf("%u %u %lu %u %u %d",
+                        props.nLights, props.lightModel, props.texUsage,
+                        props.effects, props.shadowCounts, props.fishEyeOverride);
+}
+
+// The meaning of the texture usage and effect bits may change between
+// versions, so the properties recorded by other versions are dropped.
+static string PropertiesHeader()
+{
+    return fmt::sprintf("# Celestia %s %s", VERSION, GIT_COMMIT);
+}
+
+// The properties file may have been edited or damaged, and shaders built
+// from it size their parameter arrays by the light and shadow counts, so
+// those are checked against the limits.
+static bool ParsePropertiesLine(const string& line, ShaderProperties& props)
+{
+    istringstream in(line);
+    in >> props.nLights >> props.lightModel >> props.texUsage
+       >> props.effects >> props.shadowCounts >> props.fishEyeOverride;
+    if (in.fail() ||
+        props.nLights > MaxShaderLights ||
+        props.lightModel > ShaderProperties::UnlitModel ||
+        props.fishEyeOverride < ShaderProperties::FisheyeOverrideModeNone ||
+        props.fishEyeOverride > ShaderProperties::FisheyeOverrideModeDisabled)
+    {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < MaxShaderLights; i++)
+    {
+        if (props.getEclipseShadowCountForLight(i) > MaxShaderEclipseShadows)
+            return false;
+    }
+
+    return true;
+}
+
+
+ShaderCache::ShaderCache(const fs::path& _directory) :
+    directory(_directory)
+{
+}
+
+
+bool ShaderCache::init()
+{
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec))
+    {
+        fmt::fprintf(cerr, "Shader cache directory %s doesn't exist\n", directory.string());
+        return false;
+    }
+
+    GLint formatCount = 0;
+#ifdef GL_ES
+    if (!celestia::gl::OES_get_program_binary)
+        return false;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formatCount);
+#else
+    if (!celestia::gl::ARB_get_program_binary)
+        return false;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+#endif
+    if (formatCount == 0)
+        return false;
+
+    // The attribute locations are bound by the code rather than in the
+    // shader sources, so the binaries of other versions aren't used either.
+    driver = fmt::sprintf("%s\n%s\n%s\n%s %s",
+                          (const char*) glGetString(GL_VENDOR),
+                          (const char*) glGetString(GL_RENDERER),
+                          (const char*) glGetString(GL_VERSION),
+                          VERSION, GIT_COMMIT);
+
+    ifstream in((directory / PropertiesFileName).string());
+    string line;
+    if (!getline(in, line) || line != PropertiesHeader())
+    {
+        // Written again from scratch by the first record()
+        propertiesOutdated = true;
+        return true;
+    }
+
+    while (getline(in, line))
+    {
+        ShaderProperties props;
+        if (ParsePropertiesLine(line, props) && recordedLines.insert(line).second)
+            recordedProperties.push_back(props);
+    }
+
+    return true;
+}
+
+
+void ShaderCache::prepare(const GLProgram& program) const
+{
+#ifndef GL_ES
+    glProgramParameteri(program.getID(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+}
+
+
+fs::path ShaderCache::getPath(const string& vsSource, const string& fsSource) const
+{
+    uint64_t hash = HashString(fsSource, HashString(vsSource, HashString(driver)));
+    return directory / fmt::sprintf("%016llx.bin", (unsigned long long) hash);
+}
+
+
+GLProgram* ShaderCache::load(const string& vsSource, const string& fsSource) const
+{
+    ifstream in(getPath(vsSource, fsSource).string(), ios::in | ios::binary);
+    if (!in.good())
+        return nullptr;
+
+    char magic[sizeof(ProgramFileMagic)];
+    uint32_t header[4]; // source lengths, format and binary length
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in.good() ||
+        memcmp(magic, ProgramFileMagic, sizeof(magic)) != 0 ||
+        header[0] != vsSource.length() || header[1] != fsSource.length())
+    {
+        return nullptr;
+    }
+
+    // Don't trust the binary length before checking it against the file
+    streamoff start = in.tellg();
+    in.seekg(0, ios::end);
+    streamoff end = in.tellg();
+    in.seekg(start);
+    if (start < 0 || end - start != (streamoff) header[3])
+        return nullptr;
+
+    vector<char> binary(header[3]);
+    in.read(binary.data(), binary.size());
+    if (!in.good())
+        return nullptr;
+
+    GLProgram* program = nullptr;
+    if (GLShaderLoader::CreateProgram(header[2], binary, &program) != ShaderStatus_OK)
+    {
+        DPRINTF(LOG_LEVEL_INFO, "Saved shader program rejected by the driver\n");
+        return nullptr;
+    }
+
+    return program;
+}
+
+
+void ShaderCache::store(const string& vsSource, const string& fsSource, const GLProgram& program) const
+{
+    GLenum format;
+    vector<char> binary;
+    if (!program.getBinary(format, binary))
+        return;
+
+    // Write to another file first so that an interrupted write doesn't
+    // leave a truncated program
+    fs::path path = getPath(vsSource, fsSource);
+    string tmpPath = path.string() + ".tmp";
+    ofstream out(tmpPath, ios::out | ios::binary);
+    uint32_t header[4] = { (uint32_t) vsSource.length(), (uint32_t) fsSource.length(),
+                           (uint32_t) format, (uint32_t) binary.size() };
+    out.write(ProgramFileMagic, sizeof(ProgramFileMagic));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(binary.data(), binary.size());
+    out.close();
+
+    if (!out.good())
+    {
+        fmt::fprintf(cerr, "Failed to write shader program %s\n", tmpPath);
+        remove(tmpPath.c_str());
+        return;
+    }
+
+    remove(path.string().c_str());
+    rename(tmpPath.c_str(), path.string().c_str());
+}
+
+
+void ShaderCache::record(const ShaderProperties& props)
+{
+    string line = PropertiesLine(props);
+    if (!recordedLines.insert(line).second)
+        return;
+
+    recordedProperties.push_back(props);
+    if (propertiesOutdated)
+    {
+        ofstream out((directory / PropertiesFileName).string(), ios::out | ios::trunc);
+        out << PropertiesHeader() << '\n';
+        propertiesOutdated = false;
+    }
+    ofstream out((directory / PropertiesFileName).string(), ios::out | ios::app);
+    out << line << '\n';
+}
@@ -0,0 +1,67 @@
+// shadercache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Cache of compiled shader programs on disk.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <celcompat/filesystem.h>
+#include "shadermanager.h"
+
+/*! Shader programs saved in a directory as program binaries of the OpenGL
+ *  driver, so that they don't have to be compiled again in later sessions.
+ *  Programs are found by a hash of their sources, of the driver identity
+ *  and of the Celestia version, so changed shaders and binaries of other
+ *  drivers or versions are never loaded. The properties of the generated
+ *  shaders are recorded in the same directory, along with the version
+ *  which wrote them, so that the shaders used in previous sessions can be
+ *  created at startup.
+ */
+class ShaderCache
+{
+ public:
+    explicit ShaderCache(const fs::path& directory);
+    ~ShaderCache() = default;
+
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+    /*! Check that the directory exists and that the driver can save
+     *  program binaries, and read the recorded shader properties. Requires
+     *  a current GL context; the cache can't be used if it fails.
+     */
+    bool init();
+
+    //! Ask the driver to keep the binary of a program before linking it
+    void prepare(const GLProgram&) const;
+
+    //! Create the program with these sources from its binary, or return
+    //! nullptr if it wasn't saved or the driver rejects it.
+    GLProgram* load(const std::string& vsSource, const std::string& fsSource) const;
+    void store(const std::string& vsSource, const std::string& fsSource, const GLProgram&) const;
+
+    //! Properties of the shaders generated in previous sessions
+    const std::vector<ShaderProperties>& getRecordedProperties() const
+    {
+        return recordedProperties;
+    }
+    void record(const ShaderProperties&);
+
+ private:
+    fs::path getPath(const std::string& vsSource, const std::string& fsSource) const;
+
+    fs::path directory;
+    std::string driver;
+    std::vector<ShaderProperties> recordedProperties;
+    std::set<std::string> recordedLines;
+    bool propertiesOutdated{ false };
+};
@@ -9,6 +9,7 @@
 // of the License, or (at your option) any later version.
 
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <fstream>
@@ -20,6 +21,7 @@
 #include <celutil/debug.h>
 #include "glsupport.h"
 #include "vecgl.h"
+#include "shadercache.h"
 #include "shadermanager.h"
 #include "shadowmap.h"
 
@@ -1764,7 +1766,7 @@ float calculateShadow()
     return source;
 }
 
-GLVertexShader*
+string
 ShaderManager::buildVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2116,13 +2118,11 @@ ShaderManager::buildVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2567,14 +2567,12 @@ ShaderManager::buildFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 #if 0
-GLVertexShader*
+string
 ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2624,13 +2622,11 @@ ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2709,14 +2705,12 @@ ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 #endif
 
 
-GLVertexShader*
+string
 ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2762,13 +2756,11 @@ ShaderManager::buildRingsVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2872,13 +2864,11 @@ ShaderManager::buildRingsFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
-GLVertexShader*
+string
 ShaderManager::buildAtmosphereVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2918,13 +2908,11 @@ ShaderManager::buildAtmosphereVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildAtmosphereFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -2974,15 +2962,13 @@ ShaderManager::buildAtmosphereFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 // The emissive shader ignores all lighting and uses the diffuse color
 // as the final fragment color.
-GLVertexShader*
+string
 ShaderManager::buildEmissiveVertexShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -3048,13 +3034,11 @@ ShaderManager::buildEmissiveVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source, &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source;
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildEmissiveFragmentShader(const ShaderProperties& props)
 {
     string source(CommonHeader);
@@ -3103,14 +3087,12 @@ ShaderManager::buildEmissiveFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source, &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source;
 }
 
 
 // Build the vertex shader used for rendering particle systems.
-GLVertexShader*
+string
 ShaderManager::buildParticleVertexShader(const ShaderProperties& props)
 {
     ostringstream source;
@@ -3185,13 +3167,11 @@ ShaderManager::buildParticleVertexShader(const ShaderProperties& props)
 
     DumpVSSource(source);
 
-    GLVertexShader* vs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateVertexShader(source.str(), &vs);
-    return status == ShaderStatus_OK ? vs : nullptr;
+    return source.str();
 }
 
 
-GLFragmentShader*
+string
 ShaderManager::buildParticleFragmentShader(const ShaderProperties& props)
 {
     ostringstream source;
@@ -3253,9 +3233,7 @@ ShaderManager::buildParticleFragmentShader(const ShaderProperties& props)
 
     DumpFSSource(source);
 
-    GLFragmentShader* fs = nullptr;
-    GLShaderStatus status = GLShaderLoader::CreateFragmentShader(source.str(), &fs);
-    return status == ShaderStatus_OK ? fs : nullptr;
+    return source.str();
 }
 
 CelestiaGLProgram*
@@ -3264,8 +3242,7 @@ ShaderManager::buildProgram(const ShaderProperties& props)
     GLProgram* prog = nullptr;
     GLShaderStatus status;
 
-    GLVertexShader* vs = nullptr;
-    GLFragmentShader* fs = nullptr;
+    string vs, fs;
 
     if (props.lightModel == ShaderProperties::RingIllumModel)
     {
@@ -3293,9 +3270,18 @@ ShaderManager::buildProgram(const ShaderProperties& props)
         fs = buildFragmentShader(props);
     }
 
-    if (vs != nullptr && fs != nullptr)
+    if (cache != nullptr)
+        cache->record(props);
+
+    prog = loadProgram(vs, fs);
+    if (prog != nullptr)
     {
-        status = GLShaderLoader::CreateProgram(*vs, *fs, &prog);
+        status = ShaderStatus_OK;
+    }
+    else
+    {
+        auto start = chrono::steady_clock::now();
+        status = GLShaderLoader::CreateProgram(vs, fs, &prog);
         if (status == ShaderStatus_OK)
         {
             glBindAttribLocation(prog->getID(),
@@ -3355,16 +3341,15 @@ ShaderManager::buildProgram(const ShaderProperties& props)
                                      "in_PointSize");
             }
 
+            if (cache != nullptr)
+                cache->prepare(*prog);
             status = prog->link();
         }
-    }
-    else
-    {
-        status = ShaderStatus_CompileError;
-    }
+        stats.compileTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-    delete vs;
-    delete fs;
+        if (status == ShaderStatus_OK)
+            storeProgram(vs, fs, *prog);
+    }
 
     if (status != ShaderStatus_OK)
     {
@@ -3401,6 +3386,11 @@ ShaderManager::buildProgram(const std::string& vs, const std::string& fs)
     DumpVSSource(_vs);
     DumpFSSource(_fs);
 
+    prog = loadProgram(_vs, _fs);
+    if (prog != nullptr)
+        return new CelestiaGLProgram(*prog);
+
+    auto start = chrono::steady_clock::now();
     status = GLShaderLoader::CreateProgram(_vs, _fs, &prog);
     if (status == ShaderStatus_OK)
     {
@@ -3444,8 +3434,14 @@ ShaderManager::buildProgram(const std::string& vs, const std::string& fs)
                              CelestiaGLProgram::IntensityAttributeIndex,
                              "in_Intensity");
 
+        if (cache != nullptr)
+            cache->prepare(*prog);
         status = prog->link();
     }
+    stats.compileTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (status == ShaderStatus_OK)
+        storeProgram(_vs, _fs, *prog);
 
     if (status != ShaderStatus_OK)
     {
@@ -3476,6 +3472,49 @@ void ShaderManager::setFisheyeEnabled(bool enabled)
     fisheyeEnabled = enabled;
 }
 
+bool ShaderManager::setCacheDirectory(const fs::path& directory)
+{
+    unique_ptr<ShaderCache> newCache(new ShaderCache(directory));
+    if (!newCache->init())
+        return false;
+
+    cache = move(newCache);
+    return true;
+}
+
+void ShaderManager::warmUp()
+{
+    if (cache == nullptr)
+        return;
+
+    // getShader() adds to the recorded properties
+    vector<ShaderProperties> recorded = cache->getRecordedProperties();
+    for (const auto& props : recorded)
+        getShader(props);
+}
+
+GLProgram*
+ShaderManager::loadProgram(const string& vs, const string& fs)
+{
+    GLProgram* prog = nullptr;
+    if (cache != nullptr)
+        prog = cache->load(vs, fs);
+
+    if (prog != nullptr)
+        stats.cacheHits++;
+    else
+        stats.cacheMisses++;
+
+    return prog;
+}
+
+void
+ShaderManager::storeProgram(const string& vs, const string& fs, const GLProgram& prog)
+{
+    if (cache != nullptr)
+        cache->store(vs, fs, prog);
+}
+
 CelestiaGLProgram::CelestiaGLProgram(GLProgram& _program,
                                      const ShaderProperties& _props) :
     program(&_program),
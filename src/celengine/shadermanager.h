@@ -11,7 +11,9 @@
 #define _CELENGINE_SHADERMANAGER_H_
 
 #include <map>
+#include <memory>
 #include <iostream>
+#include <celcompat/filesystem.h>
 #include <celengine/glshader.h>
 #include <celengine/lightenv.h>
 #include <celengine/atmosphere.h>
@@ -19,6 +21,8 @@
 
 #define ADVANCED_CLOUD_SHADOWS 0
 
+class ShaderCache;
+
 class ShaderProperties
 {
  public:
@@ -311,29 +315,53 @@ class ShaderManager
 
     void setFisheyeEnabled(bool enabled);
 
+    /*! Save the compiled programs in a directory and load them from there
+     *  instead of compiling them again. Requires a current GL context;
+     *  returns false if the directory or the driver can't be used.
+     */
+    bool setCacheDirectory(const fs::path&);
+
+    //! Create the shaders used in the previous sessions with the cache
+    void warmUp();
+
+    struct Stats
+    {
+        unsigned int cacheHits{ 0 };
+        unsigned int cacheMisses{ 0 };  // includes all programs without a cache
+        double compileTime{ 0.0 };      // in seconds
+    };
+
+    const Stats& getStats() const { return stats; }
+
  private:
     CelestiaGLProgram* buildProgram(const ShaderProperties&);
     CelestiaGLProgram* buildProgram(const std::string&, const std::string&);
 
-    GLVertexShader* buildVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildFragmentShader(const ShaderProperties&);
+    std::string buildVertexShader(const ShaderProperties&);
+    std::string buildFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildRingsVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildRingsFragmentShader(const ShaderProperties&);
+    std::string buildRingsVertexShader(const ShaderProperties&);
+    std::string buildRingsFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildAtmosphereVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildAtmosphereFragmentShader(const ShaderProperties&);
+    std::string buildAtmosphereVertexShader(const ShaderProperties&);
+    std::string buildAtmosphereFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildEmissiveVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildEmissiveFragmentShader(const ShaderProperties&);
+    std::string buildEmissiveVertexShader(const ShaderProperties&);
+    std::string buildEmissiveFragmentShader(const ShaderProperties&);
 
-    GLVertexShader* buildParticleVertexShader(const ShaderProperties&);
-    GLFragmentShader* buildParticleFragmentShader(const ShaderProperties&);
+    std::string buildParticleVertexShader(const ShaderProperties&);
+    std::string buildParticleFragmentShader(const ShaderProperties&);
+
+    GLProgram* loadProgram(const std::string&, const std::string&);
+    void storeProgram(const std::string&, const std::string&, const GLProgram&);
 
     std::map<ShaderProperties, CelestiaGLProgram*> dynamicShaders;
     std::map<std::string, CelestiaGLProgram*> staticShaders;
 
     bool fisheyeEnabled { false };
+
+    std::unique_ptr<ShaderCache> cache;
+    Stats stats;
 };
 
 #endif // _CELENGINE_SHADERMANAGER_H_
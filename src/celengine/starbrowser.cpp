@@ -11,151 +11,22 @@
 
 #include <string>
 #include <algorithm>
-#include <set>
 #include "starbrowser.h"
 
 using namespace Eigen;
 using namespace std;
 
 
-// TODO: More of the functions in this module should be converted to
-// methods of the StarBrowser class.
-
-struct CloserStarPredicate
-{
-    Vector3f pos;
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        Vector3f p0 = star0->getPosition();
-        Vector3f p1 = star1->getPosition();
-
-#if 0
-        Vector3f v0(p0.x * 1e6 - pos.x, p0.y * 1e6 - pos.y, p0.z * 1e6 - pos.z);
-        Vector3f v1(p1.x * 1e6 - pos.x, p1.y * 1e6 - pos.y, p1.z * 1e6 - pos.z);
-#endif
-        Vector3f v0 = p0 * 1.0e6f - pos;
-        Vector3f v1 = p1 * 1.0e6f - pos;
-
-        return (v0.squaredNorm() < v1.squaredNorm());
-    }
-};
-
-
-struct BrighterStarPredicate
-{
-    Vector3f pos;
-    UniversalCoord ucPos;
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        Vector3f p0 = star0->getPosition();
-        Vector3f p1 = star1->getPosition();
-        Vector3f v0 = p0 * 1.0e6f - pos;
-        Vector3f v1 = p1 * 1.0e6f - pos;
-        float d0 = v0.norm();
-        float d1 = v1.norm();
-
-        return (star0->getApparentMagnitude(d0) <
-                star1->getApparentMagnitude(d1));
-    }
-};
-
-
-struct BrightestStarPredicate
-{
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        return (star0->getAbsoluteMagnitude() <
-                star1->getAbsoluteMagnitude());
-    }
-};
-
-
-struct SolarSystemPredicate
-{
-    Vector3f pos;
-    SolarSystemCatalog* solarSystems;
-
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        SolarSystemCatalog::iterator iter;
-
-        iter = solarSystems->find(star0->getIndex());
-        bool hasPlanets0 = (iter != solarSystems->end());
-        iter = solarSystems->find(star1->getIndex());
-        bool hasPlanets1 = (iter != solarSystems->end());
-        if (hasPlanets1 == hasPlanets0)
-        {
-            Vector3f p0 = star0->getPosition();
-            Vector3f p1 = star1->getPosition();
-            Vector3f v0 = p0 * 1.0e6f - pos;
-            Vector3f v1 = p1 * 1.0e6f - pos;
-            return (v0.squaredNorm() < v1.squaredNorm());
-        }
-        else
-        {
-            return hasPlanets0;
-        }
-    }
-};
-
-
-// Find the nearest/brightest/X-est N stars in a database.  The
-// supplied predicate determines which of two stars is a better match.
-template<class Pred> static std::vector<const Star*>*
-findStars(const StarDatabase& stardb, Pred pred, int nStars)
-{
-    std::vector<const Star*>* finalStars = new std::vector<const Star*>();
-    if (nStars == 0)
-        return finalStars;
-    if(nStars > 500)
-        nStars = 500;
-
-    typedef std::multiset<const Star*, Pred> StarSet;
-    StarSet firstStars(pred);
-
-    int totalStars = stardb.size();
-    if (totalStars < nStars)
-        nStars = totalStars;
-
-    // We'll need at least nStars in the set, so first fill
-    // up the list indiscriminately.
-    int i = 0;
-    for (i = 0; i < nStars; i++)
-        firstStars.insert(stardb.getStar(i));
-
-    // From here on, only add a star to the set if it's
-    // a better match than the worst matching star already
-    // in the set.
-    const Star* lastStar = *--firstStars.end();
-    for (; i < totalStars; i++)
-    {
-        Star* star = stardb.getStar(i);
-        if (pred(star, lastStar))
-        {
-            firstStars.insert(star);
-            firstStars.erase(--firstStars.end());
-            lastStar = *--firstStars.end();
-        }
-    }
-
-    // Move the best matching stars into the vector
-    finalStars->reserve(nStars);
-    for (const auto& star : firstStars)
-        finalStars->push_back(star);
-
-    return finalStars;
-}
+// Maximum number of stars listed by the browser
+static const unsigned int MaxListedStars = 500;
 
 
 const Star* StarBrowser::nearestStar()
 {
     Universe* univ = appSim->getUniverse();
-    CloserStarPredicate closerPred;
-    closerPred.pos = pos;
-    std::vector<const Star*>* stars = findStars(*(univ->getStarCatalog()), closerPred, 1);
-    const Star *star = (*stars)[0];
-    delete stars;
-    return star;
+    std::vector<const Star*> stars;
+    univ->getStarCatalog()->findNearestStars(pos, 1, stars);
+    return stars.empty() ? nullptr : stars[0];
 }
 
 
@@ -163,48 +34,55 @@ std::vector<const Star*>*
 StarBrowser::listStars(unsigned int nStars)
 {
     Universe* univ = appSim->getUniverse();
+    const StarDatabase* stardb = univ->getStarCatalog();
+    nStars = min(nStars, MaxListedStars);
+
+    auto* stars = new std::vector<const Star*>();
     switch(predicate)
     {
     case BrighterStars:
-        {
-            BrighterStarPredicate brighterPred;
-            brighterPred.pos = pos;
-            brighterPred.ucPos = ucPos;
-            return findStars(*(univ->getStarCatalog()), brighterPred, nStars);
-        }
+        stardb->findBrighterStars(pos, nStars, *stars);
         break;
 
     case BrightestStars:
-        {
-            BrightestStarPredicate brightestPred;
-            return findStars(*(univ->getStarCatalog()), brightestPred, nStars);
-        }
+        stardb->findBrightestStars(nStars, *stars);
         break;
 
     case StarsWithPlanets:
         {
             SolarSystemCatalog* solarSystems = univ->getSolarSystemCatalog();
             if (!solarSystems)
+            {
+                delete stars;
                 return nullptr;
-            SolarSystemPredicate solarSysPred;
-            solarSysPred.pos = pos;
-            solarSysPred.solarSystems = solarSystems;
-            return findStars(*(univ->getStarCatalog()), solarSysPred,
-                             min((size_t) nStars, solarSystems->size()));
+            }
+
+            // There are few enough stars with planets to sort them all
+            for (const auto& solarSystem : *solarSystems)
+            {
+                const Star* star = stardb->find(solarSystem.first);
+                if (star != nullptr)
+                    stars->push_back(star);
+            }
+
+            auto closer = [this](const Star* star0, const Star* star1)
+            {
+                return (star0->getPosition() - pos).squaredNorm() <
+                       (star1->getPosition() - pos).squaredNorm();
+            };
+            auto last = stars->begin() + min((size_t) nStars, stars->size());
+            partial_sort(stars->begin(), last, stars->end(), closer);
+            stars->erase(last, stars->end());
         }
         break;
 
     case NearestStars:
     default:
-        {
-            CloserStarPredicate closerPred;
-            closerPred.pos = pos;
-            return findStars(*(univ->getStarCatalog()), closerPred, nStars);
-        }
+        stardb->findNearestStars(pos, nStars, *stars);
         break;
     }
 
-    return nullptr;  // keep compiler happy
+    return stars;
 }
 
 
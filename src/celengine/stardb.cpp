@@ -14,10 +14,14 @@
 #include <cstdlib>
 #include <cassert>
 #include <algorithm>
+#include <fstream>
+#include <limits>
+#include <queue>
 #include <celmath/mathlib.h>
 #include <celutil/bytes.h>
 #include <celutil/debug.h>
 #include <celutil/gettext.h>
+#include <celutil/mappedfile.h>
 #include "stardb.h"
 #include "astro.h"
 #include "parser.h"
@@ -50,10 +54,39 @@ constexpr const char LacailleCatalogPrefix[]  = "Lacaille ";
 constexpr const float STAR_OCTREE_ROOT_SIZE   = 1000000000.0f;
 
 constexpr const float STAR_OCTREE_MAGNITUDE   = 6.0f;
+// Ratio of the bounding sphere radius of an octree node to its scale
+constexpr const float STAR_OCTREE_NODE_RADIUS_FACTOR = 1.732050807568877f;
 //constexpr const float STAR_EXTRA_ROOM        = 0.01f; // Reserve 1% capacity for extra stars
 
+// A star culling cache is built for observers within this distance (in
+// light years) of its position, a field of view this much wider than the
+// current one, and a limiting magnitude this much fainter. At the given
+// tolerance, the magnitude of a star 1 ly away changes by at most 0.02.
+constexpr const float STAR_CACHE_TOLERANCE    = 0.01f;
+constexpr const float STAR_CACHE_FOV_SCALE    = 1.25f;
+constexpr const float STAR_CACHE_MAX_FOV      = 3.0f;
+constexpr const float STAR_CACHE_MAG_MARGIN   = 0.25f;
+
 constexpr const char FILE_HEADER[]            = "CELSTARS";
 constexpr const char CROSSINDEX_FILE_HEADER[] = "CELINDEX";
+constexpr const char OCTREE_FILE_HEADER[]     = "CELSTOCT";
+
+constexpr const uint16_t OCTREE_FILE_VERSION  = 0x0100;
+
+// Prebuilt octree star file layout, all values little endian:
+//   header: char[8] "CELSTOCT", uint16 version, uint16 reserved,
+//           uint32 star count, uint32 node count
+//   stars:  star records in the same format as in a CELSTARS file, but
+//           already sorted in octree order
+//   index:  uint32 star record numbers, ordered by catalog number
+//   nodes:  float center[3], float exclusion factor, float scale,
+//           uint32 first star, uint32 star count, uint32 first child
+// The nodes are stored breadth first so that the eight children of a
+// node are adjacent; the root is node 0 and a first child of 0 marks a
+// leaf node.
+constexpr const size_t OCTREE_FILE_HEADER_SIZE = 20;
+constexpr const size_t STAR_RECORD_SIZE        = 20;
+constexpr const size_t OCTREE_NODE_RECORD_SIZE = 32;
 
 
 // Used to sort stars by catalog number
@@ -175,6 +208,174 @@ static bool parseCelestiaCatalogNumber(const string& name,
 }
 
 
+// A star record as stored in binary star files
+struct BinaryStarRecord
+{
+    AstroCatalog::IndexNumber catNo;
+    float x, y, z;
+    int16_t absMag;
+    uint16_t spectralType;
+};
+
+
+static bool readBinaryStarRecord(istream& in, BinaryStarRecord& rec)
+{
+    in.read((char *) &rec.catNo, sizeof rec.catNo);
+    LE_TO_CPU_INT32(rec.catNo, rec.catNo);
+    in.read((char *) &rec.x, sizeof rec.x);
+    LE_TO_CPU_FLOAT(rec.x, rec.x);
+    in.read((char *) &rec.y, sizeof rec.y);
+    LE_TO_CPU_FLOAT(rec.y, rec.y);
+    in.read((char *) &rec.z, sizeof rec.z);
+    LE_TO_CPU_FLOAT(rec.z, rec.z);
+    in.read((char *) &rec.absMag, sizeof rec.absMag);
+    LE_TO_CPU_INT16(rec.absMag, rec.absMag);
+    in.read((char *) &rec.spectralType, sizeof rec.spectralType);
+    LE_TO_CPU_INT16(rec.spectralType, rec.spectralType);
+
+    return !in.bad();
+}
+
+
+static void writeBinaryStarRecord(ostream& out, const BinaryStarRecord& rec)
+{
+    BinaryStarRecord le;
+    LE_TO_CPU_INT32(le.catNo, rec.catNo);
+    LE_TO_CPU_FLOAT(le.x, rec.x);
+    LE_TO_CPU_FLOAT(le.y, rec.y);
+    LE_TO_CPU_FLOAT(le.z, rec.z);
+    LE_TO_CPU_INT16(le.absMag, rec.absMag);
+    LE_TO_CPU_INT16(le.spectralType, rec.spectralType);
+
+    out.write((const char *) &le.catNo, sizeof le.catNo);
+    out.write((const char *) &le.x, sizeof le.x);
+    out.write((const char *) &le.y, sizeof le.y);
+    out.write((const char *) &le.z, sizeof le.z);
+    out.write((const char *) &le.absMag, sizeof le.absMag);
+    out.write((const char *) &le.spectralType, sizeof le.spectralType);
+}
+
+
+static uint16_t decodeUint16(const char* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof v);
+    LE_TO_CPU_INT16(v, v);
+    return v;
+}
+
+
+static uint32_t decodeUint32(const char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    LE_TO_CPU_INT32(v, v);
+    return v;
+}
+
+
+static float decodeFloat(const char* p)
+{
+    float v;
+    memcpy(&v, p, sizeof v);
+    LE_TO_CPU_FLOAT(v, v);
+    return v;
+}
+
+
+static void writeUint32(ostream& out, uint32_t v)
+{
+    LE_TO_CPU_INT32(v, v);
+    out.write((const char *) &v, sizeof v);
+}
+
+
+static void writeFloat(ostream& out, float v)
+{
+    LE_TO_CPU_FLOAT(v, v);
+    out.write((const char *) &v, sizeof v);
+}
+
+
+static void decodeBinaryStarRecord(const char* p, BinaryStarRecord& rec)
+{
+    rec.catNo        = decodeUint32(p);
+    rec.x            = decodeFloat(p + 4);
+    rec.y            = decodeFloat(p + 8);
+    rec.z            = decodeFloat(p + 12);
+    rec.absMag       = (int16_t) decodeUint16(p + 16);
+    rec.spectralType = decodeUint16(p + 18);
+}
+
+
+static bool initStar(Star& star, const BinaryStarRecord& rec)
+{
+    StarDetails* details = nullptr;
+    StellarClass sc;
+    if (sc.unpack(rec.spectralType))
+        details = StarDetails::GetStarDetails(sc);
+
+    if (details == nullptr)
+        return false;
+
+    star.setPosition(rec.x, rec.y, rec.z);
+    star.setAbsoluteMagnitude((float) rec.absMag / 256.0f);
+    star.setDetails(details);
+    star.setIndex(rec.catNo);
+
+    return true;
+}
+
+
+static bool readBinaryHeader(istream& in, uint32_t& nStarsInFile)
+{
+    // Verify that the star database file has a correct header
+    {
+        int headerLength = strlen(FILE_HEADER);
+        char* header = new char[headerLength];
+        in.read(header, headerLength);
+        if (strncmp(header, FILE_HEADER, headerLength)) {
+            delete[] header;
+            return false;
+        }
+        delete[] header;
+    }
+
+    // Verify the version
+    {
+        uint16_t version;
+        in.read((char*) &version, sizeof version);
+        LE_TO_CPU_INT16(version, version);
+        if (version != 0x0100)
+            return false;
+    }
+
+    // Read the star count
+    in.read((char *) &nStarsInFile, sizeof nStarsInFile);
+    LE_TO_CPU_INT32(nStarsInFile, nStarsInFile);
+    return in.good();
+}
+
+
+// The root of every star octree is created with the same parameters; a
+// prebuilt octree file is only usable if it was built with them as well.
+static Vector3f starOctreeRootCenter()
+{
+    return Vector3f(1000.0f, 1000.0f, 1000.0f);
+}
+
+static float starOctreeRootAbsMag()
+{
+    return astro::appToAbsMag(STAR_OCTREE_MAGNITUDE,
+                              STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+}
+
+static DynamicStarOctree* createDynamicStarOctree()
+{
+    return new DynamicStarOctree(starOctreeRootCenter(), starOctreeRootAbsMag());
+}
+
+
 bool StarDatabase::CrossIndexEntry::operator<(const StarDatabase::CrossIndexEntry& e) const
 {
     return catalogNumber < e.catalogNumber;
@@ -190,6 +391,7 @@ StarDatabase::StarDatabase()
 StarDatabase::~StarDatabase()
 {
     delete [] stars;
+    delete [] prebuiltStars;
     delete [] catalogNumberIndex;
 
     for (const auto index : crossIndexes)
@@ -319,13 +521,13 @@ Star* StarDatabase::searchCrossIndex(const Catalog catalog, const AstroCatalog::
 }
 
 
-vector<string> StarDatabase::getCompletion(const string& name) const
+vector<string> StarDatabase::getCompletion(const string& name, size_t maxResults) const
 {
     vector<string> completion;
 
     // only named stars are supported by completion.
     if (!name.empty() && namesDB != nullptr)
-        return namesDB->getCompletion(name);
+        return namesDB->getCompletion(name, true, maxResults);
     else
         return completion;
 }
@@ -376,14 +578,9 @@ string StarDatabase::getStarName(const Star& star, bool i18n) const
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
-        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
-        {
-            if (i18n && iter->second != _(iter->second.c_str()))
-                return _(iter->second.c_str());
-            else
-                return iter->second;
-        }
+        const char* name = namesDB->getFirstName(catalogNumber);
+        if (name != nullptr)
+            return i18n ? _(name) : name;
     }
 
     /*
@@ -406,14 +603,10 @@ void StarDatabase::getStarName(const Star& star, char* nameBuffer, unsigned int
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
-        if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
+        const char* name = namesDB->getFirstName(catalogNumber);
+        if (name != nullptr)
         {
-            if (i18n && iter->second != _(iter->second.c_str()))
-                strncpy(nameBuffer, _(iter->second.c_str()), bufferSize);
-            else
-                strncpy(nameBuffer, iter->second.c_str(), bufferSize);
-
+            strncpy(nameBuffer, i18n ? _(name) : name, bufferSize);
             nameBuffer[bufferSize - 1] = '\0';
             return;
         }
@@ -433,15 +626,12 @@ string StarDatabase::getStarNameList(const Star& star, const unsigned int maxNam
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
-
-        while (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber && count < maxNames)
+        for (const auto& name : namesDB->getNamesByCatalogNumber(catalogNumber, maxNames))
         {
             if (count != 0)
                 starNames += " / ";
 
-            starNames += iter->second;
-            ++iter;
+            starNames += name;
             ++count;
         }
     }
@@ -493,16 +683,13 @@ string StarDatabase::getStarNameList(const Star& star, const unsigned int maxNam
 }
 
 
-void StarDatabase::findVisibleStars(StarHandler& starHandler,
-                                    const Vector3f& position,
-                                    const Quaternionf& orientation,
-                                    float fovY,
-                                    float aspectRatio,
-                                    float limitingMag,
-                                    OctreeProcStats *stats) const
+// Compute the bounding planes of an infinite view frustum
+static void computeFrustumPlanes(Hyperplane<float, 3>* frustumPlanes,
+                                 const Vector3f& position,
+                                 const Quaternionf& orientation,
+                                 float fovY,
+                                 float aspectRatio)
 {
-    // Compute the bounding planes of an infinite view frustum
-    Hyperplane<float, 3> frustumPlanes[5];
     Vector3f planeNormals[5];
     Eigen::Matrix3f rot = orientation.toRotationMatrix();
     float h = (float) tan(fovY / 2);
@@ -517,6 +704,35 @@ void StarDatabase::findVisibleStars(StarHandler& starHandler,
         planeNormals[i] = rot.transpose() * planeNormals[i].normalized();
         frustumPlanes[i] = Hyperplane<float, 3>(planeNormals[i], position);
     }
+}
+
+
+// Compute the directions of the four edges of an infinite view frustum
+static void computeFrustumCorners(Vector3f* frustumCorners,
+                                  const Quaternionf& orientation,
+                                  float fovY,
+                                  float aspectRatio)
+{
+    Eigen::Matrix3f rot = orientation.toRotationMatrix();
+    float h = (float) tan(fovY / 2);
+    float w = h * aspectRatio;
+    frustumCorners[0] = rot.transpose() * Vector3f( w,  h, -1.0f);
+    frustumCorners[1] = rot.transpose() * Vector3f(-w,  h, -1.0f);
+    frustumCorners[2] = rot.transpose() * Vector3f(-w, -h, -1.0f);
+    frustumCorners[3] = rot.transpose() * Vector3f( w, -h, -1.0f);
+}
+
+
+void StarDatabase::findVisibleStars(StarHandler& starHandler,
+                                    const Vector3f& position,
+                                    const Quaternionf& orientation,
+                                    float fovY,
+                                    float aspectRatio,
+                                    float limitingMag,
+                                    OctreeProcStats *stats) const
+{
+    Hyperplane<float, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
 
     octreeRoot->processVisibleObjects(starHandler,
                                       position,
@@ -524,6 +740,80 @@ void StarDatabase::findVisibleStars(StarHandler& starHandler,
                                       limitingMag,
                                       STAR_OCTREE_ROOT_SIZE,
                                       stats);
+    if (supplementalOctreeRoot != nullptr)
+    {
+        supplementalOctreeRoot->processVisibleObjects(starHandler,
+                                                      position,
+                                                      frustumPlanes,
+                                                      limitingMag,
+                                                      STAR_OCTREE_ROOT_SIZE,
+                                                      stats);
+    }
+}
+
+
+void StarDatabase::findVisibleStars(vector<VisibleStar>& visibleStars,
+                                    const Vector3f& position,
+                                    const Quaternionf& orientation,
+                                    float fovY,
+                                    float aspectRatio,
+                                    float limitingMag,
+                                    ThreadPool* pool,
+                                    StarCullingCache* cache,
+                                    OctreeProcStats *stats) const
+{
+    Hyperplane<float, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
+
+    if (cache != nullptr)
+    {
+        Vector3f frustumCorners[4];
+        computeFrustumCorners(frustumCorners, orientation, fovY, aspectRatio);
+        if (!cache->covers(&cullingTable, position, frustumCorners, limitingMag))
+        {
+            Hyperplane<float, 3> cachePlanes[5];
+            computeFrustumPlanes(cachePlanes, position, orientation,
+                                 min(fovY * STAR_CACHE_FOV_SCALE, STAR_CACHE_MAX_FOV),
+                                 aspectRatio);
+
+            const StarOctree* roots[2] = { octreeRoot, supplementalOctreeRoot };
+            cullingTable.buildCache(*cache,
+                                    roots,
+                                    supplementalOctreeRoot != nullptr ? 2 : 1,
+                                    stars,
+                                    position,
+                                    cachePlanes,
+                                    limitingMag + STAR_CACHE_MAG_MARGIN,
+                                    STAR_CACHE_TOLERANCE,
+                                    STAR_OCTREE_ROOT_SIZE,
+                                    pool);
+        }
+
+        cullingTable.findCachedStars(visibleStars, *cache, position, frustumPlanes, limitingMag, stats);
+        return;
+    }
+
+    cullingTable.findVisibleStars(visibleStars,
+                                  *octreeRoot,
+                                  stars,
+                                  position,
+                                  frustumPlanes,
+                                  limitingMag,
+                                  STAR_OCTREE_ROOT_SIZE,
+                                  pool,
+                                  stats);
+    if (supplementalOctreeRoot != nullptr)
+    {
+        cullingTable.findVisibleStars(visibleStars,
+                                      *supplementalOctreeRoot,
+                                      stars,
+                                      position,
+                                      frustumPlanes,
+                                      limitingMag,
+                                      STAR_OCTREE_ROOT_SIZE,
+                                      pool,
+                                      stats);
+    }
 }
 
 
@@ -535,6 +825,195 @@ void StarDatabase::findCloseStars(StarHandler& starHandler,
                                     position,
                                     radius,
                                     STAR_OCTREE_ROOT_SIZE);
+    if (supplementalOctreeRoot != nullptr)
+    {
+        supplementalOctreeRoot->processCloseObjects(starHandler,
+                                                    position,
+                                                    radius,
+                                                    STAR_OCTREE_ROOT_SIZE);
+    }
+}
+
+
+namespace
+{
+// Octree node waiting in the queue of a best-first search, with a lower
+// bound of the keys of the stars in its subtree.
+struct QueuedStarNode
+{
+    const StarOctree* node;
+    float scale;
+    float bound;
+
+    // Inverted so that the priority queue returns the lowest bound first
+    bool operator<(const QueuedStarNode& other) const { return bound > other.bound; }
+};
+
+typedef pair<float, const Star*> KeyedStar;
+
+bool compareKeyedStars(const KeyedStar& a, const KeyedStar& b)
+{
+    return a.first < b.first;
+}
+
+// Best-first traversal of star octrees for the nStars stars with the lowest
+// keys. nodeBound(center, scale, absMag) must return a lower bound of the
+// key of any star in the node, given that none of them is brighter than
+// absMag. Stars rejected by the filter are skipped. Nodes are visited in
+// order of their bound and the traversal stops once no node left can hold
+// a star better than those found, which are kept in a bounded max-heap.
+template<class StarKey, class NodeBound> void
+findBestStars(const StarOctree* const* roots,
+              unsigned int nRoots,
+              unsigned int nStars,
+              StarKey starKey,
+              NodeBound nodeBound,
+              const StarDatabase::StarFilter& filter,
+              vector<const Star*>& bestStars)
+{
+    if (nStars == 0)
+        return;
+
+    vector<KeyedStar> heap;
+    heap.reserve(nStars);
+
+    priority_queue<QueuedStarNode> queue;
+    for (unsigned int i = 0; i < nRoots; i++)
+    {
+        const StarOctree* root = roots[i];
+        queue.push({ root, STAR_OCTREE_ROOT_SIZE,
+                     nodeBound(root->getCellCenterPos(), STAR_OCTREE_ROOT_SIZE,
+                               -numeric_limits<float>::infinity()) });
+    }
+
+    while (!queue.empty())
+    {
+        QueuedStarNode queued = queue.top();
+        if (heap.size() == nStars && queued.bound >= heap.front().first)
+            break;
+        queue.pop();
+
+        const StarOctree* node = queued.node;
+        const Star* nodeStars = node->getFirstObject();
+        for (unsigned int i = 0; i < node->getObjectCount(); i++)
+        {
+            if (filter && !filter(nodeStars[i]))
+                continue;
+
+            float key = starKey(nodeStars[i]);
+            if (heap.size() < nStars)
+            {
+                heap.emplace_back(key, &nodeStars[i]);
+                push_heap(heap.begin(), heap.end(), compareKeyedStars);
+            }
+            else if (key < heap.front().first)
+            {
+                pop_heap(heap.begin(), heap.end(), compareKeyedStars);
+                heap.back() = KeyedStar(key, &nodeStars[i]);
+                push_heap(heap.begin(), heap.end(), compareKeyedStars);
+            }
+        }
+
+        // Stars only move down to the children of a node when they're
+        // fainter than its exclusion factor.
+        if (node->hasChildren())
+        {
+            float childScale = queued.scale * 0.5f;
+            for (int i = 0; i < 8; i++)
+            {
+                const StarOctree* child = node->getChild(i);
+                queue.push({ child, childScale,
+                             nodeBound(child->getCellCenterPos(), childScale,
+                                       node->getExclusionFactor()) });
+            }
+        }
+    }
+
+    sort_heap(heap.begin(), heap.end(), compareKeyedStars);
+    bestStars.reserve(bestStars.size() + heap.size());
+    for (const auto& star : heap)
+        bestStars.push_back(star.second);
+}
+}
+
+
+void StarDatabase::findNearestStars(const Vector3f& position,
+                                    unsigned int maxStars,
+                                    vector<const Star*>& nearStars,
+                                    const StarFilter& filter) const
+{
+    const StarOctree* roots[2] = { octreeRoot, supplementalOctreeRoot };
+    findBestStars(roots, supplementalOctreeRoot != nullptr ? 2 : 1, maxStars,
+                  [&position](const Star& star)
+                  {
+                      return (star.getPosition() - position).squaredNorm();
+                  },
+                  [&position](const Vector3f& center, float scale, float /*absMag*/)
+                  {
+                      float minDistance = (center - position).norm() - scale * STAR_OCTREE_NODE_RADIUS_FACTOR;
+                      return minDistance > 0.0f ? minDistance * minDistance : 0.0f;
+                  },
+                  filter,
+                  nearStars);
+}
+
+
+void StarDatabase::findBrighterStars(const Vector3f& position,
+                                     unsigned int maxStars,
+                                     vector<const Star*>& brightStars,
+                                     const StarFilter& filter) const
+{
+    const StarOctree* roots[2] = { octreeRoot, supplementalOctreeRoot };
+    findBestStars(roots, supplementalOctreeRoot != nullptr ? 2 : 1, maxStars,
+                  [&position](const Star& star)
+                  {
+                      return star.getApparentMagnitude((star.getPosition() - position).norm());
+                  },
+                  [&position](const Vector3f& center, float scale, float absMag)
+                  {
+                      // Extinction only makes stars fainter, so it can be
+                      // ignored for the bound.
+                      float minDistance = (center - position).norm() - scale * STAR_OCTREE_NODE_RADIUS_FACTOR;
+                      if (minDistance <= 0.0f)
+                          return -numeric_limits<float>::infinity();
+                      return astro::absToAppMag(absMag, minDistance);
+                  },
+                  filter,
+                  brightStars);
+}
+
+
+void StarDatabase::findBrightestStars(unsigned int maxStars,
+                                      vector<const Star*>& brightStars,
+                                      const StarFilter& filter) const
+{
+    // The order of the stars by absolute magnitude is only built once it's
+    // first needed.
+    {
+        lock_guard<mutex> lock(absMagOrderMutex);
+        if (absMagOrder.size() != (size_t) nStars)
+        {
+            absMagOrder.resize(nStars);
+            for (uint32_t i = 0; i < (uint32_t) nStars; i++)
+                absMagOrder[i] = i;
+            stable_sort(absMagOrder.begin(), absMagOrder.end(),
+                        [this](uint32_t a, uint32_t b)
+                        {
+                            return stars[a].getAbsoluteMagnitude() < stars[b].getAbsoluteMagnitude();
+                        });
+        }
+    }
+
+    unsigned int found = 0;
+    for (size_t i = 0; i < absMagOrder.size() && found < maxStars; i++)
+    {
+        const Star& star = stars[absMagOrder[i]];
+        if (!filter || filter(star))
+        {
+            brightStars.push_back(&star);
+            found++;
+        }
+    }
 }
 
 
@@ -620,75 +1099,24 @@ bool StarDatabase::loadCrossIndex(const Catalog catalog, istream& in)
 bool StarDatabase::loadBinary(istream& in)
 {
     uint32_t nStarsInFile = 0;
-
-    // Verify that the star database file has a correct header
-    {
-        int headerLength = strlen(FILE_HEADER);
-        char* header = new char[headerLength];
-        in.read(header, headerLength);
-        if (strncmp(header, FILE_HEADER, headerLength)) {
-            delete[] header;
-            return false;
-        }
-        delete[] header;
-    }
-
-    // Verify the version
-    {
-        uint16_t version;
-        in.read((char*) &version, sizeof version);
-        LE_TO_CPU_INT16(version, version);
-        if (version != 0x0100)
-            return false;
-    }
-
-    // Read the star count
-    in.read((char *) &nStarsInFile, sizeof nStarsInFile);
-    LE_TO_CPU_INT32(nStarsInFile, nStarsInFile);
-    if (!in.good())
+    if (!readBinaryHeader(in, nStarsInFile))
         return false;
 
     unsigned int totalStars = nStars + nStarsInFile;
 
     while (((unsigned int) nStars) < totalStars)
     {
-        AstroCatalog::IndexNumber catNo = 0;
-        float x = 0.0f, y = 0.0f, z = 0.0f;
-        int16_t absMag;
-        uint16_t spectralType;
-
-        in.read((char *) &catNo, sizeof catNo);
-        LE_TO_CPU_INT32(catNo, catNo);
-        in.read((char *) &x, sizeof x);
-        LE_TO_CPU_FLOAT(x, x);
-        in.read((char *) &y, sizeof y);
-        LE_TO_CPU_FLOAT(y, y);
-        in.read((char *) &z, sizeof z);
-        LE_TO_CPU_FLOAT(z, z);
-        in.read((char *) &absMag, sizeof absMag);
-        LE_TO_CPU_INT16(absMag, absMag);
-        in.read((char *) &spectralType, sizeof spectralType);
-        LE_TO_CPU_INT16(spectralType, spectralType);
-        if (in.bad())
-        break;
+        BinaryStarRecord rec;
+        if (!readBinaryStarRecord(in, rec))
+            break;
 
         Star star;
-        star.setPosition(x, y, z);
-        star.setAbsoluteMagnitude((float) absMag / 256.0f);
-
-        StarDetails* details = nullptr;
-        StellarClass sc;
-        if (sc.unpack(spectralType))
-            details = StarDetails::GetStarDetails(sc);
-
-        if (details == nullptr)
+        if (!initStar(star, rec))
         {
             fmt::fprintf(cerr, _("Bad spectral type in star database, star #%u\n"), nStars);
             return false;
         }
 
-        star.setDetails(details);
-        star.setIndex(catNo);
         unsortedStars.add(star);
 
         nStars++;
@@ -720,13 +1148,264 @@ bool StarDatabase::loadBinary(istream& in)
 }
 
 
+bool StarDatabase::isOctreeBinary(const fs::path& filename)
+{
+    ifstream in(filename.string(), ios::in | ios::binary);
+    char header[sizeof OCTREE_FILE_HEADER - 1];
+    in.read(header, sizeof header);
+    return in.good() && strncmp(header, OCTREE_FILE_HEADER, sizeof header) == 0;
+}
+
+
+bool StarDatabase::loadOctreeBinary(const fs::path& filename)
+{
+    // The prebuilt octree must hold every star of the binary database, so
+    // it can't be combined with another binary star file.
+    if (nStars != 0 || prebuiltStars != nullptr)
+        return false;
+
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    const char* data = file.data();
+    if (file.size() < OCTREE_FILE_HEADER_SIZE ||
+        strncmp(data, OCTREE_FILE_HEADER, strlen(OCTREE_FILE_HEADER)) != 0)
+    {
+        return false;
+    }
+
+    if (decodeUint16(data + 8) != OCTREE_FILE_VERSION)
+    {
+        cerr << _("Bad version for prebuilt star octree file\n");
+        return false;
+    }
+
+    uint32_t nStarsInFile = decodeUint32(data + 12);
+    uint32_t nNodes       = decodeUint32(data + 16);
+    if (nNodes == 0 ||
+        file.size() != OCTREE_FILE_HEADER_SIZE +
+                       (size_t) nStarsInFile * (STAR_RECORD_SIZE + sizeof(uint32_t)) +
+                       (size_t) nNodes * OCTREE_NODE_RECORD_SIZE)
+    {
+        cerr << _("Prebuilt star octree file is truncated\n");
+        return false;
+    }
+
+    const char* starRecords = data + OCTREE_FILE_HEADER_SIZE;
+    const char* catalogIndex = starRecords + (size_t) nStarsInFile * STAR_RECORD_SIZE;
+    const char* nodeRecords = catalogIndex + (size_t) nStarsInFile * sizeof(uint32_t);
+
+    Star* fileStars = new Star[nStarsInFile];
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+    {
+        BinaryStarRecord rec;
+        decodeBinaryStarRecord(starRecords + (size_t) i * STAR_RECORD_SIZE, rec);
+        if (!initStar(fileStars[i], rec))
+        {
+            fmt::fprintf(cerr, _("Bad spectral type in star database, star #%u\n"), i);
+            delete[] fileStars;
+            return false;
+        }
+    }
+
+    vector<uint32_t> order(nStarsInFile);
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+    {
+        order[i] = decodeUint32(catalogIndex + (size_t) i * sizeof(uint32_t));
+        if (order[i] >= nStarsInFile)
+        {
+            cerr << _("Bad catalog number index in prebuilt star octree file\n");
+            delete[] fileStars;
+            return false;
+        }
+    }
+
+    vector<PrebuiltOctreeNode> nodes(nNodes);
+    for (uint32_t i = 0; i < nNodes; i++)
+    {
+        const char* p = nodeRecords + (size_t) i * OCTREE_NODE_RECORD_SIZE;
+        PrebuiltOctreeNode& node = nodes[i];
+        node.center          = Vector3f(decodeFloat(p), decodeFloat(p + 4), decodeFloat(p + 8));
+        node.exclusionFactor = decodeFloat(p + 12);
+        node.scale           = decodeFloat(p + 16);
+        node.firstStar       = decodeUint32(p + 20);
+        node.nStars          = decodeUint32(p + 24);
+        node.firstChild      = decodeUint32(p + 28);
+
+        // Children always follow their parent in breadth first order, which
+        // also guarantees that the node table can't contain cycles.
+        if (node.firstStar > nStarsInFile || node.nStars > nStarsInFile - node.firstStar ||
+            (node.firstChild != 0 && (node.firstChild <= i || node.firstChild > nNodes - 8)))
+        {
+            cerr << _("Bad node table in prebuilt star octree file\n");
+            delete[] fileStars;
+            return false;
+        }
+    }
+
+    prebuiltStars = fileStars;
+    prebuiltStarCount = nStarsInFile;
+    prebuiltCatalogNumberOrder.swap(order);
+    prebuiltNodes.swap(nodes);
+
+    // The file may have been written by a version of Celestia with another
+    // root size or magnitude limit. Its stars are still good, but the
+    // octree is rebuilt from them in finish().
+    if (!prebuiltOctreeMatches())
+    {
+        cerr << _("Prebuilt star octree file was built with different parameters\n");
+        prebuiltNodes.clear();
+    }
+    nStars = nStarsInFile;
+
+    fmt::fprintf(clog, _("%d stars in binary database\n"), nStars);
+
+    // The catalog number ordering is stored in the file, so the load time
+    // index doesn't have to be sorted.
+    if (nStarsInFile > 0)
+    {
+        binFileStarCount = nStarsInFile;
+        binFileCatalogNumberIndex = new Star*[binFileStarCount];
+        for (unsigned int i = 0; i < binFileStarCount; i++)
+            binFileCatalogNumberIndex[i] = prebuiltStars + prebuiltCatalogNumberOrder[i];
+    }
+
+    return true;
+}
+
+
+bool StarDatabase::writeOctreeBinary(istream& in, ostream& out)
+{
+    uint32_t nStarsInFile = 0;
+    if (!readBinaryHeader(in, nStarsInFile))
+        return false;
+
+    vector<BinaryStarRecord> records(nStarsInFile);
+    Star* unsorted = new Star[nStarsInFile];
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+    {
+        if (!readBinaryStarRecord(in, records[i]) || !initStar(unsorted[i], records[i]))
+        {
+            delete[] unsorted;
+            return false;
+        }
+
+        // Use the record number as the index so that the stars can be
+        // matched with their records after the octree sort.
+        unsorted[i].setIndex(i);
+    }
+
+    DynamicStarOctree* root = createDynamicStarOctree();
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+        root->insertObject(unsorted[i], STAR_OCTREE_ROOT_SIZE);
+
+    Star* sorted    = new Star[nStarsInFile];
+    Star* firstStar = sorted;
+    StarOctree* octree = nullptr;
+    root->rebuildAndSort(octree, firstStar);
+    delete root;
+    delete[] unsorted;
+
+    // Flatten the octree breadth first
+    vector<const StarOctree*> nodes;
+    vector<float> scales;
+    vector<uint32_t> firstChildren;
+    nodes.push_back(octree);
+    scales.push_back(STAR_OCTREE_ROOT_SIZE);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (!nodes[i]->hasChildren())
+        {
+            firstChildren.push_back(0);
+            continue;
+        }
+
+        firstChildren.push_back((uint32_t) nodes.size());
+        float childScale = scales[i] * 0.5f;
+        for (int j = 0; j < 8; j++)
+        {
+            nodes.push_back(nodes[i]->getChild(j));
+            scales.push_back(childScale);
+        }
+    }
+
+    vector<uint32_t> order(nStarsInFile);
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+        order[i] = i;
+    sort(order.begin(), order.end(),
+         [&](uint32_t a, uint32_t b)
+         {
+             return records[sorted[a].getIndex()].catNo < records[sorted[b].getIndex()].catNo;
+         });
+
+    out.write(OCTREE_FILE_HEADER, strlen(OCTREE_FILE_HEADER));
+    uint16_t version = OCTREE_FILE_VERSION;
+    uint16_t reserved = 0;
+    LE_TO_CPU_INT16(version, version);
+    out.write((const char *) &version, sizeof version);
+    out.write((const char *) &reserved, sizeof reserved);
+    writeUint32(out, nStarsInFile);
+    writeUint32(out, (uint32_t) nodes.size());
+
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+        writeBinaryStarRecord(out, records[sorted[i].getIndex()]);
+
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+        writeUint32(out, order[i]);
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const StarOctree* node = nodes[i];
+        writeFloat(out, node->getCellCenterPos().x());
+        writeFloat(out, node->getCellCenterPos().y());
+        writeFloat(out, node->getCellCenterPos().z());
+        writeFloat(out, node->getExclusionFactor());
+        writeFloat(out, scales[i]);
+        writeUint32(out, (uint32_t) (node->getFirstObject() - sorted));
+        writeUint32(out, node->getObjectCount());
+        writeUint32(out, firstChildren[i]);
+    }
+
+    delete octree;
+    delete[] sorted;
+
+    return out.good();
+}
+
+
 void StarDatabase::finish()
 {
     fmt::fprintf(clog, _("Total star count: %d\n"), nStars);
 
-    buildOctree();
+    if (prebuiltStars != nullptr && !canUsePrebuiltOctree())
+    {
+        // Stars from the prebuilt octree were moved by stc files, or the
+        // octree was built with other parameters, so sort the whole catalog
+        // into a new octree.
+        clog << _("Rebuilding star octree\n");
+        for (uint32_t i = 0; i < prebuiltStarCount; i++)
+            unsortedStars.add(prebuiltStars[i]);
+        delete[] prebuiltStars;
+        prebuiltStars = nullptr;
+        prebuiltCatalogNumberOrder.clear();
+    }
+
+    if (prebuiltStars != nullptr)
+        linkPrebuiltOctree();
+    else
+        buildOctree();
     buildIndexes();
 
+    cullingTable.build(stars, nStars);
+
+    if (namesDB != nullptr)
+        namesDB->freeze();
+
+    vector<uint32_t>().swap(prebuiltCatalogNumberOrder);
+    vector<PrebuiltOctreeNode>().swap(prebuiltNodes);
+    vector<uint32_t>().swap(modifiedPrebuiltStars);
+
     // Delete the temporary indices used only during loading
     delete[] binFileCatalogNumberIndex;
     stcFileCatalogNumberIndex.clear();
@@ -1341,6 +2020,12 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
 
         if (ok)
         {
+            if (!isNewStar && prebuiltStars != nullptr &&
+                star >= prebuiltStars && star < prebuiltStars + prebuiltStarCount)
+            {
+                modifiedPrebuiltStars.push_back((uint32_t) (star - prebuiltStars));
+            }
+
             if (isNewStar)
             {
                 unsortedStars.add(*star);
@@ -1396,10 +2081,7 @@ void StarDatabase::buildOctree()
     // ASSERT(octreeRoot == nullptr);
 
     DPRINTF(LOG_LEVEL_INFO, "Sorting stars into octree . . .\n");
-    float absMag = astro::appToAbsMag(STAR_OCTREE_MAGNITUDE,
-                                      STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
-    DynamicStarOctree* root = new DynamicStarOctree(Vector3f(1000.0f, 1000.0f, 1000.0f),
-                                                    absMag);
+    DynamicStarOctree* root = createDynamicStarOctree();
     for (unsigned int i = 0; i < unsortedStars.size(); ++i)
     {
         root->insertObject(unsortedStars[i], STAR_OCTREE_ROOT_SIZE);
@@ -1439,6 +2121,161 @@ void StarDatabase::buildOctree()
 }
 
 
+/*! Check that the prebuilt octree has the root and node sizes of the
+ *  octrees built by createDynamicStarOctree().
+ */
+bool StarDatabase::prebuiltOctreeMatches() const
+{
+    const PrebuiltOctreeNode& root = prebuiltNodes[0];
+    if (root.center != starOctreeRootCenter() ||
+        root.scale != STAR_OCTREE_ROOT_SIZE ||
+        abs(root.exclusionFactor - starOctreeRootAbsMag()) > 1.0e-4f)
+    {
+        return false;
+    }
+
+    for (const auto& node : prebuiltNodes)
+    {
+        if (node.firstChild == 0)
+            continue;
+        for (uint32_t j = 0; j < 8; j++)
+        {
+            if (prebuiltNodes[node.firstChild + j].scale != node.scale * 0.5f)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*! Stars from a prebuilt octree file may have been changed by stc files.
+ *  The octree is still valid as long as every modified star lies within
+ *  the cube of its node and would not have been kept in the parent node
+ *  when the octree was built.
+ */
+bool StarDatabase::canUsePrebuiltOctree() const
+{
+    // No nodes were kept if the file's octree parameters didn't match
+    if (prebuiltNodes.empty())
+        return false;
+
+    if (modifiedPrebuiltStars.empty())
+        return true;
+
+    vector<uint32_t> parents(prebuiltNodes.size(), 0);
+    vector<uint32_t> byFirstStar;
+    for (uint32_t i = 0; i < prebuiltNodes.size(); i++)
+    {
+        const PrebuiltOctreeNode& node = prebuiltNodes[i];
+        if (node.firstChild != 0)
+        {
+            for (uint32_t j = 0; j < 8; j++)
+                parents[node.firstChild + j] = i;
+        }
+        if (node.nStars > 0)
+            byFirstStar.push_back(i);
+    }
+
+    sort(byFirstStar.begin(), byFirstStar.end(),
+         [this](uint32_t a, uint32_t b)
+         { return prebuiltNodes[a].firstStar < prebuiltNodes[b].firstStar; });
+
+    for (const auto starIndex : modifiedPrebuiltStars)
+    {
+        auto iter = upper_bound(byFirstStar.begin(), byFirstStar.end(), starIndex,
+                                [this](uint32_t index, uint32_t n)
+                                { return index < prebuiltNodes[n].firstStar; });
+        if (iter == byFirstStar.begin())
+            return false;
+
+        uint32_t nodeIndex = *(iter - 1);
+        const PrebuiltOctreeNode& node = prebuiltNodes[nodeIndex];
+        if (starIndex >= node.firstStar + node.nStars)
+            return false;
+
+        const Star& star = prebuiltStars[starIndex];
+        if ((star.getPosition() - node.center).cwiseAbs().maxCoeff() > node.scale)
+            return false;
+
+        // The root node accepts every star
+        if (nodeIndex == 0)
+            continue;
+
+        // Same tests as the limiting factor and straddling predicates of
+        // the star octree.
+        const PrebuiltOctreeNode& parent = prebuiltNodes[parents[nodeIndex]];
+        if (star.getAbsoluteMagnitude() <= parent.exclusionFactor)
+            return false;
+
+        float orbitalRadius = star.getOrbitalRadius();
+        if (orbitalRadius != 0.0f &&
+            (star.getPosition() - parent.center).cwiseAbs().minCoeff() < orbitalRadius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void StarDatabase::linkPrebuiltOctree()
+{
+    uint32_t nSupplementalStars = unsortedStars.size();
+    if (nSupplementalStars == 0)
+    {
+        stars = prebuiltStars;
+    }
+    else
+    {
+        stars = new Star[nStars];
+        copy(prebuiltStars, prebuiltStars + prebuiltStarCount, stars);
+        delete[] prebuiltStars;
+    }
+    prebuiltStars = nullptr;
+
+    vector<StarOctree*> nodes(prebuiltNodes.size());
+    for (size_t i = 0; i < prebuiltNodes.size(); i++)
+    {
+        const PrebuiltOctreeNode& node = prebuiltNodes[i];
+        nodes[i] = new StarOctree(node.center, node.exclusionFactor,
+                                  stars + node.firstStar, node.nStars);
+    }
+
+    for (size_t i = 0; i < prebuiltNodes.size(); i++)
+    {
+        uint32_t firstChild = prebuiltNodes[i].firstChild;
+        if (firstChild == 0)
+            continue;
+
+        auto children = new StarOctree*[8];
+        for (int j = 0; j < 8; j++)
+            children[j] = nodes[firstChild + j];
+        nodes[i]->setChildren(children);
+    }
+    octreeRoot = nodes[0];
+
+    DPRINTF(LOG_LEVEL_INFO, "Prebuilt octree has %d nodes and %d stars.\n",
+            1 + octreeRoot->countChildren(), octreeRoot->countObjects());
+
+    // Stars from stc files get an octree of their own, stored after the
+    // stars of the prebuilt octree.
+    if (nSupplementalStars > 0)
+    {
+        DynamicStarOctree* root = createDynamicStarOctree();
+        for (unsigned int i = 0; i < nSupplementalStars; ++i)
+            root->insertObject(unsortedStars[i], STAR_OCTREE_ROOT_SIZE);
+
+        Star* firstStar = stars + prebuiltStarCount;
+        root->rebuildAndSort(supplementalOctreeRoot, firstStar);
+
+        unsortedStars.clear();
+        delete root;
+    }
+}
+
+
 void StarDatabase::buildIndexes()
 {
     // This should only be called once for the database
@@ -1447,6 +2284,22 @@ void StarDatabase::buildIndexes()
     DPRINTF(LOG_LEVEL_INFO, "Building catalog number indexes . . .\n");
 
     catalogNumberIndex = new Star*[nStars];
+    if (!prebuiltCatalogNumberOrder.empty())
+    {
+        // Stars of a prebuilt octree file are already ordered; only the stars
+        // from stc files need to be sorted and merged in.
+        uint32_t nPrebuilt = prebuiltCatalogNumberOrder.size();
+        for (uint32_t i = 0; i < nPrebuilt; ++i)
+            catalogNumberIndex[i] = &stars[prebuiltCatalogNumberOrder[i]];
+        for (int i = nPrebuilt; i < nStars; ++i)
+            catalogNumberIndex[i] = &stars[i];
+
+        sort(catalogNumberIndex + nPrebuilt, catalogNumberIndex + nStars, PtrCatalogNumberOrderingPredicate());
+        inplace_merge(catalogNumberIndex, catalogNumberIndex + nPrebuilt, catalogNumberIndex + nStars,
+                      PtrCatalogNumberOrderingPredicate());
+        return;
+    }
+
     for (int i = 0; i < nStars; ++i)
         catalogNumberIndex[i] = &stars[i];
 
@@ -11,9 +11,11 @@
 #ifndef _CELENGINE_STARDB_H_
 #define _CELENGINE_STARDB_H_
 
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <celutil/blockarray.h>
 #include <celengine/constellation.h>
 #include <celengine/starname.h>
@@ -39,7 +41,7 @@ class StarDatabase
     Star* find(const std::string&) const;
     AstroCatalog::IndexNumber findCatalogNumberByName(const std::string&) const;
 
-    std::vector<std::string> getCompletion(const std::string&) const;
+    std::vector<std::string> getCompletion(const std::string&, size_t maxResults = 0) const;
 
     void findVisibleStars(StarHandler& starHandler,
                           const Eigen::Vector3f& obsPosition,
@@ -49,10 +51,43 @@ class StarDatabase
                           float limitingMag,
                           OctreeProcStats * = nullptr) const;
 
+    // Parallel variant of findVisibleStars which culls the stars from a
+    // packed copy of their positions and magnitudes and returns the indices
+    // of the visible stars instead of calling a handler for each one.
+    // When a cache is given, the octree is only traversed again once the
+    // observer has moved or turned too far from where the cache was built.
+    void findVisibleStars(std::vector<VisibleStar>& visibleStars,
+                          const Eigen::Vector3f& obsPosition,
+                          const Eigen::Quaternionf& obsOrientation,
+                          float fovY,
+                          float aspectRatio,
+                          float limitingMag,
+                          ThreadPool* pool,
+                          StarCullingCache* cache = nullptr,
+                          OctreeProcStats * = nullptr) const;
+
     void findCloseStars(StarHandler& starHandler,
                         const Eigen::Vector3f& obsPosition,
                         float radius) const;
 
+    // Top-K queries used by the star browsers. The stars are appended to
+    // the vector sorted from the best match: nearest to position, brightest
+    // seen from position, or brightest absolute magnitude. When a filter is
+    // given, only the stars for which it returns true are considered.
+    typedef std::function<bool(const Star&)> StarFilter;
+
+    void findNearestStars(const Eigen::Vector3f& position,
+                          unsigned int maxStars,
+                          std::vector<const Star*>& nearStars,
+                          const StarFilter& filter = StarFilter()) const;
+    void findBrighterStars(const Eigen::Vector3f& position,
+                           unsigned int maxStars,
+                           std::vector<const Star*>& brightStars,
+                           const StarFilter& filter = StarFilter()) const;
+    void findBrightestStars(unsigned int maxStars,
+                            std::vector<const Star*>& brightStars,
+                            const StarFilter& filter = StarFilter()) const;
+
     std::string getStarName    (const Star&, bool i18n = false) const;
     void getStarName(const Star& star, char* nameBuffer, unsigned int bufferSize, bool i18n = false) const;
     std::string getStarNameList(const Star&, const unsigned int maxNames = MAX_STAR_NAMES) const;
@@ -63,6 +98,15 @@ class StarDatabase
     bool load(std::istream&, const fs::path& resourcePath = fs::path());
     bool loadBinary(std::istream&);
 
+    // Load a star file that was written with its stars already in octree
+    // order together with the node table of the compiled octree, so that
+    // no sorting or octree building is needed at startup.
+    bool loadOctreeBinary(const fs::path&);
+    static bool isOctreeBinary(const fs::path&);
+
+    // Convert a CELSTARS binary database into the prebuilt octree format.
+    static bool writeOctreeBinary(std::istream& in, std::ostream& out);
+
     enum Catalog
     {
         HenryDraper = 0,
@@ -104,6 +148,9 @@ private:
 
     void buildOctree();
     void buildIndexes();
+    bool prebuiltOctreeMatches() const;
+    bool canUsePrebuiltOctree() const;
+    void linkPrebuiltOctree();
     Star* findWhileLoading(AstroCatalog::IndexNumber catalogNumber) const;
 
     int nStars{ 0 };
@@ -112,6 +159,12 @@ private:
     StarNameDatabase* namesDB{ nullptr };
     Star**            catalogNumberIndex{ nullptr };
     StarOctree*       octreeRoot{ nullptr };
+    // Octree of stars from stc files added to a prebuilt octree star file
+    StarOctree*       supplementalOctreeRoot{ nullptr };
+    StarCullingTable  cullingTable;
+    // Indices of the stars sorted by absolute magnitude
+    mutable std::vector<uint32_t> absMagOrder;
+    mutable std::mutex absMagOrderMutex;
     AstroCatalog::IndexNumber nextAutoCatalogNumber{ 0xfffffffe };
 
     std::vector<CrossIndex*> crossIndexes;
@@ -125,6 +178,24 @@ private:
     // Catalog number -> star mapping for stars loaded from stc files
     std::map<AstroCatalog::IndexNumber, Star*> stcFileCatalogNumberIndex;
 
+    // Stars, catalog number ordering and node table read from a prebuilt
+    // octree star file. Stars modified by stc files are remembered so
+    // that finish() can verify they still belong in their octree node.
+    struct PrebuiltOctreeNode
+    {
+        Eigen::Vector3f center;
+        float exclusionFactor;
+        float scale;
+        uint32_t firstStar;
+        uint32_t nStars;
+        uint32_t firstChild;
+    };
+    Star* prebuiltStars{ nullptr };
+    uint32_t prebuiltStarCount{ 0 };
+    std::vector<uint32_t> prebuiltCatalogNumberOrder;
+    std::vector<PrebuiltOctreeNode> prebuiltNodes;
+    std::vector<uint32_t> modifiedPrebuiltStars;
+
     struct BarycenterUsage
     {
         AstroCatalog::IndexNumber catNo;
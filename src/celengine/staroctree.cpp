@@ -10,9 +10,14 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <celutil/threadpool.h>
 #include <celengine/staroctree.h>
 
 using namespace Eigen;
+using namespace std;
 
 // Maximum permitted orbital radius for stars, in light years. Orbital
 // radii larger than this value are not guaranteed to give correct
@@ -119,21 +124,24 @@ void StarOctree::processVisibleObjects(StarHandler&    processor,
     // Process the objects in this node
     float dimmest     = minDistance > 0 ? astro::appToAbsMag(limitingFactor, minDistance) : 1000;
 
-    for (unsigned int i=0; i<nObjects; ++i)
     {
+        OctreeCandidateBuffer<Star, float> candidates(processor);
+        for (unsigned int i=0; i<nObjects; ++i)
+        {
 #ifdef OCTREE_DEBUG
-        if (stats != nullptr)
-            stats->objects++;
+            if (stats != nullptr)
+                stats->objects++;
 #endif
-        const Star& obj = _firstObject[i];
+            const Star& obj = _firstObject[i];
 
-        if (obj.getAbsoluteMagnitude() < dimmest)
-        {
-            float distance    = (obsPosition - obj.getPosition()).norm();
-            float appMag      = obj.getApparentMagnitude(distance);
+            if (obj.getAbsoluteMagnitude() < dimmest)
+            {
+                float distance    = (obsPosition - obj.getPosition()).norm();
+                float appMag      = obj.getApparentMagnitude(distance);
 
-            if (appMag < limitingFactor || (distance < MAX_STAR_ORBIT_RADIUS && obj.getOrbit()))
-                processor.process(obj, distance, appMag);
+                if (appMag < limitingFactor || (distance < MAX_STAR_ORBIT_RADIUS && obj.getOrbit()))
+                    candidates.add(obj, distance, appMag);
+            }
         }
     }
 
@@ -188,16 +196,19 @@ void StarOctree::processCloseObjects(StarHandler&    processor,
     float radiusSquared    = boundingRadius * boundingRadius;
 
     // Check all the objects in the node.
-    for (unsigned int i = 0; i < nObjects; ++i)
     {
-        Star& obj = _firstObject[i];
-
-        if ((obsPosition - obj.getPosition()).squaredNorm() < radiusSquared)
+        OctreeCandidateBuffer<Star, float> candidates(processor);
+        for (unsigned int i = 0; i < nObjects; ++i)
         {
-            float distance    = (obsPosition - obj.getPosition()).norm();
-            float appMag      = obj.getApparentMagnitude(distance);
+            Star& obj = _firstObject[i];
+
+            if ((obsPosition - obj.getPosition()).squaredNorm() < radiusSquared)
+            {
+                float distance    = (obsPosition - obj.getPosition()).norm();
+                float appMag      = obj.getApparentMagnitude(distance);
 
-            processor.process(obj, distance, appMag);
+                candidates.add(obj, distance, appMag);
+            }
         }
     }
 
@@ -213,3 +224,563 @@ void StarOctree::processCloseObjects(StarHandler&    processor,
         }
     }
 }
+
+
+// Octree levels above this depth are split into separate culling tasks
+static const int CULLING_SPLIT_DEPTH = 3;
+
+// Ratio of the bounding sphere radius of a node to its scale
+static const float NODE_RADIUS_FACTOR = 1.732050807568877f;
+
+// Stars are tested in blocks of this size, small enough for the
+// intermediate results to stay in L1 cache.
+static const uint32_t CULLING_BLOCK_SIZE = 256;
+
+
+struct StarCullingTable::CullingTask
+{
+    const StarOctree* node;
+    float             scale;
+    bool              recurse;
+    // Index of the task holding the parent node, -1 for the root
+    int               parent;
+};
+
+
+struct StarCullingTable::CullingContext
+{
+    const Star*                 stars;
+    Vector3f                    obsPosition;
+    const Hyperplane<float, 3>* frustumPlanes;
+    float                       limitingMag;
+    // 10^(0.4 * limitingMag), slightly enlarged so that the fast distance
+    // test never rejects a star accepted by the exact magnitude test.
+    float                       limitingScale;
+    // Maximum distance of the observer from obsPosition when building a
+    // culling cache, zero otherwise.
+    float                       tolerance;
+};
+
+
+// Nodes and candidate stars collected by one task while building a
+// culling cache; parent indices are local to the fragment.
+struct StarCullingTable::CacheFragment
+{
+    vector<StarCullingCache::CachedNode> nodes;
+    vector<uint32_t>                     candidates;
+};
+
+
+bool StarCullingCache::covers(const StarCullingTable* _table,
+                              const Vector3f& obsPosition,
+                              const Vector3f* frustumCorners,
+                              float _limitingMag) const
+{
+    if (table == nullptr || table != _table || tableBuild != _table->getBuildNumber() ||
+        _limitingMag > limitingMag)
+        return false;
+
+    if ((obsPosition - center).squaredNorm() > tolerance * tolerance)
+        return false;
+
+    // The new frustum lies within the cached one if all of its edges point
+    // into the cached frustum.
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            if (frustumPlanes[i].normal().dot(frustumCorners[j]) < 0.0f)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+void StarCullingTable::build(const Star* stars, uint32_t nStars)
+{
+    static std::atomic<uint32_t> builds{ 0 };
+    buildNumber = ++builds;
+
+    posX.resize(nStars);
+    posY.resize(nStars);
+    posZ.resize(nStars);
+    absMag.resize(nStars);
+    zeroMagDistance2.resize(nStars);
+    extinction.resize(nStars);
+    flags.resize(nStars);
+
+    for (uint32_t i = 0; i < nStars; i++)
+    {
+        const Star& star = stars[i];
+        Vector3f pos = star.getPosition();
+        posX[i] = pos.x();
+        posY[i] = pos.y();
+        posZ[i] = pos.z();
+        absMag[i] = star.getAbsoluteMagnitude();
+        extinction[i] = star.getExtinction();
+
+        // From absToAppMag(): the apparent magnitude reaches m at distance
+        // LY_PER_PARSEC * 10^((m - absMag + 5) / 5).
+        float d0 = (float) (LY_PER_PARSEC * pow(10.0, (5.0 - absMag[i]) / 5.0));
+        zeroMagDistance2[i] = d0 * d0;
+
+        uint8_t f = 0;
+        if (star.getOrbit() != nullptr)
+            f |= HasOrbit;
+        if (extinction[i] != 0.0f)
+            f |= HasExtinction;
+        flags[i] = f;
+    }
+}
+
+
+void StarCullingTable::cullStars(const CullingContext& ctx,
+                                 uint32_t first,
+                                 uint32_t count,
+                                 float dimmest,
+                                 vector<VisibleStar>& visibleStars) const
+{
+    const float ox = ctx.obsPosition.x();
+    const float oy = ctx.obsPosition.y();
+    const float oz = ctx.obsPosition.z();
+
+    uint8_t candidate[CULLING_BLOCK_SIZE];
+
+    for (uint32_t block = 0; block < count; block += CULLING_BLOCK_SIZE)
+    {
+        const uint32_t base = first + block;
+        const uint32_t n = min(CULLING_BLOCK_SIZE, count - block);
+        const float* x = posX.data() + base;
+        const float* y = posY.data() + base;
+        const float* z = posZ.data() + base;
+        const float* m = absMag.data() + base;
+        const float* d0 = zeroMagDistance2.data() + base;
+        const uint8_t* f = flags.data() + base;
+
+        // Branch free first pass over the packed arrays; the compiler turns
+        // this loop into SIMD code. Stars with an orbit or extinction can't
+        // be rejected by the distance test and are always passed on.
+        for (uint32_t i = 0; i < n; i++)
+        {
+            float dx = ox - x[i];
+            float dy = oy - y[i];
+            float dz = oz - z[i];
+            float d2 = dx * dx + dy * dy + dz * dz;
+            candidate[i] = (uint8_t) ((m[i] < dimmest) &
+                                      ((d2 < d0[i] * ctx.limitingScale) | (f[i] != 0)));
+        }
+
+        // Exact test of the few remaining candidates
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (candidate[i])
+                testStar(ctx, base + i, visibleStars);
+        }
+    }
+}
+
+
+inline void StarCullingTable::testStar(const CullingContext& ctx,
+                                       uint32_t index,
+                                       vector<VisibleStar>& visibleStars) const
+{
+    Vector3f starPos(posX[index], posY[index], posZ[index]);
+    float distance = (ctx.obsPosition - starPos).norm();
+    float appMag = astro::absToAppMag(absMag[index], distance) + extinction[index] * distance;
+
+    if (appMag < ctx.limitingMag ||
+        (distance < MAX_STAR_ORBIT_RADIUS && (flags[index] & HasOrbit) != 0))
+    {
+        visibleStars.push_back({ index, distance, appMag });
+    }
+}
+
+
+// Test a cubic octree node against the five planes of the infinite view
+// frustum, moved back by the tolerance of the context.
+inline bool StarCullingTable::inFrustum(const CullingContext& ctx,
+                                        const Vector3f& cellCenterPos,
+                                        float scale)
+{
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        const Hyperplane<float, 3>& plane = ctx.frustumPlanes[i];
+        float r = scale * plane.normal().cwiseAbs().sum();
+        if (plane.signedDistance(cellCenterPos) < -r - ctx.tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+
+void StarCullingTable::cullNode(const CullingContext& ctx,
+                                const StarOctree& node,
+                                float scale,
+                                bool recurse,
+                                vector<VisibleStar>& visibleStars,
+                                OctreeProcStats* stats) const
+{
+#ifdef OCTREE_DEBUG
+    size_t h;
+    if (stats != nullptr)
+    {
+        h = stats->height + 1;
+        stats->nodes++;
+    }
+#endif
+    const Vector3f& cellCenterPos = node.getCellCenterPos();
+    if (!inFrustum(ctx, cellCenterPos, scale))
+        return;
+
+    float minDistance = (ctx.obsPosition - cellCenterPos).norm() - scale * NODE_RADIUS_FACTOR;
+    float dimmest     = minDistance > 0 ? astro::appToAbsMag(ctx.limitingMag, minDistance) : 1000;
+
+    uint32_t first = (uint32_t) (node.getFirstObject() - ctx.stars);
+    cullStars(ctx, first, node.getObjectCount(), dimmest, visibleStars);
+#ifdef OCTREE_DEBUG
+    if (stats != nullptr)
+        stats->objects += node.getObjectCount();
+#endif
+
+    if (!recurse || !node.hasChildren())
+        return;
+
+    if (minDistance <= 0 || astro::absToAppMag(node.getExclusionFactor(), minDistance) <= ctx.limitingMag)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            cullNode(ctx, *node.getChild(i), scale * 0.5f, true, visibleStars, stats);
+#ifdef OCTREE_DEBUG
+            if (stats != nullptr && stats->height > h)
+                h = stats->height;
+#endif
+        }
+#ifdef OCTREE_DEBUG
+        if (stats != nullptr)
+            stats->height = h;
+#endif
+    }
+}
+
+
+// Split the top of the octree into tasks: nodes above CULLING_SPLIT_DEPTH
+// get a task for their own stars, and each node at the split depth a task
+// for its whole subtree. Tasks are listed in the order in which
+// processVisibleObjects() would visit the nodes.
+void StarCullingTable::collectTasks(vector<CullingTask>& tasks,
+                                    const CullingContext& ctx,
+                                    const StarOctree& node,
+                                    float scale,
+                                    int depth,
+                                    int parent)
+{
+    const Vector3f& cellCenterPos = node.getCellCenterPos();
+    if (!inFrustum(ctx, cellCenterPos, scale))
+        return;
+
+    if (depth == CULLING_SPLIT_DEPTH || !node.hasChildren())
+    {
+        tasks.push_back({ &node, scale, true, parent });
+        return;
+    }
+
+    int index = (int) tasks.size();
+    tasks.push_back({ &node, scale, false, parent });
+
+    float minDistance = (ctx.obsPosition - cellCenterPos).norm() - scale * NODE_RADIUS_FACTOR - ctx.tolerance;
+    if (minDistance <= 0 || astro::absToAppMag(node.getExclusionFactor(), minDistance) <= ctx.limitingMag)
+    {
+        for (int i = 0; i < 8; ++i)
+            collectTasks(tasks, ctx, *node.getChild(i), scale * 0.5f, depth + 1, index);
+    }
+}
+
+
+void StarCullingTable::findVisibleStars(vector<VisibleStar>& visibleStars,
+                                        const StarOctree& root,
+                                        const Star* stars,
+                                        const Vector3f& obsPosition,
+                                        const Hyperplane<float, 3>* frustumPlanes,
+                                        float limitingMag,
+                                        float scale,
+                                        ThreadPool* pool,
+                                        OctreeProcStats* stats) const
+{
+    CullingContext ctx;
+    ctx.stars         = stars;
+    ctx.obsPosition   = obsPosition;
+    ctx.frustumPlanes = frustumPlanes;
+    ctx.limitingMag   = limitingMag;
+    ctx.limitingScale = (float) pow(10.0, 0.4 * limitingMag) * 1.001f;
+    ctx.tolerance     = 0.0f;
+
+    vector<CullingTask> tasks;
+    collectTasks(tasks, ctx, root, scale, 0, -1);
+
+    vector<vector<VisibleStar>> results(tasks.size());
+    vector<OctreeProcStats> taskStats(stats != nullptr ? tasks.size() : 0);
+    auto runTask = [&](size_t i)
+    {
+        const CullingTask& task = tasks[i];
+        cullNode(ctx, *task.node, task.scale, task.recurse, results[i],
+                 stats != nullptr ? &taskStats[i] : nullptr);
+    };
+
+    if (pool != nullptr)
+        pool->parallelFor(tasks.size(), runTask);
+    else
+        for (size_t i = 0; i < tasks.size(); i++)
+            runTask(i);
+
+    size_t total = 0;
+    for (const auto& result : results)
+        total += result.size();
+    visibleStars.reserve(visibleStars.size() + total);
+    for (const auto& result : results)
+        visibleStars.insert(visibleStars.end(), result.begin(), result.end());
+
+    if (stats != nullptr)
+    {
+        for (const auto& s : taskStats)
+        {
+            stats->nodes += s.nodes;
+            stats->objects += s.objects;
+            stats->height = max(stats->height, s.height);
+        }
+    }
+}
+
+
+// The cache variants of cullNode() and cullStars() widen every test by the
+// tolerance: the observer may get up to that much closer to a node or star.
+void StarCullingTable::cacheStars(const CullingContext& ctx,
+                                  uint32_t first,
+                                  uint32_t count,
+                                  vector<uint32_t>& candidates) const
+{
+    const float ox = ctx.obsPosition.x();
+    const float oy = ctx.obsPosition.y();
+    const float oz = ctx.obsPosition.z();
+
+    uint8_t candidate[CULLING_BLOCK_SIZE];
+
+    for (uint32_t block = 0; block < count; block += CULLING_BLOCK_SIZE)
+    {
+        const uint32_t base = first + block;
+        const uint32_t n = min(CULLING_BLOCK_SIZE, count - block);
+        const float* x = posX.data() + base;
+        const float* y = posY.data() + base;
+        const float* z = posZ.data() + base;
+        const float* d0 = zeroMagDistance2.data() + base;
+        const uint8_t* f = flags.data() + base;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            float dx = ox - x[i];
+            float dy = oy - y[i];
+            float dz = oz - z[i];
+            float d2 = dx * dx + dy * dy + dz * dz;
+            float reach = sqrt(d0[i] * ctx.limitingScale) + ctx.tolerance;
+            candidate[i] = (uint8_t) ((d2 < reach * reach) | (f[i] != 0));
+        }
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (candidate[i])
+                candidates.push_back(base + i);
+        }
+    }
+}
+
+
+void StarCullingTable::cacheNode(const CullingContext& ctx,
+                                 const StarOctree& node,
+                                 float scale,
+                                 bool recurse,
+                                 int32_t parent,
+                                 CacheFragment& fragment) const
+{
+    const Vector3f& cellCenterPos = node.getCellCenterPos();
+    if (!inFrustum(ctx, cellCenterPos, scale))
+        return;
+
+    int32_t index = (int32_t) fragment.nodes.size();
+    uint32_t firstCandidate = (uint32_t) fragment.candidates.size();
+    uint32_t first = (uint32_t) (node.getFirstObject() - ctx.stars);
+    cacheStars(ctx, first, node.getObjectCount(), fragment.candidates);
+    fragment.nodes.push_back({ &node, scale, parent, firstCandidate,
+                               (uint32_t) fragment.candidates.size() - firstCandidate });
+
+    if (!recurse || !node.hasChildren())
+        return;
+
+    float minDistance = (ctx.obsPosition - cellCenterPos).norm() - scale * NODE_RADIUS_FACTOR - ctx.tolerance;
+    if (minDistance <= 0 || astro::absToAppMag(node.getExclusionFactor(), minDistance) <= ctx.limitingMag)
+    {
+        for (int i = 0; i < 8; ++i)
+            cacheNode(ctx, *node.getChild(i), scale * 0.5f, true, index, fragment);
+    }
+}
+
+
+void StarCullingTable::buildCache(StarCullingCache& cache,
+                                  const StarOctree* const* roots,
+                                  unsigned int nRoots,
+                                  const Star* stars,
+                                  const Vector3f& obsPosition,
+                                  const Hyperplane<float, 3>* frustumPlanes,
+                                  float limitingMag,
+                                  float tolerance,
+                                  float scale,
+                                  ThreadPool* pool) const
+{
+    CullingContext ctx;
+    ctx.stars         = stars;
+    ctx.obsPosition   = obsPosition;
+    ctx.frustumPlanes = frustumPlanes;
+    ctx.limitingMag   = limitingMag;
+    ctx.limitingScale = (float) pow(10.0, 0.4 * limitingMag) * 1.001f;
+    ctx.tolerance     = tolerance;
+
+    vector<CullingTask> tasks;
+    for (unsigned int i = 0; i < nRoots; i++)
+    {
+        // Task parents are relative to the tasks of the same root
+        size_t firstTask = tasks.size();
+        collectTasks(tasks, ctx, *roots[i], scale, 0, -1);
+        for (size_t j = firstTask; j < tasks.size(); j++)
+        {
+            if (tasks[j].parent >= 0)
+                tasks[j].parent += (int) firstTask;
+        }
+    }
+
+    vector<CacheFragment> fragments(tasks.size());
+    auto runTask = [&](size_t i)
+    {
+        const CullingTask& task = tasks[i];
+        cacheNode(ctx, *task.node, task.scale, task.recurse, -1, fragments[i]);
+    };
+
+    if (pool != nullptr)
+        pool->parallelFor(tasks.size(), runTask);
+    else
+        for (size_t i = 0; i < tasks.size(); i++)
+            runTask(i);
+
+    // Concatenate the fragments in task order and link the root node of
+    // each fragment to the node of its parent task.
+    cache.nodes.clear();
+    cache.candidates.clear();
+    vector<int32_t> taskNode(tasks.size(), -1);
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        const CacheFragment& fragment = fragments[i];
+        int32_t nodeBase = (int32_t) cache.nodes.size();
+        uint32_t candidateBase = (uint32_t) cache.candidates.size();
+        int32_t parentNode = tasks[i].parent >= 0 ? taskNode[tasks[i].parent] : -1;
+        if (!fragment.nodes.empty())
+            taskNode[i] = nodeBase;
+
+        for (StarCullingCache::CachedNode cached : fragment.nodes)
+        {
+            cached.parent = cached.parent >= 0 ? cached.parent + nodeBase : parentNode;
+            cached.firstCandidate += candidateBase;
+            cache.nodes.push_back(cached);
+        }
+        cache.candidates.insert(cache.candidates.end(),
+                                fragment.candidates.begin(),
+                                fragment.candidates.end());
+    }
+
+    cache.table       = this;
+    cache.tableBuild  = buildNumber;
+    cache.center      = obsPosition;
+    for (unsigned int i = 0; i < 5; i++)
+        cache.frustumPlanes[i] = frustumPlanes[i];
+    cache.limitingMag = limitingMag;
+    cache.tolerance   = tolerance;
+    cache.hasLastResult = false;
+}
+
+
+void StarCullingTable::findCachedStars(vector<VisibleStar>& visibleStars,
+                                       StarCullingCache& cache,
+                                       const Vector3f& obsPosition,
+                                       const Hyperplane<float, 3>* frustumPlanes,
+                                       float limitingMag,
+                                       OctreeProcStats* stats) const
+{
+    bool unchanged = cache.hasLastResult &&
+                     cache.lastPosition == obsPosition &&
+                     cache.lastLimitingMag == limitingMag;
+    for (unsigned int i = 0; i < 5 && unchanged; i++)
+        unchanged = cache.lastFrustumPlanes[i].coeffs() == frustumPlanes[i].coeffs();
+
+    if (!unchanged)
+    {
+        CullingContext ctx;
+        ctx.stars         = nullptr;
+        ctx.obsPosition   = obsPosition;
+        ctx.frustumPlanes = frustumPlanes;
+        ctx.limitingMag   = limitingMag;
+        ctx.limitingScale = 0.0f;
+        ctx.tolerance     = 0.0f;
+
+        enum
+        {
+            VisitedNode = 0x1,
+            RecurseNode = 0x2,
+        };
+
+        // The cached nodes are stored in traversal order, so the state of
+        // a parent is always known before its children are reached.
+        vector<VisibleStar>& result = cache.lastResult;
+        result.clear();
+        cache.nodeState.resize(cache.nodes.size());
+        for (size_t i = 0; i < cache.nodes.size(); i++)
+        {
+            const StarCullingCache::CachedNode& cached = cache.nodes[i];
+            uint8_t state = 0;
+            if ((cached.parent < 0 || (cache.nodeState[cached.parent] & RecurseNode) != 0) &&
+                inFrustum(ctx, cached.node->getCellCenterPos(), cached.scale))
+            {
+                state = VisitedNode;
+
+                float minDistance = (obsPosition - cached.node->getCellCenterPos()).norm() - cached.scale * NODE_RADIUS_FACTOR;
+                float dimmest     = minDistance > 0 ? astro::appToAbsMag(limitingMag, minDistance) : 1000;
+
+                const uint32_t* candidates = cache.candidates.data() + cached.firstCandidate;
+                for (uint32_t j = 0; j < cached.nCandidates; j++)
+                {
+                    if (absMag[candidates[j]] < dimmest)
+                        testStar(ctx, candidates[j], result);
+                }
+
+                if (cached.node->hasChildren() &&
+                    (minDistance <= 0 || astro::absToAppMag(cached.node->getExclusionFactor(), minDistance) <= limitingMag))
+                {
+                    state |= RecurseNode;
+                }
+
+                if (stats != nullptr)
+                {
+                    stats->nodes++;
+                    stats->objects += cached.nCandidates;
+                }
+            }
+            cache.nodeState[i] = state;
+        }
+
+        cache.lastPosition = obsPosition;
+        cache.lastLimitingMag = limitingMag;
+        for (unsigned int i = 0; i < 5; i++)
+            cache.lastFrustumPlanes[i] = frustumPlanes[i];
+        cache.hasLastResult = true;
+    }
+
+    visibleStars.insert(visibleStars.end(), cache.lastResult.begin(), cache.lastResult.end());
+}
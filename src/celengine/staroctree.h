@@ -13,12 +13,163 @@
 #ifndef _CELENGINE_STAROCTREE_H_
 #define _CELENGINE_STAROCTREE_H_
 
+#include <cstdint>
+#include <vector>
 #include <celengine/star.h>
 #include <celengine/octree.h>
 
+class ThreadPool;
+
 
 typedef DynamicOctree  <Star, float> DynamicStarOctree;
 typedef StaticOctree   <Star, float> StarOctree;
 typedef OctreeProcessor<Star, float> StarHandler;
 
+
+struct VisibleStar
+{
+    uint32_t index;
+    float    distance;
+    float    appMag;
+};
+
+
+class StarCullingTable;
+
+// Result of a conservative culling pass which stays valid while the
+// observer remains within a small distance of the position it was built
+// at, looks into a slightly wider frustum, and doesn't raise the limiting
+// magnitude.  It holds the octree nodes that may be visited under those
+// conditions, and for each node the stars that may be visible.  Looking up
+// the visible stars in a valid cache only touches these candidates, and
+// gives the same stars as a full traversal inside the view frustum.
+class StarCullingCache
+{
+ public:
+    // Test whether the cache can be used for an observer at obsPosition
+    // looking along the four frustum edge directions frustumCorners.
+    bool covers(const StarCullingTable*  table,
+                const Eigen::Vector3f&   obsPosition,
+                const Eigen::Vector3f*   frustumCorners,
+                float                    limitingMag) const;
+
+ private:
+    struct CachedNode
+    {
+        const StarOctree* node;
+        float             scale;
+        // Index of the parent node in the cache, -1 for the octree roots
+        int32_t           parent;
+        uint32_t          firstCandidate;
+        uint32_t          nCandidates;
+    };
+
+    std::vector<CachedNode>    nodes;
+    std::vector<uint32_t>      candidates;
+    std::vector<uint8_t>       nodeState;
+
+    // Caches of a table which was built again, or of another table at the
+    // same address, are told apart by the build number.
+    const StarCullingTable*    table            { nullptr };
+    uint32_t                   tableBuild       { 0 };
+    Eigen::Vector3f            center;
+    Eigen::Hyperplane<float, 3> frustumPlanes[5];
+    float                      limitingMag      { 0.0f };
+    float                      tolerance        { 0.0f };
+
+    // Inputs and result of the last lookup, returned as is while the
+    // observer doesn't move at all.
+    std::vector<VisibleStar>   lastResult;
+    Eigen::Vector3f            lastPosition;
+    Eigen::Hyperplane<float, 3> lastFrustumPlanes[5];
+    float                      lastLimitingMag  { 0.0f };
+    bool                       hasLastResult    { false };
+
+    friend class StarCullingTable;
+};
+
+
+// A packed, structure of arrays copy of the star properties used for
+// culling, stored in the same order as the octree sorted star array. It
+// allows whole octree nodes to be tested without touching the Star objects,
+// and the traversal to be split into tasks run on a thread pool.
+class StarCullingTable
+{
+ public:
+    void build(const Star* stars, uint32_t nStars);
+    // Changes each time a table is built
+    uint32_t getBuildNumber() const { return buildNumber; }
+
+    // Find the stars visible from obsPosition, with the same culling rules
+    // as StarOctree::processVisibleObjects(). The top levels of the octree are
+    // split into tasks; the results of all tasks are appended to visibleStars
+    // in octree order, so the output doesn't depend on the thread count.
+    void findVisibleStars(std::vector<VisibleStar>&         visibleStars,
+                          const StarOctree&                 root,
+                          const Star*                       stars,
+                          const Eigen::Vector3f&            obsPosition,
+                          const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                          float                             limitingMag,
+                          float                             scale,
+                          ThreadPool*                       pool,
+                          OctreeProcStats*                  stats = nullptr) const;
+
+    // Fill cache with the nodes and stars which may be visible from any
+    // position within tolerance of obsPosition, looking into the frustum
+    // bounded by frustumPlanes, down to limitingMag.
+    void buildCache(StarCullingCache&                  cache,
+                    const StarOctree* const*           roots,
+                    unsigned int                       nRoots,
+                    const Star*                        stars,
+                    const Eigen::Vector3f&             obsPosition,
+                    const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                    float                              limitingMag,
+                    float                              tolerance,
+                    float                              scale,
+                    ThreadPool*                        pool) const;
+
+    // Same as findVisibleStars(), but only tests the nodes and stars held
+    // by a cache which covers the observer.
+    void findCachedStars(std::vector<VisibleStar>&          visibleStars,
+                         StarCullingCache&                  cache,
+                         const Eigen::Vector3f&             obsPosition,
+                         const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                         float                              limitingMag,
+                         OctreeProcStats*                   stats = nullptr) const;
+
+ private:
+    struct CullingTask;
+    struct CullingContext;
+    struct CacheFragment;
+
+    static bool inFrustum(const CullingContext&, const Eigen::Vector3f& cellCenterPos, float scale);
+    static void collectTasks(std::vector<CullingTask>&, const CullingContext&,
+                             const StarOctree& node, float scale, int depth, int parent);
+    void cullNode(const CullingContext&, const StarOctree& node, float scale,
+                  bool recurse, std::vector<VisibleStar>&, OctreeProcStats*) const;
+    void cullStars(const CullingContext&, uint32_t first, uint32_t count, float dimmest,
+                   std::vector<VisibleStar>&) const;
+    void testStar(const CullingContext&, uint32_t index, std::vector<VisibleStar>&) const;
+    void cacheNode(const CullingContext&, const StarOctree& node, float scale,
+                   bool recurse, int32_t parent, CacheFragment&) const;
+    void cacheStars(const CullingContext&, uint32_t first, uint32_t count,
+                    std::vector<uint32_t>&) const;
+
+    enum
+    {
+        HasOrbit      = 0x1,
+        HasExtinction = 0x2,
+    };
+
+    std::vector<float>   posX;
+    std::vector<float>   posY;
+    std::vector<float>   posZ;
+    std::vector<float>   absMag;
+    // Square of the distance at which the star has apparent magnitude 0
+    std::vector<float>   zeroMagDistance2;
+    std::vector<float>   extinction;
+    std::vector<uint8_t> flags;
+    uint32_t             buildNumber { 0 };
+};
+
 #endif  // _CELENGINE_STAROCTREE_H_
@@ -9,8 +9,10 @@
 
 #include <config.h>
 #include <celutil/debug.h>
+#include <celutil/filetype.h>
 #include <iostream>
 #include <fstream>
+#include "glsupport.h"
 #include "multitexture.h"
 #include "texmanager.h"
 
@@ -112,20 +114,32 @@ fs::path TextureInfo::resolve(const fs::path& baseDir)
 }
 
 
-Texture* TextureInfo::load(const fs::path& name)
+Texture::AddressMode TextureInfo::getAddressMode() const
 {
-    Texture::AddressMode addressMode = Texture::EdgeClamp;
-    Texture::MipMapMode mipMode = Texture::DefaultMipMaps;
-
     if (flags & WrapTexture)
-        addressMode = Texture::Wrap;
+        return Texture::Wrap;
     else if (flags & BorderClamp)
-        addressMode = Texture::BorderClamp;
+        return Texture::BorderClamp;
+    else
+        return Texture::EdgeClamp;
+}
+
 
+Texture::MipMapMode TextureInfo::getMipMapMode() const
+{
     if (flags & NoMipMaps)
-        mipMode = Texture::NoMipMaps;
+        return Texture::NoMipMaps;
     else if (flags & AutoMipMaps)
-        mipMode = Texture::AutoMipMaps;
+        return Texture::AutoMipMaps;
+    else
+        return Texture::DefaultMipMaps;
+}
+
+
+Texture* TextureInfo::load(const fs::path& name)
+{
+    Texture::AddressMode addressMode = getAddressMode();
+    Texture::MipMapMode mipMode = getMipMapMode();
 
     if (bumpHeight == 0.0f)
     {
@@ -140,3 +154,60 @@ Texture* TextureInfo::load(const fs::path& name)
 
     return LoadHeightMapFromFile(name, bumpHeight, addressMode);
 }
+
+
+// Decode the image file on a loader thread; only the creation of the
+// OpenGL texture is left to finish().
+bool TextureInfo::prepare(const fs::path& name)
+{
+    // Virtual textures just read a small description file and are
+    // entirely loaded by finish().
+    if (DetermineFileType(name) == Content_CelestiaTexture)
+        return true;
+
+    DPRINTF(LOG_LEVEL_ERROR, "Loading texture: %s\n", name);
+
+    Image* img = LoadImageFromFile(name);
+    if (img == nullptr)
+        return false;
+
+    if (bumpHeight != 0.0f)
+    {
+        Image* normalMap = img->computeNormalMap(bumpHeight,
+                                                 getAddressMode() == Texture::Wrap);
+        delete img;
+        if (normalMap == nullptr)
+            return false;
+        img = normalMap;
+    }
+
+    image.reset(img);
+    return true;
+}
+
+
+Texture* TextureInfo::finish(const fs::path& name)
+{
+    if (image == nullptr)
+        return load(name);
+
+    Texture* tex;
+    if (bumpHeight != 0.0f)
+    {
+        tex = CreateTextureFromImage(*image, getAddressMode(), Texture::DefaultMipMaps);
+    }
+    else
+    {
+        tex = CreateTextureFromImage(*image, getAddressMode(), getMipMapMode());
+        // See LoadTextureFromFile()
+        if (tex != nullptr &&
+            DetermineFileType(name) == Content_DXT5NormalMap &&
+            image->getFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        {
+            tex->setFormatOptions(Texture::DXT5NormalMap);
+        }
+    }
+
+    image.reset();
+    return tex;
+}
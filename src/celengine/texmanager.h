@@ -12,6 +12,7 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include <celutil/resmanager.h>
 #include <celengine/texture.h>
 #include "multitexture.h"
@@ -67,6 +68,19 @@ class TextureInfo : public ResourceInfo<Texture>
 
     fs::path resolve(const fs::path&) override;
     Texture* load(const fs::path&) override;
+    bool prepare(const fs::path&) override;
+    Texture* finish(const fs::path&) override;
+    size_t getMemoryUsage() const override
+    {
+        return resource != nullptr ? resource->getMemoryUsage() : 0;
+    }
+
+ private:
+    Texture::AddressMode getAddressMode() const;
+    Texture::MipMapMode getMipMapMode() const;
+
+    // Image decoded by prepare(), waiting to be turned into a texture
+    std::shared_ptr<Image> image;
 };
 
 inline bool operator<(const TextureInfo& ti0, const TextureInfo& ti1)
@@ -370,6 +370,17 @@ int Texture::getDepth() const
 }
 
 
+size_t Texture::getMemoryUsage() const
+{
+    // Assume four bytes per texel, or one for compressed textures, plus a
+    // third for the mipmaps.
+    size_t bytes = (size_t) width * height * depth;
+    if (!compressed)
+        bytes *= 4;
+    return bytes + bytes / 3;
+}
+
+
 unsigned int Texture::getFormatOptions() const
 {
     return formatOptions;
@@ -981,9 +992,9 @@ static bool isPow2(int x)
 }
 #endif
 
-static Texture* CreateTextureFromImage(Image& img,
-                                       Texture::AddressMode addressMode,
-                                       Texture::MipMapMode mipMode)
+Texture* CreateTextureFromImage(Image& img,
+                                Texture::AddressMode addressMode,
+                                Texture::MipMapMode mipMode)
 {
 #if 0
     // Require texture dimensions to be powers of two.  Even though the
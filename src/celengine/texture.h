@@ -70,6 +70,9 @@ class Texture
     int getHeight() const;
     int getDepth() const;
 
+    // Approximate amount of texture memory used, in bytes
+    virtual size_t getMemoryUsage() const;
+
     bool hasAlpha() const { return alpha; }
     bool isCompressed() const { return compressed; }
 
@@ -180,6 +183,12 @@ extern Texture* CreateProceduralTexture(int width, int height,
 extern Texture* CreateProceduralCubeMap(int size, int format,
                                         ProceduralTexEval func);
 
+// Create a texture from an image loaded ahead of time, possibly by another
+// thread. Must be called from the thread owning the OpenGL context.
+extern Texture* CreateTextureFromImage(Image& img,
+                                       Texture::AddressMode addressMode = Texture::EdgeClamp,
+                                       Texture::MipMapMode mipMode = Texture::DefaultMipMaps);
+
 extern Texture* LoadTextureFromFile(const fs::path& filename,
                                     Texture::AddressMode addressMode = Texture::EdgeClamp,
                                     Texture::MipMapMode mipMode = Texture::DefaultMipMaps);
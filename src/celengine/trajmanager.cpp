@@ -101,3 +101,18 @@ Orbit* TrajectoryInfo::load(const fs::path& filename)
 
     return sampTrajectory;
 }
+
+
+// Loading a trajectory doesn't involve OpenGL, so the whole work is done on the
+// loader thread.
+bool TrajectoryInfo::prepare(const fs::path& name)
+{
+    resource = load(name);
+    return resource != nullptr;
+}
+
+
+Orbit* TrajectoryInfo::finish(const fs::path& /*unused*/)
+{
+    return resource;
+}
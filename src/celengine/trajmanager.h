@@ -33,6 +33,8 @@ class TrajectoryInfo : public ResourceInfo<Orbit>
 
     fs::path resolve(const fs::path&) override;
     Orbit* load(const fs::path&) override;
+    bool prepare(const fs::path&) override;
+    Orbit* finish(const fs::path&) override;
 };
 
 // Sort trajectory info records. The same trajectory can be loaded multiple times with
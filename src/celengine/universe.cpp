@@ -20,6 +20,7 @@
 #include "frametree.h"
 #include <celmath/mathlib.h>
 #include <celmath/intersect.h>
+#include <celutil/prefixindex.h>
 #include <celutil/utf8.h>
 #include <cassert>
 
@@ -225,6 +226,7 @@ public:
     ClosestStarFinder(float _maxDistance, const Universe* _universe);
     ~ClosestStarFinder() = default;
     void process(const Star& star, float distance, float appMag);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 public:
     float maxDistance;
@@ -256,6 +258,15 @@ void ClosestStarFinder::process(const Star& star, float distance, float /*unused
     }
 }
 
+void ClosestStarFinder::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (candidates[i].distance < closestDistance)
+            ClosestStarFinder::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+    }
+}
+
 
 class NearStarFinder : public StarHandler
 {
@@ -263,6 +274,7 @@ public:
     NearStarFinder(float _maxDistance, vector<const Star*>& nearStars);
     ~NearStarFinder() = default;
     void process(const Star& star, float distance, float appMag);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 private:
     float maxDistance;
@@ -282,6 +294,15 @@ void NearStarFinder::process(const Star& star, float distance, float /*unused*/)
         nearStars.push_back(&star);
 }
 
+void NearStarFinder::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (candidates[i].distance < maxDistance)
+            nearStars.push_back(candidates[i].obj);
+    }
+}
+
 
 
 struct PlanetPickInfo
@@ -517,6 +538,7 @@ public:
     ~StarPicker() = default;
 
     void process(const Star& /*star*/, float /*unused*/, float /*unused*/);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 public:
     const Star* pickedStar;
@@ -577,6 +599,12 @@ void StarPicker::process(const Star& star, float /*unused*/, float /*unused*/)
     }
 }
 
+void StarPicker::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        StarPicker::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+}
+
 
 class CloseStarPicker : public StarHandler
 {
@@ -588,6 +616,7 @@ public:
                     float angle);
     ~CloseStarPicker() = default;
     void process(const Star& star, float lowPrecDistance, float appMag);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 public:
     UniversalCoord pickOrigin;
@@ -661,6 +690,15 @@ void CloseStarPicker::process(const Star& star,
     }
 }
 
+void CloseStarPicker::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (candidates[i].distance <= maxDistance)
+            CloseStarPicker::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+    }
+}
+
 
 Selection Universe::pickStar(const UniversalCoord& origin,
                              const Vector3f& direction,
@@ -707,6 +745,7 @@ public:
     ~DSOPicker() = default;
 
     void process(DeepSkyObject* const &, double, float);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 public:
     Vector3d pickOrigin;
@@ -758,6 +797,12 @@ void DSOPicker::process(DeepSkyObject* const & dso, double /*unused*/, float /*u
     }
 }
 
+void DSOPicker::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        DSOPicker::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+}
+
 
 class CloseDSOPicker : public DSOHandler
 {
@@ -770,6 +815,7 @@ public:
     ~CloseDSOPicker() = default;
 
     void process(DeepSkyObject* const & dso, double distance, float appMag);
+    void processBatch(const Candidate* candidates, size_t count) override;
 
 public:
     Vector3d  pickOrigin;
@@ -818,6 +864,15 @@ void CloseDSOPicker::process(DeepSkyObject* const & dso,
     }
 }
 
+void CloseDSOPicker::processBatch(const Candidate* candidates, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (candidates[i].distance <= maxDistance)
+            CloseDSOPicker::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+    }
+}
+
 
 Selection Universe::pickDeepSkyObject(const UniversalCoord& origin,
                                       const Vector3f& direction,
@@ -1082,9 +1137,10 @@ Selection Universe::findPath(const string& s,
 
 
 vector<string> Universe::getCompletion(const string& s,
-                                                 Selection* contexts,
-                                                 int nContexts,
-                                                 bool withLocations)
+                                       Selection* contexts,
+                                       int nContexts,
+                                       bool withLocations,
+                                       size_t maxResults)
 {
     vector<string> completion;
     int s_length = UTF8Length(s);
@@ -1121,17 +1177,21 @@ vector<string> Universe::getCompletion(const string& s,
     // Deep sky objects:
     if (dsoCatalog != nullptr)
     {
-        vector<string> dsos  = dsoCatalog->getCompletion(s);
+        vector<string> dsos  = dsoCatalog->getCompletion(s, maxResults);
         completion.insert(completion.end(), dsos.begin(), dsos.end());
     }
 
     // and finally stars;
     if (starCatalog != nullptr)
     {
-        vector<string> stars  = starCatalog->getCompletion(s);
+        vector<string> stars  = starCatalog->getCompletion(s, maxResults);
         completion.insert(completion.end(), stars.begin(), stars.end());
     }
 
+    // Each catalog returned its best matches, keep the best of them all
+    if (maxResults != 0)
+        RankCompletion(completion, maxResults);
+
     return completion;
 }
 
@@ -1139,14 +1199,15 @@ vector<string> Universe::getCompletion(const string& s,
 vector<string> Universe::getCompletionPath(const string& s,
                                            Selection* contexts,
                                            int nContexts,
-                                           bool withLocations)
+                                           bool withLocations,
+                                           size_t maxResults)
 {
     vector<string> completion;
     vector<string> locationCompletion;
     string::size_type pos = s.rfind('/', s.length());
 
     if (pos == string::npos)
-        return getCompletion(s, contexts, nContexts, withLocations);
+        return getCompletion(s, contexts, nContexts, withLocations, maxResults);
 
     string base(s, 0, pos);
     Selection sel = findPath(base, contexts, nContexts, true);
@@ -1192,6 +1253,9 @@ vector<string> Universe::getCompletionPath(const string& s,
 
     completion.insert(completion.end(), locationCompletion.begin(), locationCompletion.end());
 
+    if (maxResults != 0)
+        RankCompletion(completion, maxResults);
+
     return completion;
 }
 
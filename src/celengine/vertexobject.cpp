@@ -123,6 +123,15 @@ void VertexObject::draw(GLenum primitive, GLsizei count, GLint first) noexcept
     glDrawArrays(primitive, first, count);
 }
 
+// The index buffer must be bound to GL_ELEMENT_ARRAY_BUFFER by the caller
+void VertexObject::drawElements(GLenum primitive, GLsizei count, GLenum indexType, GLsizeiptr offset) noexcept
+{
+    if ((m_state & State::Initialize) != 0)
+        enableAttribArrays(m_currentAttributes);
+
+    glDrawElements(primitive, count, indexType, (GLvoid*) offset);
+}
+
 void VertexObject::enableAttribArrays(AttributesType attributes) noexcept
 {
     glBindBuffer(m_bufferType, m_vboId);
@@ -42,6 +42,7 @@ class VertexObject
     void bindWritable(AttributesType attributes = AttributesType::Default) noexcept;
     void unbind() noexcept;
     void draw(GLenum primitive, GLsizei count, GLint first = 0) noexcept;
+    void drawElements(GLenum primitive, GLsizei count, GLenum indexType, GLsizeiptr offset = 0) noexcept;
     bool allocate(const void* data = nullptr) noexcept;
     bool allocate(GLsizeiptr bufferSize, const void* data = nullptr) noexcept;
     bool allocate(GLenum bufferType, GLsizeiptr bufferSize, const void* data, GLenum streamType) noexcept;
@@ -14,11 +14,13 @@
 #include <fstream>
 #include <string>
 #include <utility>
+#include <algorithm>
 #include <celutil/debug.h>
 #include "glsupport.h"
 #include <celutil/debug.h>
 #include <celcompat/filesystem.h>
 #include <celutil/filetype.h>
+#include <celutil/threadpool.h>
 #include "parser.h"
 #include "tokenizer.h"
 #include "virtualtex.h"
@@ -27,12 +29,35 @@
 using namespace std;
 
 static const int MaxResolutionLevels = 13;
+static const int MaxTreeDepth = 32;
+
+// Default limit on the memory used by the resident tiles of a virtual
+// texture, when not given by its MaxResidentTiles parameter
+static const size_t DefaultTileCacheSize = 128 << 20;
+static const unsigned int MinResidentTiles = 64;
+
+// Number of decoded tiles turned into textures at each usage, to bound
+// the time spent uploading them in a frame
+static const unsigned int MaxTileUploadsPerUsage = 4;
+static const size_t MaxPendingPrefetches = 64;
+
+// Requests not renewed for this many usages are cancelled
+static const unsigned int StaleRequestAge = 30;
+
+// Number of usages ahead for which tiles are prefetched along the motion
+static const float PrefetchHorizon = 30.0f;
 
 
 // Virtual textures are composed of tiles that are loaded from the hard drive
 // as they become visible.  Hidden tiles may be evicted from graphics memory
 // to make room for other tiles when they become visible.
 //
+// Tiles are decoded by the resource loader threads and turned into textures
+// a few at a time at the start of each usage; until a tile is resident, the
+// most detailed resident tile above it in the quadtree is drawn instead.
+// Only a limited number of tiles stays resident, the least recently used
+// ones being unloaded first.
+//
 // The virtual texture consists of one or more levels of detail.  Each level
 // of detail is twice as wide and twice as high as the previous one, therefore
 // having four times as many tiles.  The height and width of each LOD must be
@@ -60,14 +85,16 @@ VirtualTexture::VirtualTexture(const fs::path& _tilePath,
                                unsigned int _baseSplit,
                                unsigned int _tileSize,
                                const string& _tilePrefix,
-                               const string& _tileType) :
+                               const string& _tileType,
+                               unsigned int _maxResidentTiles) :
     Texture(_tileSize << (_baseSplit + 1), _tileSize << _baseSplit),
     tilePath(_tilePath),
     tilePrefix(_tilePrefix),
     baseSplit(_baseSplit),
     tileSize(_tileSize),
     ticks(0),
-    nResolutionLevels(0)
+    nResolutionLevels(0),
+    maxResidentTiles(_maxResidentTiles)
 {
     assert(tileSize != 0 && isPow2(tileSize));
     tileTree[0] = new TileQuadtreeNode();
@@ -75,11 +102,35 @@ VirtualTexture::VirtualTexture(const fs::path& _tilePath,
     tileExt = fmt::sprintf(".%s", _tileType);
     populateTileTree();
 
+    if (maxResidentTiles == 0)
+    {
+        size_t tileBytes = (size_t) tileSize * tileSize * 4;
+        maxResidentTiles = max((unsigned int) (DefaultTileCacheSize / tileBytes),
+                               MinResidentTiles);
+    }
+
     if (DetermineFileType(tileExt) == Content_DXT5NormalMap)
         setFormatOptions(Texture::DXT5NormalMap);
 }
 
 
+VirtualTexture::~VirtualTexture()
+{
+    {
+        // Wait for the loader threads to let go of the tiles
+        unique_lock<std::mutex> lock(mutex);
+        tileRequests.clear();
+        jobsDone.wait(lock, [this] { return activeJobs == 0; });
+    }
+
+    for (const auto& decoded : decodedTiles)
+        delete decoded.image;
+
+    deleteTileTree(tileTree[0]);
+    deleteTileTree(tileTree[1]);
+}
+
+
 const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 {
     tilesRequested++;
@@ -89,16 +140,21 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 
     lod += baseSplit;
 
-    if (lod < 0 || (unsigned int) lod >= nResolutionLevels ||
+    if (lod < 0 || (unsigned int) lod >= nResolutionLevels || lod >= MaxTreeDepth ||
         u < 0 || u >= (2 << lod) ||
         v < 0 || v >= (1 << lod))
     {
         return TextureTile(0);
     }
 
+    // Collect the tiles from the root down to the most detailed one
+    // covering the requested area.
+    Tile* pathTiles[MaxTreeDepth];
+    unsigned int nTiles = 0;
+
     TileQuadtreeNode* node = tileTree[u >> lod];
-    Tile* tile = node->tile;
-    unsigned int tileLOD = 0;
+    if (node->tile != nullptr)
+        pathTiles[nTiles++] = node->tile;
 
     for (int n = 0; n < lod; n++)
     {
@@ -110,28 +166,54 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 
         node = node->children[child];
         if (node->tile != nullptr)
-        {
-            tile = node->tile;
-            tileLOD = n + 1;
-        }
+            pathTiles[nTiles++] = node->tile;
     }
 
     // No tile was found at all--not even the base texture was found
-    if (!tile)
+    if (nTiles == 0)
         return TextureTile(0);
 
-    // Make the tile resident.
-    unsigned int tileU = u >> (lod - tileLOD);
-    unsigned int tileV = v >> (lod - tileLOD);
-    makeResident(tile, tileLOD, tileU, tileV);
+    Tile* wanted = pathTiles[nTiles - 1];
+    if (wanted->lastRequested != ticks)
+    {
+        wanted->lastRequested = ticks;
+        usedTiles.push_back(wanted);
+    }
+
+    requestTile(wanted, false);
+    if (nTiles > 1)
+        requestTile(pathTiles[nTiles - 2], true);
+
+    // While the wanted tile is pending, fall back to the most detailed
+    // resident tile above it.
+    Tile* tile = nullptr;
+    for (unsigned int i = nTiles; i-- > 0; )
+    {
+        if (pathTiles[i]->state == TileResident)
+        {
+            tile = pathTiles[i];
+            break;
+        }
+    }
+
+    // With nothing to fall back on, load the coarsest tile right away so
+    // that the surface is never drawn untextured.
+    for (unsigned int i = 0; tile == nullptr && i < nTiles; i++)
+    {
+        makeResident(pathTiles[i]);
+        if (pathTiles[i]->state == TileResident)
+            tile = pathTiles[i];
+    }
 
     // It's possible that we failed to make the tile resident, either
     // because the texture file was bad, or there was an unresolvable
     // out of memory situation.  In that case there is nothing else to
     // do but return a texture tile with a null texture name.
-    if (!tile->tex)
+    if (tile == nullptr)
         return TextureTile(0);
 
+    tile->lastUsed = ticks;
+
     // Set up the texture subrect to be the entire texture
     float texU = 0.0f;
     float texV = 0.0f;
@@ -140,7 +222,7 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 
     // If the tile came from a lower LOD than the requested one,
     // we'll only use a subsection of it.
-    unsigned int lodDiff = lod - tileLOD;
+    unsigned int lodDiff = lod - tile->lod;
     texDU = texDV = 1.0f / (float) (1 << lodDiff);
     texU = (u & ((1 << lodDiff) - 1)) * texDU;
     texV = (v & ((1 << lodDiff) - 1)) * texDV;
@@ -160,6 +242,14 @@ void VirtualTexture::bind()
 }
 
 
+// The tiles are paged in and out by the virtual texture itself, within
+// its own limit; their memory isn't accounted for by the texture manager.
+size_t VirtualTexture::getMemoryUsage() const
+{
+    return 0;
+}
+
+
 int VirtualTexture::getLODCount() const
 {
     return nResolutionLevels - baseSplit;
@@ -180,8 +270,14 @@ int VirtualTexture::getVTileCount(int lod) const
 
 void VirtualTexture::beginUsage()
 {
+    prefetchTiles();
+
     ticks++;
     tilesRequested = 0;
+
+    cancelStaleRequests();
+    uploadDecodedTiles();
+    evictTiles();
 }
 
 
@@ -200,24 +296,27 @@ unsigned int VirtualTexture::tileIndex(unsigned int lod,
 #endif
 
 
-ImageTexture* VirtualTexture::loadTileTexture(unsigned int lod, unsigned int u, unsigned int v)
+// Called from the loader threads
+Image* VirtualTexture::loadTileImage(const Tile* tile) const
 {
-    lod >>= baseSplit;
-    assert(lod < (unsigned)MaxResolutionLevels);
+    unsigned int level = tile->lod - baseSplit;
+    assert(level < (unsigned)MaxResolutionLevels);
 
     auto path = tilePath /
-                fmt::sprintf("level%d", lod) /
-                fmt::sprintf("%s%d_%d%s", tilePrefix, u, v, tileExt.string());
+                fmt::sprintf("level%d", level) /
+                fmt::sprintf("%s%d_%d%s", tilePrefix, tile->u, tile->v, tileExt.string());
+
+    return LoadImageFromFile(path);
+}
 
-    Image* img = LoadImageFromFile(path);
-    if (img == nullptr)
-        return nullptr;
 
+ImageTexture* VirtualTexture::createTileTexture(const Tile* tile, Image* img)
+{
     ImageTexture* tex = nullptr;
 
     // Only use mip maps for the LOD 0; for higher LODs, the function of mip
     // mapping is built into the texture.
-    MipMapMode mipMapMode = lod == 0 ? DefaultMipMaps : NoMipMaps;
+    MipMapMode mipMapMode = tile->lod == baseSplit ? DefaultMipMaps : NoMipMaps;
 
     if (isPow2(img->getWidth()) && isPow2(img->getHeight()))
         tex = new ImageTexture(*img, EdgeClamp, mipMapMode);
@@ -227,24 +326,284 @@ ImageTexture* VirtualTexture::loadTileTexture(unsigned int lod, unsigned int u,
     // sense for them.
     compressed = img->isCompressed();
 
-    delete img;
-
     return tex;
 }
 
 
-void VirtualTexture::makeResident(Tile* tile, unsigned int lod, unsigned int u, unsigned int v)
+void VirtualTexture::makeResident(Tile* tile)
+{
+    if (tile->state == TileResident || tile->state == TileLoadFailed)
+        return;
+
+    // Loaded synchronously, so a queued request for the tile is no longer
+    // needed; one already being decoded is dropped when its image arrives.
+    if (tile->state == TileLoading)
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto iter = find_if(tileRequests.begin(), tileRequests.end(),
+                            [tile](const TileRequest& r) { return r.tile == tile; });
+        if (iter != tileRequests.end())
+            tileRequests.erase(iter);
+    }
+
+    Image* img = loadTileImage(tile);
+    if (img != nullptr)
+    {
+        tile->tex = createTileTexture(tile, img);
+        delete img;
+    }
+
+    if (tile->tex != nullptr)
+    {
+        tile->state = TileResident;
+        tile->lastUsed = ticks;
+        residentTiles.push_back(tile);
+    }
+    else
+    {
+        // cout << "Texture load failed!\n";
+        tile->state = TileLoadFailed;
+    }
+}
+
+
+void VirtualTexture::makeNonResident(Tile* tile)
+{
+    delete tile->tex;
+    tile->tex = nullptr;
+    tile->state = TileNotLoaded;
+}
+
+
+void VirtualTexture::requestTile(Tile* tile, bool prefetch)
 {
-    if (tile->tex == nullptr && !tile->loadFailed)
+    if (tile->state == TileResident || tile->state == TileLoadFailed)
+        return;
+
     {
-        // Potentially evict other tiles in order to make this one fit
-        tile->tex = loadTileTexture(lod, u, v);
-        if (tile->tex == nullptr)
+        lock_guard<std::mutex> lock(mutex);
+        if (tile->state == TileLoading)
         {
-            // cout << "Texture load failed!\n";
-            tile->loadFailed = true;
+            // Already queued: just refresh the request
+            for (auto& request : tileRequests)
+            {
+                if (request.tile == tile)
+                {
+                    request.tick = ticks;
+                    request.prefetch = request.prefetch && prefetch;
+                }
+            }
+            return;
         }
+
+        if (prefetch && tileRequests.size() >= MaxPendingPrefetches)
+            return;
+
+        tile->state = TileLoading;
+        tileRequests.push_back({ tile, ticks, prefetch });
+        activeJobs++;
     }
+
+    GetResourceLoaderPool()->post([this] { decodeNextTile(); });
+}
+
+
+// Run by the loader threads; there's one job posted for each request,
+// though the jobs don't necessarily process the request that posted them.
+void VirtualTexture::decodeNextTile()
+{
+    Tile* tile = nullptr;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto best = tileRequests.end();
+        for (auto iter = tileRequests.begin(); iter != tileRequests.end(); ++iter)
+        {
+            if (best == tileRequests.end() ||
+                iter->tick > best->tick ||
+                (iter->tick == best->tick && !iter->prefetch && best->prefetch) ||
+                (iter->tick == best->tick && iter->prefetch == best->prefetch &&
+                 iter->tile->lod < best->tile->lod))
+            {
+                best = iter;
+            }
+        }
+
+        if (best != tileRequests.end())
+        {
+            tile = best->tile;
+            tileRequests.erase(best);
+        }
+    }
+
+    Image* img = tile != nullptr ? loadTileImage(tile) : nullptr;
+
+    lock_guard<std::mutex> lock(mutex);
+    if (tile != nullptr)
+        decodedTiles.push_back({ tile, img });
+    activeJobs--;
+    jobsDone.notify_all();
+}
+
+
+void VirtualTexture::uploadDecodedTiles()
+{
+    vector<DecodedTile> decoded;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        size_t nTiles = min(decodedTiles.size(), (size_t) MaxTileUploadsPerUsage);
+        decoded.assign(decodedTiles.begin(), decodedTiles.begin() + nTiles);
+        decodedTiles.erase(decodedTiles.begin(), decodedTiles.begin() + nTiles);
+    }
+
+    for (const auto& d : decoded)
+    {
+        Tile* tile = d.tile;
+        // The tile may have been loaded synchronously or its request
+        // cancelled in the meantime.
+        if (tile->state == TileLoading)
+        {
+            if (d.image != nullptr)
+                tile->tex = createTileTexture(tile, d.image);
+
+            if (tile->tex != nullptr)
+            {
+                tile->state = TileResident;
+                tile->lastUsed = ticks;
+                residentTiles.push_back(tile);
+            }
+            else
+            {
+                tile->state = TileLoadFailed;
+            }
+        }
+        delete d.image;
+    }
+}
+
+
+// Drop the requests for tiles that haven't been wanted for a while, as
+// the camera has moved on.
+void VirtualTexture::cancelStaleRequests()
+{
+    lock_guard<std::mutex> lock(mutex);
+    auto iter = tileRequests.begin();
+    while (iter != tileRequests.end())
+    {
+        if (ticks - iter->tick > StaleRequestAge)
+        {
+            if (iter->tile->state == TileLoading)
+                iter->tile->state = TileNotLoaded;
+            iter = tileRequests.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+
+// Unload the least recently used tiles when over the limit. Tiles used
+// in the last usage are kept even then, as are those of the coarsest
+// level, which serve as the fallback for every other tile.
+void VirtualTexture::evictTiles()
+{
+    if (residentTiles.size() <= maxResidentTiles)
+        return;
+
+    sort(residentTiles.begin(), residentTiles.end(),
+         [](const Tile* a, const Tile* b) { return a->lastUsed < b->lastUsed; });
+
+    size_t nEvictable = residentTiles.size() - maxResidentTiles;
+    vector<Tile*> kept;
+    kept.reserve(residentTiles.size());
+    for (Tile* tile : residentTiles)
+    {
+        if (nEvictable > 0 && tile->lod > baseSplit && ticks - tile->lastUsed > 1)
+        {
+            makeNonResident(tile);
+            nEvictable--;
+        }
+        else
+        {
+            kept.push_back(tile);
+        }
+    }
+    residentTiles.swap(kept);
+}
+
+
+// Estimate the motion of the viewed area from the tiles used in the last
+// two usages, and queue the neighbours of the used tiles that are coming
+// into view.
+void VirtualTexture::prefetchTiles()
+{
+    if (usedTiles.empty())
+    {
+        hasPreviousCenter = false;
+        return;
+    }
+
+    Eigen::Vector2f center = Eigen::Vector2f::Zero();
+    for (const Tile* tile : usedTiles)
+    {
+        center += Eigen::Vector2f(((float) tile->u + 0.5f) / (float) (2 << tile->lod),
+                                  ((float) tile->v + 0.5f) / (float) (1 << tile->lod));
+    }
+    center /= (float) usedTiles.size();
+
+    Eigen::Vector2f motion = center - previousCenter;
+    bool moving = hasPreviousCenter;
+    previousCenter = center;
+    hasPreviousCenter = true;
+
+    if (moving)
+    {
+        // Wrap around in longitude
+        if (motion.x() > 0.5f)
+            motion.x() -= 1.0f;
+        else if (motion.x() < -0.5f)
+            motion.x() += 1.0f;
+
+        for (Tile* tile : usedTiles)
+        {
+            // Motion over the prefetch horizon, in tiles of this level
+            float du = motion.x() * (float) (2 << tile->lod) * PrefetchHorizon;
+            float dv = motion.y() * (float) (1 << tile->lod) * PrefetchHorizon;
+            int stepU = du >= 0.5f ? 1 : (du <= -0.5f ? -1 : 0);
+            int stepV = dv >= 0.5f ? 1 : (dv <= -0.5f ? -1 : 0);
+            if (stepU == 0 && stepV == 0)
+                continue;
+
+            unsigned int uTiles = 2 << tile->lod;
+            unsigned int u = (tile->u + uTiles + stepU) % uTiles;
+            int v = (int) tile->v + stepV;
+            if (v < 0 || v >= (1 << tile->lod))
+                v = tile->v;
+
+            Tile* neighbour = findTile(tile->lod, u, (unsigned int) v);
+            if (neighbour != nullptr && neighbour->lastRequested != ticks)
+                requestTile(neighbour, true);
+        }
+    }
+
+    usedTiles.clear();
+}
+
+
+VirtualTexture::Tile* VirtualTexture::findTile(unsigned int lod,
+                                               unsigned int u, unsigned int v)
+{
+    TileQuadtreeNode* node = tileTree[u >> lod];
+
+    for (unsigned int i = 0; i < lod && node != nullptr; i++)
+    {
+        unsigned int mask = 1 << (lod - i - 1);
+        unsigned int child = (((v & mask) << 1) | (u & mask)) >> (lod - i - 1);
+        node = node->children[child];
+    }
+
+    return node != nullptr ? node->tile : nullptr;
 }
 
 
@@ -276,7 +635,7 @@ void VirtualTexture::populateTileTree()
                     if (u >= 0 && v >= 0 && u < uLimit && v < vLimit)
                     {
                         // Found a tile, so add it to the quadtree
-                        Tile* tile = new Tile();
+                        Tile* tile = new Tile(maxLevel, (unsigned int) u, (unsigned int) v);
                         addTileToTree(tile, maxLevel, (unsigned int) u, (unsigned int) v);
                     }
                 }
@@ -307,6 +666,25 @@ void VirtualTexture::addTileToTree(Tile* tile, unsigned int lod, unsigned int u,
     // Verify that the tile doesn't already exist
     if (!node->tile)
         node->tile = tile;
+    else
+        delete tile;
+}
+
+
+void VirtualTexture::deleteTileTree(TileQuadtreeNode* node)
+{
+    if (node == nullptr)
+        return;
+
+    for (auto child : node->children)
+        deleteTileTree(child);
+
+    if (node->tile != nullptr)
+    {
+        delete node->tile->tex;
+        delete node->tile;
+    }
+    delete node;
 }
 
 
@@ -349,6 +727,10 @@ static VirtualTexture* CreateVirtualTexture(Hash* texParams,
     string tilePrefix = "tx_";
     texParams->getString("TilePrefix", tilePrefix);
 
+    // Zero selects a limit based on the tile size
+    double maxResidentTiles = 0.0;
+    texParams->getNumber("MaxResidentTiles", maxResidentTiles);
+
     // if absolute directory notation for ImageDirectory used,
     // don't prepend the current add-on path.
     fs::path directory(imageDirectory);
@@ -359,7 +741,8 @@ static VirtualTexture* CreateVirtualTexture(Hash* texParams,
                               (unsigned int) baseSplit,
                               (unsigned int) tileSize,
                               tilePrefix,
-                              tileType);
+                              tileType,
+                              (unsigned int) max(maxResidentTiles, 0.0));
 }
 
 
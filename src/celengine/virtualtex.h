@@ -10,7 +10,11 @@
 #ifndef _CELENGINE_VIRTUALTEX_H_
 #define _CELENGINE_VIRTUALTEX_H_
 
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <vector>
+#include <Eigen/Core>
 #include <celengine/texture.h>
 
 
@@ -21,8 +25,9 @@ class VirtualTexture : public Texture
                    unsigned int _baseSplit,
                    unsigned int _tileSize,
                    const std::string& _tilePrefix,
-                   const std::string& _tileType);
-    ~VirtualTexture() = default;
+                   const std::string& _tileType,
+                   unsigned int _maxResidentTiles = 0);
+    ~VirtualTexture();
 
     const TextureTile getTile(int lod, int u, int v) override;
     void bind() override;
@@ -32,14 +37,30 @@ class VirtualTexture : public Texture
     int getVTileCount(int lod) const override;
     void beginUsage() override;
     void endUsage() override;
+    size_t getMemoryUsage() const override;
+
+    unsigned int getResidentTileCount() const { return (unsigned int) residentTiles.size(); }
 
  private:
+    enum TileState
+    {
+        TileNotLoaded,
+        TileLoading,
+        TileResident,
+        TileLoadFailed,
+    };
+
     struct Tile
     {
-        Tile() = default;
+        Tile(unsigned int _lod, unsigned int _u, unsigned int _v) :
+            lod(_lod), u(_u), v(_v) {};
+        unsigned int lod;
+        unsigned int u;
+        unsigned int v;
         unsigned int lastUsed{ 0 };
+        unsigned int lastRequested{ 0 };
         ImageTexture* tex{ nullptr };
-        bool loadFailed{ false };
+        TileState state{ TileNotLoaded };
     };
 
     struct TileQuadtreeNode
@@ -49,12 +70,37 @@ class VirtualTexture : public Texture
         TileQuadtreeNode* children[4]{ nullptr, nullptr, nullptr, nullptr};
     };
 
+    // A tile waiting to be decoded by the loader threads. Tiles needed
+    // for the most recent frame are decoded first, then the prefetched
+    // ones, coarsest tiles first since they serve as fallbacks.
+    struct TileRequest
+    {
+        Tile* tile;
+        unsigned int tick;
+        bool prefetch;
+    };
+
+    struct DecodedTile
+    {
+        Tile* tile;
+        Image* image;
+    };
+
     void populateTileTree();
     void addTileToTree(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
-    void makeResident(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
-    ImageTexture* loadTileTexture(unsigned int lod, unsigned int u, unsigned int v);
+    void deleteTileTree(TileQuadtreeNode* node);
+    void makeResident(Tile* tile);
+    void makeNonResident(Tile* tile);
+    Image* loadTileImage(const Tile* tile) const;
+    ImageTexture* createTileTexture(const Tile* tile, Image* img);
+
+    void requestTile(Tile* tile, bool prefetch);
+    void decodeNextTile();
+    void uploadDecodedTiles();
+    void cancelStaleRequests();
+    void evictTiles();
+    void prefetchTiles();
 
-    Tile* tiles{ nullptr };
     Tile* findTile(unsigned int lod,
                    unsigned int u, unsigned int v);
 
@@ -67,14 +113,24 @@ class VirtualTexture : public Texture
     unsigned int ticks{ 0 };
     unsigned int tilesRequested{ 0 };
     unsigned int nResolutionLevels{ 0 };
-
-    enum
-    {
-        TileNotLoaded  = -1,
-        TileLoadFailed = -2,
-    };
+    unsigned int maxResidentTiles{ 0 };
 
     TileQuadtreeNode* tileTree[2];
+
+    std::vector<Tile*> residentTiles;
+
+    // Most detailed tiles requested during the current usage, used to
+    // estimate the motion of the camera over the texture
+    std::vector<Tile*> usedTiles;
+    Eigen::Vector2f previousCenter{ Eigen::Vector2f::Zero() };
+    bool hasPreviousCenter{ false };
+
+    // Shared with the loader threads
+    std::vector<TileRequest> tileRequests;
+    std::vector<DecodedTile> decodedTiles;
+    unsigned int activeJobs{ 0 };
+    std::mutex mutex;
+    std::condition_variable jobsDone;
 };
 
 
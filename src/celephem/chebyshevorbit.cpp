@@ -0,0 +1,312 @@
+// chebyshevorbit.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Piecewise Chebyshev approximations of orbits, used in place of the
+// analytic theories over the time span they cover.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <celmath/mathlib.h>
+#include <celutil/bytes.h>
+#include "chebyshevorbit.h"
+
+using namespace Eigen;
+using namespace std;
+
+// Number of coefficients of each polynomial; the same as used for the
+// planets in DE405.
+static const unsigned int NCoeffs = 14;
+
+// Number of points per segment at which the fit is checked
+static const unsigned int NTestPoints = NCoeffs * 2;
+
+// Don't try segments shorter than this (in days) to meet the tolerance
+static const double MinSegmentDuration = 0.01;
+
+static const char FileHeader[] = "CELCHEB";
+static const uint32_t FileVersion = 1;
+
+
+// Little-endian file values
+static uint32_t readUint(istream& in)
+{
+    uint32_t ret;
+    in.read((char*) &ret, sizeof(uint32_t));
+    LE_TO_CPU_INT32(ret, ret);
+    return ret;
+}
+
+static double readDouble(istream& in)
+{
+    double d;
+    in.read((char*) &d, sizeof(double));
+    LE_TO_CPU_DOUBLE(d, d);
+    return d;
+}
+
+static void writeUint(ostream& out, uint32_t n)
+{
+    LE_TO_CPU_INT32(n, n);
+    out.write((const char*) &n, sizeof(uint32_t));
+}
+
+static void writeDouble(ostream& out, double d)
+{
+    LE_TO_CPU_DOUBLE(d, d);
+    out.write((const char*) &d, sizeof(double));
+}
+
+
+// Evaluate a Chebyshev series at u in [-1, 1], and its derivative.
+static double evaluateSeries(const double* c, double u, double* derivative = nullptr)
+{
+    double t0 = 1.0, t1 = u;
+    double dt0 = 0.0, dt1 = 1.0;
+    double sum = c[0] + c[1] * u;
+    double dsum = c[1];
+    for (unsigned int j = 2; j < NCoeffs; j++)
+    {
+        double t2 = 2.0 * u * t1 - t0;
+        double dt2 = 2.0 * t1 + 2.0 * u * dt1 - dt0;
+        sum += c[j] * t2;
+        dsum += c[j] * dt2;
+        t0 = t1; t1 = t2;
+        dt0 = dt1; dt1 = dt2;
+    }
+
+    if (derivative != nullptr)
+        *derivative = dsum;
+    return sum;
+}
+
+
+/*! Return the coefficients of the segment containing jd, and set u to the
+ *  normalized time within it.
+ */
+const double* ChebyshevEphemeris::segmentCoeffs(double jd, double& u) const
+{
+    double t = (jd - startDate) / segmentDuration;
+    auto segment = (unsigned int) max(0.0, t);
+    // Make sure we don't go past the end of the array if jd == endDate
+    if (segment >= nSegments)
+        segment = nSegments - 1;
+
+    u = 2.0 * (t - segment) - 1.0;
+    return &coeffs[segment * NCoeffs * 3];
+}
+
+
+Vector3d ChebyshevEphemeris::position(double jd) const
+{
+    double u;
+    const double* c = segmentCoeffs(jd, u);
+    return Vector3d(evaluateSeries(c, u),
+                    evaluateSeries(c + NCoeffs, u),
+                    evaluateSeries(c + NCoeffs * 2, u));
+}
+
+
+Vector3d ChebyshevEphemeris::velocity(double jd) const
+{
+    double u;
+    const double* c = segmentCoeffs(jd, u);
+    Vector3d v;
+    for (int i = 0; i < 3; i++)
+        evaluateSeries(c + NCoeffs * i, u, &v[i]);
+
+    // Convert from per unit of u to per day
+    return v * (2.0 / segmentDuration);
+}
+
+
+/*! Interpolate the orbit at the Chebyshev nodes of the segment starting at
+ *  t0, and check the result against the orbit between them.
+ */
+bool ChebyshevEphemeris::fitSegment(const Orbit& orbit, double t0,
+                                    double tolerance, double* c) const
+{
+    Vector3d samples[NCoeffs];
+    for (unsigned int k = 0; k < NCoeffs; k++)
+    {
+        double u = cos(PI * (k + 0.5) / NCoeffs);
+        samples[k] = orbit.positionAtTime(t0 + (u + 1.0) * 0.5 * segmentDuration);
+    }
+
+    for (unsigned int j = 0; j < NCoeffs; j++)
+    {
+        Vector3d sum = Vector3d::Zero();
+        for (unsigned int k = 0; k < NCoeffs; k++)
+            sum += samples[k] * cos(PI * j * (k + 0.5) / NCoeffs);
+        sum *= (j == 0 ? 1.0 : 2.0) / NCoeffs;
+        for (int i = 0; i < 3; i++)
+            c[NCoeffs * i + j] = sum[i];
+    }
+
+    for (unsigned int k = 0; k <= NTestPoints; k++)
+    {
+        double u = 2.0 * k / NTestPoints - 1.0;
+        Vector3d p(evaluateSeries(c, u),
+                   evaluateSeries(c + NCoeffs, u),
+                   evaluateSeries(c + NCoeffs * 2, u));
+        if ((p - orbit.positionAtTime(t0 + (u + 1.0) * 0.5 * segmentDuration)).norm() > tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+
+ChebyshevEphemeris* ChebyshevEphemeris::fit(const Orbit& orbit,
+                                            double startDate, double endDate,
+                                            double tolerance)
+{
+    if (!(endDate > startDate) || !(tolerance > 0.0))
+        return nullptr;
+
+    unique_ptr<ChebyshevEphemeris> eph(new ChebyshevEphemeris());
+    eph->startDate = startDate;
+    eph->endDate = endDate;
+
+    // Start from segments a quarter of an orbit long, and halve them
+    // until all segments are within the tolerance.
+    double span = endDate - startDate;
+    double duration = span;
+    if (orbit.isPeriodic() && orbit.getPeriod() > 0.0)
+        duration = min(span, orbit.getPeriod() * 0.25);
+
+    for (;;)
+    {
+        eph->nSegments = (unsigned int) ceil(span / duration);
+        eph->segmentDuration = span / eph->nSegments;
+        if (eph->segmentDuration < MinSegmentDuration)
+            return nullptr;
+
+        eph->coeffs.resize((size_t) eph->nSegments * NCoeffs * 3);
+        bool ok = true;
+        for (unsigned int i = 0; i < eph->nSegments && ok; i++)
+        {
+            ok = eph->fitSegment(orbit, startDate + i * eph->segmentDuration,
+                                 tolerance, &eph->coeffs[i * NCoeffs * 3]);
+        }
+
+        if (ok)
+            return eph.release();
+        duration = eph->segmentDuration * 0.5;
+    }
+}
+
+
+ChebyshevEphemeris* ChebyshevEphemeris::load(istream& in)
+{
+    char header[sizeof(FileHeader)];
+    in.read(header, sizeof(header));
+    if (!in.good() || memcmp(header, FileHeader, sizeof(FileHeader)) != 0)
+        return nullptr;
+
+    if (readUint(in) != FileVersion || readUint(in) != NCoeffs)
+        return nullptr;
+
+    unique_ptr<ChebyshevEphemeris> eph(new ChebyshevEphemeris());
+    eph->nSegments = readUint(in);
+    eph->startDate = readDouble(in);
+    eph->endDate = readDouble(in);
+    if (!in.good() || eph->nSegments == 0 || !(eph->endDate > eph->startDate))
+        return nullptr;
+    eph->segmentDuration = (eph->endDate - eph->startDate) / eph->nSegments;
+
+    // Check the segment count against the size of the rest of the file
+    // before allocating the coefficients, so that a corrupt count can't
+    // cause a huge allocation.
+    streamoff start = in.tellg();
+    in.seekg(0, ios::end);
+    streamoff end = in.tellg();
+    in.seekg(start);
+    if (start < 0 || end < start ||
+        eph->nSegments > (uint64_t) (end - start) / (NCoeffs * 3 * sizeof(double)))
+    {
+        return nullptr;
+    }
+
+    eph->coeffs.resize((size_t) eph->nSegments * NCoeffs * 3);
+    for (auto& c : eph->coeffs)
+        c = readDouble(in);
+    if (!in.good())
+        return nullptr;
+
+    return eph.release();
+}
+
+
+bool ChebyshevEphemeris::save(ostream& out) const
+{
+    out.write(FileHeader, sizeof(FileHeader));
+    writeUint(out, FileVersion);
+    writeUint(out, NCoeffs);
+    writeUint(out, nSegments);
+    writeDouble(out, startDate);
+    writeDouble(out, endDate);
+    for (auto c : coeffs)
+        writeDouble(out, c);
+
+    return out.good();
+}
+
+
+ChebyshevOrbit::ChebyshevOrbit(Orbit* _orbit, ChebyshevEphemeris* _ephemeris) :
+    orbit(_orbit),
+    ephemeris(_ephemeris)
+{
+}
+
+
+ChebyshevOrbit::~ChebyshevOrbit()
+{
+    delete orbit;
+}
+
+
+Vector3d ChebyshevOrbit::positionAtTime(double jd) const
+{
+    if (ephemeris->covers(jd))
+        return ephemeris->position(jd);
+    return orbit->positionAtTime(jd);
+}
+
+
+Vector3d ChebyshevOrbit::velocityAtTime(double jd) const
+{
+    if (ephemeris->covers(jd))
+        return ephemeris->velocity(jd);
+    return orbit->velocityAtTime(jd);
+}
+
+
+double ChebyshevOrbit::getPeriod() const
+{
+    return orbit->getPeriod();
+}
+
+
+double ChebyshevOrbit::getBoundingRadius() const
+{
+    return orbit->getBoundingRadius();
+}
+
+
+bool ChebyshevOrbit::isPeriodic() const
+{
+    return orbit->isPeriodic();
+}
+
+
+void ChebyshevOrbit::getValidRange(double& begin, double& end) const
+{
+    orbit->getValidRange(begin, end);
+}
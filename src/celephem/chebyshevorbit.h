@@ -0,0 +1,88 @@
+// chebyshevorbit.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Piecewise Chebyshev approximations of orbits, used in place of the
+// analytic theories over the time span they cover.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#ifndef _CELEPHEM_CHEBYSHEVORBIT_H_
+#define _CELEPHEM_CHEBYSHEVORBIT_H_
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+#include "orbit.h"
+
+/*! Positions over a time span, given by Chebyshev polynomials fitted over
+ *  segments of equal duration, as in the JPL ephemerides.
+ */
+class ChebyshevEphemeris
+{
+ public:
+    ~ChebyshevEphemeris() = default;
+
+    bool covers(double jd) const { return jd >= startDate && jd <= endDate; }
+    double getStartDate() const { return startDate; }
+    double getEndDate() const { return endDate; }
+    unsigned int getSegmentCount() const { return nSegments; }
+
+    // Position (km) and velocity (km/day) at a time covered by the
+    // ephemeris
+    Eigen::Vector3d position(double jd) const;
+    Eigen::Vector3d velocity(double jd) const;
+
+    /*! Fit Chebyshev polynomials to the orbit between startDate and
+     *  endDate, with segments short enough that the positions computed
+     *  from them are within tolerance kilometers of the orbit's ones.
+     *  Return nullptr if the tolerance can't be met.
+     */
+    static ChebyshevEphemeris* fit(const Orbit& orbit,
+                                   double startDate, double endDate,
+                                   double tolerance);
+
+    static ChebyshevEphemeris* load(std::istream& in);
+    bool save(std::ostream& out) const;
+
+ private:
+    ChebyshevEphemeris() = default;
+
+    const double* segmentCoeffs(double jd, double& u) const;
+    bool fitSegment(const Orbit& orbit, double t0, double tolerance, double* coeffs) const;
+
+    double startDate{ 0.0 };
+    double endDate{ 0.0 };
+    double segmentDuration{ 0.0 };
+    unsigned int nSegments{ 0 };
+    // Coefficients of each segment, for x, y and z in turn
+    std::vector<double> coeffs;
+};
+
+
+/*! Orbit evaluated with a Chebyshev ephemeris over the span it covers, and
+ *  with the orbit it was fitted to outside of it.
+ */
+class ChebyshevOrbit : public Orbit
+{
+ public:
+    ChebyshevOrbit(Orbit* orbit, ChebyshevEphemeris* ephemeris);
+    virtual ~ChebyshevOrbit();
+
+    virtual Eigen::Vector3d positionAtTime(double jd) const;
+    virtual Eigen::Vector3d velocityAtTime(double jd) const;
+    virtual double getPeriod() const;
+    virtual double getBoundingRadius() const;
+    virtual bool isPeriodic() const;
+    virtual void getValidRange(double& begin, double& end) const;
+
+ private:
+    Orbit* orbit;
+    std::unique_ptr<ChebyshevEphemeris> ephemeris;
+};
+
+#endif // _CELEPHEM_CHEBYSHEVORBIT_H_
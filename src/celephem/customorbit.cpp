@@ -10,6 +10,7 @@
 #include "customorbit.h"
 #include "vsop87.h"
 #include "jpleph.h"
+#include "chebyshevorbit.h"
 #include <celengine/astro.h>
 #include <celmath/mathlib.h>
 #include <celmath/geomutil.h>
@@ -38,6 +39,10 @@ static const double SaturnRadius = 60330.0;
 // the apocenter distance computed from the mean elements.
 static const double BoundingRadiusSlack = 1.2;
 
+// Chebyshev ephemerides compiled from the custom orbits are looked for
+// here, as <orbit name>.cheb
+static const string ChebyshevEphemerisDirectory = "data/ephemeris/";
+
 static bool jplephInitialized = false;
 static JPLEphemeris* jpleph = nullptr;
 
@@ -3147,15 +3152,13 @@ static double yearToJD(int year)
 }
 
 
-Orbit* GetCustomOrbit(const string& name)
+static Orbit* CreateCustomOrbit(const string& name)
 {
     // Attempt to load JPL ephemeris data if we haven't tried already
     if (!jplephInitialized)
     {
         jplephInitialized = true;
-        ifstream in("data/jpleph.dat", ios::in | ios::binary);
-        if (in.good())
-            jpleph = JPLEphemeris::load(in);
+        jpleph = JPLEphemeris::open("data/jpleph.dat");
         if (jpleph != nullptr)
         {
            fmt::fprintf(clog, "Loaded DE%u ephemeris. Valid from JD %.8lf to JD %.8lf\n",
@@ -3294,3 +3297,28 @@ Orbit* GetCustomOrbit(const string& name)
     else
         return CreateVSOP87Orbit(name);
 }
+
+
+Orbit* GetCustomOrbit(const string& name, bool useEphemerisCache)
+{
+    Orbit* orbit = CreateCustomOrbit(name);
+    if (orbit == nullptr || !useEphemerisCache)
+        return orbit;
+
+    // Use a precomputed Chebyshev ephemeris over the span it covers if one
+    // has been compiled for this orbit.
+    ifstream in(ChebyshevEphemerisDirectory + name + ".cheb", ios::in | ios::binary);
+    if (!in.good())
+        return orbit;
+
+    ChebyshevEphemeris* ephemeris = ChebyshevEphemeris::load(in);
+    if (ephemeris == nullptr)
+    {
+        fmt::fprintf(clog, "Error loading Chebyshev ephemeris for custom orbit %s\n", name);
+        return orbit;
+    }
+
+    fmt::fprintf(clog, "Loaded Chebyshev ephemeris for custom orbit %s. Valid from JD %.8lf to JD %.8lf\n",
+                 name, ephemeris->getStartDate(), ephemeris->getEndDate());
+    return new ChebyshevOrbit(orbit, ephemeris);
+}
@@ -13,6 +13,9 @@
 #include "orbit.h"
 #include <string>
 
-Orbit* GetCustomOrbit(const std::string& name);
+// Return the custom orbit with the specified name, evaluated with the
+// Chebyshev ephemeris compiled for it if there is one and
+// useEphemerisCache is true.
+Orbit* GetCustomOrbit(const std::string& name, bool useEphemerisCache = true);
 
 #endif // _CUSTOMORBIT_H_
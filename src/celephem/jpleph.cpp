@@ -10,9 +10,11 @@
 // Load JPL's DE200, DE405, and DE406 ephemerides and compute planet
 // positions.
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
-#include <cassert>
+#include <iterator>
 #include <celutil/bytes.h>
 #include "jpleph.h"
 
@@ -22,41 +24,46 @@ using namespace std;
 static const unsigned int DE200RecordSize    =  826;
 static const unsigned int DE405RecordSize    = 1018;
 static const unsigned int DE406RecordSize    =  728;
+static const unsigned int DE421RecordSize    = 1018;
+static const unsigned int DE430RecordSize    = 1018;
+static const unsigned int DE440RecordSize    = 1018;
 
 static const unsigned int NConstants         =  400;
 static const unsigned int ConstantNameLength =  6;
 
 static const unsigned int MaxChebyshevCoeffs = 32;
+static const unsigned int MaxGranules        = 32;
 
 static const int LabelSize = 84;
 
+// Size of the part of the first record that we use
+static const unsigned int HeaderSize = 2856;
+
+// Number of decoded records kept in memory; records span from 8 to 64 days,
+// so this covers at least several months around the current time.
+static const unsigned int RecordCacheSize = 16;
+
 
 // Read a big-endian 32-bit unsigned integer
-static int32_t readUint(istream& in)
+static uint32_t readUint(const char* p)
 {
     int32_t ret;
-    in.read((char*) &ret, sizeof(int32_t));
+    memcpy(&ret, p, sizeof(int32_t));
     BE_TO_CPU_INT32(ret, ret);
     return (uint32_t) ret;
 }
 
 // Read a big-endian 64-bit IEEE double--if the native double format isn't
 // IEEE 754, there will be troubles.
-static double readDouble(istream& in)
+static double readDouble(const char* p)
 {
     double d;
-    in.read((char*) &d, sizeof(double));
+    memcpy(&d, p, sizeof(double));
     BE_TO_CPU_DOUBLE(d, d);
     return d;
 }
 
 
-JPLEphRecord::~JPLEphRecord()
-{
-    delete coeffs;
-}
-
-
 unsigned int JPLEphemeris::getDENumber() const
 {
     return DENum;
@@ -72,6 +79,12 @@ double JPLEphemeris::getEndDate() const
     return endDate;
 }
 
+unsigned int JPLEphemeris::getDecodedRecordCount() const
+{
+    lock_guard<mutex> lock(cacheMutex);
+    return decodedRecordCount;
+}
+
 
 // Return the position of an object relative to the solar system barycenter
 // or the Earth (in the case of the Moon) at a specified TDB Julian date tjd.
@@ -85,54 +98,140 @@ Vector3d JPLEphemeris::getPlanetPosition(JPLEphemItem planet, double tjd) const
         return Vector3d::Zero();
     }
 
-    // The position of the Earth must be computed from the positions of the
-    // Earth-Moon barycenter and Moon
-    if (planet == JPLEph_Earth)
-    {
-        Vector3d embPos = getPlanetPosition(JPLEph_EarthMoonBary, tjd);
+    unsigned int recNo = getRecordIndex(tjd);
+    return getPlanetPosition(*getRecord(recNo), planet, tjd);
+}
 
-        // Get the geocentric position of the Moon
-        Vector3d moonPos = getPlanetPosition(JPLEph_Moon, tjd);
 
-        return embPos - moonPos * (1.0 / (earthMoonMassRatio + 1.0));
+void JPLEphemeris::getPlanetPositions(const vector<JPLEphemItem>& items,
+                                      const vector<double>& tjds,
+                                      vector<Vector3d>& positions) const
+{
+    positions.resize(items.size() * tjds.size());
+
+    auto position = positions.begin();
+    shared_ptr<const JPLEphRecord> rec;
+    unsigned int currentRecNo = 0;
+    for (double tjd : tjds)
+    {
+        // Consecutive times often fall in the same record
+        unsigned int recNo = getRecordIndex(tjd);
+        if (rec == nullptr || recNo != currentRecNo)
+        {
+            rec = getRecord(recNo);
+            currentRecNo = recNo;
+        }
+
+        for (JPLEphemItem item : items)
+        {
+            if (item == JPLEph_SSB)
+                *position++ = Vector3d::Zero();
+            else
+                *position++ = getPlanetPosition(*rec, item, tjd);
+        }
     }
+}
 
-    // Clamp time to [ startDate, endDate ]
+
+// Clamp tjd to [ startDate, endDate ] and return the index of the record
+// containing it.
+unsigned int JPLEphemeris::getRecordIndex(double& tjd) const
+{
     if (tjd < startDate)
         tjd = startDate;
     else if (tjd > endDate)
-    tjd = endDate;
+        tjd = endDate;
 
     // recNo is always >= 0:
     auto recNo = (unsigned int) ((tjd - startDate) / daysPerInterval);
-    // Make sure we don't go past the end of the array if t == endDate
-    if (recNo >= records.size())
-        recNo = records.size() - 1;
-    const JPLEphRecord* rec = &records[recNo];
+    // Make sure we don't go past the last record if t == endDate
+    if (recNo >= nRecords)
+        recNo = nRecords - 1;
+    return recNo;
+}
+
 
-    assert(coeffInfo[planet].nGranules >= 1);
-    assert(coeffInfo[planet].nGranules <= 32);
-    assert(coeffInfo[planet].nCoeffs <= MaxChebyshevCoeffs);
+shared_ptr<const JPLEphRecord> JPLEphemeris::getRecord(unsigned int recNo) const
+{
+    lock_guard<mutex> lock(cacheMutex);
+
+    cacheClock++;
+    for (auto& entry : recordCache)
+    {
+        if (entry.recNo == recNo)
+        {
+            entry.lastUse = cacheClock;
+            return entry.record;
+        }
+    }
+
+    // The first two records are the header and the constants. The first
+    // two 'coefficients' of each record are actually the start and end
+    // time (t0 and t1).
+    const char* p = data + (size_t) (recNo + 2) * recordSize * sizeof(double);
+    auto rec = make_shared<JPLEphRecord>();
+    rec->t0 = readDouble(p);
+    rec->t1 = readDouble(p + sizeof(double));
+    rec->coeffs.resize(recordSize - 2);
+    for (unsigned int i = 0; i < recordSize - 2; i++)
+        rec->coeffs[i] = readDouble(p + (i + 2) * sizeof(double));
+    decodedRecordCount++;
+
+    // Replace the least recently used record once the cache is full
+    if (recordCache.size() < RecordCacheSize)
+    {
+        recordCache.push_back({ recNo, cacheClock, rec });
+    }
+    else
+    {
+        auto oldest = min_element(recordCache.begin(), recordCache.end(),
+                                  [](const CacheEntry& a, const CacheEntry& b)
+                                  { return a.lastUse < b.lastUse; });
+        *oldest = { recNo, cacheClock, rec };
+    }
+
+    return rec;
+}
+
+
+// Evaluate the position of planet at tjd, which must be within rec
+Vector3d JPLEphemeris::getPlanetPosition(const JPLEphRecord& rec,
+                                         JPLEphemItem planet,
+                                         double tjd) const
+{
+    // The position of the Earth must be computed from the positions of the
+    // Earth-Moon barycenter and Moon
+    if (planet == JPLEph_Earth)
+    {
+        Vector3d embPos = getPlanetPosition(rec, JPLEph_EarthMoonBary, tjd);
+
+        // Get the geocentric position of the Moon
+        Vector3d moonPos = getPlanetPosition(rec, JPLEph_Moon, tjd);
+
+        return embPos - moonPos * (1.0 / (earthMoonMassRatio + 1.0));
+    }
 
     // u is the normalized time (in [-1, 1]) for interpolating
     // coeffs is a pointer to the Chebyshev coefficients
     double u = 0.0;
-    double* coeffs = nullptr;
+    const double* coeffs = nullptr;
 
     // nGranules is unsigned int so it will be compared against FFFFFFFF:
     if (coeffInfo[planet].nGranules == (unsigned int) -1)
     {
-        coeffs = rec->coeffs + coeffInfo[planet].offset;
-        u = 2.0 * (tjd - rec->t0) / daysPerInterval - 1.0;
+        coeffs = rec.coeffs.data() + coeffInfo[planet].offset;
+        u = 2.0 * (tjd - rec.t0) / daysPerInterval - 1.0;
     }
     else
     {
-    double daysPerGranule = daysPerInterval / coeffInfo[planet].nGranules;
-    auto granule = (int) ((tjd - rec->t0) / daysPerGranule);
-    double granuleStartDate = rec->t0 + daysPerGranule * (double) granule;
-    coeffs = rec->coeffs + coeffInfo[planet].offset +
-            granule * coeffInfo[planet].nCoeffs * 3;
-    u = 2.0 * (tjd - granuleStartDate) / daysPerGranule - 1.0;
+        double daysPerGranule = daysPerInterval / coeffInfo[planet].nGranules;
+        auto granule = (int) ((tjd - rec.t0) / daysPerGranule);
+        // tjd == t1 belongs to the last granule
+        granule = min(granule, (int) coeffInfo[planet].nGranules - 1);
+        double granuleStartDate = rec.t0 + daysPerGranule * (double) granule;
+        coeffs = rec.coeffs.data() + coeffInfo[planet].offset +
+                granule * coeffInfo[planet].nCoeffs * 3;
+        u = 2.0 * (tjd - granuleStartDate) / daysPerGranule - 1.0;
     }
 
     // Evaluate the Chebyshev polynomials
@@ -155,110 +254,130 @@ Vector3d JPLEphemeris::getPlanetPosition(JPLEphemItem planet, double tjd) const
 }
 
 
+// Read the whole stream; the records are decoded from the copy when they're
+// used, as with a mapped file.
 JPLEphemeris* JPLEphemeris::load(istream& in)
 {
-    JPLEphemeris* eph = nullptr;
-
-    // Skip past three header labels
-    in.ignore(LabelSize * 3);
-    if (!in.good())
+    auto* eph = new JPLEphemeris();
+    eph->buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    eph->data = eph->buffer.data();
+    eph->dataSize = eph->buffer.size();
+    if (!eph->init())
+    {
+        delete eph;
         return nullptr;
+    }
 
-    // Skip past the constant names
-    in.ignore(NConstants * ConstantNameLength);
-    if (!in.good())
-        return nullptr;
+    return eph;
+}
 
-    eph = new JPLEphemeris();
 
-    // Read the start time, end time, and time interval
-    eph->startDate = readDouble(in);
-    eph->endDate = readDouble(in);
-    eph->daysPerInterval = readDouble(in);
-    if (!in.good())
+JPLEphemeris* JPLEphemeris::open(const fs::path& filename)
+{
+    auto* eph = new JPLEphemeris();
+    if (!eph->file.open(filename))
+    {
+        delete eph;
+        return nullptr;
+    }
+
+    eph->data = eph->file.data();
+    eph->dataSize = eph->file.size();
+    if (!eph->init())
     {
         delete eph;
         return nullptr;
     }
 
-    // Number of constants with valid values; not useful for us
-    (void) readUint(in);
+    return eph;
+}
+
 
-    eph->au = readDouble(in);     // kilometers per astronomical unit
-    eph->earthMoonMassRatio = readDouble(in);
+// Read and validate the header
+bool JPLEphemeris::init()
+{
+    if (dataSize < HeaderSize)
+        return false;
+
+    // Skip past three header labels and the constant names
+    const char* p = data + LabelSize * 3 + NConstants * ConstantNameLength;
+
+    // Read the start time, end time, and time interval
+    startDate = readDouble(p);
+    endDate = readDouble(p + 8);
+    daysPerInterval = readDouble(p + 16);
+    // Number of constants with valid values (at p + 24) isn't useful for us
+    au = readDouble(p + 28);     // kilometers per astronomical unit
+    earthMoonMassRatio = readDouble(p + 36);
+    p += 44;
 
     // Read the coefficient information for each item in the ephemeris
-    unsigned int i;
-    for (i = 0; i < JPLEph_NItems; i++)
-    {
-        eph->coeffInfo[i].offset = readUint(in) - 3;
-        eph->coeffInfo[i].nCoeffs = readUint(in);
-        eph->coeffInfo[i].nGranules = readUint(in);
-    }
-    if (!in.good())
+    for (unsigned int i = 0; i < JPLEph_NItems; i++, p += 12)
     {
-        delete eph;
-        return nullptr;
+        coeffInfo[i].offset = readUint(p) - 3;
+        coeffInfo[i].nCoeffs = readUint(p + 4);
+        coeffInfo[i].nGranules = readUint(p + 8);
     }
 
-    eph->DENum = readUint(in);
+    DENum = readUint(p);
+    p += 4;
 
-    switch (eph->DENum)
+    switch (DENum)
     {
     case 200:
-        eph->recordSize = DE200RecordSize;
+        recordSize = DE200RecordSize;
         break;
     case 405:
-        eph->recordSize = DE405RecordSize;
+        recordSize = DE405RecordSize;
         break;
     case 406:
-        eph->recordSize = DE406RecordSize;
+        recordSize = DE406RecordSize;
+        break;
+    case 421:
+        recordSize = DE421RecordSize;
+        break;
+    case 430:
+        recordSize = DE430RecordSize;
+        break;
+    case 440:
+        recordSize = DE440RecordSize;
         break;
     default:
-        delete eph;
-        return nullptr;
+        return false;
     }
 
-    eph->librationCoeffInfo.offset        = readUint(in);
-    eph->librationCoeffInfo.nCoeffs       = readUint(in);
-    eph->librationCoeffInfo.nGranules     = readUint(in);
-    if (!in.good())
-    {
-        delete eph;
-        return nullptr;
-    }
+    librationCoeffInfo.offset        = readUint(p);
+    librationCoeffInfo.nCoeffs       = readUint(p + 4);
+    librationCoeffInfo.nGranules     = readUint(p + 8);
 
-    // Skip past the rest of the record
-    in.ignore(eph->recordSize * 8 - 2856);
-    // The next record contains constant values (which we don't need)
-    in.ignore(eph->recordSize * 8);
-    if (!in.good())
-    {
-        delete eph;
-        return nullptr;
-    }
+    if (!(daysPerInterval > 0.0) || !(endDate > startDate))
+        return false;
 
-    auto nRecords = (unsigned int) ((eph->endDate - eph->startDate) /
-                        eph->daysPerInterval);
-    eph->records.resize(nRecords);
-    for (i = 0; i < nRecords; i++)
+    // Make sure that the coefficients of the items we use are within the
+    // records, so that corrupt files can't make us read past them.
+    for (unsigned int i = JPLEph_Mercury; i <= JPLEph_Sun; i++)
     {
-        eph->records[i].t0 = readDouble(in);
-        eph->records[i].t1 = readDouble(in);
-
-        // Allocate coefficient array for this record; the first two
-        // 'coefficients' are actually the start and end time (t0 and t1)
-        eph->records[i].coeffs = new double[eph->recordSize - 2];
-        for (unsigned int j = 0; j < eph->recordSize - 2; j++)
-            eph->records[i].coeffs[j] = readDouble(in);
-
-        // Make sure that we read this record successfully
-        if (!in.good())
+        const JPLEphCoeffInfo& info = coeffInfo[i];
+        unsigned int nGranules = info.nGranules == (unsigned int) -1 ? 1 : info.nGranules;
+        if (info.nCoeffs < 2 || info.nCoeffs > MaxChebyshevCoeffs ||
+            nGranules < 1 || nGranules > MaxGranules ||
+            info.offset > recordSize - 2 ||
+            nGranules * info.nCoeffs * 3 > recordSize - 2 - info.offset)
         {
-            delete eph;
-            return nullptr;
+            return false;
         }
     }
 
-    return eph;
+    // The records follow the header and the constants, and the file must
+    // contain all of them.
+    nRecords = (unsigned int) ((endDate - startDate) / daysPerInterval);
+    if (nRecords == 0 ||
+        dataSize / (recordSize * sizeof(double)) < (size_t) nRecords + 2)
+    {
+        return false;
+    }
+
+    // Check that the first record starts at the start date
+    const char* firstRecord = data + 2 * recordSize * sizeof(double);
+    return readDouble(firstRecord) == startDate;
 }
@@ -13,9 +13,14 @@
 #ifndef _CELENGINE_JPLEPH_H_
 #define _CELENGINE_JPLEPH_H_
 
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <Eigen/Core>
+#include <celcompat/filesystem.h>
+#include <celutil/mappedfile.h>
 
 enum JPLEphemItem
 {
@@ -45,17 +50,20 @@ struct JPLEphCoeffInfo
 };
 
 
+// A record decoded from the big-endian file data
 struct JPLEphRecord
 {
-    JPLEphRecord() = default;
-    ~JPLEphRecord();
-
     double t0{ 0.0 };
     double t1{ 0.0 };
-    double* coeffs{ nullptr };
+    std::vector<double> coeffs;
 };
 
 
+/*! JPL DE ephemerides are read from a memory mapping of the binary file (or
+ *  from a copy of the stream for load()); only the header is decoded when
+ *  the ephemeris is opened. The Chebyshev records are decoded when they're
+ *  first used, and the most recently used ones are kept in a small cache.
+ */
 class JPLEphemeris
 {
 private:
@@ -66,13 +74,31 @@ public:
 
     Eigen::Vector3d getPlanetPosition(JPLEphemItem, double t) const;
 
+    /*! Compute the positions of all the items at all the times;
+     *  positions[i * items.size() + j] is the position of items[j] at
+     *  tjds[i]. Each record is looked up once for all the items, so it's
+     *  faster than separate calls to getPlanetPosition().
+     */
+    void getPlanetPositions(const std::vector<JPLEphemItem>& items,
+                            const std::vector<double>& tjds,
+                            std::vector<Eigen::Vector3d>& positions) const;
+
     static JPLEphemeris* load(std::istream&);
+    static JPLEphemeris* open(const fs::path& filename);
 
     unsigned int getDENumber() const;
     double getStartDate() const;
     double getEndDate() const;
 
+    // Number of records decoded since the ephemeris was opened
+    unsigned int getDecodedRecordCount() const;
+
 private:
+    bool init();
+    unsigned int getRecordIndex(double& tjd) const;
+    std::shared_ptr<const JPLEphRecord> getRecord(unsigned int recNo) const;
+    Eigen::Vector3d getPlanetPosition(const JPLEphRecord&, JPLEphemItem, double tjd) const;
+
     JPLEphCoeffInfo coeffInfo[JPLEph_NItems];
     JPLEphCoeffInfo librationCoeffInfo;
 
@@ -85,8 +111,25 @@ private:
 
     unsigned int DENum;       // ephemeris version
     unsigned int recordSize;  // number of doubles per record
-
-    std::vector<JPLEphRecord> records;
+    unsigned int nRecords;
+
+    // The file data is either mapped or read into buffer
+    MappedFile file;
+    std::vector<char> buffer;
+    const char* data{ nullptr };
+    size_t dataSize{ 0 };
+
+    struct CacheEntry
+    {
+        unsigned int recNo;
+        uint64_t lastUse;
+        std::shared_ptr<const JPLEphRecord> record;
+    };
+
+    mutable std::mutex cacheMutex;
+    mutable std::vector<CacheEntry> recordCache;
+    mutable uint64_t cacheClock{ 0 };
+    mutable unsigned int decodedRecordCount{ 0 };
 };
 
 #endif // _CELENGINE_JPLEPH_H_
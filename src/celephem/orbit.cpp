@@ -9,6 +9,7 @@
 // of the License, or (at your option) any later version.
 
 #include "orbit.h"
+#include "threadcache.h"
 #include <celengine/body.h>
 #include <celmath/mathlib.h>
 #include <celmath/solve.h>
@@ -435,41 +436,80 @@ double EllipticalOrbit::getBoundingRadius() const
 }
 
 
+namespace
+{
+struct CachedOrbitState
+{
+    uint64_t id{ 0 };
+    double time{ 0.0 };
+    Vector3d position;
+    Vector3d velocity;
+    bool positionValid{ false };
+    bool velocityValid{ false };
+};
+
+typedef ThreadCache<CachedOrbitState> OrbitStateCache;
+}
+
+
+CachingOrbit::CachingOrbit() :
+    cacheId(OrbitStateCache::newId())
+{
+}
+
+
+CachingOrbit::CachingOrbit(const CachingOrbit&) :
+    Orbit(),
+    cacheId(OrbitStateCache::newId())
+{
+}
+
+
+CachingOrbit::~CachingOrbit()
+{
+    OrbitStateCache::releaseId(cacheId);
+}
+
+
 Vector3d CachingOrbit::positionAtTime(double jd) const
 {
-    if (jd != lastTime)
-    {
-        lastTime = jd;
-        lastPosition = computePosition(jd);
-        positionCacheValid = true;
-        velocityCacheValid = false;
-    }
-    else if (!positionCacheValid)
+    CachedOrbitState& state = OrbitStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == jd && state.positionValid)
+        return state.position;
+
+    // The entry may be updated while computing the position, by nested
+    // evaluations of this orbit, so it's only checked again afterwards.
+    Vector3d position = computePosition(jd);
+    if (state.id != cacheId || state.time != jd)
     {
-        lastPosition = computePosition(jd);
-        positionCacheValid = true;
+        state.id = cacheId;
+        state.time = jd;
+        state.velocityValid = false;
     }
+    state.position = position;
+    state.positionValid = true;
 
-    return lastPosition;
+    return position;
 }
 
 
 Vector3d CachingOrbit::velocityAtTime(double jd) const
 {
-    if (jd != lastTime)
-    {
-        lastVelocity = computeVelocity(jd);
-        lastTime = jd;  // must be set *after* call to computeVelocity
-        positionCacheValid = false;
-        velocityCacheValid = true;
-    }
-    else if (!velocityCacheValid)
+    CachedOrbitState& state = OrbitStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == jd && state.velocityValid)
+        return state.velocity;
+
+    Vector3d velocity = computeVelocity(jd);
+    if (state.id != cacheId || state.time != jd)
     {
-        lastVelocity = computeVelocity(jd);
-        velocityCacheValid = true;
+        state.id = cacheId;
+        state.time = jd;
+        state.positionValid = false;
     }
+    state.velocity = velocity;
+    state.velocityValid = true;
 
-    return lastVelocity;
+    return velocity;
 }
 
 
@@ -10,6 +10,7 @@
 #ifndef _CELENGINE_ORBIT_H_
 #define _CELENGINE_ORBIT_H_
 
+#include <cstdint>
 #include <Eigen/Core>
 
 
@@ -104,13 +105,17 @@ class OrbitSampleProc
  * Celestia may need require position of a planet more than once per frame; in
  * order to avoid redundant calculation, the CachingOrbit class saves the
  * result of the last calculation and uses it if the time matches the cached
- * time.
+ * time. The results are cached separately by each thread, so that the same
+ * orbit may be evaluated from several threads at once; computePosition()
+ * and computeVelocity() must not modify the orbit.
  */
 class CachingOrbit : public Orbit
 {
  public:
-    CachingOrbit() = default;
-    virtual ~CachingOrbit() = default;
+    CachingOrbit();
+    CachingOrbit(const CachingOrbit&);
+    CachingOrbit& operator=(const CachingOrbit&) = delete;
+    virtual ~CachingOrbit();
 
     virtual Eigen::Vector3d computePosition(double jd) const = 0;
     virtual Eigen::Vector3d computeVelocity(double jd) const;
@@ -121,11 +126,8 @@ class CachingOrbit : public Orbit
     Eigen::Vector3d velocityAtTime(double jd) const;
 
  private:
-    mutable Eigen::Vector3d lastPosition;
-    mutable Eigen::Vector3d lastVelocity;
-    mutable double lastTime{ -1.0e30 };
-    mutable bool positionCacheValid{ false };
-    mutable bool velocityCacheValid{ false };
+    // Identifies the orbit in the per-thread caches
+    const uint64_t cacheId;
 };
 
 
@@ -12,6 +12,7 @@
 // of the License, or (at your option) any later version.
 
 #include "rotation.h"
+#include "threadcache.h"
 #include <celmath/geomutil.h>
 #include <celmath/mathlib.h>
 #include <cmath>
@@ -55,75 +56,106 @@ RotationModel::angularVelocityAtTime(double tdb) const
 
 /***** CachingRotationModel *****/
 
+namespace
+{
+struct CachedRotationState
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    uint64_t id{ 0 };
+    double time{ 0.0 };
+    Quaterniond spin;
+    Quaterniond equator;
+    Vector3d angularVelocity;
+    bool spinValid{ false };
+    bool equatorValid{ false };
+    bool angularVelocityValid{ false };
+};
+
+typedef ThreadCache<CachedRotationState> RotationStateCache;
+
+// Make the cache entry hold the state of the rotation model with the given
+// id at time tjd, discarding whatever it held before.
+void selectState(CachedRotationState& state, uint64_t id, double tjd)
+{
+    if (state.id != id || state.time != tjd)
+    {
+        state.id = id;
+        state.time = tjd;
+        state.spinValid = false;
+        state.equatorValid = false;
+        state.angularVelocityValid = false;
+    }
+}
+}
+
+
 CachingRotationModel::CachingRotationModel() :
-    lastTime(365.0),
-    spinCacheValid(false),
-    equatorCacheValid(false),
-    angularVelocityCacheValid(false)
+    cacheId(RotationStateCache::newId())
+{
+}
+
+
+CachingRotationModel::CachingRotationModel(const CachingRotationModel&) :
+    RotationModel(),
+    cacheId(RotationStateCache::newId())
+{
+}
+
+
+CachingRotationModel::~CachingRotationModel()
 {
+    RotationStateCache::releaseId(cacheId);
 }
 
 
+// The cache entry may be updated by nested evaluations of the rotation
+// model while computing a state, so it's only updated once it is known.
 Quaterniond
 CachingRotationModel::spin(double tjd) const
 {
-    if (tjd != lastTime)
-    {
-        lastTime = tjd;
-        lastSpin = computeSpin(tjd);
-        spinCacheValid = true;
-        equatorCacheValid = false;
-        angularVelocityCacheValid = false;
-    }
-    else if (!spinCacheValid)
-    {
-        lastSpin = computeSpin(tjd);
-        spinCacheValid = true;
-    }
+    CachedRotationState& state = RotationStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == tjd && state.spinValid)
+        return state.spin;
+
+    Quaterniond q = computeSpin(tjd);
+    selectState(state, cacheId, tjd);
+    state.spin = q;
+    state.spinValid = true;
 
-    return lastSpin;
+    return q;
 }
 
 
 Quaterniond
 CachingRotationModel::equatorOrientationAtTime(double tjd) const
 {
-    if (tjd != lastTime)
-    {
-        lastTime = tjd;
-        lastEquator = computeEquatorOrientation(tjd);
-        spinCacheValid = false;
-        equatorCacheValid = true;
-        angularVelocityCacheValid = false;
-    }
-    else if (!equatorCacheValid)
-    {
-        lastEquator = computeEquatorOrientation(tjd);
-        equatorCacheValid = true;
-    }
+    CachedRotationState& state = RotationStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == tjd && state.equatorValid)
+        return state.equator;
 
-    return lastEquator;
+    Quaterniond q = computeEquatorOrientation(tjd);
+    selectState(state, cacheId, tjd);
+    state.equator = q;
+    state.equatorValid = true;
+
+    return q;
 }
 
 
 Vector3d
 CachingRotationModel::angularVelocityAtTime(double tjd) const
 {
-    if (tjd != lastTime)
-    {
-        lastAngularVelocity = computeAngularVelocity(tjd);
-        lastTime = tjd;
-        spinCacheValid = false;
-        equatorCacheValid = false;
-        angularVelocityCacheValid = true;
-    }
-    else if (!angularVelocityCacheValid)
-    {
-        lastAngularVelocity = computeAngularVelocity(tjd);
-        angularVelocityCacheValid = true;
-    }
+    CachedRotationState& state = RotationStateCache::entry(cacheId);
+    if (state.id == cacheId && state.time == tjd && state.angularVelocityValid)
+        return state.angularVelocity;
+
+    Vector3d w = computeAngularVelocity(tjd);
+    selectState(state, cacheId, tjd);
+    state.angularVelocity = w;
+    state.angularVelocityValid = true;
 
-    return lastAngularVelocity;
+    return w;
 }
 
 
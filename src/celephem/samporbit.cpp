@@ -18,6 +18,8 @@
 #include <celutil/bytes.h>
 #include <celutil/gettext.h>
 #include <celutil/debug.h>
+#include <celutil/mappedfile.h>
+#include <atomic>
 #include <cmath>
 #include <string>
 #include <algorithm>
@@ -88,7 +90,8 @@ private:
     vector<Sample<T> > samples;
     double boundingRadius;
     double period;
-    mutable int lastSample;
+    // Hint for the next search, shared by all threads
+    mutable std::atomic<int> lastSample;
 
     TrajectoryInterpolation interpolation;
 };
@@ -177,9 +180,9 @@ template <typename T> Vector3d SampledOrbit<T>::computePosition(double jd) const
     {
         Sample<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        int n = lastSample.load(std::memory_order_relaxed);
 
-        if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
+        if (n < 1 || n >= (int) samples.size() || jd <= samples[n - 1].t || jd > samples[n].t)
         {
             typename vector<Sample<T> >::const_iterator iter = lower_bound(samples.begin(),
                                                                            samples.end(),
@@ -189,7 +192,7 @@ template <typename T> Vector3d SampledOrbit<T>::computePosition(double jd) const
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            lastSample.store(n, std::memory_order_relaxed);
         }
 
         if (n == 0)
@@ -292,9 +295,9 @@ template <typename T> Vector3d SampledOrbit<T>::computeVelocity(double jd) const
     {
         Sample<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        int n = lastSample.load(std::memory_order_relaxed);
 
-        if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
+        if (n < 1 || n >= (int) samples.size() || jd <= samples[n - 1].t || jd > samples[n].t)
         {
             typename vector<Sample<T> >::const_iterator iter = lower_bound(samples.begin(),
                                                                            samples.end(),
@@ -303,7 +306,7 @@ template <typename T> Vector3d SampledOrbit<T>::computeVelocity(double jd) const
                 n = samples.size();
             else
                 n = iter - samples.begin();
-            lastSample = n;
+            lastSample.store(n, std::memory_order_relaxed);
         }
 
         if (n == 0)
@@ -453,7 +456,8 @@ private:
     vector<SampleXYZV<T> > samples;
     double boundingRadius;
     double period;
-    mutable int lastSample;
+    // Hint for the next search, shared by all threads
+    mutable std::atomic<int> lastSample;
 
     TrajectoryInterpolation interpolation;
 };
@@ -529,9 +533,9 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computePosition(double jd) c
     {
         SampleXYZV<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        int n = lastSample.load(std::memory_order_relaxed);
 
-        if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
+        if (n < 1 || n >= (int) samples.size() || jd <= samples[n - 1].t || jd > samples[n].t)
         {
             typename vector<SampleXYZV<T> >::const_iterator iter = lower_bound(samples.begin(),
                                                                                samples.end(),
@@ -541,7 +545,7 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computePosition(double jd) c
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            lastSample.store(n, std::memory_order_relaxed);
         }
 
         if (n == 0)
@@ -600,9 +604,9 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computeVelocity(double jd) c
     {
         SampleXYZV<T> samp;
         samp.t = jd;
-        int n = lastSample;
+        int n = lastSample.load(std::memory_order_relaxed);
 
-        if (n < 1 || n >= (int) samples.size() || jd < samples[n - 1].t || jd > samples[n].t)
+        if (n < 1 || n >= (int) samples.size() || jd <= samples[n - 1].t || jd > samples[n].t)
         {
             typename vector<SampleXYZV<T> >::const_iterator iter = lower_bound(samples.begin(),
                                                                                samples.end(),
@@ -612,7 +616,7 @@ template <typename T> Vector3d SampledOrbitXYZV<T>::computeVelocity(double jd) c
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            lastSample.store(n, std::memory_order_relaxed);
         }
 
         if (n > 0 && n < (int) samples.size())
@@ -665,6 +669,275 @@ template <typename T> void SampledOrbitXYZV<T>::sample(double /* startTime */, d
 }
 
 
+// Trajectory read from an indexed binary file. The file is memory mapped
+// rather than read, so only the pages holding the samples actually used
+// are loaded from disk, and the bucket index finds the samples around a
+// time in constant time for evenly sampled trajectories.
+class IndexedSampledOrbit : public CachingOrbit
+{
+public:
+    IndexedSampledOrbit(TrajectoryInterpolation /*_interpolation*/);
+    ~IndexedSampledOrbit() override = default;
+
+    bool load(const fs::path& filename);
+
+    double getPeriod() const override;
+    double getBoundingRadius() const override;
+    Vector3d computePosition(double jd) const override;
+    Vector3d computeVelocity(double jd) const override;
+
+    bool isPeriodic() const override;
+    void getValidRange(double& begin, double& end) const override;
+
+    void sample(double startTime, double endTime, OrbitSampleProc& proc) const override;
+
+private:
+    size_t findSample(double jd) const;
+    Vector3d samplePosition(size_t i) const;
+    Vector3d sampleVelocity(size_t i) const;
+
+    MappedFile file;
+    const XYZVIndexedHeader* header{ nullptr };
+    const uint64_t* index{ nullptr };
+    const XYZVBinaryData* samples{ nullptr };
+    size_t nSamples{ 0 };
+    // Hint for the next search, shared by all threads
+    mutable std::atomic<size_t> lastSample{ 0 };
+
+    TrajectoryInterpolation interpolation;
+};
+
+
+IndexedSampledOrbit::IndexedSampledOrbit(TrajectoryInterpolation _interpolation) :
+    interpolation(_interpolation)
+{
+}
+
+
+bool IndexedSampledOrbit::load(const fs::path& filename)
+{
+    if (!file.open(filename))
+        return false;
+
+    if (file.size() < sizeof(XYZVIndexedHeader))
+    {
+        fmt::fprintf(cerr, _("Error reading header of %s.\n"), filename);
+        return false;
+    }
+
+    header = reinterpret_cast<const XYZVIndexedHeader*>(file.data());
+    if (string(header->magic, 7) != "CELXYZI")
+    {
+        fmt::fprintf(cerr, _("Bad indexed xyzv file %s.\n"), filename);
+        return false;
+    }
+
+    if (header->byteOrder != __BYTE_ORDER__)
+    {
+        fmt::fprintf(cerr, _("Unsupported byte order %i, expected %i.\n"),
+                     header->byteOrder, __BYTE_ORDER__);
+        return false;
+    }
+
+    if (header->digits != std::numeric_limits<double>::digits)
+    {
+        fmt::fprintf(cerr, _("Unsupported digits number %i, expected %i.\n"),
+                     header->digits, std::numeric_limits<double>::digits);
+        return false;
+    }
+
+    // The counts are compared with the file size before being multiplied,
+    // so that huge counts can't overflow and pass the size check.
+    uint64_t available = file.size() - sizeof(XYZVIndexedHeader);
+    if (header->count == 0 || header->bucketCount == 0 || !(header->bucketWidth > 0.0) ||
+        header->bucketCount >= available / sizeof(uint64_t) ||
+        header->count > (available - (header->bucketCount + 1) * sizeof(uint64_t)) / sizeof(XYZVBinaryData))
+    {
+        fmt::fprintf(cerr, _("Bad indexed xyzv file %s.\n"), filename);
+        return false;
+    }
+
+    uint64_t indexSize = (header->bucketCount + 1) * sizeof(uint64_t);
+    index = reinterpret_cast<const uint64_t*>(file.data() + sizeof(XYZVIndexedHeader));
+    samples = reinterpret_cast<const XYZVBinaryData*>(file.data() + sizeof(XYZVIndexedHeader) + indexSize);
+    nSamples = (size_t) header->count;
+
+    // findSample() searches between index[b] and index[b + 1] without
+    // checking them
+    bool validIndex = index[0] == 0 && index[header->bucketCount] == header->count;
+    for (uint64_t i = 0; validIndex && i < header->bucketCount; i++)
+        validIndex = index[i] <= index[i + 1];
+    if (!validIndex)
+    {
+        fmt::fprintf(cerr, _("Bad indexed xyzv file %s.\n"), filename);
+        return false;
+    }
+
+    return true;
+}
+
+
+double IndexedSampledOrbit::getPeriod() const
+{
+    return samples[nSamples - 1].tdb - samples[0].tdb;
+}
+
+
+bool IndexedSampledOrbit::isPeriodic() const
+{
+    return false;
+}
+
+
+void IndexedSampledOrbit::getValidRange(double& begin, double& end) const
+{
+    begin = samples[0].tdb;
+    end = samples[nSamples - 1].tdb;
+}
+
+
+double IndexedSampledOrbit::getBoundingRadius() const
+{
+    return header->boundingRadius;
+}
+
+
+Vector3d IndexedSampledOrbit::samplePosition(size_t i) const
+{
+    return Map<const Vector3d>(samples[i].position);
+}
+
+
+// Velocities are stored in km/s; return km/Julian day
+Vector3d IndexedSampledOrbit::sampleVelocity(size_t i) const
+{
+    return Map<const Vector3d>(samples[i].velocity) * astro::daysToSecs(1.0);
+}
+
+
+// Return the index of the first sample not before jd, as lower_bound()
+// would.
+size_t IndexedSampledOrbit::findSample(double jd) const
+{
+    size_t n = lastSample.load(std::memory_order_relaxed);
+    if (n >= 1 && n < nSamples && jd > samples[n - 1].tdb && jd <= samples[n].tdb)
+        return n;
+
+    double bucket = std::floor((jd - header->startTime) / header->bucketWidth);
+    size_t b = (size_t) clamp(bucket, 0.0, (double) (header->bucketCount - 1));
+
+    const XYZVBinaryData* first = samples + index[b];
+    const XYZVBinaryData* last = samples + index[b + 1];
+    n = lower_bound(first, last, jd,
+                    [](const XYZVBinaryData& s, double t) { return s.tdb < t; }) - samples;
+
+    // Guard against rounding differences with the bucketing of the
+    // samples when the file was written.
+    while (n > 0 && samples[n - 1].tdb >= jd)
+        n--;
+    while (n < nSamples && samples[n].tdb < jd)
+        n++;
+
+    lastSample.store(n, std::memory_order_relaxed);
+    return n;
+}
+
+
+Vector3d IndexedSampledOrbit::computePosition(double jd) const
+{
+    Vector3d pos;
+    size_t n = findSample(jd);
+
+    if (n == 0)
+    {
+        pos = samplePosition(0);
+    }
+    else if (n < nSamples)
+    {
+        const XYZVBinaryData& s0 = samples[n - 1];
+        const XYZVBinaryData& s1 = samples[n];
+        double h = s1.tdb - s0.tdb;
+        double t = (jd - s0.tdb) / h;
+
+        if (interpolation == TrajectoryInterpolationLinear)
+        {
+            Vector3d p0 = samplePosition(n - 1);
+            pos = p0 + t * (samplePosition(n) - p0);
+        }
+        else if (interpolation == TrajectoryInterpolationCubic)
+        {
+            pos = cubicInterpolate(samplePosition(n - 1), sampleVelocity(n - 1) * h,
+                                   samplePosition(n), sampleVelocity(n) * h,
+                                   t);
+        }
+        else
+        {
+            // Unknown interpolation type
+            pos = Vector3d::Zero();
+        }
+    }
+    else
+    {
+        pos = samplePosition(nSamples - 1);
+    }
+
+    // Add correction for Celestia's coordinate system
+    return Vector3d(pos.x(), pos.z(), -pos.y());
+}
+
+
+Vector3d IndexedSampledOrbit::computeVelocity(double jd) const
+{
+    Vector3d vel(Vector3d::Zero());
+    size_t n = findSample(jd);
+
+    if (n > 0 && n < nSamples)
+    {
+        const XYZVBinaryData& s0 = samples[n - 1];
+        const XYZVBinaryData& s1 = samples[n];
+        double h = s1.tdb - s0.tdb;
+
+        if (interpolation == TrajectoryInterpolationLinear)
+        {
+            vel = (samplePosition(n) - samplePosition(n - 1)) * (1.0 / h);
+        }
+        else if (interpolation == TrajectoryInterpolationCubic)
+        {
+            double ih = 1.0 / h;
+            double t = (jd - s0.tdb) * ih;
+            vel = cubicInterpolateVelocity(samplePosition(n - 1), sampleVelocity(n - 1) * h,
+                                           samplePosition(n), sampleVelocity(n) * h,
+                                           t) * ih;
+        }
+    }
+
+    // Add correction for Celestia's coordinate system
+    return Vector3d(vel.x(), vel.z(), -vel.y());
+}
+
+
+// Only the samples spanning the requested time range are visited, so that
+// the rest of the file needn't be paged in.
+void IndexedSampledOrbit::sample(double startTime, double endTime,
+                                 OrbitSampleProc& proc) const
+{
+    size_t first = findSample(startTime);
+    size_t last = findSample(endTime);
+    if (first > 0)
+        first--;
+    last = min(last + 1, nSamples);
+
+    for (size_t i = first; i < last; i++)
+    {
+        Vector3d p = samplePosition(i);
+        Vector3d v = sampleVelocity(i);
+        proc.sample(samples[i].tdb,
+                    Vector3d(p.x(), p.z(), -p.y()),
+                    Vector3d(v.x(), v.z(), -v.y()));
+    }
+}
+
+
 // Scan past comments. A comment begins with the # character and ends
 // with a newline. Return true if the stream state is good. The stream
 // position will be at the first non-comment, non-whitespace character.
@@ -894,10 +1167,34 @@ LoadSampledOrbitXYZVBinary(const fs::path& filename, TrajectoryInterpolation int
 }
 
 
+/* Load an indexed xyzv trajectory file, if there's one.
+ */
+static Orbit* LoadIndexedSampledOrbit(const fs::path& filename, TrajectoryInterpolation interpolation)
+{
+    std::error_code ec;
+    if (!fs::exists(filename, ec))
+        return nullptr;
+
+    auto* orbit = new IndexedSampledOrbit(interpolation);
+    if (!orbit->load(filename))
+    {
+        delete orbit;
+        return nullptr;
+    }
+
+    return orbit;
+}
+
+
 /*! Load a trajectory file containing single precision positions.
  */
 Orbit* LoadSampledTrajectorySinglePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
+    auto f = filename;
+    Orbit* ret = LoadIndexedSampledOrbit(f += fs::path("idx"), interpolation);
+    if (ret != nullptr)
+        return ret;
+
     return LoadSampledOrbit(filename, interpolation, 0.0f);
 }
 
@@ -906,6 +1203,11 @@ Orbit* LoadSampledTrajectorySinglePrec(const fs::path& filename, TrajectoryInter
  */
 Orbit* LoadSampledTrajectoryDoublePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
+    auto f = filename;
+    Orbit* ret = LoadIndexedSampledOrbit(f += fs::path("idx"), interpolation);
+    if (ret != nullptr)
+        return ret;
+
     return LoadSampledOrbit(filename, interpolation, 0.0);
 }
 
@@ -915,7 +1217,12 @@ Orbit* LoadSampledTrajectoryDoublePrec(const fs::path& filename, TrajectoryInter
 Orbit* LoadXYZVTrajectorySinglePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
     auto f = filename;
-    Orbit* ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0f); // FIXME
+    Orbit* ret = LoadIndexedSampledOrbit(f += fs::path("idx"), interpolation);
+    if (ret != nullptr)
+        return ret;
+
+    f = filename;
+    ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0f); // FIXME
     if (ret != nullptr)
         return ret;
 
@@ -928,7 +1235,12 @@ Orbit* LoadXYZVTrajectorySinglePrec(const fs::path& filename, TrajectoryInterpol
 Orbit* LoadXYZVTrajectoryDoublePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
     auto f = filename;
-    Orbit* ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0); // FIXME
+    Orbit* ret = LoadIndexedSampledOrbit(f += fs::path("idx"), interpolation);
+    if (ret != nullptr)
+        return ret;
+
+    f = filename;
+    ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0); // FIXME
     if (ret != nullptr)
         return ret;
 
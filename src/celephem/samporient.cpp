@@ -14,6 +14,7 @@
 #include "samporient.h"
 #include <celmath/mathlib.h>
 #include <celmath/geomutil.h>
+#include <atomic>
 #include <cmath>
 #include <cassert>
 #include <string>
@@ -99,7 +100,8 @@ private:
 
 private:
     OrientationSampleVector samples;
-    mutable int lastSample{0};
+    // Hint for the next search, shared by all threads
+    mutable std::atomic<int> lastSample{0};
 
     enum InterpolationType
     {
@@ -165,12 +167,12 @@ SampledOrientation::getOrientation(double tjd) const
     {
         OrientationSample samp;
         samp.t = tjd;
-        int n = lastSample;
+        int n = lastSample.load(std::memory_order_relaxed);
 
         // Do a binary search to find the samples that define the orientation
         // at the current time. Cache the previous sample used and avoid
         // the search if the covers the requested time.
-        if (n < 1 || n >= (int) samples.size() || tjd < samples[n - 1].t || tjd > samples[n].t)
+        if (n < 1 || n >= (int) samples.size() || tjd <= samples[n - 1].t || tjd > samples[n].t)
         {
             OrientationSampleVector::const_iterator iter = lower_bound(samples.begin(),
                                                                        samples.end(),
@@ -180,7 +182,7 @@ SampledOrientation::getOrientation(double tjd) const
             else
                 n = iter - samples.begin();
 
-            lastSample = n;
+            lastSample.store(n, std::memory_order_relaxed);
         }
 
         if (n == 0)
@@ -42,6 +42,14 @@ GetScriptedObjectContext()
 }
 
 
+std::recursive_mutex&
+GetScriptedObjectMutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+
 /*! Generate a unique name for this script orbit object so that
  * we can refer to it later.
  */
@@ -18,6 +18,7 @@
 
 #include "lua.hpp"
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <celengine/parser.h>
 
@@ -26,6 +27,10 @@ void SetScriptedObjectContext(lua_State* l);
 
 lua_State* GetScriptedObjectContext();
 
+// Lua states can't be used from several threads at once; scripted orbits
+// and rotations hold this lock while calling into the script context.
+std::recursive_mutex& GetScriptedObjectMutex();
+
 
 std::string GenerateScriptObjectName();
 
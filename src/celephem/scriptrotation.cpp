@@ -138,6 +138,8 @@ ScriptedRotation::initialize(const std::string& moduleName,
 Quaterniond
 ScriptedRotation::spin(double tjd) const
 {
+    // The lock also guards the cached orientation
+    std::lock_guard<std::recursive_mutex> lock(GetScriptedObjectMutex());
     if (tjd != lastTime || !cacheable)
     {
         lua_getglobal(luaState, luaRotationObjectName.c_str());
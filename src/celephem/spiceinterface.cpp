@@ -111,3 +111,10 @@ bool LoadSpiceKernel(const fs::path& filepath)
      clog << "Loaded SPK file " << filepath << "\n";
      return true;
 }
+
+
+std::mutex& GetSpiceMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
@@ -12,6 +12,7 @@
 #ifndef _CELENGINE_SPICEINTERFACE_H_
 #define _CELENGINE_SPICEINTERFACE_H_
 
+#include <mutex>
 #include <string>
 #include <celcompat/filesystem.h>
 
@@ -23,4 +24,8 @@ extern bool GetNaifId(const std::string& name, int* id);
 extern bool IsSpiceKernelLoaded(const fs::path& filepath);
 extern bool LoadSpiceKernel(const fs::path& filepath);
 
+// The SPICE Toolkit isn't thread-safe; hold this lock while calling it
+// from code which may run on several threads.
+extern std::mutex& GetSpiceMutex();
+
 #endif // _CELENGINE_SPICEINTERFACE_H_
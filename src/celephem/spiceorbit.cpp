@@ -248,6 +248,7 @@ SpiceOrbit::computePosition(double jd) const
     {
         // Input time for SPICE is seconds after J2000
         double t = astro::daysToSecs(jd - astro::J2000);
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
         double position[3];
         double lt;          // One way light travel time
 
@@ -293,6 +294,7 @@ SpiceOrbit::computeVelocity(double jd) const
     {
         // Input time for SPICE is seconds after J2000
         double t = astro::daysToSecs(jd - astro::J2000);
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
         double state[6];
         double lt;          // One way light travel time
 
@@ -152,6 +152,7 @@ SpiceRotation::computeSpin(double jd) const
         double t = astro::daysToSecs(jd - astro::J2000);
         double xform[3][3];
 
+        std::lock_guard<std::mutex> lock(GetSpiceMutex());
         pxform_c(m_frameName.c_str(), m_baseFrameName.c_str(), t, xform);
 
         if (failed_c())
@@ -0,0 +1,87 @@
+// threadcache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Per-thread caches for the results of orbit and rotation evaluation.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Orbits and rotation models cache the last state they computed, as the
+// same one is often needed several times per frame. Keeping that state in
+// the object would prevent evaluating it from several threads at once, so
+// each thread has its own cache of states instead, with an entry for each
+// live caching object.
+//
+// An id is made of the index of the object's entry, in the low 32 bits,
+// and of a sequence number telling apart the objects which used that entry
+// in turn. The entries are reused after releaseId(), so that their number
+// stays that of the live objects. T must have an id member, which is zero
+// for unused entries.
+template<typename T> class ThreadCache
+{
+ public:
+    // The entries are allocated in pages, so that references to them
+    // stay valid when evaluating an object adds entries for others.
+    static constexpr unsigned int PageSize = 256;
+
+    static T& entry(uint64_t id)
+    {
+        static thread_local std::vector<std::unique_ptr<T[]>> pages;
+        auto index = (uint32_t) id;
+        size_t page = index / PageSize;
+        if (page >= pages.size())
+            pages.resize(page + 1);
+        if (pages[page] == nullptr)
+            pages[page].reset(new T[PageSize]);
+        return pages[page][index % PageSize];
+    }
+
+    static uint64_t newId()
+    {
+        Ids& ids = getIds();
+        std::lock_guard<std::mutex> lock(ids.mutex);
+        uint32_t index;
+        if (ids.freeIndices.empty())
+        {
+            index = ids.nIndices++;
+        }
+        else
+        {
+            index = ids.freeIndices.back();
+            ids.freeIndices.pop_back();
+        }
+        return (++ids.sequence << 32) | index;
+    }
+
+    static void releaseId(uint64_t id)
+    {
+        Ids& ids = getIds();
+        std::lock_guard<std::mutex> lock(ids.mutex);
+        ids.freeIndices.push_back((uint32_t) id);
+    }
+
+ private:
+    struct Ids
+    {
+        std::mutex mutex;
+        std::vector<uint32_t> freeIndices;
+        uint32_t nIndices{ 0 };
+        uint64_t sequence{ 0 };
+    };
+
+    static Ids& getIds()
+    {
+        static Ids ids;
+        return ids;
+    }
+};
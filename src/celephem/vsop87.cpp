@@ -13,10 +13,16 @@
 // of the License, or (at your option) any later version.
 
 #include <cmath>
+#include <vector>
 #include <celmath/mathlib.h>
 #include <celengine/astro.h>
 #include "vsop87.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 using namespace Eigen;
 using namespace std;
 
@@ -11011,6 +11017,179 @@ static double SumSeries(const VSOPSeries& series, double t)
     return x;
 }
 
+
+// Time step used to differentiate positions, as in
+// CachingOrbit::computeVelocity()
+static const double VelocityDiffDelta = 1.0 / 1440.0;
+
+
+#ifdef USE_SSE2
+// pi/2 in three parts of 33 bits (from fdlibm), so that the products with
+// the quadrant number are exact for quadrants below 2^20.
+static const double PiOver2_1 = 1.57079632673412561417e+00;
+static const double PiOver2_2 = 6.07710050630396597660e-11;
+static const double PiOver2_3 = 2.02226624871116645580e-21;
+
+// VectorCos() is accurate for arguments up to this magnitude
+static const double MaxVectorCosArgument = 1.0e6;
+
+/*! Compute the cosines of two doubles. The argument is reduced to
+ *  [-pi/4, pi/4] by subtracting the nearest multiple of pi/2 in three
+ *  parts, then the sine or cosine of the remainder is computed with the
+ *  fdlibm minimax polynomials. The result is within two ulps of the
+ *  exact value for arguments below MaxVectorCosArgument.
+ */
+static inline __m128d VectorCos(__m128d x)
+{
+    __m128i q = _mm_cvtpd_epi32(_mm_mul_pd(x, _mm_set1_pd(2.0 / PI)));
+    __m128d qd = _mm_cvtepi32_pd(q);
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(qd, _mm_set1_pd(PiOver2_1)));
+    r = _mm_sub_pd(r, _mm_mul_pd(qd, _mm_set1_pd(PiOver2_2)));
+    r = _mm_sub_pd(r, _mm_mul_pd(qd, _mm_set1_pd(PiOver2_3)));
+    __m128d z = _mm_mul_pd(r, r);
+
+    __m128d c = _mm_set1_pd(-1.13596475577881948265e-11);
+    c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(2.08757232129817482790e-09));
+    c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(-2.75573143513906633035e-07));
+    c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(2.48015872894767294178e-05));
+    c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(-1.38888888888741095749e-03));
+    c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(4.16666666666666019037e-02));
+    __m128d cosr = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), z)),
+                              _mm_mul_pd(_mm_mul_pd(z, z), c));
+
+    __m128d s = _mm_set1_pd(1.58969099521155010221e-10);
+    s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-2.50507602534068634195e-08));
+    s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(2.75573137070700676789e-06));
+    s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-1.98412698298579493134e-04));
+    s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(8.33333333332248946124e-03));
+    s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-1.66666666666666324348e-01));
+    __m128d sinr = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, z), s));
+
+    // cos(x) is cos(r), -sin(r), -cos(r) and sin(r) in quadrants 0 to 3.
+    // Copy each quadrant number to both halves of its 64 bit lane to
+    // build the masks.
+    __m128i q64 = _mm_shuffle_epi32(q, _MM_SHUFFLE(1, 1, 0, 0));
+    __m128i one = _mm_set1_epi32(1);
+    __m128d useSin = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(q64, one), one));
+    __m128d result = _mm_or_pd(_mm_and_pd(useSin, sinr), _mm_andnot_pd(useSin, cosr));
+    __m128i sign = _mm_slli_epi64(_mm_and_si128(_mm_add_epi32(q64, one), _mm_set1_epi32(2)), 62);
+    return _mm_xor_pd(result, _mm_castsi128_pd(sign));
+}
+#endif
+
+
+/*! The terms of a series as separate arrays, padded with null terms to an
+ *  even count, for the vectorized evaluation.
+ */
+class VSOPTermTable
+{
+ public:
+    explicit VSOPTermTable(const VSOPSeries& series)
+    {
+        size_t n = (series.nTerms + 1) & ~1;
+        A.assign(n, 0.0);
+        B.assign(n, 0.0);
+        C.assign(n, 0.0);
+        for (int i = 0; i < series.nTerms; i++)
+        {
+            A[i] = series.terms[i].A;
+            B[i] = series.terms[i].B;
+            C[i] = series.terms[i].C;
+            maxB = max(maxB, abs(B[i]));
+            maxC = max(maxC, abs(C[i]));
+        }
+    }
+
+    double sum(double t) const
+    {
+#ifdef USE_SSE2
+        if (maxB + maxC * abs(t) < MaxVectorCosArgument)
+        {
+            __m128d tv = _mm_set1_pd(t);
+            __m128d x = _mm_setzero_pd();
+            for (size_t i = 0; i < A.size(); i += 2)
+            {
+                __m128d arg = _mm_add_pd(_mm_loadu_pd(&B[i]), _mm_mul_pd(_mm_loadu_pd(&C[i]), tv));
+                x = _mm_add_pd(x, _mm_mul_pd(_mm_loadu_pd(&A[i]), VectorCos(arg)));
+            }
+            return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+        }
+#endif
+        double x = 0.0;
+        for (size_t i = 0; i < A.size(); i++)
+            x += A[i] * cos(B[i] + C[i] * t);
+        return x;
+    }
+
+    // Sum the series at two times at once
+    void sum(const double t[2], double x[2]) const
+    {
+#ifdef USE_SSE2
+        if (maxB + maxC * max(abs(t[0]), abs(t[1])) < MaxVectorCosArgument)
+        {
+            __m128d tv = _mm_loadu_pd(t);
+            __m128d xv = _mm_setzero_pd();
+            for (size_t i = 0; i < A.size(); i++)
+            {
+                __m128d arg = _mm_add_pd(_mm_set1_pd(B[i]), _mm_mul_pd(_mm_set1_pd(C[i]), tv));
+                xv = _mm_add_pd(xv, _mm_mul_pd(_mm_set1_pd(A[i]), VectorCos(arg)));
+            }
+            _mm_storeu_pd(x, xv);
+            return;
+        }
+#endif
+        x[0] = sum(t[0]);
+        x[1] = sum(t[1]);
+    }
+
+ private:
+    std::vector<double> A, B, C;
+    double maxB{ 0.0 };
+    double maxC{ 0.0 };
+};
+
+typedef std::vector<VSOPTermTable> VSOPTermTables;
+
+
+static VSOPTermTables MakeTermTables(const VSOPSeries* series, int nSeries)
+{
+    VSOPTermTables tables;
+    for (int i = 0; i < nSeries; i++)
+        tables.emplace_back(series[i]);
+    return tables;
+}
+
+
+// Evaluate the polynomial in t whose coefficients are the series
+static double SumPolynomial(const VSOPTermTables& tables, double t)
+{
+    double x = 0.0;
+    double T = 1.0;
+    for (const auto& table : tables)
+    {
+        x += table.sum(t) * T;
+        T *= t;
+    }
+    return x;
+}
+
+
+static void SumPolynomial(const VSOPTermTables& tables, const double t[2], double x[2])
+{
+    double T[2] = { 1.0, 1.0 };
+    x[0] = x[1] = 0.0;
+    for (const auto& table : tables)
+    {
+        double s[2];
+        table.sum(t, s);
+        for (int j = 0; j < 2; j++)
+        {
+            x[j] += s[j] * T[j];
+            T[j] *= t[j];
+        }
+    }
+}
+
 class VSOP87Orbit : public CachingOrbit
 {
  private:
@@ -11022,19 +11201,31 @@ class VSOP87Orbit : public CachingOrbit
     int nR;
     double period;
     double boundingRadius;
+    bool vectorized;
+    VSOPTermTables tablesL;
+    VSOPTermTables tablesB;
+    VSOPTermTables tablesR;
 
  public:
     VSOP87Orbit(VSOPSeries* _vsL, int _nL,
                 VSOPSeries* _vsB, int _nB,
                 VSOPSeries* _vsR, int _nR,
                 double _period,
-                double _boundingRadius) :
+                double _boundingRadius,
+                bool _vectorized) :
         vsL(_vsL), nL(_nL),
         vsB(_vsB), nB(_nB),
         vsR(_vsR), nR(_nR),
         period(_period),
-        boundingRadius(_boundingRadius)
+        boundingRadius(_boundingRadius),
+        vectorized(_vectorized)
     {
+        if (vectorized)
+        {
+            tablesL = MakeTermTables(vsL, nL);
+            tablesB = MakeTermTables(vsB, nB);
+            tablesR = MakeTermTables(vsR, nR);
+        }
     };
     ~VSOP87Orbit() override = default;
 
@@ -11053,6 +11244,13 @@ class VSOP87Orbit : public CachingOrbit
         // t is Julian millenia since J2000.0
         double t = (jd - 2451545.0) / 365250.0;
 
+        if (vectorized)
+        {
+            return toCartesian(SumPolynomial(tablesL, t),
+                               SumPolynomial(tablesB, t),
+                               SumPolynomial(tablesR, t));
+        }
+
         // Heliocentric coordinates
         double l = 0.0; // longitude
         double b = 0.0; // latitude
@@ -11085,15 +11283,29 @@ class VSOP87Orbit : public CachingOrbit
             T = t * T;
         }
 
-        r *= KM_PER_AU;
+        return toCartesian(l, b, r);
+    }
 
-        // Corrections for internal coordinate system
-        b -= PI / 2;
-        l += PI;
+    /*! Compute the positions at two times at once, sharing the loads of
+     *  the terms between both.
+     */
+    void computePositions(const double jd[2], Vector3d p[2]) const
+    {
+        if (!vectorized)
+        {
+            p[0] = computePosition(jd[0]);
+            p[1] = computePosition(jd[1]);
+            return;
+        }
 
-        return Vector3d(cos(l) * sin(b) * r,
-                        cos(b) * r,
-                        -sin(l) * sin(b) * r);
+        double t[2] = { (jd[0] - 2451545.0) / 365250.0,
+                        (jd[1] - 2451545.0) / 365250.0 };
+        double l[2], b[2], r[2];
+        SumPolynomial(tablesL, t, l);
+        SumPolynomial(tablesB, t, b);
+        SumPolynomial(tablesR, t, r);
+        p[0] = toCartesian(l[0], b[0], r[0]);
+        p[1] = toCartesian(l[1], b[1], r[1]);
     }
 
 
@@ -11104,6 +11316,27 @@ class VSOP87Orbit : public CachingOrbit
     {
         double span = getPeriod();
 
+        if (vectorized)
+        {
+            // The samples are uniformly spaced, so there's no need for the
+            // error estimates of adaptiveSample(). Each sample needs the
+            // position at t and t + VelocityDiffDelta for the velocity,
+            // which are evaluated together.
+            double step = span / 150.0;
+            double t = startTime;
+            for (;;)
+            {
+                double jd[2] = { t, t + VelocityDiffDelta };
+                Vector3d p[2];
+                computePositions(jd, p);
+                proc.sample(t, p[0], (p[1] - p[0]) * (1.0 / VelocityDiffDelta));
+                if (t >= endTime)
+                    break;
+                t += min(step, endTime - t);
+            }
+            return;
+        }
+
         AdaptiveSamplingParameters samplingParams{};
         samplingParams.tolerance = 1.0; // kilometers
 
@@ -11117,6 +11350,19 @@ class VSOP87Orbit : public CachingOrbit
         adaptiveSample(startTime, endTime, proc, samplingParams);
     }
 
+ private:
+    static Vector3d toCartesian(double l, double b, double r)
+    {
+        r *= KM_PER_AU;
+
+        // Corrections for internal coordinate system
+        b -= PI / 2;
+        l += PI;
+
+        return Vector3d(cos(l) * sin(b) * r,
+                        cos(b) * r,
+                        -sin(l) * sin(b) * r);
+    }
 };
 
 
@@ -11132,19 +11378,31 @@ class VSOP87OrbitRect : public CachingOrbit
     int nZ;
     double period;
     double boundingRadius;
+    bool vectorized;
+    VSOPTermTables tablesX;
+    VSOPTermTables tablesY;
+    VSOPTermTables tablesZ;
 
  public:
     VSOP87OrbitRect(VSOPSeries* _vsX, int _nX,
                     VSOPSeries* _vsY, int _nY,
                     VSOPSeries* _vsZ, int _nZ,
                     double _period,
-                    double _boundingRadius) :
+                    double _boundingRadius,
+                    bool _vectorized) :
         vsX(_vsX), nX(_nX),
         vsY(_vsY), nY(_nY),
         vsZ(_vsZ), nZ(_nZ),
         period(_period),
-        boundingRadius(_boundingRadius)
+        boundingRadius(_boundingRadius),
+        vectorized(_vectorized)
     {
+        if (vectorized)
+        {
+            tablesX = MakeTermTables(vsX, nX);
+            tablesY = MakeTermTables(vsY, nY);
+            tablesZ = MakeTermTables(vsZ, nZ);
+        }
     };
     ~VSOP87OrbitRect() override = default;
 
@@ -11170,31 +11428,40 @@ class VSOP87OrbitRect : public CachingOrbit
 
         Vector3d v(Vector3d::Zero());
 
-        int i;
-        double T;
-
-        // Evaluate series for x
-        T = 1;
-        for (i = 0; i < nX; i++)
-        {
-            v.x() += SumSeries(vsX[i], t) * T;
-            T = t * T;
-        }
-
-        // Evaluate series for y
-        T = 1;
-        for (i = 0; i < nY; i++)
+        if (vectorized)
         {
-            v.y() += SumSeries(vsY[i], t) * T;
-            T = t * T;
+            v = Vector3d(SumPolynomial(tablesX, t),
+                         SumPolynomial(tablesY, t),
+                         SumPolynomial(tablesZ, t));
         }
-
-        // Evaluate series for z
-        T = 1;
-        for (i = 0; i < nZ; i++)
+        else
         {
-            v.z() += SumSeries(vsZ[i], t) * T;
-            T = t * T;
+            int i;
+            double T;
+
+            // Evaluate series for x
+            T = 1;
+            for (i = 0; i < nX; i++)
+            {
+                v.x() += SumSeries(vsX[i], t) * T;
+                T = t * T;
+            }
+
+            // Evaluate series for y
+            T = 1;
+            for (i = 0; i < nY; i++)
+            {
+                v.y() += SumSeries(vsY[i], t) * T;
+                T = t * T;
+            }
+
+            // Evaluate series for z
+            T = 1;
+            for (i = 0; i < nZ; i++)
+            {
+                v.z() += SumSeries(vsZ[i], t) * T;
+                T = t * T;
+            }
         }
 
         v *= KM_PER_AU;
@@ -11212,7 +11479,7 @@ static double yearToJD(int year)
 }
 
 
-Orbit* CreateVSOP87Orbit(const string& name)
+Orbit* CreateVSOP87Orbit(const string& name, bool vectorized)
 {
     if (name == "vsop87-mercury")
     {
@@ -11220,7 +11487,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    mercury_B, 6,
                                    mercury_R, 5,
                                    0.2408 * 365.25,
-                                   60000000.0);
+                                   60000000.0,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11230,7 +11498,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    venus_B, 6,
                                    venus_R, 5,
                                    0.6152 * 365.25,
-                                   100000000.0);
+                                   100000000.0,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11240,7 +11509,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    earth_B, 3,
                                    earth_R, 6,
                                    365.25,
-                                   160000000.0);
+                                   160000000.0,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11250,7 +11520,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    mars_B, 6,
                                    mars_R, 6,
                                    1.8809 * 365.25,
-                                   240000000);
+                                   240000000,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11260,7 +11531,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    jupiter_B, 6,
                                    jupiter_R, 6,
                                    11.86 * 365.25,
-                                   800000000.0);
+                                   800000000.0,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11270,7 +11542,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    saturn_B, 6,
                                    saturn_R, 6,
                                    29.4577 * 365.25,
-                                   1.5e9);
+                                   1.5e9,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11280,7 +11553,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    uranus_B, 4,
                                    uranus_R, 5,
                                    84.0139 * 365.25,
-                                   3.0e9);
+                                   3.0e9,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11290,7 +11564,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                    neptune_B, 4,
                                    neptune_R, 5,
                                    164.793 * 365.25,
-                                   4.7e9);
+                                   4.7e9,
+                                   vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(4000),
                               astro::SolarMass);
     }
@@ -11300,7 +11575,8 @@ Orbit* CreateVSOP87Orbit(const string& name)
                                        sun_Y, 5,
                                        sun_Z, 3,
                                        0.0,
-                                       2000000);
+                                       2000000,
+                                       vectorized);
         return new MixedOrbit(o, yearToJD(-4000), yearToJD(6000),
                               astro::SolarMass);
     }
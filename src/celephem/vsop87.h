@@ -13,6 +13,8 @@
 #include <string>
 #include "orbit.h"
 
-extern Orbit* CreateVSOP87Orbit(const std::string& name);
+// The series are summed with SIMD instructions when vectorized is true
+// and they are available; otherwise they are summed one term at a time.
+extern Orbit* CreateVSOP87Orbit(const std::string& name, bool vectorized = true);
 
 #endif // _CELENGINE_VSOP87_H_
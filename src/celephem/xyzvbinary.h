@@ -17,3 +17,22 @@ struct XYZVBinaryData
     double position[3];
     double velocity[3];
 };
+
+// Indexed trajectory file, read through a memory mapping. The header is
+// followed by bucketCount + 1 uint64_t sample indices and then by count
+// XYZVBinaryData records sorted by time. The time span of the trajectory
+// is divided into buckets of equal width; samples index[i] up to but not
+// including index[i + 1] fall into bucket i, so that the samples around
+// a given time are found without searching the whole trajectory.
+struct XYZVIndexedHeader
+{
+    char magic[8];
+    uint16_t byteOrder;
+    uint16_t digits;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t bucketCount;
+    double startTime;
+    double bucketWidth;
+    double boundingRadius;
+};
@@ -50,7 +50,6 @@ bool AVICapture::start(const string& filename,
     // Compute the width of a row in bytes; pad so that rows are aligned on
     // 4 byte boundaries.
     int rowBytes = (width * 3 + 3) & ~0x3;
-    image = new unsigned char[rowBytes * height];
 
     HRESULT hr = AVIFileOpenA(&aviFile,
                               filename.c_str(),
@@ -121,6 +120,11 @@ bool AVICapture::start(const string& filename,
         return false;
     }
 
+    // Frames are written to the stream on the encoder thread
+    pipeline.reset(new CapturePipeline(renderer,
+                                       [this](const CapturedFrame& frame) { return writeFrame(frame); },
+                                       ReadbackLatency, MaxQueuedFrames));
+
     capturing = true;
     frameCounter = 0;
 
@@ -142,31 +146,27 @@ bool AVICapture::captureFrame()
     if (!capturing)
         return false;
 
-    // Get the dimensions of the current viewport
-    int x, y, w, h;
-    renderer->getViewport(&x, &y, &w, &h);
-
-    x += (w - width) / 2;
-    y += (h - height) / 2;
-    renderer->captureFrame(x, y, width, height,
-                 Renderer::PixelFormat::BGR_EXT,
-                 image);
+    return captureViewportCenter(width, height, Renderer::PixelFormat::BGR_EXT);
+}
 
-    int rowBytes = (width * 3 + 3) & ~0x3;
 
+// Run on the encoder thread of the capture pipeline. Captured frames have
+// the layout of a bottom up DIB.
+bool AVICapture::writeFrame(const CapturedFrame& frame)
+{
     LONG samplesWritten = 0;
     LONG bytesWritten = 0;
     HRESULT hr = AVIStreamWrite(compAviStream,
                                 frameCounter,
                                 1,
-                                image,
-                                rowBytes * height,
+                                (LPVOID) frame.pixels.data(),
+                                (LONG) frame.pixels.size(),
                                 AVIIF_KEYFRAME,
                                 &samplesWritten,
                                 &bytesWritten);
     if (hr != AVIERR_OK)
     {
-        DPRINTF(0, "AVIStreamWrite failed on frame %d\n", frameCounter);
+        DPRINTF(0, "AVIStreamWrite failed on frame %d\n", frameCounter.load());
         return false;
     }
 
@@ -180,6 +180,9 @@ bool AVICapture::captureFrame()
 
 void AVICapture::cleanup()
 {
+    // Wait for the frames still in the pipeline to be written
+    pipeline.reset();
+
     if (aviStream != nullptr)
     {
         AVIStreamRelease(aviStream);
@@ -195,11 +198,6 @@ void AVICapture::cleanup()
         AVIFileRelease(aviFile);
         aviFile = nullptr;
     }
-    if (image != nullptr)
-    {
-        delete[] image;
-        image = nullptr;
-    }
 }
 
 
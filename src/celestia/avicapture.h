@@ -10,6 +10,7 @@
 #ifndef _AVICAPTURE_H_
 #define _AVICAPTURE_H_
 
+#include <atomic>
 #include <windows.h>
 #include <windowsx.h>
 #include <vfw.h>
@@ -38,17 +39,18 @@ class AVICapture : public MovieCapture
 
  private:
     void cleanup();
+    bool writeFrame(const CapturedFrame&);
 
  private:
     int width{ -1 };
     int height{ -1 };
     float frameRate{ 30.0f };
-    int frameCounter{ 0 };
+    // Updated by the encoder thread
+    std::atomic<int> frameCounter{ 0 };
     bool capturing{ false };
     PAVIFILE aviFile{ nullptr };
     PAVISTREAM aviStream{ nullptr };
     PAVISTREAM compAviStream{ nullptr };
-    unsigned char* image{ nullptr };
 };
 
 #endif // _AVICAPTURE_H_
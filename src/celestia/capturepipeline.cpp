@@ -0,0 +1,180 @@
+// capturepipeline.cpp
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Read back and encoding of captured frames off the render thread.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <iostream>
+#include <fmt/printf.h>
+#include "capturepipeline.h"
+
+using namespace std;
+
+
+CapturePipeline::CapturePipeline(const Renderer* _renderer,
+                                 Encoder _encoder,
+                                 unsigned int _latency,
+                                 size_t _maxQueuedFrames) :
+    renderer(_renderer),
+    defaultEncoder(std::move(_encoder)),
+    latency(_latency),
+    maxQueuedFrames(max(_maxQueuedFrames, (size_t) 1))
+{
+    encoderThread = std::thread([this] { encoderMain(); });
+}
+
+CapturePipeline::~CapturePipeline()
+{
+    finish();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_all();
+    encoderThread.join();
+}
+
+bool CapturePipeline::capture(int x, int y, int width, int height,
+                              Renderer::PixelFormat format, bool back,
+                              Encoder encoder)
+{
+    if (readback == nullptr)
+        readback.reset(new FrameReadback(renderer, latency));
+
+    bool ok = readback->read(x, y, width, height, format, back);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            pendingEncoders.push_back(std::move(encoder));
+        else
+            droppedCount++;
+    }
+
+    while (readback->hasReadyFrame())
+        retrieveFrame();
+    writeErrors();
+
+    return ok;
+}
+
+void CapturePipeline::retrieveFrame()
+{
+    CapturedFrame frame;
+    Encoder encoder;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spareFrames.empty())
+        {
+            frame = std::move(spareFrames.back());
+            spareFrames.pop_back();
+        }
+        encoder = std::move(pendingEncoders.front());
+        pendingEncoders.pop_front();
+    }
+
+    if (readback->retrieve(frame))
+    {
+        submit(std::move(frame), std::move(encoder));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        droppedCount++;
+    }
+}
+
+void CapturePipeline::submit(CapturedFrame&& frame, Encoder encoder)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    encoderProgress.wait(lock, [this] { return queue.size() < maxQueuedFrames; });
+    queue.push_back({ std::move(frame), std::move(encoder) });
+    lock.unlock();
+    frameQueued.notify_one();
+}
+
+void CapturePipeline::finish()
+{
+    if (readback != nullptr)
+    {
+        while (readback->hasPendingFrame())
+            retrieveFrame();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        encoderProgress.wait(lock, [this] { return queue.empty() && !encoding; });
+    }
+    writeErrors();
+}
+
+void CapturePipeline::reportError(std::string message)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    errors.push_back(std::move(message));
+}
+
+void CapturePipeline::writeErrors()
+{
+    std::vector<std::string> messages;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages.swap(errors);
+    }
+    for (const auto& message : messages)
+        fmt::fprintf(cerr, "%s\n", message);
+}
+
+int CapturePipeline::getQueuedFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int) (pendingEncoders.size() + queue.size()) + (encoding ? 1 : 0);
+}
+
+int CapturePipeline::getDroppedFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedCount;
+}
+
+int CapturePipeline::getEncodedFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return encodedCount;
+}
+
+void CapturePipeline::encoderMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        frameQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        QueuedFrame queued = std::move(queue.front());
+        queue.pop_front();
+        encoding = true;
+        lock.unlock();
+        // There's room in the queue for another frame
+        encoderProgress.notify_all();
+
+        const Encoder& encoder = queued.encoder ? queued.encoder : defaultEncoder;
+        bool ok = encoder && encoder(queued.frame);
+
+        lock.lock();
+        encoding = false;
+        if (ok)
+            encodedCount++;
+        else
+            droppedCount++;
+        if (spareFrames.size() <= maxQueuedFrames)
+            spareFrames.push_back(std::move(queued.frame));
+        encoderProgress.notify_all();
+    }
+}
@@ -0,0 +1,106 @@
+// capturepipeline.h
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Read back and encoding of captured frames off the render thread.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <celengine/framereadback.h>
+
+
+// Frames captured by the render thread are read back through a
+// FrameReadback ring, then put in a bounded queue from which a dedicated
+// thread encodes them in order. The render thread only waits when the
+// queue is full.
+class CapturePipeline
+{
+ public:
+    // Called on the encoder thread; returns false if the frame couldn't be
+    // encoded.
+    typedef std::function<bool(const CapturedFrame&)> Encoder;
+
+    // Frames are retrieved from the read back ring latency frames after
+    // being captured. At most maxQueuedFrames read back frames wait for
+    // the encoder.
+    CapturePipeline(const Renderer* renderer, Encoder encoder,
+                    unsigned int latency, size_t maxQueuedFrames);
+    ~CapturePipeline();
+
+    CapturePipeline(const CapturePipeline&) = delete;
+    CapturePipeline& operator=(const CapturePipeline&) = delete;
+
+    // Start reading back a rectangle of the frame buffer, to be encoded
+    // by encoder, or by the encoder of the pipeline if it is null. This
+    // must be called from the render thread.
+    bool capture(int x, int y, int width, int height,
+                 Renderer::PixelFormat format, bool back,
+                 Encoder encoder = nullptr);
+
+    // Queue a frame read by other means for encoding, waiting while the
+    // queue is full.
+    void submit(CapturedFrame&& frame, Encoder encoder = nullptr);
+
+    // Wait until all the frames captured have been encoded. This must be
+    // called from the render thread when frames have been captured.
+    void finish();
+
+    // Report why a frame couldn't be encoded. This is meant for encoders:
+    // the messages are written to the standard error by the render thread,
+    // in capture() and finish(), as it may be redirected to the console.
+    void reportError(std::string message);
+
+    // Frames captured but not encoded yet
+    int getQueuedFrameCount() const;
+    // Frames which couldn't be read back or encoded
+    int getDroppedFrameCount() const;
+    int getEncodedFrameCount() const;
+
+ private:
+    struct QueuedFrame
+    {
+        CapturedFrame frame;
+        Encoder encoder;
+    };
+
+    void retrieveFrame();
+    void writeErrors();
+    void encoderMain();
+
+    const Renderer* renderer;
+    Encoder defaultEncoder;
+    unsigned int latency;
+    size_t maxQueuedFrames;
+
+    // Created on first use, as it needs the GL context
+    std::unique_ptr<FrameReadback> readback;
+    std::deque<Encoder> pendingEncoders;
+
+    std::deque<QueuedFrame> queue;
+    std::vector<std::string> errors;
+    // Frames which have been encoded, kept to reuse their pixel storage
+    std::vector<CapturedFrame> spareFrames;
+    bool encoding{ false };
+    bool stopping{ false };
+    int encodedCount{ 0 };
+    int droppedCount{ 0 };
+
+    mutable std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable encoderProgress;
+    std::thread encoderThread;
+};
@@ -52,6 +52,8 @@
 #include <set>
 #include <celengine/rectangle.h>
 #include <celengine/mapmanager.h>
+#include <celengine/meshmanager.h>
+#include <celengine/texmanager.h>
 
 #ifdef CELX
 #include <celephem/scriptobject.h>
@@ -86,6 +88,13 @@ static const float MinimumFOV = degToRad(0.001f);
 static float KeyRotationAccel = degToRad(120.0f);
 static float MouseRotationSensitivity = degToRad(1.0f);
 
+// Screen shots waiting to be written before saveScreenShot() blocks
+static const size_t MaxQueuedScreenShots = 4;
+
+// Completions offered for typed object names; the best ones are kept when
+// a short prefix matches many catalog names.
+static const size_t MaxCompletionCount = 1000;
+
 
 static void warning(string s)
 {
@@ -171,6 +180,9 @@ CelestiaCore::~CelestiaCore()
     if (movieCapture != nullptr)
         recordEnd();
 
+    // Finish writing screen shots
+    screenshotPipeline.reset();
+
     delete timer;
     delete renderer;
 
@@ -321,6 +333,12 @@ void CelestiaCore::runScript(const fs::path& filename)
 }
 
 
+bool CelestiaCore::isScriptRunning() const
+{
+    return m_script != nullptr;
+}
+
+
 static bool checkMask(int modifiers, int mask)
 {
     return (modifiers & mask) == mask;
@@ -922,7 +940,7 @@ void CelestiaCore::charEntered(const char *c_p, int modifiers)
                     typedText = string(typedText, 0, typedText.size() - 1);
                     if (typedText.size() > 0)
                     {
-                        typedTextCompletion = sim->getObjectCompletion(typedText, (renderer->getLabelMode() & Renderer::LocationLabels) != 0);
+                        typedTextCompletion = sim->getObjectCompletion(typedText, (renderer->getLabelMode() & Renderer::LocationLabels) != 0, MaxCompletionCount);
                     } else {
                         typedTextCompletion.clear();
                     }
@@ -3507,6 +3525,9 @@ void CelestiaCore::renderOverlay()
                               movieWidth, movieHeight,
                               movieCapture->getFrameRate(),
                               recording ? _("Recording") : _("Paused"));
+        fmt::fprintf(*overlay, _("  %d queued, %d dropped"),
+                     movieCapture->getQueuedFrameCount(),
+                     movieCapture->getDroppedFrameCount());
 
         overlay->endText();
         overlay->restorePos();
@@ -3965,6 +3986,34 @@ bool CelestiaCore::initRenderer()
         return false;
     }
 
+    // Trajectories are always loaded synchronously, as the catalog parser
+    // needs them as soon as it reads an object definition.
+    if (config->asyncResourceLoading)
+    {
+        GetTextureManager()->setAsyncLoading(true);
+        GetGeometryManager()->setAsyncLoading(true);
+    }
+
+    // Trajectories can't be unloaded either, since bodies keep pointers
+    // to their orbits.
+    GetTextureManager()->setMemoryBudget((size_t) config->textureMemoryBudget << 20,
+                                         config->resourceEvictionAge);
+    GetGeometryManager()->setMemoryBudget((size_t) config->modelMemoryBudget << 20,
+                                          config->resourceEvictionAge);
+
+    if (!config->shaderCacheDirectory.empty())
+    {
+        ShaderManager& shaderManager = renderer->getShaderManager();
+        if (!shaderManager.setCacheDirectory(config->shaderCacheDirectory))
+        {
+            DPRINTF(LOG_LEVEL_WARNING, "Shader programs can't be cached in %s\n", config->shaderCacheDirectory.string());
+        }
+        else if (config->warmUpShaders)
+        {
+            shaderManager.warmUp();
+        }
+    }
+
     if ((renderer->getRenderFlags() & Renderer::ShowAutoMag) != 0)
     {
         renderer->setFaintestAM45deg(renderer->getFaintestAM45deg());
@@ -4068,7 +4117,13 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
             return false;
         }
 
-        if (!starDB->loadBinary(starFile))
+        bool loaded;
+        if (StarDatabase::isOctreeBinary(cfg.starDatabaseFile))
+            loaded = starDB->loadOctreeBinary(cfg.starDatabaseFile);
+        else
+            loaded = starDB->loadBinary(starFile);
+
+        if (!loaded)
         {
             cerr << _("Error reading stars file\n");
             delete starDB;
@@ -4613,7 +4668,7 @@ bool CelestiaCore::initLuaHook(ProgressNotifier* progressNotifier)
 void CelestiaCore::setTypedText(const char *c_p)
 {
     typedText += string(c_p);
-    typedTextCompletion = sim->getObjectCompletion(typedText, (renderer->getLabelMode() & Renderer::LocationLabels) != 0);
+    typedTextCompletion = sim->getObjectCompletion(typedText, (renderer->getLabelMode() & Renderer::LocationLabels) != 0, MaxCompletionCount);
     typedTextCompletionIdx = -1;
 #ifdef AUTO_COMPLETION
     if (typedTextCompletion.size() == 1)
@@ -4653,19 +4708,24 @@ bool CelestiaCore::saveScreenShot(const fs::path& filename, ContentType type) co
     array<int, 4> viewport;
     getRenderer()->getViewport(viewport);
 
+    // Screen shots are read immediately, but compressed and written on
+    // another thread so that scripts taking one every frame don't stall.
+    if (screenshotPipeline == nullptr)
+        screenshotPipeline.reset(new CapturePipeline(getRenderer(), nullptr, 0, MaxQueuedScreenShots));
+
     if (type == Content_JPEG)
     {
         return CaptureGLBufferToJPEG(filename,
                                      viewport[0], viewport[1],
                                      viewport[2], viewport[3],
-                                     getRenderer());
+                                     *screenshotPipeline);
     }
     if (type == Content_PNG)
     {
         return CaptureGLBufferToPNG(filename,
                                     viewport[0], viewport[1],
                                     viewport[2], viewport[3],
-                                    getRenderer());
+                                    *screenshotPipeline);
     }
 
     return false;
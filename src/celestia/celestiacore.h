@@ -253,6 +253,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     void runScript(const fs::path& filename);
     void cancelScript();
     void resumeScript();
+    bool isScriptRunning() const;
 
     int getHudDetail();
     void setHudDetail(int);
@@ -469,6 +470,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     double KeyAccel{ 1.0 };
 
     MovieCapture* movieCapture{ nullptr };
+    mutable std::unique_ptr<CapturePipeline> screenshotPipeline;
     bool recording{ false };
 
     Alerter* alerter{ nullptr };
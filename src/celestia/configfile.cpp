@@ -110,6 +110,17 @@ CelestiaConfig* ReadCelestiaConfig(const fs::path& filename, CelestiaConfig *con
     config->hdr = false;
     configParams->getBoolean("HighDynamicRange", config->hdr);
 
+    config->asyncResourceLoading = false;
+    configParams->getBoolean("AsyncResourceLoading", config->asyncResourceLoading);
+
+    config->textureMemoryBudget = getUint(configParams, "TextureMemoryBudget", 0);
+    config->modelMemoryBudget = getUint(configParams, "ModelMemoryBudget", 0);
+    config->resourceEvictionAge = getUint(configParams, "ResourceEvictionAge", 300);
+
+    configParams->getPath("ShaderCacheDirectory", config->shaderCacheDirectory);
+    config->warmUpShaders = false;
+    configParams->getBoolean("WarmUpShaders", config->warmUpShaders);
+
     config->rotateAcceleration = 120.0f;
     configParams->getNumber("RotateAcceleration", config->rotateAcceleration);
     config->mouseRotationSensitivity = 1.0f;
@@ -69,6 +69,17 @@ public:
 
     bool hdr;
 
+    bool asyncResourceLoading;
+
+    // Memory budgets in megabytes; zero means unlimited
+    unsigned int textureMemoryBudget;
+    unsigned int modelMemoryBudget;
+    unsigned int resourceEvictionAge;
+
+    // Directory of the compiled shader programs, empty if not cached
+    fs::path shaderCacheDirectory;
+    bool warmUpShaders;
+
     unsigned int consoleLogRows;
 
     Hash* params;
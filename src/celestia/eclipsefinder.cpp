@@ -10,8 +10,10 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
-#include <cstring>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <celutil/threadpool.h>
 #include "eclipsefinder.h"
 #include "celmath/ray.h"
 #include "celmath/distance.h"
@@ -21,7 +23,6 @@ using namespace std;
 using namespace celmath;
 
 
-constexpr const double dT = 1.0 / (24.0 * 60.0);
 constexpr const int EclipseObjectMask = Body::Planet      |
                                         Body::Moon        |
                                         Body::MinorMoon   |
@@ -31,6 +32,38 @@ constexpr const int EclipseObjectMask = Body::Planet      |
 // TODO: share this constant and function with render.cpp
 static const float MinRelativeOccluderRadius = 0.005f;
 
+// Number of times per synodic period at which the distance from a receiver
+// to the shadow axis of a caster is sampled. Eclipses occur around the
+// minima of that distance, which must span a few samples to be bracketed.
+constexpr const double SamplesPerPeriod = 24.0;
+
+// Bounds of the time between samples, in days, and the step used when the
+// orbital periods are unknown
+constexpr const double MinSearchStep = 1.0 / (24.0 * 60.0);
+constexpr const double MaxSearchStep = 1.0;
+constexpr const double DefaultSearchStep = 1.0 / 24.0;
+
+// Length in days of the time spans searched in parallel
+constexpr const double SearchChunkDuration = 30.0;
+
+// Precision of eclipse start and end times
+constexpr const double DurationPrecision = 1.0 / (24.0 * 360.0); // ten seconds
+
+constexpr const double InvGoldenRatio = 0.6180339887498949;
+
+
+namespace
+{
+struct EclipsePair
+{
+    const Body* receiver;
+    const Body* caster;
+    // Time between samples of the shadow distance
+    double step;
+};
+}
+
+
 EclipseFinder::EclipseFinder(Body* _body,
                              EclipseFinderWatcher* _watcher) :
     body(_body),
@@ -39,165 +72,274 @@ EclipseFinder::EclipseFinder(Body* _body,
 }
 
 
-bool testEclipse(const Body& receiver, const Body& caster, double now)
+// Return the distance from the center of the receiver to the axis of the
+// shadow of the caster, minus the distance below which the receiver is in
+// the shadow. Also return the position of the caster relative to the
+// receiver, and the distance from the receiver surface to the caster.
+static double shadowDistance(const Body& receiver, const Body& caster, double now,
+                             Vector3d& casterOffset, double& distToCaster)
+{
+    // All of the eclipse related code assumes that both the caster
+    // and receiver are spherical.  Irregular receivers will work more
+    // or less correctly, but casters that are sufficiently non-spherical
+    // will produce obviously incorrect shadows.  Another assumption we
+    // make is that the distance between the caster and receiver is much
+    // less than the distance between the sun and the receiver.  This
+    // approximation works everywhere in the solar system, and likely
+    // works for any orbitally stable pair of objects orbiting a star.
+    Vector3d posReceiver = receiver.getAstrocentricPosition(now);
+    Vector3d posCaster = caster.getAstrocentricPosition(now);
+
+    const Star* sun = receiver.getSystem()->getStar();
+    assert(sun != nullptr);
+    double distToSun = posReceiver.norm();
+    float appSunRadius = (float) (sun->getRadius() / distToSun);
+
+    casterOffset = posCaster - posReceiver;
+    distToCaster = casterOffset.norm() - receiver.getRadius();
+    float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
+
+    // The shadow radius is the radius of the occluder plus some additional
+    // amount that depends upon the apparent radius of the sun.  For
+    // a sun that's distant/small and effectively a point, the shadow
+    // radius will be the same as the radius of the occluder.
+    float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
+        caster.getRadius();
+
+    // Test whether a shadow is cast on the receiver.  We want to know
+    // if the receiver lies within the shadow volume of the caster.  Since
+    // we're assuming that everything is a sphere and the sun is far
+    // away relative to the caster, the shadow volume is a
+    // cylinder capped at one end.  Testing for the intersection of a
+    // singly capped cylinder is as simple as checking the distance
+    // from the center of the receiver to the axis of the shadow cylinder.
+    // If the distance is less than the sum of the caster's and receiver's
+    // radii, then we have an eclipse.
+    float R = receiver.getRadius() + shadowRadius;
+    return distance(posReceiver, Ray3d(posCaster, posCaster)) - R;
+}
+
+
+// Ignore situations where the shadow casting body is much smaller than
+// the receiver, as these shadows aren't likely to be relevant.  Also,
+// ignore eclipses where the caster is not an ellipsoid, since we can't
+// generate correct shadows in this case.
+static bool canCastShadow(const Body& receiver, const Body& caster)
 {
-    // Ignore situations where the shadow casting body is much smaller than
-    // the receiver, as these shadows aren't likely to be relevant.  Also,
-    // ignore eclipses where the caster is not an ellipsoid, since we can't
-    // generate correct shadows in this case.
-    if (caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
-        caster.isEllipsoid())
+    return caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
+           caster.isEllipsoid();
+}
+
+
+// Test whether the receiver is in the shadow of the caster at time now
+static bool testEclipse(const Body& receiver, const Body& caster, double now)
+{
+    if (!canCastShadow(receiver, caster))
+        return false;
+
+    Vector3d casterOffset;
+    double distToCaster;
+    if (shadowDistance(receiver, caster, now, casterOffset, distToCaster) < 0.0)
     {
-        // All of the eclipse related code assumes that both the caster
-        // and receiver are spherical.  Irregular receivers will work more
-        // or less correctly, but casters that are sufficiently non-spherical
-        // will produce obviously incorrect shadows.  Another assumption we
-        // make is that the distance between the caster and receiver is much
-        // less than the distance between the sun and the receiver.  This
-        // approximation works everywhere in the solar system, and likely
-        // works for any orbitally stable pair of objects orbiting a star.
-        Vector3d posReceiver = receiver.getAstrocentricPosition(now);
-        Vector3d posCaster = caster.getAstrocentricPosition(now);
-
-        const Star* sun = receiver.getSystem()->getStar();
-        assert(sun != nullptr);
-        double distToSun = posReceiver.norm();
-        float appSunRadius = (float) (sun->getRadius() / distToSun);
-
-        Vector3d dir = posCaster - posReceiver;
-        double distToCaster = dir.norm() - receiver.getRadius();
-        float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
-
-        // The shadow radius is the radius of the occluder plus some additional
-        // amount that depends upon the apparent radius of the sun.  For
-        // a sun that's distant/small and effectively a point, the shadow
-        // radius will be the same as the radius of the occluder.
-        float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
-            caster.getRadius();
-
-        // Test whether a shadow is cast on the receiver.  We want to know
-        // if the receiver lies within the shadow volume of the caster.  Since
-        // we're assuming that everything is a sphere and the sun is far
-        // away relative to the caster, the shadow volume is a
-        // cylinder capped at one end.  Testing for the intersection of a
-        // singly capped cylinder is as simple as checking the distance
-        // from the center of the receiver to the axis of the shadow cylinder.
-        // If the distance is less than the sum of the caster's and receiver's
-        // radii, then we have an eclipse.
-        float R = receiver.getRadius() + shadowRadius;
-        double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
-        if (dist < R)
-        {
-            // Ignore "eclipses" where the caster and receiver have
-            // intersecting bounding spheres.
-            if (distToCaster > caster.getRadius())
-                return true;
-        }
+        // Ignore "eclipses" where the caster and receiver have
+        // intersecting bounding spheres.
+        return distToCaster > caster.getRadius();
     }
 
     return false;
 }
 
-#if 1
-double findEclipseSpan(const Body& receiver, const Body& caster,
-                       double now, double dt)
+
+static bool testEclipse(const EclipsePair& pair, double now)
 {
-    double t = now;
-    while (testEclipse(receiver, caster, t))
-        t += dt;
+    return testEclipse(*pair.receiver, *pair.caster, now);
+}
+
 
-    return t;
+static double shadowDistance(const EclipsePair& pair, double now, Vector3d& casterOffset)
+{
+    double distToCaster;
+    return shadowDistance(*pair.receiver, *pair.caster, now, casterOffset, distToCaster);
 }
-#else
-// Given a time during an eclipse, find the start of the eclipse to
-// a precision of minStep.
-double findEclipseStart(const Body& receiver, const Body& occulter,
-                        double now,
-                        double startStep,
-                        double minStep)
+
+
+// The geometry of an eclipse repeats with the synodic period of the
+// satellite, which is at least 1 / (1 / P_satellite + 1 / P_primary)
+// whatever the direction of its orbit. Sample it often enough over that.
+static double searchStep(const Body& primary, const Body& satellite, double t)
 {
-    double step = startStep / 2;
-    double t = now - step;
-    bool eclipsed = true;
+    double frequency = 0.0;
+    for (const Body* b : { &primary, &satellite })
+    {
+        double period = b->getOrbit(t)->getPeriod();
+        if (period > 0.0 && isfinite(period))
+            frequency += 1.0 / period;
+    }
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    if (frequency == 0.0)
+        return DefaultSearchStep;
+
+    return min(max(1.0 / (frequency * SamplesPerPeriod), MinSearchStep), MaxSearchStep);
+}
+
+
+// Given a time during an eclipse, find the first time after it (or before
+// it for a negative step) at which the receiver is not in eclipse, to a
+// precision of DurationPrecision.
+static double findEclipseBoundary(const EclipsePair& pair, double now, double step)
+{
+    Vector3d offset;
+
+    // First do a coarse search to bracket the boundary
+    double inside = now;
+    double insideDist = shadowDistance(pair, inside, offset);
+    double outside = now + step;
+    double outsideDist = shadowDistance(pair, outside, offset);
+    while (outsideDist < 0.0)
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
-        if (eclipsed)
-            t -= step;
-        else
-            t += step;
+        inside = outside;
+        insideDist = outsideDist;
+        outside += step;
+        outsideDist = shadowDistance(pair, outside, offset);
     }
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t -= step;
+    // The shadow distance is smooth around the boundary, so find its root
+    // by false position, using the Illinois variant to keep both ends of
+    // the bracket converging. Always return a time when the receiver is
+    // /not/ in eclipse.
+    int lastSide = 0;
+    while (abs(outside - inside) > DurationPrecision)
+    {
+        double t = (inside * outsideDist - outside * insideDist) / (outsideDist - insideDist);
+        if (!(abs(t - inside) < abs(outside - inside) && abs(t - outside) < abs(outside - inside)))
+            t = (inside + outside) * 0.5;
+
+        double dist = shadowDistance(pair, t, offset);
+        if (dist < 0.0)
+        {
+            inside = t;
+            insideDist = dist;
+            if (lastSide < 0)
+                outsideDist *= 0.5;
+            lastSide = -1;
+        }
+        else
+        {
+            outside = t;
+            outsideDist = dist;
+            if (lastSide > 0)
+                insideDist *= 0.5;
+            lastSide = 1;
+        }
+    }
 
-    return t;
+    return outside;
 }
 
-// Given a time during an eclipse, find the end of the eclipse to
-// a precision of minStep.
-double findEclipseEnd(const Body& receiver, const Body& occulter,
-                      double now,
-                      double startStep,
-                      double minStep)
+
+static Eclipse makeEclipse(const EclipsePair& pair, double now)
 {
-    // First do a coarse search to find the eclipse end to within the precision
-    // of startStep.
-    while (testEclipse(receiver, occulter, now + startStep))
-        now += startStep;
+    Eclipse eclipse;
+    eclipse.startTime = findEclipseBoundary(pair, now, -pair.step);
+    eclipse.endTime = findEclipseBoundary(pair, now, pair.step);
+    eclipse.receiver = const_cast<Body*>(pair.receiver);
+    eclipse.occulter = const_cast<Body*>(pair.caster);
+    return eclipse;
+}
 
-    double step = startStep / 2;
-    double t = now + step;
-    bool eclipsed = true;
 
+// Golden section search of the minimum of the shadow distance in [a, b],
+// which it is assumed to bracket. Return true and a time in eclipse as
+// soon as one is found.
+static bool findEclipseTime(const EclipsePair& pair, double a, double b, double& t)
+{
+    Vector3d offset;
+    double x1 = b - InvGoldenRatio * (b - a);
+    double x2 = a + InvGoldenRatio * (b - a);
+    double d1 = shadowDistance(pair, x1, offset);
+    double d2 = shadowDistance(pair, x2, offset);
+    if (d1 < 0.0 && testEclipse(pair, x1))
+    {
+        t = x1;
+        return true;
+    }
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    while (b - a > DurationPrecision)
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
-        if (eclipsed)
-            t += step;
+        double x;
+        double d;
+        if (d1 < d2)
+        {
+            b = x2;
+            x2 = x1;
+            d2 = d1;
+            x = x1 = b - InvGoldenRatio * (b - a);
+            d = d1 = shadowDistance(pair, x1, offset);
+        }
         else
-            t -= step;
-    }
+        {
+            a = x1;
+            x1 = x2;
+            d1 = d2;
+            x = x2 = a + InvGoldenRatio * (b - a);
+            d = d2 = shadowDistance(pair, x2, offset);
+        }
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t += step;
+        if (d < 0.0 && testEclipse(pair, x))
+        {
+            t = x;
+            return true;
+        }
+    }
 
-    return t;
+    return false;
 }
-#endif
 
-void addEclipse(const Body& receiver, const Body& occulter,
-                double now,
-                double /*startStep*/, double /*minStep*/,
-                vector<Eclipse>& eclipses,
-                vector<double>& previousEclipseEndTimes, int i)
+
+// Find the eclipses around the minima of the shadow distance sampled in
+// [chunkStart, chunkEnd). Samples are taken on a grid starting at
+// searchStart, so that each minimum is found in exactly one chunk.
+static void findEclipsesInChunk(const EclipsePair& pair,
+                                double searchStart,
+                                double chunkStart,
+                                double chunkEnd,
+                                vector<Eclipse>& eclipses)
 {
-    if (testEclipse(receiver, occulter, now))
+    double step = pair.step;
+    auto first = (int64_t) ceil((chunkStart - searchStart) / step);
+    auto last = (int64_t) ceil((chunkEnd - searchStart) / step);
+    if (first >= last)
+        return;
+
+    Vector3d prevOffset, offset, nextOffset;
+    double prevDist = shadowDistance(pair, searchStart + (first - 1) * step, prevOffset);
+    double dist = shadowDistance(pair, searchStart + first * step, offset);
+    for (int64_t i = first; i < last; i++)
     {
-        Eclipse eclipse;
-#if 1
-        eclipse.startTime = findEclipseSpan(receiver, occulter, now, -dT);
-        eclipse.endTime = findEclipseSpan(receiver, occulter, now, dT);
-#else
-        eclipse.startTime = findEclipseStart(receiver, occulter, now, searchStep, minStep);
-        eclipse.endTime = findEclipseEnd(receiver, occulter, now, searchStep, minStep);
-#endif
-        eclipse.receiver = const_cast<Body*>(&receiver);
-        eclipse.occulter = const_cast<Body*>(&occulter);
-        eclipses.emplace_back(eclipse);
-
-        previousEclipseEndTimes[i] = eclipse.endTime;
+        double nextDist = shadowDistance(pair, searchStart + (i + 1) * step, nextOffset);
+        if (dist < prevDist && dist <= nextDist)
+        {
+            // Between samples the shadow distance changes at most by about
+            // the motion of the caster relative to the receiver; skip the
+            // minima which can't get below zero, such as those where the
+            // caster is behind the receiver.
+            double maxChange = 2.0 * max((offset - prevOffset).norm(), (nextOffset - offset).norm());
+            double t;
+            if (dist < maxChange &&
+                findEclipseTime(pair, searchStart + (i - 1) * step, searchStart + (i + 1) * step, t))
+            {
+                eclipses.push_back(makeEclipse(pair, t));
+            }
+        }
+
+        prevDist = dist;
+        prevOffset = offset;
+        dist = nextDist;
+        offset = nextOffset;
     }
 }
 
+
 void EclipseFinder::findEclipses(double startDate,
                                  double endDate,
                                  int eclipseTypeMask,
@@ -209,53 +351,96 @@ void EclipseFinder::findEclipses(double startDate,
     if (satellites == nullptr)
         return;
 
-    // For each body, we'll need to store the time when the last eclipse ended
-    vector<double> previousEclipseEndTimes;
-
     // Make a list of satellites that we'll actually test for eclipses; ignore
     // spacecraft and very small objects.
-    vector<Body*> testBodies;
+    vector<EclipsePair> pairs;
     for (int i = 0; i < satellites->getSystemSize(); i++)
     {
         Body* obj = satellites->getBody(i);
         if ((obj->getClassification() & EclipseObjectMask) != 0 &&
             obj->getRadius() >= body->getRadius() * MinRelativeOccluderRadius)
         {
-            testBodies.push_back(obj);
-            previousEclipseEndTimes.push_back(startDate - 1.0);
+            double step = searchStep(*body, *obj, startDate);
+            if ((eclipseTypeMask & Eclipse::Solar) != 0 && canCastShadow(*body, *obj))
+                pairs.push_back({ body, obj, step });
+            if ((eclipseTypeMask & Eclipse::Lunar) != 0 && canCastShadow(*obj, *body))
+                pairs.push_back({ obj, body, step });
         }
     }
 
-    if (testBodies.empty())
+    if (pairs.empty())
         return;
 
-    // TODO: Use a fixed step of one hour for now; we should use a binary
-    // search instead.
-    double searchStep = 1.0 / 24.0; // one hour
+    // For each pair, we'll need to store the time when the last eclipse
+    // ended, as an eclipse may be found from several minima.
+    vector<double> previousEclipseEndTimes(pairs.size(), startDate - 1.0);
+    vector<Eclipse> found;
+    auto addEclipses = [&](size_t pairIndex, const vector<Eclipse>& pairEclipses)
+    {
+        for (const auto& eclipse : pairEclipses)
+        {
+            if (eclipse.startTime <= previousEclipseEndTimes[pairIndex] ||
+                eclipse.startTime > endDate || eclipse.endTime < startDate)
+            {
+                continue;
+            }
+
+            found.push_back(eclipse);
+            previousEclipseEndTimes[pairIndex] = eclipse.endTime;
+        }
+    };
 
-    // Precision of eclipse duration calculation
-    double durationPrecision = 1.0 / (24.0 * 360.0); // ten seconds
+    // Report the results found in each batch of chunks in order of time
+    auto reportEclipses = [&]()
+    {
+        stable_sort(found.begin(), found.end(),
+                    [](const Eclipse& a, const Eclipse& b) { return a.startTime < b.startTime; });
+        for (const auto& eclipse : found)
+        {
+            eclipses.push_back(eclipse);
+            if (watcher != nullptr)
+                watcher->eclipseFinderEclipseFound(eclipse);
+        }
+        found.clear();
+    };
 
-    for (double t = startDate; t <= endDate; t += searchStep)
+    // Eclipses in progress at the start date have their minimum before it
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        if (testEclipse(pairs[i], startDate))
+            addEclipses(i, { makeEclipse(pairs[i], startDate) });
+    }
+    reportEclipses();
+
+    // Search chunks of the date range for all pairs in parallel. The
+    // batches are kept small enough for the watcher to be updated often.
+    ThreadPool* threadPool = GetThreadPool();
+    size_t nPairs = pairs.size();
+    auto nChunks = max((size_t) ceil((endDate - startDate) / SearchChunkDuration), (size_t) 1);
+    size_t batchSize = max((size_t) threadPool->concurrency() * 4 / nPairs, (size_t) 1);
+    vector<vector<Eclipse>> chunkEclipses;
+    for (size_t batchStart = 0; batchStart < nChunks; batchStart += batchSize)
     {
         if (watcher != nullptr)
         {
+            double t = startDate + batchStart * SearchChunkDuration;
             if (watcher->eclipseFinderProgressUpdate(t) == EclipseFinderWatcher::AbortOperation)
                 return;
         }
 
-        for (unsigned int i = 0; i < testBodies.size(); i++)
+        size_t nBatchChunks = min(batchSize, nChunks - batchStart);
+        chunkEclipses.assign(nBatchChunks * nPairs, vector<Eclipse>());
+        threadPool->parallelFor(nBatchChunks * nPairs, [&](size_t i)
         {
-            // Only test for an eclipse if we're not in the middle of
-            // of previous one.
-            if (t <= previousEclipseEndTimes[i])
-                continue;
-
-            if (eclipseTypeMask & Eclipse::Solar)
-                addEclipse(*body, *testBodies[i], t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
-
-            if (eclipseTypeMask & Eclipse::Lunar)
-                addEclipse(*testBodies[i], *body, t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
-        }
+            size_t chunk = batchStart + i / nPairs;
+            findEclipsesInChunk(pairs[i % nPairs], startDate,
+                                startDate + chunk * SearchChunkDuration,
+                                startDate + (chunk + 1) * SearchChunkDuration,
+                                chunkEclipses[i]);
+        });
+
+        for (size_t i = 0; i < chunkEclipses.size(); i++)
+            addEclipses(i % nPairs, chunkEclipses[i]);
+        reportEclipses();
     }
 }
@@ -41,6 +41,8 @@ class EclipseFinderWatcher
     };
 
     virtual Status eclipseFinderProgressUpdate(double t) = 0;
+    // Called for each eclipse as soon as it's found, in order of start time
+    virtual void eclipseFinderEclipseFound(const Eclipse&) {}
     virtual ~EclipseFinderWatcher() = default;
 };
 
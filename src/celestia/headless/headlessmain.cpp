@@ -0,0 +1,719 @@
+// headlessmain.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Front end rendering offscreen through EGL, without a window or display,
+// for batch generation of images from scripts, URLs and time ranges.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <config.h>
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <fmt/printf.h>
+// celengine/glsupport.h must be included before EGL/egl.h
+#include <celengine/glsupport.h>
+#include <EGL/egl.h>
+#include <celengine/astro.h>
+#include <celengine/shadermanager.h>
+#include <celengine/simulation.h>
+#include <celutil/debug.h>
+#include <celutil/filetype.h>
+#include <celutil/gettext.h>
+#include <celestia/celestiacore.h>
+#include <celestia/imagecapture.h>
+#include <celestia/moviecapture.h>
+
+using namespace std;
+
+namespace celestia
+{
+
+typedef chrono::steady_clock Clock;
+
+static double MillisecondsSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+
+struct FrameTiming
+{
+    double tdb{ 0.0 };
+    double renderTime{ 0.0 };   // milliseconds
+    double encodeTime{ 0.0 };   // milliseconds
+    size_t sphereUploads{ 0 };  // planet surface patches sent to the GPU
+    bool encoded{ false };
+};
+
+
+/*! Writes each frame drawn while recording to its own image file, named
+ *  from a printf pattern and the frame number. Frames are handed to the
+ *  capture pipelines in turn, so that several images are compressed at
+ *  once on the pipelines' encoder threads.
+ */
+class FrameSequenceCapture : public MovieCapture
+{
+ public:
+    FrameSequenceCapture(const Renderer* r, unsigned int nEncoders) :
+        MovieCapture(r),
+        encoderCount(max(nEncoders, 1u))
+    {
+    }
+
+    ~FrameSequenceCapture() override
+    {
+        end();
+    }
+
+    bool start(const string& _pattern, int w, int h, float fps) override
+    {
+        pattern = _pattern;
+        width = w;
+        height = h;
+        frameRate = fps;
+        for (unsigned int i = 0; i < encoderCount; i++)
+            pipelines.emplace_back(new CapturePipeline(renderer, nullptr, ReadbackLatency, MaxQueuedFrames));
+        return true;
+    }
+
+    bool end() override
+    {
+        for (auto& pipeline : pipelines)
+            pipeline->finish();
+        return true;
+    }
+
+    bool captureFrame() override
+    {
+        int frame = (int) timings.size();
+        {
+            lock_guard<mutex> lock(timingMutex);
+            timings.emplace_back();
+        }
+
+        CapturePipeline& pipeline = *pipelines[frame % pipelines.size()];
+        string filename = fmt::sprintf(pattern, frame);
+        CapturePipeline::Encoder encoder = GetImageFileEncoder(filename, pipeline);
+        if (encoder == nullptr)
+        {
+            fmt::fprintf(cerr, "Can't write frame to %s\n", filename);
+            return false;
+        }
+
+        // Time the encoding on the encoder thread
+        auto timedEncoder = [this, frame, encoder](const CapturedFrame& captured)
+        {
+            auto encodeStart = Clock::now();
+            bool ok = encoder(captured);
+            double elapsed = MillisecondsSince(encodeStart);
+
+            lock_guard<mutex> lock(timingMutex);
+            timings[frame].encodeTime = elapsed;
+            timings[frame].encoded = ok;
+            return ok;
+        };
+
+        int x, y, w, h;
+        renderer->getViewport(&x, &y, &w, &h);
+        return pipeline.capture(x + (w - width) / 2, y + (h - height) / 2, width, height,
+                                GetImageCaptureFormat(), true, timedEncoder);
+    }
+
+    int getFrameCount() const override { return (int) timings.size(); }
+    int getWidth() const override { return width; }
+    int getHeight() const override { return height; }
+    float getFrameRate() const override { return frameRate; }
+
+    void setAspectRatio(int, int) override {}
+    void setQuality(float) override {}
+    void recordingStatus(bool) override {}
+
+    // Record the time, render duration and uploads of the last frame
+    // captured
+    void setFrameTiming(double tdb, double renderTime, size_t sphereUploads)
+    {
+        lock_guard<mutex> lock(timingMutex);
+        if (!timings.empty())
+        {
+            timings.back().tdb = tdb;
+            timings.back().renderTime = renderTime;
+            timings.back().sphereUploads = sphereUploads;
+        }
+    }
+
+    // Must be called after end()
+    const vector<FrameTiming>& getTimings() const { return timings; }
+
+ private:
+    unsigned int encoderCount;
+    vector<unique_ptr<CapturePipeline>> pipelines;
+    string pattern;
+    int width{ 0 };
+    int height{ 0 };
+    float frameRate{ 30.0f };
+
+    mutex timingMutex;
+    // Grown by the render thread only; the encoder threads fill in the
+    // timings of frames which already exist.
+    vector<FrameTiming> timings;
+};
+
+
+class OffscreenContext
+{
+ public:
+    ~OffscreenContext();
+
+    bool create(int width, int height);
+    const char* getError() const { return error; }
+
+ private:
+    EGLDisplay display{ EGL_NO_DISPLAY };
+    EGLSurface surface{ EGL_NO_SURFACE };
+    EGLContext context{ EGL_NO_CONTEXT };
+    const char* error{ "" };
+};
+
+OffscreenContext::~OffscreenContext()
+{
+    if (display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    eglTerminate(display);
+}
+
+// Rendering goes to a pbuffer surface. With Mesa, EGL_PLATFORM=surfaceless
+// selects a display which doesn't need a window system, and
+// LIBGL_ALWAYS_SOFTWARE=1 renders in software on machines without a GPU.
+bool OffscreenContext::create(int width, int height)
+{
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        error = "Can't initialize the EGL display";
+        return false;
+    }
+
+#ifdef GL_ES
+    const EGLint renderableType = EGL_OPENGL_ES2_BIT;
+    const EGLenum api = EGL_OPENGL_ES_API;
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+#else
+    const EGLint renderableType = EGL_OPENGL_BIT;
+    const EGLenum api = EGL_OPENGL_API;
+    const EGLint contextAttribs[] = { EGL_NONE };
+#endif
+
+    const EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RED_SIZE,        8,
+        EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,       8,
+        EGL_ALPHA_SIZE,      8,
+        EGL_DEPTH_SIZE,      24,
+        EGL_RENDERABLE_TYPE, renderableType,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint nConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &nConfigs) || nConfigs == 0)
+    {
+        error = "No suitable EGL configuration";
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE)
+    {
+        error = "Can't create the offscreen surface";
+        return false;
+    }
+
+    if (!eglBindAPI(api))
+    {
+        error = "Can't bind the OpenGL API";
+        return false;
+    }
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+    {
+        error = "Can't create the OpenGL context";
+        return false;
+    }
+
+    return true;
+}
+
+
+class HeadlessAlerter : public CelestiaCore::Alerter
+{
+ public:
+    void fatalError(const string& msg) override
+    {
+        fmt::fprintf(cerr, "%s\n", msg);
+    }
+};
+
+
+struct Options
+{
+    int width{ 1920 };
+    int height{ 1080 };
+    string configFile;
+    vector<fs::path> extrasDirs;
+    string scriptFile;
+    string urlFile;
+    string startDate;
+    string endDate;
+    double step{ 0.0 };     // seconds
+    int nFrames{ 0 };
+    float fps{ 30.0f };
+    double maxDuration{ 3600.0 };
+    string outputPattern{ "frame%05d.png" };
+    unsigned int nEncoders{ 0 };
+    string timingsFile;
+    bool showOverlay{ false };
+};
+
+
+static void Usage()
+{
+    cout << "Usage: celestia-headless [options]\n"
+            "  --width W, --height H   size of the images (1920x1080)\n"
+            "  --config FILE           configuration file\n"
+            "  --extrasdir DIR         additional extras directory\n"
+            "  --dir DIR               data directory\n"
+            "  --script FILE           capture frames while a .cel or .celx script runs\n"
+            "  --urls FILE             capture each cel:// URL listed in FILE\n"
+            "  --start DATE            start of the time range, \"YYYY MM DD HH:MM:SS\" UTC\n"
+            "  --end DATE              end of the time range\n"
+            "  --step SECONDS          time between frames in the range\n"
+            "  --frames N              number of frames in the range\n"
+            "  --fps F                 frame rate of scripts (30)\n"
+            "  --max-duration SECONDS  limit on the capture of scripts (3600)\n"
+            "  --output PATTERN        printf pattern of the .png or .jpg files (frame%05d.png)\n"
+            "  --encoders N            images encoded at once (number of cores)\n"
+            "  --timings FILE          write the per frame timings as CSV\n"
+            "  --overlay               show the text overlay in the images\n";
+}
+
+
+// The output pattern is formatted with the frame number, so it must have a
+// single integer conversion for each frame to get its own file, and name
+// PNG or JPEG files.
+static bool CheckOutputPattern(const string& pattern)
+{
+    int nConversions = 0;
+    bool integerConversions = true;
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] != '%')
+            continue;
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%')
+        {
+            i++;
+            continue;
+        }
+
+        // Flags, width, precision and length
+        size_t end = pattern.find_first_not_of("#0- +123456789.hlLjzt", i + 1);
+        nConversions++;
+        if (end == string::npos || string("diouxX").find(pattern[end]) == string::npos)
+            integerConversions = false;
+        else
+            i = end;
+    }
+
+    string filename;
+    try
+    {
+        filename = fmt::sprintf(pattern, 0);
+    }
+    catch (const fmt::format_error&)
+    {
+        integerConversions = false;
+    }
+
+    if (nConversions != 1 || !integerConversions)
+    {
+        fmt::fprintf(cerr, "The output pattern '%s' must have a single integer conversion, such as %%05d.\n",
+                     pattern);
+        return false;
+    }
+
+    ContentType type = DetermineFileType(filename);
+    if (type != Content_PNG && type != Content_JPEG)
+    {
+        fmt::fprintf(cerr, "The output pattern '%s' must name .png or .jpg files.\n", pattern);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+    static const option longOptions[] =
+    {
+        { "width",        required_argument, nullptr, 'w' },
+        { "height",       required_argument, nullptr, 'h' },
+        { "config",       required_argument, nullptr, 'c' },
+        { "extrasdir",    required_argument, nullptr, 'e' },
+        { "dir",          required_argument, nullptr, 'd' },
+        { "script",       required_argument, nullptr, 's' },
+        { "urls",         required_argument, nullptr, 'u' },
+        { "start",        required_argument, nullptr, 'S' },
+        { "end",          required_argument, nullptr, 'E' },
+        { "step",         required_argument, nullptr, 't' },
+        { "frames",       required_argument, nullptr, 'n' },
+        { "fps",          required_argument, nullptr, 'f' },
+        { "max-duration", required_argument, nullptr, 'm' },
+        { "output",       required_argument, nullptr, 'o' },
+        { "encoders",     required_argument, nullptr, 'j' },
+        { "timings",      required_argument, nullptr, 'T' },
+        { "overlay",      no_argument,       nullptr, 'O' },
+        { "verbose",      optional_argument, nullptr, 'v' },
+        { nullptr,        0,                 nullptr, 0   }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+    {
+        switch (c)
+        {
+        case 'w': options.width = atoi(optarg); break;
+        case 'h': options.height = atoi(optarg); break;
+        case 'c': options.configFile = optarg; break;
+        case 'e': options.extrasDirs.emplace_back(optarg); break;
+        case 'd':
+            if (chdir(optarg) == -1)
+            {
+                fmt::fprintf(cerr, "Cannot chdir to '%s'\n", optarg);
+                return false;
+            }
+            break;
+        case 's': options.scriptFile = optarg; break;
+        case 'u': options.urlFile = optarg; break;
+        case 'S': options.startDate = optarg; break;
+        case 'E': options.endDate = optarg; break;
+        case 't': options.step = atof(optarg); break;
+        case 'n': options.nFrames = atoi(optarg); break;
+        case 'f': options.fps = (float) atof(optarg); break;
+        case 'm': options.maxDuration = atof(optarg); break;
+        case 'o': options.outputPattern = optarg; break;
+        case 'j': options.nEncoders = (unsigned int) atoi(optarg); break;
+        case 'T': options.timingsFile = optarg; break;
+        case 'O': options.showOverlay = true; break;
+        case 'v': SetDebugVerbosity(optarg != nullptr ? atoi(optarg) : 0); break;
+        default:
+            return false;
+        }
+    }
+
+    if (options.width <= 0 || options.height <= 0 || options.fps <= 0.0f)
+        return false;
+    if (!options.scriptFile.empty() && !options.urlFile.empty())
+    {
+        cerr << "--script and --urls can't be used together.\n";
+        return false;
+    }
+    if (options.scriptFile.empty() && options.urlFile.empty() && options.startDate.empty())
+    {
+        cerr << "Nothing to render: give a script, a list of URLs or a time range.\n";
+        return false;
+    }
+
+    return CheckOutputPattern(options.outputPattern);
+}
+
+
+static bool ParseTDB(const string& s, double& tdb)
+{
+    astro::Date date;
+    if (!astro::parseDate(s, date))
+    {
+        fmt::fprintf(cerr, "Invalid date '%s'\n", s);
+        return false;
+    }
+
+    tdb = astro::UTCtoTDB(date);
+    return true;
+}
+
+
+// TDB times of the frames of the time range, or just the time of the view
+// if there's no range.
+static bool GetFrameTimes(const Options& options, vector<double>& times)
+{
+    if (options.startDate.empty())
+        return true;
+
+    double start, end;
+    if (!ParseTDB(options.startDate, start))
+        return false;
+    end = start;
+    if (!options.endDate.empty() && !ParseTDB(options.endDate, end))
+        return false;
+
+    // Frames are a step apart, up to the end date or for the given number
+    // of frames. Without a step, they're spread evenly over the range.
+    double step = options.step / 86400.0;
+    int nFrames = 1;
+    if (options.nFrames > 0)
+        nFrames = options.nFrames;
+    else if (step > 0.0)
+        nFrames = (int) ((end - start) / step + 1.0e-6) + 1; // end included
+    if (step <= 0.0 && nFrames > 1)
+        step = (end - start) / (nFrames - 1);
+
+    for (int i = 0; i < nFrames; i++)
+        times.push_back(start + step * i);
+
+    return true;
+}
+
+
+static bool ReadUrls(const string& filename, vector<string>& urls)
+{
+    ifstream in(filename);
+    if (!in.good())
+    {
+        fmt::fprintf(cerr, "Can't read URLs from '%s'\n", filename);
+        return false;
+    }
+
+    string line;
+    while (getline(in, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && line[0] != '#')
+            urls.push_back(line);
+    }
+
+    return true;
+}
+
+
+static void WriteTimings(const Options& options, const vector<FrameTiming>& timings,
+                         const ShaderManager::Stats& shaderStats)
+{
+    double totalRender = 0.0, maxRender = 0.0;
+    double totalEncode = 0.0, maxEncode = 0.0;
+    int nEncoded = 0;
+    size_t sphereUploads = 0;
+    int nUploadFrames = 0;
+    for (const auto& timing : timings)
+    {
+        sphereUploads += timing.sphereUploads;
+        if (timing.sphereUploads > 0)
+            nUploadFrames++;
+        totalRender += timing.renderTime;
+        maxRender = max(maxRender, timing.renderTime);
+        if (timing.encoded)
+        {
+            totalEncode += timing.encodeTime;
+            maxEncode = max(maxEncode, timing.encodeTime);
+            nEncoded++;
+        }
+    }
+
+    if (!timings.empty())
+    {
+        fmt::printf("%d frames, %d written\n", (int) timings.size(), nEncoded);
+        fmt::printf("Render: %.2f ms mean, %.2f ms max\n", totalRender / timings.size(), maxRender);
+        fmt::printf("Sphere patches: %zu uploaded in %d frames\n", sphereUploads, nUploadFrames);
+        fmt::printf("Shaders: %u loaded from the cache, %u built in %.2f ms\n",
+                    shaderStats.cacheHits, shaderStats.cacheMisses, shaderStats.compileTime * 1000.0);
+    }
+    if (nEncoded > 0)
+        fmt::printf("Encode: %.2f ms mean, %.2f ms max\n", totalEncode / nEncoded, maxEncode);
+
+    if (options.timingsFile.empty())
+        return;
+
+    ofstream out(options.timingsFile);
+    if (!out.good())
+    {
+        fmt::fprintf(cerr, "Can't write timings to '%s'\n", options.timingsFile);
+        return;
+    }
+
+    out << "frame,tdb,render_ms,encode_ms,sphere_uploads,written\n";
+    for (size_t i = 0; i < timings.size(); i++)
+    {
+        const FrameTiming& timing = timings[i];
+        fmt::fprintf(out, "%d,%.8f,%.3f,%.3f,%zu,%d\n", (int) i, timing.tdb,
+                     timing.renderTime, timing.encodeTime, timing.sphereUploads,
+                     timing.encoded ? 1 : 0);
+    }
+}
+
+
+// Advance the simulation, then draw and capture a frame. The render time
+// includes waiting for the GPU to finish the frame, so that it measures the
+// rendering rather than how far ahead of the GPU the CPU can run.
+static void RenderFrame(CelestiaCore* appCore, FrameSequenceCapture* capture)
+{
+    auto renderStart = Clock::now();
+    appCore->tick();
+    double tdb = appCore->getSimulation()->getTime();
+    appCore->draw();
+    glFinish();
+    capture->setFrameTiming(tdb, MillisecondsSince(renderStart),
+                            appCore->getRenderer()->getSphereMeshStats().uploads);
+}
+
+
+static int Run(const Options& options)
+{
+    vector<double> times;
+    vector<string> urls;
+    if (!GetFrameTimes(options, times))
+        return 1;
+    if (!options.urlFile.empty() && !ReadUrls(options.urlFile, urls))
+        return 1;
+
+    OffscreenContext context;
+    if (!context.create(options.width, options.height))
+    {
+        fmt::fprintf(cerr, "%s\n", context.getError());
+        return 1;
+    }
+
+    // The core sends the standard error to its console, which isn't in the
+    // images, so errors would be lost. The log stays there.
+    streambuf* cerrBuffer = cerr.rdbuf();
+    unique_ptr<CelestiaCore> appCore(new CelestiaCore());
+    cerr.rdbuf(cerrBuffer);
+    appCore->setAlerter(new HeadlessAlerter());
+    if (!appCore->initSimulation(options.configFile, options.extrasDirs))
+    {
+        cerr << "Error initializing simulation.\n";
+        return 1;
+    }
+
+    if (!gl::init() || !gl::checkVersion(gl::GL_2_1))
+    {
+        cerr << _("Celestia was unable to initialize OpenGL 2.1.\n");
+        return 1;
+    }
+
+    appCore->initRenderer();
+    appCore->getRenderer()->setSolarSystemMaxDistance(appCore->getConfig()->SolarSystemMaxDistance);
+    appCore->getRenderer()->setShadowMapSize(appCore->getConfig()->ShadowMapSize);
+    appCore->start();
+    appCore->resize(options.width, options.height);
+    if (!options.showOverlay)
+        appCore->setHudDetail(0);
+
+    unsigned int nEncoders = options.nEncoders;
+    if (nEncoders == 0)
+        nEncoders = max(thread::hardware_concurrency(), 1u);
+
+    // The capture is owned by the core once it's been handed to it
+    auto* capture = new FrameSequenceCapture(appCore->getRenderer(), nEncoders);
+    capture->start(options.outputPattern, options.width, options.height, options.fps);
+    appCore->initMovieCapture(capture);
+    appCore->recordBegin();
+
+    Simulation* sim = appCore->getSimulation();
+    if (!options.scriptFile.empty())
+    {
+        // The time step is 1/fps while recording
+        appCore->runScript(options.scriptFile);
+        auto maxFrames = (int) (options.maxDuration * options.fps);
+        while (appCore->isScriptRunning() && capture->getFrameCount() < maxFrames)
+            RenderFrame(appCore.get(), capture);
+    }
+    else
+    {
+        // Without URLs, the time range is rendered from the initial view
+        if (urls.empty())
+            urls.emplace_back();
+
+        for (const auto& url : urls)
+        {
+            if (!url.empty() && !appCore->goToUrl(url))
+            {
+                fmt::fprintf(cerr, "Invalid URL '%s'\n", url);
+                continue;
+            }
+
+            if (times.empty())
+            {
+                // A still at the time of the URL
+                sim->setPauseState(true);
+                RenderFrame(appCore.get(), capture);
+                continue;
+            }
+
+            sim->setPauseState(true);
+            for (double t : times)
+            {
+                sim->setTime(t);
+                RenderFrame(appCore.get(), capture);
+            }
+        }
+    }
+
+    capture->end();
+    WriteTimings(options, capture->getTimings(),
+                 appCore->getRenderer()->getShaderManager().getStats());
+    appCore->recordEnd();
+
+    return 0;
+}
+
+} // namespace celestia
+
+
+int main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+    setlocale(LC_NUMERIC, "C");
+#ifdef ENABLE_NLS
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    bind_textdomain_codeset(PACKAGE, "UTF-8");
+    textdomain(PACKAGE);
+#endif
+
+    if (chdir(CONFIG_DATA_DIR) == -1)
+    {
+        cerr << "Cannot chdir to '" << CONFIG_DATA_DIR <<
+            "', probably due to improper installation\n";
+    }
+
+    celestia::Options options;
+    if (!celestia::ParseOptions(argc, argv, options))
+    {
+        celestia::Usage();
+        return 1;
+    }
+
+    return celestia::Run(options);
+}
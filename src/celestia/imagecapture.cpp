@@ -9,6 +9,9 @@
 
 #include <config.h>
 #include <celutil/debug.h>
+#include <celutil/filetype.h>
+#include <memory>
+#include <vector>
 #include "imagecapture.h"
 
 extern "C" {
@@ -19,55 +22,72 @@ extern "C" {
 
 using namespace std;
 
-
-bool CaptureGLBufferToJPEG(const fs::path& filename,
-                           int x, int y,
-                           int width, int height,
-                           const Renderer *renderer)
-{
 #ifdef GL_ES
-    int rowStride = width * 4;
-    int imageSize = height * rowStride;
-    Renderer::PixelFormat format = Renderer::PixelFormat::RGBA;
+static const Renderer::PixelFormat CaptureFormat = Renderer::PixelFormat::RGBA;
 #else
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    Renderer::PixelFormat format = Renderer::PixelFormat::RGB;
+static const Renderer::PixelFormat CaptureFormat = Renderer::PixelFormat::RGB;
 #endif
-    auto* pixels = new unsigned char[imageSize];
 
-    if (!renderer->captureFrame(x, y, width, height,
-                                format,
-                                pixels, true))
-    {
-        return false;
-    }
+struct FileCloser
+{
+    void operator()(FILE* f) const { fclose(f); }
+};
+typedef unique_ptr<FILE, FileCloser> ImageFile;
 
-    FILE* out;
+static ImageFile OpenImageFile(const fs::path& filename)
+{
 #ifdef _WIN32
-    out = _wfopen(filename.c_str(), L"wb");
+    FILE* out = _wfopen(filename.c_str(), L"wb");
 #else
-    out = fopen(filename.c_str(), "wb");
+    FILE* out = fopen(filename.c_str(), "wb");
 #endif
     if (out == nullptr)
     {
         DPRINTF(LOG_LEVEL_ERROR, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
-        return false;
+        return nullptr;
     }
 
+    return ImageFile(out);
+}
+
+
+// Get row i from the top of a frame as RGB, stripping alpha values if the
+// frame is in RGBA format.
+static const unsigned char* GetRGBRow(const CapturedFrame& frame, int i,
+                                      vector<unsigned char>& rowBuffer)
+{
+    const unsigned char* rowHead = &frame.pixels[frame.rowStride * (frame.height - i - 1)];
+    if (frame.format != Renderer::PixelFormat::RGBA)
+        return rowHead;
+
+    rowBuffer.resize(frame.width * 3);
+    for (int x = 0; x < frame.width; x++)
+    {
+        const unsigned char* pixelIn = &rowHead[x * 4];
+        unsigned char* pixelOut = &rowBuffer[x * 3];
+        pixelOut[0] = pixelIn[0];
+        pixelOut[1] = pixelIn[1];
+        pixelOut[2] = pixelIn[2];
+    }
+    return rowBuffer.data();
+}
+
+
+static bool WriteJPEG(FILE* out, const CapturedFrame& frame)
+{
     struct jpeg_compress_struct cinfo;
 
     struct jpeg_error_mgr jerr;
     JSAMPROW row[1];
+    vector<unsigned char> rowBuffer;
 
     cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_compress(&cinfo);
 
     jpeg_stdio_dest(&cinfo, out);
 
-    cinfo.image_width = width;
-    cinfo.image_height = height;
+    cinfo.image_width = frame.width;
+    cinfo.image_height = frame.height;
     cinfo.input_components = 3;
     cinfo.in_color_space = JCS_RGB;
 
@@ -79,29 +99,13 @@ bool CaptureGLBufferToJPEG(const fs::path& filename,
 
     while (cinfo.next_scanline < cinfo.image_height)
     {
-        unsigned char *rowHead = &pixels[rowStride * (cinfo.image_height - cinfo.next_scanline - 1)];
-        // Strip alpha values if we are in RGBA format
-        if (format == Renderer::PixelFormat::RGBA)
-        {
-            for (int x = 0; x < width; x++)
-            {
-                const unsigned char* pixelIn = &rowHead[x * 4];
-                unsigned char* pixelOut = &rowHead[x * 3];
-                pixelOut[0] = pixelIn[0];
-                pixelOut[1] = pixelIn[1];
-                pixelOut[2] = pixelIn[2];
-            }
-        }
-        row[0] = rowHead;
+        row[0] = const_cast<JSAMPLE*>(GetRGBRow(frame, cinfo.next_scanline, rowBuffer));
         (void) jpeg_write_scanlines(&cinfo, row, 1);
     }
 
     jpeg_finish_compress(&cinfo);
-    fclose(out);
     jpeg_destroy_compress(&cinfo);
 
-    delete[] pixels;
-
     return true;
 }
 
@@ -113,62 +117,11 @@ void PNGWriteData(png_structp png_ptr, png_bytep data, png_size_t length)
 }
 
 
-bool CaptureGLBufferToPNG(const fs::path& filename,
-                           int x, int y,
-                           int width, int height,
-                           const Renderer *renderer)
+static bool WritePNG(const fs::path& filename, FILE* out, const CapturedFrame& frame)
 {
-#ifdef GL_ES
-    int rowStride = width * 4;
-    int imageSize = height * rowStride;
-    Renderer::PixelFormat format = Renderer::PixelFormat::RGBA;
-#else
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    Renderer::PixelFormat format = Renderer::PixelFormat::RGB;
-#endif
-    auto* pixels = new unsigned char[imageSize];
-
-    if (!renderer->captureFrame(x, y, width, height,
-                                format,
-                                pixels, true))
-    {
-        return false;
-    }
-
-#ifdef _WIN32
-    FILE* out = _wfopen(filename.c_str(), L"wb");
-#else
-    FILE* out = fopen(filename.c_str(), "wb");
-#endif
-    if (out == nullptr)
-    {
-        DPRINTF(LOG_LEVEL_ERROR, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
-        return false;
-    }
-
-    auto* row_pointers = new png_bytep[height];
-    for (int i = 0; i < height; i++)
-    {
-        unsigned char *rowHead = &pixels[rowStride * (height - i - 1)];
-        // Strip alpha values if we are in RGBA format
-        if (format == Renderer::PixelFormat::RGBA)
-        {
-            for (int x = 0; x < width; x++)
-            {
-                const unsigned char* pixelIn = &rowHead[x * 4];
-                unsigned char* pixelOut = &rowHead[x * 3];
-                pixelOut[0] = pixelIn[0];
-                pixelOut[1] = pixelIn[1];
-                pixelOut[2] = pixelIn[2];
-            }
-        }
-        row_pointers[i] = (png_bytep) rowHead;
-    }
-
     png_structp png_ptr;
     png_infop info_ptr;
+    vector<unsigned char> rowBuffer;
 
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                       nullptr, nullptr, nullptr);
@@ -176,9 +129,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (png_ptr == nullptr)
     {
         DPRINTF(LOG_LEVEL_ERROR, "Screen capture: error allocating png_ptr\n");
-        fclose(out);
-        delete[] pixels;
-        delete[] row_pointers;
         return false;
     }
 
@@ -186,9 +136,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (info_ptr == nullptr)
     {
         DPRINTF(LOG_LEVEL_ERROR, "Screen capture: error allocating info_ptr\n");
-        fclose(out);
-        delete[] pixels;
-        delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, (png_infopp) nullptr);
         return false;
     }
@@ -196,9 +143,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (setjmp(png_jmpbuf(png_ptr)))
     {
         DPRINTF(LOG_LEVEL_ERROR, "Error writing PNG file '%s'\n", filename);
-        fclose(out);
-        delete[] pixels;
-        delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, &info_ptr);
         return false;
     }
@@ -208,7 +152,7 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
 
     png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
     png_set_IHDR(png_ptr, info_ptr,
-                 width, height,
+                 frame.width, frame.height,
                  8,
                  PNG_COLOR_TYPE_RGB,
                  PNG_INTERLACE_NONE,
@@ -216,14 +160,118 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
                  PNG_FILTER_TYPE_DEFAULT);
 
     png_write_info(png_ptr, info_ptr);
-    png_write_image(png_ptr, row_pointers);
+    for (int i = 0; i < frame.height; i++)
+        png_write_row(png_ptr, (png_bytep) GetRGBRow(frame, i, rowBuffer));
     png_write_end(png_ptr, info_ptr);
 
     // Clean up everything . . .
     png_destroy_write_struct(&png_ptr, &info_ptr);
-    delete[] row_pointers;
-    delete[] pixels;
-    fclose(out);
 
     return true;
 }
+
+
+// The file is only opened once the frame has been read, so that a failed
+// capture leaves an existing file alone.
+static bool WriteImageFile(const fs::path& filename, ContentType type,
+                           const CapturedFrame& frame)
+{
+    ImageFile out = OpenImageFile(filename);
+    if (out == nullptr)
+        return false;
+
+    bool ok = type == Content_JPEG ? WriteJPEG(out.get(), frame)
+                                   : WritePNG(filename, out.get(), frame);
+    return ok && fflush(out.get()) == 0 && ferror(out.get()) == 0;
+}
+
+
+// Frames are encoded on the encoder thread of the pipeline, after the
+// capture call has returned, so failures are reported through it.
+static CapturePipeline::Encoder ImageFileEncoder(const fs::path& filename, ContentType type,
+                                                 CapturePipeline& pipeline)
+{
+    return [filename, type, &pipeline](const CapturedFrame& frame)
+    {
+        if (WriteImageFile(filename, type, frame))
+            return true;
+        pipeline.reportError(fmt::sprintf("Failed to write screen capture file '%s'",
+                                          filename.string()));
+        return false;
+    };
+}
+
+
+static bool CaptureGLBuffer(CapturedFrame& frame,
+                            int x, int y,
+                            int width, int height,
+                            const Renderer *renderer)
+{
+    frame.width = width;
+    frame.height = height;
+    frame.format = CaptureFormat;
+    frame.rowStride = (width * frame.bytesPerPixel() + 3) & ~0x3;
+    frame.pixels.resize(frame.rowStride * height);
+
+    return renderer->captureFrame(x, y, width, height,
+                                  frame.format,
+                                  frame.pixels.data(), true);
+}
+
+
+bool CaptureGLBufferToJPEG(const fs::path& filename,
+                           int x, int y,
+                           int width, int height,
+                           const Renderer *renderer)
+{
+    CapturedFrame frame;
+    return CaptureGLBuffer(frame, x, y, width, height, renderer) &&
+           WriteImageFile(filename, Content_JPEG, frame);
+}
+
+
+bool CaptureGLBufferToPNG(const fs::path& filename,
+                          int x, int y,
+                          int width, int height,
+                          const Renderer *renderer)
+{
+    CapturedFrame frame;
+    return CaptureGLBuffer(frame, x, y, width, height, renderer) &&
+           WriteImageFile(filename, Content_PNG, frame);
+}
+
+
+bool CaptureGLBufferToJPEG(const fs::path& filename,
+                           int x, int y,
+                           int width, int height,
+                           CapturePipeline& pipeline)
+{
+    return pipeline.capture(x, y, width, height, CaptureFormat, true,
+                            ImageFileEncoder(filename, Content_JPEG, pipeline));
+}
+
+
+bool CaptureGLBufferToPNG(const fs::path& filename,
+                          int x, int y,
+                          int width, int height,
+                          CapturePipeline& pipeline)
+{
+    return pipeline.capture(x, y, width, height, CaptureFormat, true,
+                            ImageFileEncoder(filename, Content_PNG, pipeline));
+}
+
+
+CapturePipeline::Encoder GetImageFileEncoder(const fs::path& filename, CapturePipeline& pipeline)
+{
+    ContentType type = DetermineFileType(filename);
+    if (type != Content_JPEG && type != Content_PNG)
+        return nullptr;
+
+    return ImageFileEncoder(filename, type, pipeline);
+}
+
+
+Renderer::PixelFormat GetImageCaptureFormat()
+{
+    return CaptureFormat;
+}
@@ -12,6 +12,7 @@
 
 #include <celcompat/filesystem.h>
 #include <celengine/render.h>
+#include "capturepipeline.h"
 
 
 extern bool CaptureGLBufferToJPEG(const fs::path& filename,
@@ -23,4 +24,25 @@ extern bool CaptureGLBufferToPNG(const fs::path& filename,
                                  int width, int height,
                                  const Renderer *renderer);
 
+// Asynchronous versions of the captures: the image is compressed and
+// written by the encoder thread of the pipeline, and failures are reported
+// through the pipeline as the capture has already returned.
+extern bool CaptureGLBufferToJPEG(const fs::path& filename,
+                                  int x, int y,
+                                  int width, int height,
+                                  CapturePipeline& pipeline);
+extern bool CaptureGLBufferToPNG(const fs::path& filename,
+                                 int x, int y,
+                                 int width, int height,
+                                 CapturePipeline& pipeline);
+
+// Encoder writing frames to filename, as a JPEG or PNG image depending on
+// its extension; null for other extensions. The file is created when the
+// frame is encoded, and failures are reported through pipeline, which must
+// run the encoder. Frames must be read in the format returned by
+// GetImageCaptureFormat().
+extern CapturePipeline::Encoder GetImageFileEncoder(const fs::path& filename,
+                                                    CapturePipeline& pipeline);
+extern Renderer::PixelFormat GetImageCaptureFormat();
+
 #endif // _IMAGECAPTURE_H_
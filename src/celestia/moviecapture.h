@@ -10,8 +10,10 @@
 #ifndef _MOVIECAPTURE_H_
 #define _MOVIECAPTURE_H_
 
+#include <memory>
 #include <string>
 #include <celengine/render.h>
+#include "capturepipeline.h"
 
 
 class MovieCapture
@@ -35,8 +37,36 @@ class MovieCapture
     virtual void setQuality(float) = 0;
     virtual void recordingStatus(bool started) = 0; /* to update UI recording status indicator */
 
+    // Frames captured but not encoded yet, and frames lost
+    int getQueuedFrameCount() const
+    {
+        return pipeline != nullptr ? pipeline->getQueuedFrameCount() : 0;
+    }
+    int getDroppedFrameCount() const
+    {
+        return pipeline != nullptr ? pipeline->getDroppedFrameCount() : 0;
+    }
+
  protected:
+    // Frames are read back with this latency, and at most this many wait
+    // for the encoder before captureFrame() blocks.
+    static constexpr unsigned int ReadbackLatency = 2;
+    static constexpr size_t MaxQueuedFrames = 8;
+
+    // Read back a rectangle of the given size at the center of the
+    // viewport, to be encoded by the pipeline.
+    bool captureViewportCenter(int width, int height, Renderer::PixelFormat format)
+    {
+        int x, y, w, h;
+        renderer->getViewport(&x, &y, &w, &h);
+        x += (w - width) / 2;
+        y += (h - height) / 2;
+        return pipeline->capture(x, y, width, height, format, false);
+    }
+
     const Renderer *renderer{ nullptr };
+    // Created by start(), its encoder runs on a separate thread
+    std::unique_ptr<CapturePipeline> pipeline;
 };
 
 #endif // _MOVIECAPTURE_H_
@@ -68,11 +68,13 @@
 #include <celutil/debug.h>
 #include <celutil/gettext.h>
 #include <string>
+#include <utility>
 #include <theora/theora.h>
 
 using namespace std;
 
 #include "oggtheoracapture.h"
+#include "yuvconvert.h"
 
 //  {"video-rate-target",required_argument,nullptr,'V'},
 //  {"video-quality",required_argument,nullptr,'v'},
@@ -99,8 +101,6 @@ OggTheoraCapture::OggTheoraCapture(const Renderer *r):
     capturing(false),
     video_frame_count(0),
     video_bytesout(0),
-    rowStride(0),
-    pixels(nullptr),
     outfile(nullptr)
 {
     yuvframe[0] = nullptr;
@@ -280,29 +280,21 @@ bool OggTheoraCapture::start(const std::string& filename,
         fwrite(videopage.header,1,videopage.header_len,outfile);
         fwrite(videopage.body,1,  videopage.body_len,outfile);
     }
-    /* Initialize the double frame buffer.
-     * We allocate enough for a 4:4:4 color sampling
-     */
-    yuvframe[0]= new unsigned char[video_x*video_y*3];
-    yuvframe[1]= new unsigned char[video_x*video_y*3];
-
-    // Now the buffer for reading the GL RGB pixels
-    rowStride = (frame_x * 3 + 3) & ~0x3;
-    pixels = new unsigned char[rowStride*frame_y];
+    /* Initialize the double frame buffer, with 4:2:0 color sampling */
+    yuvframe[0]= new unsigned char[video_x*video_y*3/2];
+    yuvframe[1]= new unsigned char[video_x*video_y*3/2];
 
         /* clear initial frame as it may be larger than actual video data */
         /* fill Y plane with 0x10 and UV planes with 0x80, for black data */
-    // The UV plane must be 4:2:0
     memset(yuvframe[0],0x10,video_x*video_y);
-    memset(yuvframe[0]+video_x*video_y,0x80,video_x*video_y*2);
+    memset(yuvframe[0]+video_x*video_y,0x80,video_x*video_y/2);
     memset(yuvframe[1],0x10,video_x*video_y);
-    memset(yuvframe[1]+video_x*video_y,0x80,video_x*video_y*2);
+    memset(yuvframe[1]+video_x*video_y,0x80,video_x*video_y/2);
 
     yuv.y_width=video_x;
     yuv.y_height=video_y;
     yuv.y_stride=video_x;
 
-    // Note we lie here by saying it's 4:2:0 and we will convert 4:4:4 to 4:2;0 later
     yuv.uv_width=video_x/2;
     yuv.uv_height=video_y/2;
     yuv.uv_stride=video_x/2;
@@ -316,6 +308,11 @@ bool OggTheoraCapture::start(const std::string& filename,
             video_x,video_y,
             frame_x_offset,frame_y_offset);
 
+    // Colour conversion and encoding are done on the encoder thread
+    pipeline.reset(new CapturePipeline(renderer,
+                                       [this](const CapturedFrame& frame) { return encodeFrame(frame); },
+                                       ReadbackLatency, MaxQueuedFrames));
+
     capturing = true;
     return true;
 }
@@ -325,6 +322,16 @@ bool OggTheoraCapture::captureFrame()
     if (!capturing)
         return false;
 
+    if (!captureViewportCenter(frame_x, frame_y, Renderer::PixelFormat::RGBA))
+        return false;
+
+    frameCaptured();
+    return true;
+}
+
+// Run on the encoder thread of the capture pipeline
+bool OggTheoraCapture::encodeFrame(const CapturedFrame& frame)
+{
     while (ogg_stream_pageout(&to,&videopage)>0)
     {
         /* flush a video page */
@@ -334,36 +341,16 @@ bool OggTheoraCapture::captureFrame()
     }
     if(ogg_stream_eos(&to)) return false;
 
-    // Get the dimensions of the current viewport
-    int x, y, w, h;
-    renderer->getViewport(&x, &y, &w, &h);
-
-    x += (w - frame_x) / 2;
-    y += (h - frame_y) / 2;
-    renderer->captureFrame(x, y, frame_x, frame_y,
-                           Renderer::PixelFormat::RGB,
-                           pixels);
-
-    unsigned char *ybase = yuvframe[0];
-    unsigned char *ubase = yuvframe[0]+ video_x*video_y;
-    unsigned char *vbase = yuvframe[0]+ video_x*video_y*2;
-    // We go ahead and build 4:4:4 frames
-    for (int y=0; y<frame_y; y++)
-    {
-        unsigned char *yptr = ybase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *uptr = ubase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *vptr = vbase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *rgb = pixels + ((frame_y-1-y)*rowStride); // The video is inverted
-        for (int x=0; x<frame_x; x++)
-        {
-            unsigned char r = *rgb++;
-            unsigned char g = *rgb++;
-            unsigned char b = *rgb++;
-            *yptr++ = min(abs(r * 2104 + g * 4130 + b * 802 + 4096 + 131072) >> 13,235);
-            *uptr++ = min(abs(r * -1214 + g * -2384 + b * 3598 + 4096 + 1048576) >> 13,240);
-            *vptr++ = min(abs(r * 3598 + g * -3013 + b * -585 + 4096 + 1048576) >> 13,240);
-        }
-    }
+    // The frame is read bottom up, and the video is top down
+    int uvStride = video_x / 2;
+    unsigned char *ybase = yuvframe[0] + video_x*frame_y_offset + frame_x_offset;
+    unsigned char *ubase = yuvframe[0] + video_x*video_y + uvStride*(frame_y_offset/2) + frame_x_offset/2;
+    unsigned char *vbase = ubase + uvStride*(video_y/2);
+    ConvertRGBAToYUV420(frame.pixels.data() + (frame.height-1)*frame.rowStride,
+                        -(ptrdiff_t) frame.rowStride,
+                        frame_x, frame_y,
+                        ybase, video_x,
+                        ubase, vbase, uvStride);
 
     /*
      * The video strategy is to capture one frame ahead so when we're at end of
@@ -373,90 +360,39 @@ bool OggTheoraCapture::captureFrame()
      */
 
     if (video_frame_count > 0)
-    {
-        yuv.y= yuvframe[1];
-        yuv.u= yuvframe[1]+ video_x*video_y;
-        yuv.v= yuvframe[1]+ video_x*video_y*2;
-        // Convert to 4:2:0
-        unsigned char * uin0 = yuv.u;
-        unsigned char * uin1 = yuv.u + video_x;
-        unsigned char * uout = yuv.u;
-        unsigned char * vin0 = yuv.v;
-        unsigned char * vin1 = yuv.v + video_x;
-        unsigned char * vout = yuv.v;
-        for (int y = 0; y < video_y; y += 2)
-        {
-            for (int x = 0; x < video_x; x += 2)
-            {
-                *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                uin0 += 2;
-                uin1 += 2;
-                uout++;
-                *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                vin0 += 2;
-                vin1 += 2;
-                vout++;
-            }
-            uin0 += video_x;
-            uin1 += video_x;
-            vin0 += video_x;
-            vin1 += video_x;
-        }
-        theora_encode_YUVin(&td,&yuv);
-        theora_encode_packetout(&td,0,&op);
-        ogg_stream_packetin(&to,&op);
-    }
+        encodeYUVFrame(yuvframe[1], 0);
+
     video_frame_count += 1;
     //if ((video_frame_count % 10) == 0)
     //    DPRINTF(LOG_LEVEL_VERBOSE, "Writing frame %d\n", video_frame_count);
-    unsigned char *temp = yuvframe[0];
-    yuvframe[0] = yuvframe[1];
-    yuvframe[1] = temp;
-    frameCaptured();
+    std::swap(yuvframe[0], yuvframe[1]);
 
     return true;
 }
+
+void OggTheoraCapture::encodeYUVFrame(unsigned char *frame, int last)
+{
+    yuv.y= frame;
+    yuv.u= frame + video_x*video_y;
+    yuv.v= yuv.u + (video_x/2)*(video_y/2);
+    theora_encode_YUVin(&td,&yuv);
+    theora_encode_packetout(&td,last,&op);
+    ogg_stream_packetin(&to,&op);
+}
+
 void OggTheoraCapture::cleanup()
 {
     capturing = false;
+    // Wait for the frames still in the pipeline to be encoded
+    pipeline.reset();
     /* clear out state */
 
     if(outfile)
     {
-        DPRINTF(LOG_LEVEL_VERBOSE, _("OggTheoraCapture::cleanup() - wrote %d frames\n"), video_frame_count);
+        DPRINTF(LOG_LEVEL_VERBOSE, _("OggTheoraCapture::cleanup() - wrote %d frames\n"), video_frame_count.load());
         if (video_frame_count > 0)
         {
-            yuv.y= yuvframe[1];
-            yuv.u= yuvframe[1]+ video_x*video_y;
-            yuv.v= yuvframe[1]+ video_x*video_y*2 ;
-            // Convert to 4:2:0
-            unsigned char * uin0 = yuv.u;
-            unsigned char * uin1 = yuv.u + video_x;
-            unsigned char * uout = yuv.u;
-            unsigned char * vin0 = yuv.v;
-            unsigned char * vin1 = yuv.v + video_x;
-            unsigned char * vout = yuv.v;
-            for (int y = 0; y < video_y; y += 2)
-            {
-                for (int x = 0; x < video_x; x += 2)
-                {
-                    *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                    uin0 += 2;
-                    uin1 += 2;
-                    uout++;
-                    *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                    vin0 += 2;
-                    vin1 += 2;
-                    vout++;
-                }
-                uin0 += video_x;
-                uin1 += video_x;
-                vin0 += video_x;
-                vin1 += video_x;
-            }
-            theora_encode_YUVin(&td,&yuv);
-            theora_encode_packetout(&td,1,&op);
-            ogg_stream_packetin(&to,&op);
+            encodeYUVFrame(yuvframe[1], 1);
         }
         while(ogg_stream_pageout(&to,&videopage)>0)
         {
@@ -480,7 +416,6 @@ void OggTheoraCapture::cleanup()
         outfile = nullptr;
         delete [] yuvframe[0];
         delete [] yuvframe[1];
-        delete [] pixels;
     }
 }
 
@@ -2,6 +2,7 @@
 #ifndef _OGGTHEORACAPTURE_H_
 #define _OGGTHEORACAPTURE_H_
 
+#include <atomic>
 #include "theora/theora.h"
 #include "moviecapture.h"
 
@@ -26,6 +27,8 @@ public:
 
 private:
     void cleanup();
+    bool encodeFrame(const CapturedFrame&);
+    void encodeYUVFrame(unsigned char*, int last);
 
 private:
     int video_x;
@@ -42,15 +45,10 @@ private:
     int video_q; // 0-63 aka 0-10 * 6.3
 
     bool       capturing;
-    int        video_frame_count;
+    // Updated by the encoder thread
+    std::atomic<int> video_frame_count;
     int        video_bytesout;
 
-    // Consider RGB to YUV Color converstion table - jpeglib has one
-    // but according the standards it's incorrect (generates values 0-255,
-    // instead of clamped to 16-240).
-
-    int            rowStride;
-    unsigned char  *pixels;
     unsigned char  *yuvframe[2];
     yuv_buffer     yuv;
     FILE           *outfile;
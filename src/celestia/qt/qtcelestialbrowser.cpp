@@ -30,8 +30,8 @@
 #include <QRegExp>
 #include <QFontMetrics>
 #include <QCollator>
+#include <algorithm>
 #include <vector>
-#include <set>
 
 using namespace Eigen;
 using namespace std;
@@ -399,25 +399,6 @@ void StarTableModel::populate(const UniversalCoord& _observerPos,
     observerPos = _observerPos;
     now = _now;
 
-    typedef multiset<Star*, StarPredicate> StarSet;
-    StarPredicate pred(criterion, observerPos, universe);
-
-    // Apply the filter
-    vector<Star*> filteredStars;
-    unsigned int totalStars = stardb.size();
-    unsigned int i = 0;
-    filteredStars.reserve(totalStars);
-    for (i = 0; i < totalStars; i++)
-    {
-        Star* star = stardb.getStar(i);
-        if (!filterPred(star))
-            filteredStars.push_back(star);
-    }
-
-    // Don't try and show more stars than remain after the filter
-    if (filteredStars.size() < nStars)
-        nStars = filteredStars.size();
-
     // Clear out the results of the previous populate() call
     if (stars.size() != 0)
     {
@@ -426,40 +407,46 @@ void StarTableModel::populate(const UniversalCoord& _observerPos,
         endResetModel();
     }
 
-    if (filteredStars.empty())
-        return;
-
-    StarSet firstStars(pred);
-
-    // We'll need at least nStars in the set, so first fill
-    // up the list indiscriminately.
-    for (i = 0; i < nStars; i++)
-    {
-        firstStars.insert(filteredStars[i]);
-    }
-
-    // From here on, only add a star to the set if it's
-    // A better match than the worst matching star already
-    // in the set.
-    const Star* lastStar = *--firstStars.end();
-    for (; i < filteredStars.size(); i++)
+    auto filter = [&filterPred](const Star& star) { return !filterPred(&star); };
+    vector<const Star*> bestStars;
+    if (filterPred.planetsFilterEnabled)
     {
-        Star* star = filteredStars[i];
-        if (pred(star, lastStar))
+        // Only stars with planets can match, there are few enough of them
+        // to sort them all.
+        if (filterPred.solarSystems != nullptr)
         {
-            firstStars.insert(star);
-            firstStars.erase(--firstStars.end());
-            lastStar = *--firstStars.end();
+            for (const auto& solarSystem : *filterPred.solarSystems)
+            {
+                const Star* star = stardb.find(solarSystem.first);
+                if (star != nullptr && filter(*star))
+                    bestStars.push_back(star);
+            }
         }
-    }
 
-    // Move the best matching stars into the vector
-    stars.reserve(nStars);
-    for (const auto& star : firstStars)
+        StarPredicate pred(criterion, observerPos, universe);
+        auto last = bestStars.begin() + min((size_t) nStars, bestStars.size());
+        partial_sort(bestStars.begin(), last, bestStars.end(), pred);
+        bestStars.erase(last, bestStars.end());
+    }
+    else
     {
-        stars.push_back(star);
+        Vector3f pos = observerPos.toLy().cast<float>();
+        if (criterion == StarPredicate::Brightness)
+            stardb.findBrighterStars(pos, nStars, bestStars, filter);
+        else if (criterion == StarPredicate::IntrinsicBrightness)
+            stardb.findBrightestStars(nStars, bestStars, filter);
+        else
+            stardb.findNearestStars(pos, nStars, bestStars, filter);
     }
 
+    if (bestStars.empty())
+        return;
+
+    // Move the best matching stars into the vector
+    stars.reserve(bestStars.size());
+    for (const auto& star : bestStars)
+        stars.push_back(const_cast<Star*>(star));
+
     beginInsertRows(QModelIndex(), 0, stars.size());
     endInsertRows();
 }
@@ -11,7 +11,6 @@
 
 #include <string>
 #include <algorithm>
-#include <set>
 #include <windows.h>
 #include <commctrl.h>
 #include <cstring>
@@ -98,105 +97,6 @@ struct CloserStarPredicate
     }
 };
 
-struct BrighterStarPredicate
-{
-    Vector3f pos;
-    UniversalCoord ucPos;
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        float d0 = (pos - star0->getPosition()).norm();
-        float d1 = (pos - star1->getPosition()).norm();
-
-        // If the stars are closer than one light year, use
-        // a more precise distance estimate.
-        if (d0 < 1.0f)
-            d0 = ucPos.offsetFromLy(star0->getPosition()).norm();
-        if (d1 < 1.0f)
-            d1 = ucPos.offsetFromLy(star1->getPosition()).norm();
-
-        return (star0->getApparentMagnitude(d0) <
-                star1->getApparentMagnitude(d1));
-    }
-};
-
-struct SolarSystemPredicate
-{
-    Vector3f pos;
-    SolarSystemCatalog* solarSystems;
-
-    bool operator()(const Star* star0, const Star* star1) const
-    {
-        SolarSystemCatalog::iterator iter;
-
-        iter = solarSystems->find(star0->getIndex());
-        bool hasPlanets0 = (iter != solarSystems->end());
-        iter = solarSystems->find(star1->getIndex());
-        bool hasPlanets1 = (iter != solarSystems->end());
-        if (hasPlanets1 == hasPlanets0)
-        {
-            return ((pos - star0->getPosition()).squaredNorm() <
-                    (pos - star1->getPosition()).squaredNorm());
-        }
-        else
-        {
-            return hasPlanets0;
-        }
-    }
-};
-
-
-// Find the nearest/brightest/X-est N stars in a database.  The
-// supplied predicate determines which of two stars is a better match.
-template<class Pred> vector<const Star*>*
-FindStars(const StarDatabase& stardb, Pred pred, int nStars)
-{
-    vector<const Star*>* finalStars = new vector<const Star*>();
-    if (nStars == 0)
-        return finalStars;
-
-    typedef multiset<const Star*, Pred> StarSet;
-    StarSet firstStars(pred);
-
-    int totalStars = stardb.size();
-    if (totalStars < nStars)
-        nStars = totalStars;
-
-    // We'll need at least nStars in the set, so first fill
-    // up the list indiscriminately.
-    int i = 0;
-    for (i = 0; i < nStars; i++)
-    {
-        Star* star = stardb.getStar(i);
-        if (star->getVisibility())
-            firstStars.insert(star);
-    }
-
-    // From here on, only add a star to the set if it's
-    // a better match than the worst matching star already
-    // in the set.
-    const Star* lastStar = *--firstStars.end();
-    for (; i < totalStars; i++)
-    {
-        Star* star = stardb.getStar(i);
-        if (star->getVisibility() && pred(star, lastStar))
-        {
-            firstStars.insert(star);
-            firstStars.erase(--firstStars.end());
-            lastStar = *--firstStars.end();
-        }
-    }
-
-    // Move the best matching stars into the vector
-    finalStars->reserve(nStars);
-    for (const auto& star : firstStars)
-    {
-        finalStars->insert(finalStars->end(), star);
-    }
-
-    return finalStars;
-}
-
-
 bool InitStarBrowserLVItems(HWND listView, vector<const Star*>& stars)
 {
     LVITEM lvi;
@@ -224,35 +124,37 @@ bool InitStarBrowserItems(HWND listView, StarBrowser* browser)
     StarDatabase* stardb = univ->getStarCatalog();
     SolarSystemCatalog* solarSystems = univ->getSolarSystemCatalog();
 
-    vector<const Star*>* stars = NULL;
+    // Barycenters aren't listed
+    auto isVisible = [](const Star& star) { return star.getVisibility(); };
+
+    vector<const Star*> stars;
     switch (browser->predicate)
     {
     case BrightestStars:
-        {
-            BrighterStarPredicate brighterPred;
-            brighterPred.pos = browser->pos;
-            brighterPred.ucPos = browser->ucPos;
-            stars = FindStars(*stardb, brighterPred, browser->nStars);
-        }
+        stardb->findBrighterStars(browser->pos, browser->nStars, stars, isVisible);
         break;
 
     case NearestStars:
-        {
-            CloserStarPredicate closerPred;
-            closerPred.pos = browser->pos;
-            stars = FindStars(*stardb, closerPred, browser->nStars);
-        }
+        stardb->findNearestStars(browser->pos, browser->nStars, stars, isVisible);
         break;
 
     case StarsWithPlanets:
         {
             if (solarSystems == NULL)
                 return false;
-            SolarSystemPredicate solarSysPred;
-            solarSysPred.pos = browser->pos;
-            solarSysPred.solarSystems = solarSystems;
-            stars = FindStars(*stardb, solarSysPred,
-                              min((unsigned int) browser->nStars, (unsigned int) solarSystems->size()));
+
+            for (const auto& solarSystem : *solarSystems)
+            {
+                const Star* star = stardb->find(solarSystem.first);
+                if (star != NULL && star->getVisibility())
+                    stars.push_back(star);
+            }
+
+            CloserStarPredicate closerPred;
+            closerPred.pos = browser->pos;
+            auto last = stars.begin() + min((size_t) browser->nStars, stars.size());
+            partial_sort(stars.begin(), last, stars.end(), closerPred);
+            stars.erase(last, stars.end());
         }
         break;
 
@@ -260,10 +162,7 @@ bool InitStarBrowserItems(HWND listView, StarBrowser* browser)
         return false;
     }
 
-    bool succeeded = InitStarBrowserLVItems(listView, *stars);
-    delete stars;
-
-    return succeeded;
+    return InitStarBrowserLVItems(listView, stars);
 }
 
 
@@ -0,0 +1,206 @@
+// yuvconvert.cpp
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Colour conversion of captured frames for video encoding.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "yuvconvert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Fixed point coefficients of the conversion, scaled by 2^13. See
+// http://en.wikipedia.org/wiki/YUV/RGB_conversion_formulas
+//   Y = (2104 R + 4130 G +  802 B + 4096 + 131072) >> 13
+//   U = (-1214 R - 2384 G + 3598 B + 4096 + 1048576) >> 13
+//   V = (3598 R - 3013 G -  585 B + 4096 + 1048576) >> 13
+// Chroma is computed from the sum of four pixels, hence the additional
+// shift by two.
+constexpr const int YR = 2104, YG = 4130, YB = 802;
+constexpr const int UR = -1214, UG = -2384, UB = 3598;
+constexpr const int VR = 3598, VG = -3013, VB = -585;
+constexpr const int YOffset = 4096 + 131072;
+constexpr const int UVOffset = 4 * (4096 + 1048576);
+constexpr const int YMax = 235;
+constexpr const int UVMax = 240;
+
+static inline unsigned char luma(const unsigned char* p)
+{
+    return (unsigned char) min((p[0] * YR + p[1] * YG + p[2] * YB + YOffset) >> 13, YMax);
+}
+
+// Convert the pixels from column x0 onwards of a pair of rows. row1 is
+// the same as row0 and y1 is null for the last row of an image of odd
+// height.
+static void convertRowPair(const unsigned char* row0, const unsigned char* row1,
+                           int x0, int width,
+                           unsigned char* y0, unsigned char* y1,
+                           unsigned char* u, unsigned char* v)
+{
+    for (int x = x0; x < width; x++)
+    {
+        y0[x] = luma(row0 + x * 4);
+        if (y1 != nullptr)
+            y1[x] = luma(row1 + x * 4);
+    }
+
+    for (int x = x0; x < width; x += 2)
+    {
+        int x1 = min(x + 1, width - 1);
+        const unsigned char* p[4] = { row0 + x * 4, row0 + x1 * 4, row1 + x * 4, row1 + x1 * 4 };
+        int r = p[0][0] + p[1][0] + p[2][0] + p[3][0];
+        int g = p[0][1] + p[1][1] + p[2][1] + p[3][1];
+        int b = p[0][2] + p[1][2] + p[2][2] + p[3][2];
+        u[x / 2] = (unsigned char) min((r * UR + g * UG + b * UB + UVOffset) >> 15, UVMax);
+        v[x / 2] = (unsigned char) min((r * VR + g * VG + b * VB + UVOffset) >> 15, UVMax);
+    }
+}
+
+void ConvertRGBAToYUV420Scalar(const unsigned char* rgba, ptrdiff_t rgbaStride,
+                               int width, int height,
+                               unsigned char* y, int yStride,
+                               unsigned char* u, unsigned char* v, int uvStride)
+{
+    for (int row = 0; row < height; row += 2)
+    {
+        bool pair = row + 1 < height;
+        const unsigned char* row0 = rgba + row * rgbaStride;
+        const unsigned char* row1 = pair ? row0 + rgbaStride : row0;
+        convertRowPair(row0, row1, 0, width,
+                       y + row * yStride, pair ? y + (row + 1) * yStride : nullptr,
+                       u + (row / 2) * uvStride, v + (row / 2) * uvStride);
+    }
+}
+
+#ifdef USE_SSE2
+
+// Dot products of the RGB components of the two pixels held as 16 bit
+// integers in p with the coefficients c; the results are in elements 0
+// and 2.
+static inline __m128i dot2(__m128i p, __m128i c)
+{
+    __m128i m = _mm_madd_epi16(p, c);
+    return _mm_add_epi32(m, _mm_srli_epi64(m, 32));
+}
+
+// Gather elements 0 and 2 of a and b
+static inline __m128i gather(__m128i a, __m128i b)
+{
+    return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 2, 0)),
+                              _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 0)));
+}
+
+// Convert eight pixels of a row to luma
+static inline void luma8(const __m128i px[4], unsigned char* y)
+{
+    const __m128i coeffs = _mm_setr_epi16(YR, YG, YB, 0, YR, YG, YB, 0);
+    const __m128i offset = _mm_set1_epi32(YOffset);
+
+    __m128i y03 = gather(dot2(px[0], coeffs), dot2(px[1], coeffs));
+    __m128i y47 = gather(dot2(px[2], coeffs), dot2(px[3], coeffs));
+    y03 = _mm_srai_epi32(_mm_add_epi32(y03, offset), 13);
+    y47 = _mm_srai_epi32(_mm_add_epi32(y47, offset), 13);
+    __m128i y8 = _mm_min_epi16(_mm_packs_epi32(y03, y47), _mm_set1_epi16(YMax));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(y), _mm_packus_epi16(y8, y8));
+}
+
+// Load eight RGBA pixels, unpacked to 16 bit integers two pixels at a time
+static inline void load8(const unsigned char* rgba, __m128i px[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16));
+    px[0] = _mm_unpacklo_epi8(a, zero);
+    px[1] = _mm_unpackhi_epi8(a, zero);
+    px[2] = _mm_unpacklo_epi8(b, zero);
+    px[3] = _mm_unpackhi_epi8(b, zero);
+}
+
+void ConvertRGBAToYUV420(const unsigned char* rgba, ptrdiff_t rgbaStride,
+                         int width, int height,
+                         unsigned char* y, int yStride,
+                         unsigned char* u, unsigned char* v, int uvStride)
+{
+    const __m128i uCoeffs = _mm_setr_epi16(UR, UG, UB, 0, UR, UG, UB, 0);
+    const __m128i vCoeffs = _mm_setr_epi16(VR, VG, VB, 0, VR, VG, VB, 0);
+    const __m128i uvOffset = _mm_set1_epi32(UVOffset);
+    const __m128i uvMax = _mm_set1_epi16(UVMax);
+
+    int simdWidth = width & ~7;
+    for (int row = 0; row + 1 < height; row += 2)
+    {
+        const unsigned char* row0 = rgba + row * rgbaStride;
+        const unsigned char* row1 = row0 + rgbaStride;
+        unsigned char* y0 = y + row * yStride;
+        unsigned char* y1 = y0 + yStride;
+        unsigned char* uRow = u + (row / 2) * uvStride;
+        unsigned char* vRow = v + (row / 2) * uvStride;
+
+        for (int x = 0; x < simdWidth; x += 8)
+        {
+            __m128i px0[4], px1[4];
+            load8(row0 + x * 4, px0);
+            load8(row1 + x * 4, px1);
+            luma8(px0, y0 + x);
+            luma8(px1, y1 + x);
+
+            // Sum the 2x2 blocks: first vertically, then the two pixels
+            // held in each register.
+            __m128i sums[4];
+            for (int i = 0; i < 4; i++)
+            {
+                __m128i s = _mm_add_epi16(px0[i], px1[i]);
+                sums[i] = _mm_add_epi16(s, _mm_srli_si128(s, 8));
+            }
+            __m128i c01 = _mm_unpacklo_epi64(sums[0], sums[1]);
+            __m128i c23 = _mm_unpacklo_epi64(sums[2], sums[3]);
+
+            __m128i u4 = gather(dot2(c01, uCoeffs), dot2(c23, uCoeffs));
+            __m128i v4 = gather(dot2(c01, vCoeffs), dot2(c23, vCoeffs));
+            u4 = _mm_srai_epi32(_mm_add_epi32(u4, uvOffset), 15);
+            v4 = _mm_srai_epi32(_mm_add_epi32(v4, uvOffset), 15);
+            __m128i uv = _mm_min_epi16(_mm_packs_epi32(u4, v4), uvMax);
+            uv = _mm_packus_epi16(uv, uv);
+
+            int32_t u32 = _mm_cvtsi128_si32(uv);
+            int32_t v32 = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+            memcpy(uRow + x / 2, &u32, 4);
+            memcpy(vRow + x / 2, &v32, 4);
+        }
+
+        convertRowPair(row0, row1, simdWidth, width, y0, y1, uRow, vRow);
+    }
+
+    if (height % 2 != 0)
+    {
+        int row = height - 1;
+        const unsigned char* row0 = rgba + row * rgbaStride;
+        convertRowPair(row0, row0, 0, width, y + row * yStride, nullptr,
+                       u + (row / 2) * uvStride, v + (row / 2) * uvStride);
+    }
+}
+
+#else
+
+void ConvertRGBAToYUV420(const unsigned char* rgba, ptrdiff_t rgbaStride,
+                         int width, int height,
+                         unsigned char* y, int yStride,
+                         unsigned char* u, unsigned char* v, int uvStride)
+{
+    ConvertRGBAToYUV420Scalar(rgba, rgbaStride, width, height,
+                              y, yStride, u, v, uvStride);
+}
+
+#endif
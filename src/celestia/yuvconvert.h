@@ -0,0 +1,31 @@
+// yuvconvert.h
+//
+// Copyright (C) 2020, the Celestia Development Team
+//
+// Colour conversion of captured frames for video encoding.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+
+// Convert an RGBA image to planar YUV 4:2:0, using the Rec. 601 studio
+// range: Y in [16, 235], U and V in [16, 240]. Rows of the source image
+// are rgbaStride bytes apart; a negative stride flips the image. Each
+// chroma sample is computed from the average colour of a 2x2 block of
+// pixels, the last column or row being repeated for odd sizes.
+void ConvertRGBAToYUV420(const unsigned char* rgba, std::ptrdiff_t rgbaStride,
+                         int width, int height,
+                         unsigned char* y, int yStride,
+                         unsigned char* u, unsigned char* v, int uvStride);
+
+// Portable version of the conversion, giving identical results. The
+// SIMD version uses it for the edges of the image.
+void ConvertRGBAToYUV420Scalar(const unsigned char* rgba, std::ptrdiff_t rgbaStride,
+                               int width, int height,
+                               unsigned char* y, int yStride,
+                               unsigned char* u, unsigned char* v, int uvStride);
@@ -0,0 +1,128 @@
+// bvh.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy used to accelerate ray picking.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "bvh.h"
+#include <algorithm>
+#include <limits>
+
+using namespace cmod;
+using namespace Eigen;
+using namespace std;
+
+// Maximum number of primitives in a leaf node
+static const unsigned int MaxLeafSize = 4;
+
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const vector<AlignedBox<float, 3>>& primitiveBoxes)
+{
+    if (primitiveBoxes.empty())
+        return;
+
+    vector<Vector3f> centers;
+    centers.reserve(primitiveBoxes.size());
+    primitives.reserve(primitiveBoxes.size());
+    for (unsigned int i = 0; i < primitiveBoxes.size(); i++)
+    {
+        centers.push_back(primitiveBoxes[i].center());
+        primitives.push_back(i);
+    }
+
+    nodes.reserve(2 * primitiveBoxes.size() / MaxLeafSize + 1);
+    build(primitiveBoxes, centers, 0, (unsigned int) primitiveBoxes.size(), 1);
+}
+
+
+/*! Split the primitives at the median of their centers along the axis
+ *  over which the centers are the most spread out.
+ */
+void
+BoundingVolumeHierarchy::build(const vector<AlignedBox<float, 3>>& boxes,
+                               const vector<Vector3f>& centers,
+                               unsigned int first, unsigned int count,
+                               unsigned int depth)
+{
+    auto begin = primitives.begin() + first;
+    auto end = begin + count;
+
+    Node node;
+    AlignedBox<float, 3> centerBox;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+        node.box.extend(boxes[*iter]);
+        centerBox.extend(centers[*iter]);
+    }
+
+    unsigned int nodeIndex = (unsigned int) nodes.size();
+    if (count <= MaxLeafSize || depth == MaxDepth)
+    {
+        node.first = first;
+        node.count = count;
+        nodes.push_back(node);
+        return;
+    }
+
+    node.first = 0;
+    node.count = 0;
+    nodes.push_back(node);
+
+    int axis;
+    centerBox.sizes().maxCoeff(&axis);
+    unsigned int half = count / 2;
+    nth_element(begin, begin + half, end,
+                [&centers, axis](unsigned int a, unsigned int b)
+                { return centers[a][axis] < centers[b][axis]; });
+
+    build(boxes, centers, first, half, depth + 1);
+    nodes[nodeIndex].first = (unsigned int) nodes.size();
+    build(boxes, centers, first + half, count - half, depth + 1);
+}
+
+
+/*! Return the distance along the ray at which it enters the box, zero if
+ *  the ray starts inside it, or infinity if it misses the box or enters
+ *  it farther than closest.
+ */
+double
+BoundingVolumeHierarchy::intersectBox(const AlignedBox<float, 3>& box,
+                                      const Vector3d& rayOrigin,
+                                      const Vector3d& rayDirection,
+                                      double closest)
+{
+    constexpr double miss = numeric_limits<double>::infinity();
+    if (box.isEmpty())
+        return miss;
+
+    double tNear = 0.0;
+    double tFar = closest;
+    for (int i = 0; i < 3; i++)
+    {
+        double boxMin = box.min()[i];
+        double boxMax = box.max()[i];
+        if (rayDirection[i] == 0.0)
+        {
+            if (rayOrigin[i] < boxMin || rayOrigin[i] > boxMax)
+                return miss;
+            continue;
+        }
+
+        double invDirection = 1.0 / rayDirection[i];
+        double t0 = (boxMin - rayOrigin[i]) * invDirection;
+        double t1 = (boxMax - rayOrigin[i]) * invDirection;
+        if (t0 > t1)
+            swap(t0, t1);
+        tNear = max(tNear, t0);
+        tFar = min(tFar, t1);
+        if (tNear > tFar)
+            return miss;
+    }
+
+    return tNear;
+}
@@ -0,0 +1,133 @@
+// bvh.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy used to accelerate ray picking.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#ifndef _CELMODEL_BVH_H_
+#define _CELMODEL_BVH_H_
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <utility>
+#include <vector>
+
+
+namespace cmod
+{
+
+/*! A binary tree of axis aligned bounding boxes over a set of primitives,
+ *  such as the triangles of a mesh or the meshes of a model. Primitives
+ *  are identified by their index in the list of boxes the hierarchy is
+ *  built from.
+ */
+class BoundingVolumeHierarchy
+{
+ public:
+    BoundingVolumeHierarchy() = default;
+    explicit BoundingVolumeHierarchy(const std::vector<Eigen::AlignedBox<float, 3>>& primitiveBoxes);
+
+    bool empty() const { return nodes.empty(); }
+
+    /*! Call intersect(primitive, closest) for all the primitives whose
+     *  bounding box is hit by the ray closer than closest, nearest boxes
+     *  first. intersect() returns true and updates closest when the ray
+     *  hits the primitive closer than closest.
+     */
+    template<typename F> bool
+    traverse(const Eigen::Vector3d& rayOrigin,
+             const Eigen::Vector3d& rayDirection,
+             double& closest,
+             F intersect) const
+    {
+        if (nodes.empty() ||
+            intersectBox(nodes[0].box, rayOrigin, rayDirection, closest) >= closest)
+        {
+            return false;
+        }
+
+        bool hit = false;
+        unsigned int stack[MaxDepth];
+        unsigned int stackSize = 0;
+        unsigned int nodeIndex = 0;
+        for (;;)
+        {
+            const Node& node = nodes[nodeIndex];
+            if (node.count != 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                {
+                    if (intersect(primitives[i], closest))
+                        hit = true;
+                }
+            }
+            else
+            {
+                // Visit the nearest child first, and the other one later
+                // if it is still closer than the nearest hit.
+                unsigned int left = nodeIndex + 1;
+                unsigned int right = node.first;
+                double tLeft = intersectBox(nodes[left].box, rayOrigin, rayDirection, closest);
+                double tRight = intersectBox(nodes[right].box, rayOrigin, rayDirection, closest);
+                if (tLeft > tRight)
+                {
+                    std::swap(left, right);
+                    std::swap(tLeft, tRight);
+                }
+
+                if (tLeft < closest)
+                {
+                    if (tRight < closest)
+                        stack[stackSize++] = right;
+                    nodeIndex = left;
+                    continue;
+                }
+            }
+
+            // Pop nodes which are now farther than the nearest hit
+            for (;;)
+            {
+                if (stackSize == 0)
+                    return hit;
+                nodeIndex = stack[--stackSize];
+                if (intersectBox(nodes[nodeIndex].box, rayOrigin, rayDirection, closest) < closest)
+                    break;
+            }
+        }
+    }
+
+ private:
+    struct Node
+    {
+        Eigen::AlignedBox<float, 3> box;
+        // For leaves, the range of primitives in the primitive list; for
+        // inner nodes, count is zero and first is the index of the right
+        // child. The left child always follows its parent.
+        unsigned int first;
+        unsigned int count;
+    };
+
+    static constexpr unsigned int MaxDepth = 64;
+
+    static double intersectBox(const Eigen::AlignedBox<float, 3>& box,
+                               const Eigen::Vector3d& rayOrigin,
+                               const Eigen::Vector3d& rayDirection,
+                               double closest);
+
+    void build(const std::vector<Eigen::AlignedBox<float, 3>>& boxes,
+               const std::vector<Eigen::Vector3f>& centers,
+               unsigned int first, unsigned int count,
+               unsigned int depth);
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> primitives;
+};
+
+} // namespace cmod
+
+#endif // !_CELMODEL_BVH_H_
@@ -9,6 +9,7 @@
 // of the License, or (at your option) any later version.
 
 #include "mesh.h"
+#include "bvh.h"
 #include <cassert>
 #include <iostream>
 #include <algorithm>
@@ -180,6 +181,9 @@ Mesh::PrimitiveGroup::getPrimitiveCount() const
 }
 
 
+Mesh::Mesh() = default;
+
+
 Mesh::~Mesh()
 {
     for (const auto group : groups)
@@ -204,6 +208,7 @@ Mesh::setVertices(unsigned int _nVertices, void* vertexData)
 
     nVertices = _nVertices;
     vertices = vertexData;
+    invalidatePickTree();
 }
 
 
@@ -214,6 +219,7 @@ Mesh::setVertexDescription(const VertexDescription& desc)
         return false;
 
     vertexDesc = desc;
+    invalidatePickTree();
 
     return true;
 }
@@ -249,6 +255,7 @@ unsigned int
 Mesh::addGroup(PrimitiveGroup* group)
 {
     groups.push_back(group);
+    invalidatePickTree();
     return groups.size();
 }
 
@@ -379,6 +386,7 @@ Mesh::clearGroups()
         delete group;
 
     groups.clear();
+    invalidatePickTree();
 }
 
 
@@ -406,6 +414,7 @@ Mesh::remapIndices(const vector<index32>& indexMap)
             group->indices[i] = indexMap[group->indices[i]];
         }
     }
+    invalidatePickTree();
 }
 
 
@@ -433,6 +442,138 @@ Mesh::aggregateByMaterial()
 }
 
 
+// Intersect a ray with a triangle, updating closest and returning true if
+// the ray hits the triangle closer than closest.
+static bool
+IntersectTriangle(const Vector3d& v0, const Vector3d& v1, const Vector3d& v2,
+                  const Vector3d& rayOrigin, const Vector3d& rayDirection,
+                  double& closest)
+{
+    // Compute the edge vectors e0 and e1, and the normal n
+    Vector3d e0 = v1 - v0;
+    Vector3d e1 = v2 - v0;
+    Vector3d n = e0.cross(e1);
+
+    // c is the cosine of the angle between the ray and triangle normal
+    double c = n.dot(rayDirection);
+
+    // If the ray is parallel to the triangle, it either misses the
+    // triangle completely, or is contained in the triangle's plane.
+    // If it's contained in the plane, we'll still call it a miss.
+    if (c == 0.0)
+        return false;
+
+    double t = (n.dot(v0 - rayOrigin)) / c;
+    if (t >= closest || t <= 0.0)
+        return false;
+
+    double m00 = e0.dot(e0);
+    double m01 = e0.dot(e1);
+    double m10 = e1.dot(e0);
+    double m11 = e1.dot(e1);
+    double det = m00 * m11 - m01 * m10;
+    if (det == 0.0)
+        return false;
+
+    Vector3d p = rayOrigin + rayDirection * t;
+    Vector3d q = p - v0;
+    double q0 = e0.dot(q);
+    double q1 = e1.dot(q);
+    double d = 1.0 / det;
+    double s0 = (m11 * q0 - m01 * q1) * d;
+    double s1 = (m00 * q1 - m10 * q0) * d;
+    if (s0 < 0.0 || s1 < 0.0 || s0 + s1 > 1.0)
+        return false;
+
+    closest = t;
+    return true;
+}
+
+
+// The triangles of all the triangle primitive groups in the mesh, with a
+// bounding volume hierarchy over them.
+struct Mesh::PickTree
+{
+    struct Triangle
+    {
+        index32 indices[3];
+        PrimitiveGroup* group;
+        unsigned int primitiveIndex;
+    };
+
+    vector<Triangle> triangles;
+    BoundingVolumeHierarchy bvh;
+};
+
+
+const Mesh::PickTree*
+Mesh::getPickTree() const
+{
+    std::lock_guard<std::mutex> lock(pickTreeMutex);
+    if (pickTree != nullptr)
+        return pickTree.get();
+
+    pickTree.reset(new PickTree);
+
+    for (const auto group : groups)
+    {
+        Mesh::PrimitiveGroupType primType = group->prim;
+        index32 nIndices = group->nIndices;
+
+        // Only attempt to compute the intersection of the ray with triangle
+        // groups.
+        if (!(primType == TriList || primType == TriStrip || primType == TriFan) ||
+            nIndices < 3 ||
+            (primType == TriList && nIndices % 3 != 0))
+        {
+            continue;
+        }
+
+        const index32* indices = group->indices;
+        if (primType == TriList)
+        {
+            for (index32 i = 0; i < nIndices; i += 3)
+                pickTree->triangles.push_back({ { indices[i], indices[i + 1], indices[i + 2] }, group, i / 3 });
+        }
+        else if (primType == TriStrip)
+        {
+            // TODO: alternate orientation of triangles in a strip
+            for (index32 i = 2; i < nIndices; i++)
+                pickTree->triangles.push_back({ { indices[i - 2], indices[i - 1], indices[i] }, group, i - 2 });
+        }
+        else // primType == TriFan
+        {
+            for (index32 i = 2; i < nIndices; i++)
+                pickTree->triangles.push_back({ { indices[0], indices[i - 1], indices[i] }, group, i - 2 });
+        }
+    }
+
+    unsigned int posOffset = vertexDesc.getAttribute(Position).offset;
+    const char* vdata = reinterpret_cast<const char*>(vertices) + posOffset;
+
+    vector<AlignedBox<float, 3>> boxes;
+    boxes.reserve(pickTree->triangles.size());
+    for (const auto& triangle : pickTree->triangles)
+    {
+        AlignedBox<float, 3> box;
+        for (auto index : triangle.indices)
+            box.extend(Map<const Vector3f>(reinterpret_cast<const float*>(vdata + index * vertexDesc.stride)));
+        boxes.push_back(box);
+    }
+    pickTree->bvh = BoundingVolumeHierarchy(boxes);
+
+    return pickTree.get();
+}
+
+
+void
+Mesh::invalidatePickTree()
+{
+    std::lock_guard<std::mutex> lock(pickTreeMutex);
+    pickTree.reset();
+}
+
+
 bool
 Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult* result) const
 {
@@ -448,116 +589,33 @@ Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult*
     }
 
     unsigned int posOffset = vertexDesc.getAttribute(Position).offset;
-    auto* vdata = reinterpret_cast<char*>(vertices);
+    const char* vdata = reinterpret_cast<const char*>(vertices) + posOffset;
+    auto position = [this, vdata](index32 index)
+    {
+        return Map<const Vector3f>(reinterpret_cast<const float*>(vdata + index * vertexDesc.stride)).cast<double>();
+    };
 
-    // Iterate over all primitive groups in the mesh
-    for (const auto group : groups)
+    const PickTree* tree = getPickTree();
+    tree->bvh.traverse(rayOrigin, rayDirection, closest,
+                       [&](unsigned int i, double& distance)
     {
-        Mesh::PrimitiveGroupType primType = group->prim;
-        index32 nIndices = group->nIndices;
+        const PickTree::Triangle& triangle = tree->triangles[i];
+        if (!IntersectTriangle(position(triangle.indices[0]),
+                               position(triangle.indices[1]),
+                               position(triangle.indices[2]),
+                               rayOrigin, rayDirection, distance))
+        {
+            return false;
+        }
 
-        // Only attempt to compute the intersection of the ray with triangle
-        // groups.
-        if ((primType == TriList || primType == TriStrip || primType == TriFan) &&
-            (nIndices >= 3) &&
-            !(primType == TriList && nIndices % 3 != 0))
+        if (result)
         {
-            unsigned int primitiveIndex = 0;
-            index32 index = 0;
-            index32 i0 = group->indices[0];
-            index32 i1 = group->indices[1];
-            index32 i2 = group->indices[2];
-
-            // Iterate over the triangles in the primitive group
-            do
-            {
-                // Get the triangle vertices v0, v1, and v2
-                Vector3d v0 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i0 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v1 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i1 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v2 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i2 * vertexDesc.stride + posOffset)).cast<double>();
-
-                // Compute the edge vectors e0 and e1, and the normal n
-                Vector3d e0 = v1 - v0;
-                Vector3d e1 = v2 - v0;
-                Vector3d n = e0.cross(e1);
-
-                // c is the cosine of the angle between the ray and triangle normal
-                double c = n.dot(rayDirection);
-
-                // If the ray is parallel to the triangle, it either misses the
-                // triangle completely, or is contained in the triangle's plane.
-                // If it's contained in the plane, we'll still call it a miss.
-                if (c != 0.0)
-                {
-                    double t = (n.dot(v0 - rayOrigin)) / c;
-                    if (t < closest && t > 0.0)
-                    {
-                        double m00 = e0.dot(e0);
-                        double m01 = e0.dot(e1);
-                        double m10 = e1.dot(e0);
-                        double m11 = e1.dot(e1);
-                        double det = m00 * m11 - m01 * m10;
-                        if (det != 0.0)
-                        {
-                            Vector3d p = rayOrigin + rayDirection * t;
-                            Vector3d q = p - v0;
-                            double q0 = e0.dot(q);
-                            double q1 = e1.dot(q);
-                            double d = 1.0 / det;
-                            double s0 = (m11 * q0 - m01 * q1) * d;
-                            double s1 = (m00 * q1 - m10 * q0) * d;
-                            if (s0 >= 0.0 && s1 >= 0.0 && s0 + s1 <= 1.0)
-                            {
-                                closest = t;
-                                if (result)
-                                {
-                                    result->group = group;
-                                    result->primitiveIndex = primitiveIndex;
-                                    result->distance = closest;
-                                }
-                            }
-                        }
-                    }
-                }
-
-                // Get the indices for the next triangle
-                if (primType == TriList)
-                {
-                    index += 3;
-                    if (index < nIndices)
-                    {
-                        i0 = group->indices[index + 0];
-                        i1 = group->indices[index + 1];
-                        i2 = group->indices[index + 2];
-                    }
-                }
-                else if (primType == TriStrip)
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        i0 = i1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                        // TODO: alternate orientation of triangles in a strip
-                    }
-                }
-                else // primType == TriFan
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        index += 1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                    }
-                }
-
-                primitiveIndex++;
-
-            } while (index < nIndices);
+            result->group = triangle.group;
+            result->primitiveIndex = triangle.primitiveIndex;
+            result->distance = distance;
         }
-    }
+        return true;
+    });
 
     return closest != maxDistance;
 }
@@ -621,6 +679,8 @@ Mesh::transform(const Vector3f& translation, float scale)
     if (vertexDesc.getAttribute(Position).format != Float3)
         return;
 
+    invalidatePickTree();
+
     char* vdata = reinterpret_cast<char*>(vertices) + vertexDesc.getAttribute(Position).offset;
     unsigned int i;
 
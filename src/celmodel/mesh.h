@@ -14,6 +14,8 @@
 #include "material.h"
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -157,7 +159,7 @@ class Mesh
         double distance{ -1.0 };
     };
 
-    Mesh() = default;
+    Mesh();
     ~Mesh();
 
     void setVertices(unsigned int _nVertices, void* vertexData);
@@ -187,6 +189,12 @@ class Mesh
     const std::string& getName() const;
     void setName(const std::string&);
 
+    /*! Find the closest intersection between the ray and the triangles
+     *  of the mesh. A bounding volume hierarchy over the triangles is
+     *  built on the first pick and kept until the vertices or primitive
+     *  groups of the mesh are changed. Picking may be done from several
+     *  threads at once, as long as the mesh isn't being modified.
+     */
     bool pick(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, PickResult* result) const;
     bool pick(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, double& distance) const;
 
@@ -205,7 +213,11 @@ class Mesh
     static unsigned int              getVertexAttributeSize(VertexAttributeFormat);
 
  private:
+    struct PickTree;
+
     void recomputeBoundingBox();
+    const PickTree* getPickTree() const;
+    void invalidatePickTree();
 
  private:
     VertexDescription vertexDesc{ 0, 0, nullptr };
@@ -217,6 +229,9 @@ class Mesh
     std::vector<PrimitiveGroup*> groups;
 
     std::string name;
+
+    mutable std::unique_ptr<PickTree> pickTree;
+    mutable std::mutex pickTreeMutex;
 };
 
 } // namespace cmod
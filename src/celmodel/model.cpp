@@ -9,6 +9,8 @@
 // of the License, or (at your option) any later version.
 
 #include "model.h"
+#include "bvh.h"
+#include <celutil/threadpool.h>
 #include <cassert>
 #include <functional>
 #include <algorithm>
@@ -17,6 +19,9 @@ using namespace cmod;
 using namespace Eigen;
 using namespace std;
 
+// Batches with fewer rays are traced by the calling thread alone
+static const size_t MinParallelPickRays = 64;
+
 
 Model::Model()
 {
@@ -121,10 +126,36 @@ unsigned int
 Model::addMesh(Mesh* m)
 {
     meshes.push_back(m);
+    invalidateMeshTree();
     return meshes.size();
 }
 
 
+const BoundingVolumeHierarchy*
+Model::getMeshTree() const
+{
+    std::lock_guard<std::mutex> lock(meshTreeMutex);
+    if (meshTree == nullptr)
+    {
+        vector<AlignedBox<float, 3>> boxes;
+        boxes.reserve(meshes.size());
+        for (const auto mesh : meshes)
+            boxes.push_back(mesh->getBoundingBox());
+        meshTree.reset(new BoundingVolumeHierarchy(boxes));
+    }
+
+    return meshTree.get();
+}
+
+
+void
+Model::invalidateMeshTree()
+{
+    std::lock_guard<std::mutex> lock(meshTreeMutex);
+    meshTree.reset();
+}
+
+
 bool
 Model::pick(const Eigen::Vector3d& rayOrigin,
             const Eigen::Vector3d& rayDirection,
@@ -134,19 +165,23 @@ Model::pick(const Eigen::Vector3d& rayOrigin,
     double closest = maxDistance;
     Mesh::PickResult closestResult;
 
-    for (const auto mesh : meshes)
+    // Meshes are only picked if the ray hits their bounding box closer
+    // than the closest intersection found so far.
+    getMeshTree()->traverse(rayOrigin, rayDirection, closest,
+                            [&](unsigned int i, double& distance)
     {
-        Mesh::PickResult result;
-        if (mesh->pick(rayOrigin, rayDirection, &result))
+        Mesh::PickResult meshResult;
+        if (!meshes[i]->pick(rayOrigin, rayDirection, &meshResult) ||
+            meshResult.distance >= distance)
         {
-            if (result.distance < closest)
-            {
-                closestResult = result;
-                closestResult.mesh = mesh;
-                closest = result.distance;
-            }
+            return false;
         }
-    }
+
+        closestResult = meshResult;
+        closestResult.mesh = meshes[i];
+        distance = meshResult.distance;
+        return true;
+    });
 
     if (closest != maxDistance)
     {
@@ -175,6 +210,39 @@ Model::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, double& dis
 }
 
 
+unsigned int
+Model::pick(const vector<Vector3d>& rayOrigins,
+            const vector<Vector3d>& rayDirections,
+            vector<double>& distances) const
+{
+    assert(rayOrigins.size() == rayDirections.size());
+
+    size_t nRays = rayOrigins.size();
+    distances.assign(nRays, -1.0);
+
+    auto pickRay = [&](size_t i)
+    {
+        pick(rayOrigins[i], rayDirections[i], distances[i]);
+    };
+
+    if (nRays < MinParallelPickRays)
+    {
+        for (size_t i = 0; i < nRays; i++)
+            pickRay(i);
+    }
+    else
+    {
+        // Mesh hierarchies are built by the first thread reaching them
+        // while the others wait.
+        getMeshTree();
+        GetThreadPool()->parallelFor(nRays, pickRay);
+    }
+
+    return (unsigned int) count_if(distances.begin(), distances.end(),
+                                   [](double distance) { return distance >= 0.0; });
+}
+
+
 /*! Translate and scale a model. The transformation applied to
  *  each vertex in the model is:
  *     v' = (v + translation) * scale
@@ -184,6 +252,7 @@ Model::transform(const Vector3f& translation, float scale)
 {
     for (const auto mesh : meshes)
         mesh->transform(translation, scale);
+    invalidateMeshTree();
 }
 
 
@@ -432,4 +501,5 @@ Model::sortMeshes(const MeshComparator& comparator)
 
     // Sort the meshes so that completely opaque ones are first
     sort(meshes.begin(), meshes.end(), MeshComparatorAdapter(comparator));
+    invalidateMeshTree();
 }
@@ -13,12 +13,16 @@
 
 #include "mesh.h"
 #include <memory>
+#include <mutex>
 #include <array>
+#include <vector>
 
 
 namespace cmod
 {
 
+class BoundingVolumeHierarchy;
+
 /*!
  * Model is the standard geometry object in Celestia.  A Model
  * consists of a library of materials together with a list of
@@ -84,6 +88,17 @@ class Model
               const Eigen::Vector3d& rayDirection,
               double& distance) const;
 
+    /** Find the closest intersections between a batch of rays and
+     *  the model. distances is resized to the number of rays, and
+     *  distances[i] set to the distance along ray i to the closest
+     *  intersection, or to a negative value if the ray misses the
+     *  model. Large batches are traced in parallel. Return the
+     *  number of rays which intersect the model.
+     */
+    unsigned int pick(const std::vector<Eigen::Vector3d>& rayOrigins,
+                      const std::vector<Eigen::Vector3d>& rayDirections,
+                      std::vector<double>& distances) const;
+
     void transform(const Eigen::Vector3f& translation, float scale);
 
     /** Apply a uniform scale to the model so that it fits into
@@ -150,12 +165,20 @@ class Model
     };
 
  private:
+    const BoundingVolumeHierarchy* getMeshTree() const;
+    void invalidateMeshTree();
+
     std::vector<const Material*> materials;
     std::vector<Mesh*> meshes;
 
     std::array<bool, Material::TextureSemanticMax> textureUsage;
     bool opaque{ true };
     bool normalized{ false };
+
+    // Hierarchy over the bounding boxes of the meshes, built on the
+    // first pick
+    mutable std::unique_ptr<BoundingVolumeHierarchy> meshTree;
+    mutable std::mutex meshTreeMutex;
 };
 
 } // namespace
@@ -0,0 +1,40 @@
+// mappedfile.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Read-only memory mapping of a file.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <celcompat/filesystem.h>
+
+class MappedFile
+{
+ public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const fs::path& filename);
+    void close();
+
+    bool isOpen() const { return base != nullptr; }
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+ private:
+    const char* base{ nullptr };
+    size_t length{ 0 };
+#ifdef _WIN32
+    void* fileHandle{ nullptr };
+    void* mappingHandle{ nullptr };
+#endif
+};
@@ -0,0 +1,159 @@
+// prefixindex.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Index of names for finding the ones starting with a prefix.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <utility>
+#include "prefixindex.h"
+#include "utf8.h"
+
+using namespace std;
+
+
+// Compare the beginning of the names in the index with a prefix
+struct PrefixIndex::PrefixCompare
+{
+    const string& keys;
+
+    bool operator()(const Entry& entry, const string& prefix) const
+    {
+        return keys.compare(entry.offset, prefix.length(), prefix) < 0;
+    }
+
+    bool operator()(const string& prefix, const Entry& entry) const
+    {
+        return keys.compare(entry.offset, prefix.length(), prefix) > 0;
+    }
+};
+
+
+void PrefixIndex::add(const string& name, Value value)
+{
+    string key = UTF8Normalize(name);
+    entries.push_back({ (uint32_t) keys.length(), (uint32_t) key.length(), value });
+    keys += key;
+    lengthStarts.clear();
+}
+
+
+void PrefixIndex::build()
+{
+    sort(entries.begin(), entries.end(),
+         [this](const Entry& e0, const Entry& e1)
+         {
+             if (e0.length != e1.length)
+                 return e0.length < e1.length;
+             return keys.compare(e0.offset, e0.length, keys, e1.offset, e1.length) < 0;
+         });
+
+    uint32_t maxLength = entries.empty() ? 0 : entries.back().length;
+    lengthStarts.assign(maxLength + 2, 0);
+    uint32_t i = 0;
+    for (uint32_t length = 0; length <= maxLength + 1; length++)
+    {
+        while (i < entries.size() && entries[i].length < length)
+            i++;
+        lengthStarts[length] = i;
+    }
+}
+
+
+void PrefixIndex::clear()
+{
+    keys.clear();
+    entries.clear();
+    lengthStarts.clear();
+}
+
+
+void PrefixIndex::find(const vector<string>& prefixes,
+                       vector<Value>& values,
+                       size_t maxResults) const
+{
+    if (lengthStarts.empty() || prefixes.empty())
+        return;
+
+    vector<string> normalized;
+    for (const auto& prefix : prefixes)
+        normalized.push_back(UTF8Normalize(prefix));
+
+    // Drop the prefixes which start with another prefix, as their matches
+    // are already matches of the shorter prefix. Once sorted, such a prefix
+    // follows the shorter one or other prefixes which are also dropped.
+    sort(normalized.begin(), normalized.end());
+    size_t kept = 1;
+    for (size_t i = 1; i < normalized.size(); i++)
+    {
+        const string& last = normalized[kept - 1];
+        if (normalized[i].compare(0, last.length(), last) != 0)
+            normalized[kept++].swap(normalized[i]);
+    }
+    normalized.resize(kept);
+
+    size_t minLength = normalized.front().length();
+    for (const auto& prefix : normalized)
+        minLength = min(minLength, prefix.length());
+
+    size_t found = 0;
+    PrefixCompare compare{ keys };
+    for (size_t length = minLength; length + 1 < lengthStarts.size(); length++)
+    {
+        auto first = entries.begin() + lengthStarts[length];
+        auto last = entries.begin() + lengthStarts[length + 1];
+        if (first == last)
+            continue;
+
+        for (const auto& prefix : normalized)
+        {
+            if (prefix.length() > length)
+                continue;
+
+            auto range = equal_range(first, last, prefix, compare);
+            for (auto iter = range.first; iter != range.second; ++iter)
+            {
+                values.push_back(iter->value);
+                if (++found == maxResults)
+                    return;
+            }
+        }
+    }
+}
+
+
+void RankCompletion(vector<string>& completion, size_t maxResults)
+{
+    vector<pair<string, size_t>> keys;
+    keys.reserve(completion.size());
+    for (size_t i = 0; i < completion.size(); i++)
+        keys.emplace_back(UTF8Normalize(completion[i]), i);
+
+    auto less = [](const pair<string, size_t>& k0, const pair<string, size_t>& k1)
+    {
+        if (k0.first.length() != k1.first.length())
+            return k0.first.length() < k1.first.length();
+        return k0 < k1;
+    };
+
+    if (maxResults != 0 && maxResults < keys.size())
+    {
+        partial_sort(keys.begin(), keys.begin() + maxResults, keys.end(), less);
+        keys.resize(maxResults);
+    }
+    else
+    {
+        sort(keys.begin(), keys.end(), less);
+    }
+
+    vector<string> ranked;
+    ranked.reserve(keys.size());
+    for (const auto& key : keys)
+        ranked.push_back(move(completion[key.second]));
+    completion = move(ranked);
+}
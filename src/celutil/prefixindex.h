@@ -0,0 +1,68 @@
+// prefixindex.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Index of names for finding the ones starting with a prefix.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*! Index of the names of a catalog for name completion. The names are
+ *  normalized with UTF8Normalize() and sorted by length then contents, so
+ *  that the names starting with a prefix are a contiguous range among the
+ *  names of each length. Matches are found with a binary search for each
+ *  length, shortest first, which ranks exact matches first and lets the
+ *  search stop as soon as enough names were found.
+ */
+class PrefixIndex
+{
+ public:
+    using Value = uint32_t;
+
+    PrefixIndex() = default;
+    ~PrefixIndex() = default;
+
+    //! Add a name; build() must be called before the name can be found.
+    void add(const std::string& name, Value value);
+    void build();
+    void clear();
+
+    size_t size() const { return entries.size(); }
+
+    /*! Append to values the values of the names starting with any of the
+     *  prefixes, ranked by length then in alphabetical order. At most
+     *  maxResults values are appended, or all of them if it's zero.
+     */
+    void find(const std::vector<std::string>& prefixes,
+              std::vector<Value>& values,
+              size_t maxResults = 0) const;
+
+ private:
+    struct Entry
+    {
+        uint32_t offset;
+        uint32_t length;
+        Value value;
+    };
+
+    struct PrefixCompare;
+
+    // Normalized names, one after the other
+    std::string keys;
+    std::vector<Entry> entries;
+    // Index in entries of the first name of each length, and entries.size()
+    std::vector<uint32_t> lengthStarts;
+};
+
+//! Sort completions the way PrefixIndex ranks them and keep at most
+//! maxResults of them, or all of them if it's zero.
+void RankCompletion(std::vector<std::string>& completion, size_t maxResults = 0);
@@ -10,9 +10,17 @@
 #ifndef _CELUTIL_RESMANAGER_H_
 #define _CELUTIL_RESMANAGER_H_
 
-#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 #include <celutil/reshandle.h>
+#include <celutil/threadpool.h>
+#include <celutil/timer.h>
 #include <celcompat/filesystem.h>
 
 
@@ -20,22 +28,36 @@ enum ResourceState {
     ResourceNotLoaded     = 0,
     ResourceLoaded        = 1,
     ResourceLoadingFailed = 2,
+    ResourceLoading       = 3,
 };
 
 
 template<class T> class ResourceInfo
 {
  public:
-    ResourceInfo() : state(ResourceNotLoaded), resource(nullptr) {};
+    ResourceInfo() : state(ResourceNotLoaded), resource(nullptr), lastUsed(0) {};
     virtual ~ResourceInfo() {};
 
     virtual fs::path resolve(const fs::path&) = 0;
     virtual T* load(const fs::path&) = 0;
 
+    // Asynchronous loading is split in two steps, both called on a copy of
+    // the resource info. prepare() runs on a loader thread and does the work
+    // which doesn't need the render thread, such as reading and decoding
+    // files; finish() runs later on the render thread and creates the
+    // resource. By default all the work is left to finish().
+    virtual bool prepare(const fs::path&) { return true; }
+    virtual T* finish(const fs::path& name) { return load(name); }
+
+    // Approximate memory used by the loaded resource, in bytes
+    virtual size_t getMemoryUsage() const { return 0; }
+
     typedef T ResourceType;
     ResourceState state;
     fs::path resolvedName;
     T* resource;
+    // Frame in which the resource was last looked up
+    uint32_t lastUsed;
 };
 
 
@@ -52,20 +74,55 @@ template<class T> class ResourceManager
     typedef typename T::ResourceType ResourceType;
 
  private:
-    typedef std::vector<T> ResourceTable;
+    // A deque keeps references to the resource infos valid while handles
+    // are added from the loader threads.
+    typedef std::deque<T> ResourceTable;
     typedef std::map<T, ResourceHandle> ResourceHandleMap;
-    typedef std::map<fs::path, ResourceType*> NameMap;
+    struct LoadedResource
+    {
+        ResourceType* resource;
+        size_t memoryUsage;
+    };
+
+    typedef std::map<fs::path, LoadedResource> NameMap;
 
     typedef typename ResourceHandleMap::value_type ResourceHandleMapValue;
     typedef typename NameMap::value_type NameMapValue;
 
+    struct LoadRequest
+    {
+        ResourceHandle handle;
+        float priority;
+    };
+
+    struct PreparedResource
+    {
+        ResourceHandle handle;
+        std::unique_ptr<T> info;
+        bool prepared;
+    };
+
     ResourceTable resources;
     ResourceHandleMap handles;
     NameMap loadedResources;
 
+    std::vector<LoadRequest> pendingLoads;
+    std::deque<PreparedResource> preparedLoads;
+    bool asyncLoading { false };
+
+    size_t memoryUsage { 0 };
+    size_t memoryBudget { 0 };
+    uint32_t evictionAge { 0 };
+    uint32_t currentFrame { 0 };
+    // No resource can be old enough to be unloaded before this frame
+    uint32_t nextEviction { 0 };
+
+    mutable std::mutex mutex;
+
  public:
     ResourceHandle getHandle(const T& info)
     {
+        std::lock_guard<std::mutex> lock(mutex);
         typename ResourceHandleMap::iterator iter = handles.find(info);
         if (iter != handles.end())
         {
@@ -80,54 +137,293 @@ template<class T> class ResourceManager
         }
     }
 
-    ResourceType* find(ResourceHandle h)
+    // In asynchronous mode, find() doesn't load a resource itself but
+    // queues it for the loader threads and returns nullptr until it has
+    // been created by finishLoads(). Resources with a higher priority are
+    // loaded first.
+    void setAsyncLoading(bool enable)
     {
+        std::lock_guard<std::mutex> lock(mutex);
+        asyncLoading = enable;
+    }
+
+    ResourceType* find(ResourceHandle h, float priority = 0.0f)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
         if (h >= (int) handles.size() || h < 0)
-        {
             return nullptr;
+
+        resources[h].lastUsed = currentFrame;
+        if (resources[h].state == ResourceNotLoaded)
+        {
+            if (asyncLoading)
+            {
+                resources[h].state = ResourceLoading;
+                pendingLoads.push_back({ h, priority });
+                lock.unlock();
+                GetResourceLoaderPool()->post([this] { prepareNext(); });
+                return nullptr;
+            }
+
+            load(h);
         }
+        else if (resources[h].state == ResourceLoading)
+        {
+            for (auto& request : pendingLoads)
+            {
+                if (request.handle == h)
+                    request.priority = std::max(request.priority, priority);
+            }
+        }
+
+        if (resources[h].state == ResourceLoaded)
+            return resources[h].resource;
         else
+            return nullptr;
+    }
+
+    ResourceState getState(ResourceHandle h)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (h >= (int) handles.size() || h < 0)
+            return ResourceLoadingFailed;
+        else
+            return resources[h].state;
+    }
+
+    // Create the resources prepared by the loader threads. This must be
+    // called from the render thread; it returns once about timeBudget
+    // seconds have been spent, but always creates at least one resource.
+    void finishLoads(double timeBudget)
+    {
+        Timer timer;
+        for (;;)
         {
-            if (resources[h].state == ResourceNotLoaded)
+            PreparedResource loaded;
+            ResourceType* resource = nullptr;
             {
-                resources[h].resolvedName = resources[h].resolve(baseDir);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (preparedLoads.empty())
+                    return;
+                loaded = std::move(preparedLoads.front());
+                preparedLoads.pop_front();
+
                 typename NameMap::iterator iter =
-                    loadedResources.find(resources[h].resolvedName);
+                    loadedResources.find(loaded.info->resolvedName);
                 if (iter != loadedResources.end())
                 {
-                    resources[h].resource = iter->second;
-                    resources[h].state = ResourceLoaded;
+                    // Another handle has already loaded the same file
+                    delete loaded.info->resource;
+                    resource = iter->second.resource;
+                    loaded.prepared = false;
+                }
+            }
+
+            if (loaded.prepared)
+                resource = loaded.info->finish(loaded.info->resolvedName);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                T& info = resources[loaded.handle];
+                info.resolvedName = loaded.info->resolvedName;
+                info.resource = resource;
+                if (resource == nullptr)
+                {
+                    info.state = ResourceLoadingFailed;
                 }
                 else
                 {
-                    resources[h].resource = resources[h].load(resources[h].resolvedName);
-                    if (resources[h].resource == nullptr)
-                    {
-                        resources[h].state = ResourceLoadingFailed;
-                    }
-                    else
-                    {
-                        resources[h].state = ResourceLoaded;
-                        loadedResources.insert(NameMapValue(resources[h].resolvedName, resources[h].resource));
-                    }
+                    info.state = ResourceLoaded;
+                    if (loaded.prepared)
+                        addLoadedResource(info);
                 }
             }
 
-            if (resources[h].state == ResourceLoaded)
-                return resources[h].resource;
-            else
-                return nullptr;
+            if (timer.getTime() >= timeBudget)
+                return;
+        }
+    }
+
+    // Unload the least recently used resources once their total memory
+    // usage exceeds budget bytes. Only resources which haven't been looked
+    // up for at least minUnusedFrames frames are unloaded; they're loaded
+    // again transparently by the next find(). A budget of zero, the
+    // default, keeps every resource loaded. Don't set a budget for
+    // resources of which pointers are kept between frames.
+    void setMemoryBudget(size_t budget, uint32_t minUnusedFrames)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memoryBudget = budget;
+        evictionAge = minUnusedFrames;
+        nextEviction = currentFrame;
+    }
+
+    size_t getMemoryBudget() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return memoryBudget;
+    }
+
+    // Approximate memory used by all loaded resources, in bytes
+    size_t getMemoryUsage() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return memoryUsage;
+    }
+
+    size_t getLoadedCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return loadedResources.size();
+    }
+
+    // Advance the frame counter used to track the use of resources, and
+    // unload resources while over budget. This must be called from the
+    // render thread, at a point where no resource pointers are held.
+    void nextFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentFrame++;
+        if (memoryBudget != 0 && memoryUsage > memoryBudget &&
+            (int32_t) (currentFrame - nextEviction) >= 0)
+        {
+            evict();
         }
     }
 
     const T* getResourceInfo(ResourceHandle h)
     {
+        std::lock_guard<std::mutex> lock(mutex);
         if (h >= (int) handles.size() || h < 0)
             return nullptr;
         else
             return &resources[h];
     }
+
+ private:
+    void load(ResourceHandle h)
+    {
+        resources[h].resolvedName = resources[h].resolve(baseDir);
+        typename NameMap::iterator iter =
+            loadedResources.find(resources[h].resolvedName);
+        if (iter != loadedResources.end())
+        {
+            resources[h].resource = iter->second.resource;
+            resources[h].state = ResourceLoaded;
+        }
+        else
+        {
+            resources[h].resource = resources[h].load(resources[h].resolvedName);
+            if (resources[h].resource == nullptr)
+            {
+                resources[h].state = ResourceLoadingFailed;
+            }
+            else
+            {
+                resources[h].state = ResourceLoaded;
+                addLoadedResource(resources[h]);
+            }
+        }
+    }
+
+    void addLoadedResource(const T& info)
+    {
+        LoadedResource loaded = { info.resource, info.getMemoryUsage() };
+        loadedResources.insert(NameMapValue(info.resolvedName, loaded));
+        memoryUsage += loaded.memoryUsage;
+    }
+
+    void evict()
+    {
+        // Several handles may share a resource; it was last used when the
+        // most recently used of them was.
+        std::map<ResourceType*, uint32_t> lastUsed;
+        for (const T& info : resources)
+        {
+            if (info.state == ResourceLoaded)
+            {
+                uint32_t& frame = lastUsed[info.resource];
+                frame = std::max(frame, info.lastUsed);
+            }
+        }
+
+        // Resources without a cost, such as virtual textures which manage
+        // their own tiles, are never unloaded. The frame of the next pass
+        // is found from the least recently used of the remaining resources,
+        // since their last use can only get later until then.
+        std::vector<typename NameMap::iterator> candidates;
+        uint32_t oldest = currentFrame;
+        for (auto iter = loadedResources.begin(); iter != loadedResources.end(); ++iter)
+        {
+            if (iter->second.memoryUsage == 0)
+                continue;
+
+            uint32_t frame = lastUsed[iter->second.resource];
+            if (currentFrame - frame >= evictionAge)
+                candidates.push_back(iter);
+            else if ((int32_t) (frame - oldest) < 0)
+                oldest = frame;
+        }
+        nextEviction = oldest + evictionAge;
+
+        std::sort(candidates.begin(), candidates.end(),
+                  [&lastUsed](typename NameMap::iterator a, typename NameMap::iterator b)
+                  { return lastUsed[a->second.resource] < lastUsed[b->second.resource]; });
+
+        std::set<ResourceType*> evicted;
+        for (auto iter : candidates)
+        {
+            if (memoryUsage <= memoryBudget)
+            {
+                // The candidates left can be unloaded as soon as the
+                // budget is exceeded again
+                nextEviction = currentFrame;
+                break;
+            }
+
+            memoryUsage -= iter->second.memoryUsage;
+            evicted.insert(iter->second.resource);
+            delete iter->second.resource;
+            loadedResources.erase(iter);
+        }
+
+        if (evicted.empty())
+            return;
+
+        for (T& info : resources)
+        {
+            if (info.state == ResourceLoaded && evicted.count(info.resource) != 0)
+            {
+                info.state = ResourceNotLoaded;
+                info.resource = nullptr;
+            }
+        }
+    }
+
+    // Run on a loader thread: prepare the pending resource with the
+    // highest priority.
+    void prepareNext()
+    {
+        PreparedResource loaded;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pendingLoads.empty())
+                return;
+
+            auto next = std::max_element(pendingLoads.begin(), pendingLoads.end(),
+                                         [](const LoadRequest& a, const LoadRequest& b)
+                                         { return a.priority < b.priority; });
+            loaded.handle = next->handle;
+            loaded.info.reset(new T(resources[loaded.handle]));
+            pendingLoads.erase(next);
+        }
+
+        loaded.info->resolvedName = loaded.info->resolve(baseDir);
+        loaded.prepared = loaded.info->prepare(loaded.info->resolvedName);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        preparedLoads.push_back(std::move(loaded));
+    }
 };
 
 #endif // _CELUTIL_RESMANAGER_H_
-
@@ -0,0 +1,153 @@
+// threadpool.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A fixed size pool of worker threads.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <atomic>
+#include <memory>
+#include "threadpool.h"
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(unsigned int nThreads)
+{
+    if (nThreads == 0)
+    {
+        unsigned int hw = thread::hardware_concurrency();
+        nThreads = hw > 1 ? hw - 1 : 0;
+    }
+
+    for (unsigned int i = 0; i < nThreads; i++)
+        workers.emplace_back(&ThreadPool::workerMain, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::post(function<void()> job)
+{
+    if (workers.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+
+void ThreadPool::workerMain()
+{
+    for (;;)
+    {
+        function<void()> job;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+
+namespace
+{
+// State of a parallelFor() call; shared with helper jobs which may only get
+// to run after the call has returned.
+struct ParallelForState
+{
+    const function<void(size_t)>* func;
+    size_t n;
+    atomic<size_t> next{ 0 };
+    size_t completed{ 0 };
+    std::mutex mutex;
+    condition_variable done;
+
+    void run()
+    {
+        size_t count = 0;
+        for (size_t i = next++; i < n; i = next++)
+        {
+            (*func)(i);
+            count++;
+        }
+
+        if (count > 0)
+        {
+            lock_guard<std::mutex> lock(mutex);
+            completed += count;
+            if (completed == n)
+                done.notify_all();
+        }
+    }
+};
+}
+
+
+void ThreadPool::parallelFor(size_t n, const function<void(size_t)>& func)
+{
+    if (n == 0)
+        return;
+
+    if (workers.empty() || n == 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            func(i);
+        return;
+    }
+
+    auto state = make_shared<ParallelForState>();
+    state->func = &func;
+    state->n = n;
+
+    size_t nHelpers = min(workers.size(), n - 1);
+    for (size_t i = 0; i < nHelpers; i++)
+        post([state] { state->run(); });
+
+    state->run();
+
+    unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state] { return state->completed == state->n; });
+}
+
+
+// Function local statics are initialized once even when the pools are
+// first requested from several threads
+ThreadPool* GetThreadPool()
+{
+    static ThreadPool* pool = new ThreadPool();
+    return pool;
+}
+
+
+ThreadPool* GetResourceLoaderPool()
+{
+    static ThreadPool* pool = new ThreadPool(2);
+    return pool;
+}
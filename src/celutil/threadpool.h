@@ -0,0 +1,58 @@
+// threadpool.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A fixed size pool of worker threads.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+ public:
+    // With nThreads == 0, one worker is started for each hardware thread
+    // except the one running the caller.
+    explicit ThreadPool(unsigned int nThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in parallelFor(), including the caller
+    unsigned int concurrency() const { return (unsigned int) workers.size() + 1; }
+
+    // Queue a job to be run asynchronously by one of the workers.
+    void post(std::function<void()> job);
+
+    // Call func(i) for every i in [0, n). The calling thread takes part in
+    // the work and the method returns once all calls have completed.
+    void parallelFor(size_t n, const std::function<void(size_t)>& func);
+
+ private:
+    void workerMain();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping{ false };
+};
+
+// Pool shared by the engine; created on first use.
+ThreadPool* GetThreadPool();
+
+// Pool used to load resources in the background. Its jobs mostly wait for
+// I/O, so it has a fixed number of workers whatever the processor count.
+ThreadPool* GetResourceLoaderPool();
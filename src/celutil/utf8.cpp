@@ -518,6 +518,33 @@ inline wchar_t UTF8Normalize(wchar_t ch)
 }
 
 
+//! Return the string with the same normalization as UTF8StringCompare(),
+//! which also folds the case of the WGL-4 letters. Bytes which aren't valid
+//! UTF-8 are copied unchanged.
+std::string UTF8Normalize(const std::string& s)
+{
+    std::string normalized;
+    normalized.reserve(s.length());
+
+    int len = s.length();
+    char buf[8];
+    for (int i = 0; i < len;)
+    {
+        wchar_t ch = 0;
+        if (!UTF8Decode(s, i, ch))
+        {
+            normalized += s[i++];
+            continue;
+        }
+
+        i += UTF8EncodedSize(ch);
+        normalized.append(buf, UTF8Encode(UTF8Normalize(ch), buf));
+    }
+
+    return normalized;
+}
+
+
 //! Perform a normalized comparison of two UTF-8 strings.  The normalization
 //! only works for characters in the WGL-4 subset, and no multicharacter
 //! translations are performed.
@@ -44,6 +44,7 @@ class UTF8StringOrderingPredicate
 
 
 int UTF8Length(const std::string& s);
+std::string UTF8Normalize(const std::string& s);
 
 inline int UTF8EncodedSize(wchar_t ch)
 {
@@ -0,0 +1,62 @@
+// chebyfit.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Compile a custom orbit into a Chebyshev ephemeris file which Celestia
+// uses in place of the analytic theory over the span it covers.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <celephem/chebyshevorbit.h>
+#include <celephem/customorbit.h>
+#include <fmt/printf.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 5)
+    {
+        fmt::fprintf(cerr, "Usage: %s <custom orbit> <start JD> <end JD> <tolerance km> [outfile.cheb]\n", argv[0]);
+        return 1;
+    }
+
+    string name = argv[1];
+    double startDate = atof(argv[2]);
+    double endDate = atof(argv[3]);
+    double tolerance = atof(argv[4]);
+    string outFilename = argc > 5 ? argv[5] : name + ".cheb";
+
+    unique_ptr<Orbit> orbit(GetCustomOrbit(name, false));
+    if (orbit == nullptr)
+    {
+        fmt::fprintf(cerr, "Unknown custom orbit %s.\n", name);
+        return 1;
+    }
+
+    unique_ptr<ChebyshevEphemeris> ephemeris(ChebyshevEphemeris::fit(*orbit, startDate, endDate, tolerance));
+    if (ephemeris == nullptr)
+    {
+        fmt::fprintf(cerr, "Can't fit %s from JD %f to JD %f within %f km.\n",
+                     name, startDate, endDate, tolerance);
+        return 1;
+    }
+
+    ofstream out(outFilename, ios::out | ios::binary);
+    if (!ephemeris->save(out))
+    {
+        fmt::fprintf(cerr, "Error writing %s.\n", outFilename);
+        return 1;
+    }
+
+    fmt::fprintf(cout, "Wrote %u segments to %s.\n", ephemeris->getSegmentCount(), outFilename);
+    return 0;
+}
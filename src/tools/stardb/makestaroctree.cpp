@@ -0,0 +1,56 @@
+// makestaroctree.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// Convert a binary Celestia star database to a star file with a prebuilt
+// octree, which can be loaded without sorting the stars at startup.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <celengine/stardb.h>
+
+using namespace std;
+
+
+void Usage()
+{
+    cerr << "Usage: makestaroctree <input star database> <output file>\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        Usage();
+        return 1;
+    }
+
+    ifstream inputFile(argv[1], ios::in | ios::binary);
+    if (!inputFile.good())
+    {
+        cerr << "Error opening input file " << argv[1] << '\n';
+        return 1;
+    }
+
+    ofstream outputFile(argv[2], ios::out | ios::binary);
+    if (!outputFile.good())
+    {
+        cerr << "Error opening output file " << argv[2] << '\n';
+        return 1;
+    }
+
+    if (!StarDatabase::writeOctreeBinary(inputFile, outputFile))
+    {
+        cerr << "Error converting star database\n";
+        return 1;
+    }
+
+    return 0;
+}
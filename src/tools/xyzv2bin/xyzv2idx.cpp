@@ -0,0 +1,231 @@
+#include <celephem/xyzvbinary.h>
+#include <celutil/bytes.h> // __BYTE_ORDER__
+#include <fmt/printf.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring> // memcpy
+#include <fstream>
+#include <iostream>
+#include <limits> // std::numeric_limits
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr char magic[8] = "CELXYZI";
+
+// Average number of samples per index bucket
+constexpr double DefaultSamplesPerBucket = 4.0;
+
+// Scan past comments. A comment begins with the # character and ends
+// with a newline. Return true if the stream state is good. The stream
+// position will be at the first non-comment, non-whitespace character.
+static bool SkipComments(istream& in)
+{
+    bool inComment = false;
+    bool done = false;
+
+    int c = in.get();
+    while (!done)
+    {
+        if (in.eof())
+        {
+            done = true;
+        }
+        else
+        {
+            if (inComment)
+            {
+                if (c == '\n')
+                    inComment = false;
+            }
+            else
+            {
+                if (c == '#')
+                {
+                    inComment = true;
+                }
+                else if (isspace(c) == 0)
+                {
+                    in.unget();
+                    done = true;
+                }
+            }
+        }
+
+        if (!done)
+            c = in.get();
+    }
+
+    return in.good();
+}
+
+// Read a text xyz or xyzv file. Samples with duplicate times are skipped,
+// as Celestia does when loading the text files.
+static bool readSamples(const string& filename, bool hasVelocity, vector<XYZVBinaryData>& samples)
+{
+    ifstream in(filename);
+    if (!in.good() || !SkipComments(in))
+        return false;
+
+    double lastSampleTime = -numeric_limits<double>::infinity();
+    while (in.good())
+    {
+        XYZVBinaryData data;
+        in >> data.tdb;
+        in >> data.position[0];
+        in >> data.position[1];
+        in >> data.position[2];
+        if (hasVelocity)
+        {
+            in >> data.velocity[0];
+            in >> data.velocity[1];
+            in >> data.velocity[2];
+        }
+        else
+        {
+            data.velocity[0] = data.velocity[1] = data.velocity[2] = 0.0;
+        }
+
+        if (!in.good() || data.tdb == lastSampleTime)
+            continue;
+
+        if (data.tdb < lastSampleTime)
+        {
+            fmt::fprintf(cerr, "Samples of %s aren't sorted by time.\n", filename);
+            return false;
+        }
+
+        samples.push_back(data);
+        lastSampleTime = data.tdb;
+    }
+
+    return !samples.empty();
+}
+
+// Estimate velocities of position only samples by averaging the slopes of
+// the adjacent spans, the same way cubic interpolation of xyz files does.
+static void estimateVelocities(vector<XYZVBinaryData>& samples)
+{
+    constexpr double secondsPerDay = 86400.0;
+
+    size_t n = samples.size();
+    if (n < 2)
+        return;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            double v;
+            if (i == 0)
+            {
+                v = (samples[1].position[k] - samples[0].position[k]) /
+                    (samples[1].tdb - samples[0].tdb);
+            }
+            else if (i == n - 1)
+            {
+                v = (samples[i].position[k] - samples[i - 1].position[k]) /
+                    (samples[i].tdb - samples[i - 1].tdb);
+            }
+            else
+            {
+                double v0 = (samples[i + 1].position[k] - samples[i].position[k]) /
+                            (samples[i + 1].tdb - samples[i].tdb);
+                double v1 = (samples[i].position[k] - samples[i - 1].position[k]) /
+                            (samples[i].tdb - samples[i - 1].tdb);
+                v = (v0 + v1) * 0.5;
+            }
+
+            // Velocities are stored in km/s
+            samples[i].velocity[k] = v / secondsPerDay;
+        }
+    }
+}
+
+static bool writeIndexed(const string& filename,
+                         const vector<XYZVBinaryData>& samples,
+                         double samplesPerBucket)
+{
+    ofstream out(filename, ios::binary);
+    if (!out.good())
+        return false;
+
+    double startTime = samples.front().tdb;
+    double endTime = samples.back().tdb;
+
+    XYZVIndexedHeader header;
+    memcpy(header.magic, magic, 8);
+    header.byteOrder = __BYTE_ORDER__;
+    header.digits = std::numeric_limits<double>::digits;
+    header.reserved = 0;
+    header.count = samples.size();
+    header.bucketCount = max((uint64_t) ceil((double) samples.size() / samplesPerBucket), (uint64_t) 1);
+    header.startTime = startTime;
+    header.bucketWidth = endTime > startTime ? (endTime - startTime) / (double) header.bucketCount : 1.0;
+    header.boundingRadius = 0.0;
+    for (const auto& s : samples)
+    {
+        double r = sqrt(s.position[0] * s.position[0] +
+                        s.position[1] * s.position[1] +
+                        s.position[2] * s.position[2]);
+        header.boundingRadius = max(header.boundingRadius, r);
+    }
+
+    // index[b] is the first sample falling into bucket b or a later one
+    vector<uint64_t> index(header.bucketCount + 1, samples.size());
+    for (size_t i = samples.size(); i-- > 0; )
+    {
+        double bucket = floor((samples[i].tdb - startTime) / header.bucketWidth);
+        uint64_t b = (uint64_t) min(max(bucket, 0.0), (double) (header.bucketCount - 1));
+        index[b] = i;
+    }
+    for (size_t b = header.bucketCount; b-- > 0; )
+        index[b] = min(index[b], index[b + 1]);
+    index[0] = 0;
+
+    if (!out.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t)) ||
+        !out.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(XYZVBinaryData)))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fmt::fprintf(cerr, "Usage: %s infile.xyz[v] outfile.xyz[v]idx [samples-per-bucket]\n", argv[0]);
+        return 1;
+    }
+
+    string inFilename(argv[1]);
+    bool hasVelocity = inFilename.size() >= 5 &&
+                       inFilename.compare(inFilename.size() - 5, 5, ".xyzv") == 0;
+
+    double samplesPerBucket = DefaultSamplesPerBucket;
+    if (argc > 3)
+        samplesPerBucket = max(atof(argv[3]), 1.0);
+
+    vector<XYZVBinaryData> samples;
+    if (!readSamples(inFilename, hasVelocity, samples))
+    {
+        fmt::fprintf(cerr, "Error reading %s.\n", inFilename);
+        return 1;
+    }
+
+    if (!hasVelocity)
+        estimateVelocities(samples);
+
+    if (!writeIndexed(argv[2], samples, samplesPerBucket))
+    {
+        fmt::fprintf(cerr, "Error writing %s.\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <celestia/capturepipeline.h>
+#include <celestia/yuvconvert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+static std::vector<unsigned char> randomImage(int width, int height)
+{
+    std::mt19937 rng(width * 1000 + height);
+    std::vector<unsigned char> rgba(width * height * 4);
+    for (auto& c : rgba)
+        c = (unsigned char) rng();
+    return rgba;
+}
+
+TEST_CASE("RGBA to YUV conversion", "[Capture]")
+{
+    SECTION("Reference colours")
+    {
+        // Black, white and red, in the studio range
+        const unsigned char colours[3][4] = { { 0, 0, 0, 255 }, { 255, 255, 255, 255 }, { 255, 0, 0, 255 } };
+        const unsigned char expected[3][3] = { { 16, 128, 128 }, { 235, 128, 128 }, { 81, 90, 240 } };
+        for (int i = 0; i < 3; i++)
+        {
+            std::vector<unsigned char> rgba;
+            for (int j = 0; j < 16 * 2; j++)
+                rgba.insert(rgba.end(), colours[i], colours[i] + 4);
+
+            std::vector<unsigned char> y(16 * 2), u(8), v(8);
+            ConvertRGBAToYUV420(rgba.data(), 16 * 4, 16, 2, y.data(), 16, u.data(), v.data(), 8);
+            for (auto c : y)
+                REQUIRE((int) c == expected[i][0]);
+            for (int j = 0; j < 8; j++)
+            {
+                REQUIRE((int) u[j] == expected[i][1]);
+                REQUIRE((int) v[j] == expected[i][2]);
+            }
+        }
+    }
+
+    SECTION("Same results as the scalar conversion")
+    {
+        // Odd sizes exercise the edges, negative strides flipped images
+        for (int width : { 1, 7, 8, 9, 31, 64 })
+        {
+            for (int height : { 1, 2, 5, 16 })
+            {
+                INFO("Image size " << width << "x" << height);
+                std::vector<unsigned char> rgba = randomImage(width, height);
+                int uvWidth = (width + 1) / 2;
+                size_t uvSize = uvWidth * ((height + 1) / 2);
+
+                for (int stride : { width * 4, -width * 4 })
+                {
+                    const unsigned char* first = stride > 0 ? rgba.data() : rgba.data() + (height - 1) * width * 4;
+                    std::vector<unsigned char> y0(width * height), u0(uvSize), v0(uvSize);
+                    std::vector<unsigned char> y1(y0.size()), u1(uvSize), v1(uvSize);
+                    ConvertRGBAToYUV420(first, stride, width, height,
+                                        y0.data(), width, u0.data(), v0.data(), uvWidth);
+                    ConvertRGBAToYUV420Scalar(first, stride, width, height,
+                                              y1.data(), width, u1.data(), v1.data(), uvWidth);
+                    REQUIRE(y0 == y1);
+                    REQUIRE(u0 == u1);
+                    REQUIRE(v0 == v1);
+                }
+            }
+        }
+    }
+}
+
+static CapturedFrame makeFrame(int index)
+{
+    CapturedFrame frame;
+    frame.width = 1;
+    frame.height = 1;
+    frame.rowStride = 4;
+    frame.pixels.assign(4, (unsigned char) index);
+    return frame;
+}
+
+TEST_CASE("Capture pipeline", "[Capture]")
+{
+    constexpr int NFrames = 50;
+    constexpr size_t MaxQueued = 4;
+
+    SECTION("Frames are encoded in order, and failures counted")
+    {
+        std::vector<int> encoded;
+        CapturePipeline pipeline(nullptr,
+                                 [&encoded](const CapturedFrame& frame)
+                                 {
+                                     encoded.push_back(frame.pixels[0]);
+                                     return frame.pixels[0] % 10 != 0;
+                                 },
+                                 0, MaxQueued);
+        for (int i = 0; i < NFrames; i++)
+            pipeline.submit(makeFrame(i));
+        pipeline.finish();
+
+        REQUIRE(pipeline.getQueuedFrameCount() == 0);
+        REQUIRE(pipeline.getDroppedFrameCount() == NFrames / 10);
+        REQUIRE(pipeline.getEncodedFrameCount() == NFrames - NFrames / 10);
+        REQUIRE(encoded.size() == (size_t) NFrames);
+        for (int i = 0; i < NFrames; i++)
+            REQUIRE(encoded[i] == i);
+    }
+
+    SECTION("Errors reported by encoders are written by the render thread")
+    {
+        std::thread::id encoderThread;
+        CapturePipeline pipeline(nullptr, nullptr, 0, MaxQueued);
+        auto encoder = [&](const CapturedFrame& frame)
+        {
+            encoderThread = std::this_thread::get_id();
+            pipeline.reportError("Frame " + std::to_string(frame.pixels[0]));
+            return false;
+        };
+
+        std::ostringstream errors;
+        std::streambuf* cerrBuffer = std::cerr.rdbuf(errors.rdbuf());
+        pipeline.submit(makeFrame(3), encoder);
+        pipeline.submit(makeFrame(4), encoder);
+        pipeline.finish();
+        std::cerr.rdbuf(cerrBuffer);
+
+        REQUIRE(encoderThread != std::this_thread::get_id());
+        REQUIRE(errors.str() == "Frame 3\nFrame 4\n");
+        REQUIRE(pipeline.getDroppedFrameCount() == 2);
+    }
+
+    SECTION("The queue is bounded")
+    {
+        std::mutex mutex;
+        std::condition_variable released;
+        bool blocked = true;
+        std::promise<void> firstStarted;
+        std::atomic<int> started{ 0 };
+        CapturePipeline pipeline(nullptr,
+                                 [&](const CapturedFrame&)
+                                 {
+                                     if (started++ == 0)
+                                         firstStarted.set_value();
+                                     std::unique_lock<std::mutex> lock(mutex);
+                                     released.wait(lock, [&blocked] { return !blocked; });
+                                     return true;
+                                 },
+                                 0, MaxQueued);
+
+        // One frame is being encoded while the others wait in the queue,
+        // so the submissions return until the queue is full.
+        pipeline.submit(makeFrame(0));
+        firstStarted.get_future().wait();
+        for (int i = 1; i <= (int) MaxQueued; i++)
+            pipeline.submit(makeFrame(i));
+        // Not REQUIRE, as the encoder must be released before returning
+        CHECK(pipeline.getQueuedFrameCount() == (int) MaxQueued + 1);
+
+        // The next one waits for the encoder
+        auto producer = std::async(std::launch::async, [&pipeline]
+        {
+            for (int i = (int) MaxQueued + 1; i < NFrames; i++)
+                pipeline.submit(makeFrame(i));
+        });
+        CHECK(producer.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout);
+        CHECK(pipeline.getQueuedFrameCount() == (int) MaxQueued + 1);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = false;
+        }
+        released.notify_all();
+        producer.get();
+
+        // Frames given their own encoder don't use the pipeline's one
+        int ownEncoderCalls = 0;
+        pipeline.submit(makeFrame(0), [&ownEncoderCalls](const CapturedFrame&) { ownEncoderCalls++; return true; });
+        pipeline.finish();
+
+        REQUIRE(started == NFrames);
+        REQUIRE(ownEncoderCalls == 1);
+        REQUIRE(pipeline.getEncodedFrameCount() == NFrames + 1);
+        REQUIRE(pipeline.getDroppedFrameCount() == 0);
+    }
+}
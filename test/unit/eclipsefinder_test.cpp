@@ -0,0 +1,252 @@
+#include <celengine/body.h>
+#include <celengine/frame.h>
+#include <celengine/frametree.h>
+#include <celengine/star.h>
+#include <celengine/timeline.h>
+#include <celengine/timelinephase.h>
+#include <celephem/customorbit.h>
+#include <celephem/rotation.h>
+#include <celestia/eclipsefinder.h>
+#include <celmath/distance.h>
+#include <celmath/ray.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const double StartDate = 2451545.0;
+constexpr const double BruteForceStep = 1.0 / 24.0;
+
+// Jupiter and the Galilean moons, orbiting a Sun-like star
+class JupiterSystem
+{
+ public:
+    JupiterSystem() :
+        sunSystem(&sun),
+        sunFrameTree(&sun),
+        rotation(Quaterniond::Identity())
+    {
+        sun.setDetails(StarDetails::GetStarDetails(StellarClass(StellarClass::NormalStar,
+                                                                StellarClass::Spectral_G, 2,
+                                                                StellarClass::Lum_V)));
+        sun.setAbsoluteMagnitude(4.83f);
+
+        jupiter.reset(new Body(&sunSystem, "Jupiter"));
+        addBody(*jupiter, Body::Planet, 71492.0f, "vsop87-jupiter", Selection(&sun), &sunFrameTree);
+
+        jupiter->setSatellites(new PlanetarySystem(jupiter.get()));
+        for (const auto& moon : { std::make_pair("Io", 1821.6f),
+                                  std::make_pair("Europa", 1560.8f),
+                                  std::make_pair("Ganymede", 2631.2f),
+                                  std::make_pair("Callisto", 2410.3f) })
+        {
+            std::string orbitName(moon.first);
+            orbitName[0] = (char) tolower(orbitName[0]);
+            moons.emplace_back(new Body(jupiter->getSatellites(), moon.first));
+            addBody(*moons.back(), Body::Moon, moon.second, orbitName.c_str(),
+                    Selection(jupiter.get()), jupiter->getOrCreateFrameTree());
+        }
+    }
+
+    ~JupiterSystem()
+    {
+        // Moons must be removed before the satellite system of Jupiter
+        moons.clear();
+        jupiter.reset();
+    }
+
+    Body& getJupiter() { return *jupiter; }
+
+ private:
+    void addBody(Body& body, int classification, float radius, const char* orbitName,
+                 const Selection& center, FrameTree* frameTree)
+    {
+        Orbit* orbit = GetCustomOrbit(orbitName);
+        REQUIRE(orbit != nullptr);
+        orbits.emplace_back(orbit);
+
+        body.setClassification(classification);
+        body.setSemiAxes(Vector3f::Constant(radius));
+
+        auto frame = std::make_shared<J2000EclipticFrame>(center);
+        auto phase = std::make_shared<const TimelinePhase>(&body, -1.0e10, 1.0e10,
+                                                           frame, orbit, frame, &rotation,
+                                                           frameTree);
+        frameTree->addChild(phase);
+
+        auto timeline = new Timeline();
+        timeline->appendPhase(phase);
+        body.setTimeline(timeline);
+    }
+
+    Star sun;
+    PlanetarySystem sunSystem;
+    FrameTree sunFrameTree;
+    ConstantOrientation rotation;
+    std::vector<std::unique_ptr<Orbit>> orbits;
+    std::unique_ptr<Body> jupiter;
+    std::vector<std::unique_ptr<Body>> moons;
+};
+
+// The shadow test done by EclipseFinder before it used root bracketing:
+// the receiver is eclipsed when its center is closer to the axis of the
+// caster's shadow cylinder than the sum of its radius and the shadow's.
+static bool testEclipse(const Body& receiver, const Body& caster, double now)
+{
+    using namespace celmath;
+
+    if (caster.getRadius() < receiver.getRadius() * 0.005f || !caster.isEllipsoid())
+        return false;
+
+    Vector3d posReceiver = receiver.getAstrocentricPosition(now);
+    Vector3d posCaster = caster.getAstrocentricPosition(now);
+
+    const Star* sun = receiver.getSystem()->getStar();
+    assert(sun != nullptr);
+    float appSunRadius = (float) (sun->getRadius() / posReceiver.norm());
+
+    double distToCaster = (posCaster - posReceiver).norm() - receiver.getRadius();
+    float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
+    float shadowRadius = (1 + appSunRadius / appOccluderRadius) * caster.getRadius();
+
+    float R = receiver.getRadius() + shadowRadius;
+    return distance(posReceiver, Ray3d(posCaster, posCaster)) < R &&
+           distToCaster > caster.getRadius();
+}
+
+// The search done by EclipseFinder before it used root bracketing: test for
+// eclipses every hour, and step by a minute to find their extent.
+static void findEclipsesBruteForce(Body& body, double startDate, double endDate,
+                                   std::vector<Eclipse>& eclipses)
+{
+    constexpr double dT = 1.0 / (24.0 * 60.0);
+
+    PlanetarySystem* satellites = body.getSatellites();
+    std::vector<double> previousEclipseEndTimes(satellites->getSystemSize(), startDate - 1.0);
+    for (double t = startDate; t <= endDate; t += BruteForceStep)
+    {
+        for (int i = 0; i < satellites->getSystemSize(); i++)
+        {
+            if (t <= previousEclipseEndTimes[i])
+                continue;
+
+            Body* satellite = satellites->getBody(i);
+            for (const auto& pair : { std::make_pair(&body, satellite), std::make_pair(satellite, &body) })
+            {
+                if (!testEclipse(*pair.first, *pair.second, t))
+                    continue;
+
+                Eclipse eclipse;
+                eclipse.receiver = pair.first;
+                eclipse.occulter = pair.second;
+                for (eclipse.startTime = t; testEclipse(*pair.first, *pair.second, eclipse.startTime); )
+                    eclipse.startTime -= dT;
+                for (eclipse.endTime = t; testEclipse(*pair.first, *pair.second, eclipse.endTime); )
+                    eclipse.endTime += dT;
+                eclipses.push_back(eclipse);
+                previousEclipseEndTimes[i] = eclipse.endTime;
+            }
+        }
+    }
+}
+
+static bool sameEclipse(const Eclipse& a, const Eclipse& b)
+{
+    // The brute force search finds the start and end times to a minute
+    constexpr double tolerance = 1.5 / (24.0 * 60.0);
+    return a.receiver == b.receiver && a.occulter == b.occulter &&
+           std::abs(a.startTime - b.startTime) < tolerance &&
+           std::abs(a.endTime - b.endTime) < tolerance;
+}
+
+static void compareEclipses(const std::vector<Eclipse>& eclipses,
+                            const std::vector<Eclipse>& expected)
+{
+    // Every eclipse found by the brute force search must be found, as well
+    // as possibly a few which were too short to be caught by the hourly steps
+    for (const auto& e : expected)
+    {
+        INFO("Eclipse of " << e.receiver->getName() << " by " << e.occulter->getName()
+             << " at " << e.startTime);
+        REQUIRE(std::count_if(eclipses.begin(), eclipses.end(),
+                              [&e](const Eclipse& other) { return sameEclipse(e, other); }) == 1);
+    }
+
+    for (const auto& e : eclipses)
+    {
+        if (e.endTime - e.startTime >= BruteForceStep)
+        {
+            INFO("Eclipse of " << e.receiver->getName() << " by " << e.occulter->getName()
+                 << " at " << e.startTime);
+            REQUIRE(std::any_of(expected.begin(), expected.end(),
+                                [&e](const Eclipse& other) { return sameEclipse(e, other); }));
+        }
+    }
+}
+
+class EclipseCollector : public EclipseFinderWatcher
+{
+ public:
+    Status eclipseFinderProgressUpdate(double) override { return ContinueOperation; }
+    void eclipseFinderEclipseFound(const Eclipse& eclipse) override { found.push_back(eclipse); }
+
+    std::vector<Eclipse> found;
+};
+
+TEST_CASE("Eclipse search", "[EclipseFinder]")
+{
+    JupiterSystem system;
+    double endDate = StartDate + 365.25;
+
+    std::vector<Eclipse> expected;
+    findEclipsesBruteForce(system.getJupiter(), StartDate, endDate, expected);
+    REQUIRE(expected.size() > 500);
+
+    EclipseCollector collector;
+    std::vector<Eclipse> eclipses;
+    EclipseFinder finder(&system.getJupiter(), &collector);
+    finder.findEclipses(StartDate, endDate, Eclipse::Solar | Eclipse::Lunar, eclipses);
+
+    compareEclipses(eclipses, expected);
+
+    // Results are streamed to the watcher as they're found
+    REQUIRE(collector.found.size() == eclipses.size());
+    for (size_t i = 0; i < eclipses.size(); i++)
+        REQUIRE(sameEclipse(collector.found[i], eclipses[i]));
+
+    // Only the requested type of eclipse is searched for
+    std::vector<Eclipse> solarEclipses;
+    finder.findEclipses(StartDate, endDate, Eclipse::Solar, solarEclipses);
+    REQUIRE(solarEclipses.size() < eclipses.size());
+    for (const auto& e : solarEclipses)
+        REQUIRE(e.receiver == &system.getJupiter());
+}
+
+TEST_CASE("Eclipse search speed", "[!benchmark]")
+{
+    JupiterSystem system;
+    double endDate = StartDate + 365.25;
+
+    BENCHMARK("Hourly steps")
+    {
+        std::vector<Eclipse> eclipses;
+        findEclipsesBruteForce(system.getJupiter(), StartDate, endDate, eclipses);
+        return eclipses.size();
+    };
+
+    BENCHMARK("EclipseFinder")
+    {
+        std::vector<Eclipse> eclipses;
+        EclipseFinder(&system.getJupiter()).findEclipses(StartDate, endDate,
+                                                         Eclipse::Solar | Eclipse::Lunar,
+                                                         eclipses);
+        return eclipses.size();
+    };
+}
@@ -0,0 +1,156 @@
+#include <celengine/body.h>
+#include <celengine/frame.h>
+#include <celengine/frametree.h>
+#include <celengine/star.h>
+#include <celengine/timeline.h>
+#include <celengine/timelinephase.h>
+#include <celephem/customorbit.h>
+#include <celephem/orbit.h>
+#include <celephem/rotation.h>
+#include <celutil/threadpool.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const double StartDate = 2451545.0;
+
+// Planets, each with a moon whose orbit is given in a frame that turns
+// with the planet's orbital motion, as is usual for spacecraft. Evaluating
+// the moons evaluates the planets and the caching frames several times.
+class PlanetSystem
+{
+ public:
+    PlanetSystem(int nPlanets) :
+        sunSystem(&sun),
+        sunFrameTree(&sun),
+        rotation(Quaterniond::Identity())
+    {
+        sun.setDetails(StarDetails::GetStarDetails(StellarClass(StellarClass::NormalStar,
+                                                                StellarClass::Spectral_G, 2,
+                                                                StellarClass::Lum_V)));
+        sun.setAbsoluteMagnitude(4.83f);
+
+        const char* orbitNames[] = { "vsop87-mercury", "vsop87-venus", "vsop87-earth", "vsop87-mars" };
+        for (int i = 0; i < nPlanets; i++)
+        {
+            Body* planet = new Body(&sunSystem, "Planet " + std::to_string(i));
+            planets.emplace_back(planet);
+            Orbit* orbit = GetCustomOrbit(orbitNames[i % 4], false);
+            REQUIRE(orbit != nullptr);
+            auto frame = std::make_shared<J2000EclipticFrame>(Selection(&sun));
+            addBody(*planet, orbit, frame, &sunFrameTree);
+
+            planet->setSatellites(new PlanetarySystem(planet));
+            Body* moon = new Body(planet->getSatellites(), "Moon " + std::to_string(i));
+            moons.emplace_back(moon);
+            Selection center(planet);
+            auto moonFrame = std::make_shared<TwoVectorFrame>(center,
+                FrameVector::createRelativePositionVector(center, Selection(&sun)), 1,
+                FrameVector::createRelativeVelocityVector(center, Selection(&sun)), 2);
+            addBody(*moon, new EllipticalOrbit(10000.0 + i, 0.01, 0.1, 0.0, 0.0, 0.0, 1.0 + i * 0.001),
+                    moonFrame, planet->getOrCreateFrameTree());
+        }
+    }
+
+    ~PlanetSystem()
+    {
+        // Moons must be removed before the satellite systems of the planets
+        moons.clear();
+        planets.clear();
+    }
+
+    std::vector<std::unique_ptr<Body>> moons;
+
+ private:
+    void addBody(Body& body, Orbit* orbit, const ReferenceFrame::SharedConstPtr& frame,
+                 FrameTree* frameTree)
+    {
+        orbits.emplace_back(orbit);
+        body.setSemiAxes(Vector3f::Constant(1000.0f));
+
+        auto phase = std::make_shared<const TimelinePhase>(&body, -1.0e10, 1.0e10,
+                                                           frame, orbit, frame, &rotation,
+                                                           frameTree);
+        frameTree->addChild(phase);
+
+        auto timeline = new Timeline();
+        timeline->appendPhase(phase);
+        body.setTimeline(timeline);
+    }
+
+    Star sun;
+    PlanetarySystem sunSystem;
+    FrameTree sunFrameTree;
+    ConstantOrientation rotation;
+    std::vector<std::unique_ptr<Orbit>> orbits;
+    std::vector<std::unique_ptr<Body>> planets;
+};
+
+// Compute the positions of the moons twice, as the render lists and the
+// orbit lists are built, optionally on a thread pool.
+static void evaluateMoons(const PlanetSystem& system, double t, ThreadPool* pool,
+                          std::vector<Vector3d>& positions)
+{
+    size_t nMoons = system.moons.size();
+    positions.resize(nMoons);
+    auto evaluate = [&](size_t i)
+    {
+        positions[i] = system.moons[i]->getAstrocentricPosition(t);
+        positions[i] += system.moons[i]->getAstrocentricPosition(t);
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor(nMoons, evaluate);
+    }
+    else
+    {
+        for (size_t i = 0; i < nMoons; i++)
+            evaluate(i);
+    }
+}
+
+TEST_CASE("Concurrent frame evaluation", "[Frame]")
+{
+    PlanetSystem system(300);
+    ThreadPool pool(4);
+
+    for (int i = 0; i < 20; i++)
+    {
+        double t = StartDate + i * 3.7;
+        std::vector<Vector3d> expected;
+        std::vector<Vector3d> positions;
+        evaluateMoons(system, t, nullptr, expected);
+        evaluateMoons(system, t + 1.0, &pool, positions);
+        evaluateMoons(system, t, &pool, positions);
+        REQUIRE(positions == expected);
+    }
+}
+
+TEST_CASE("Frame evaluation speed", "[!benchmark]")
+{
+    // As many bodies as in a catalog with some of the minor bodies
+    PlanetSystem system(2000);
+    std::vector<Vector3d> positions;
+
+    double t = StartDate;
+    BENCHMARK("Serial")
+    {
+        t += 1.0;
+        evaluateMoons(system, t, nullptr, positions);
+        return positions.size();
+    };
+
+    BENCHMARK("Thread pool")
+    {
+        t += 1.0;
+        evaluateMoons(system, t, GetThreadPool(), positions);
+        return positions.size();
+    };
+}
@@ -0,0 +1,148 @@
+// celengine/glsupport.h must be included before EGL/egl.h
+#include <celengine/glsupport.h>
+#include <EGL/egl.h>
+#include <celengine/framereadback.h>
+#include <celengine/render.h>
+#include <cstdlib>
+#include <deque>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace celestia;
+
+constexpr const int Width = 37;
+constexpr const int Height = 5;
+
+// A pbuffer surface, current while the object lives. Without a display
+// or a GPU, Mesa renders it in software.
+class PbufferContext
+{
+ public:
+    PbufferContext()
+    {
+        setenv("EGL_PLATFORM", "surfaceless", 0);
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        REQUIRE(display != EGL_NO_DISPLAY);
+        REQUIRE(eglInitialize(display, nullptr, nullptr));
+
+#ifdef GL_ES
+        const EGLint renderableType = EGL_OPENGL_ES2_BIT;
+        const EGLenum api = EGL_OPENGL_ES_API;
+        const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+#else
+        const EGLint renderableType = EGL_OPENGL_BIT;
+        const EGLenum api = EGL_OPENGL_API;
+        const EGLint contextAttribs[] = { EGL_NONE };
+#endif
+        const EGLint configAttribs[] =
+        {
+            EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+            EGL_RED_SIZE,        8,
+            EGL_GREEN_SIZE,      8,
+            EGL_BLUE_SIZE,       8,
+            EGL_ALPHA_SIZE,      8,
+            EGL_RENDERABLE_TYPE, renderableType,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint nConfigs = 0;
+        REQUIRE(eglChooseConfig(display, configAttribs, &config, 1, &nConfigs));
+        REQUIRE(nConfigs == 1);
+
+        const EGLint surfaceAttribs[] = { EGL_WIDTH, Width, EGL_HEIGHT, Height, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+        REQUIRE(surface != EGL_NO_SURFACE);
+        REQUIRE(eglBindAPI(api));
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        REQUIRE(context != EGL_NO_CONTEXT);
+        REQUIRE(eglMakeCurrent(display, surface, surface, context));
+    }
+
+    ~PbufferContext()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        eglTerminate(display);
+    }
+
+ private:
+    EGLDisplay display{ EGL_NO_DISPLAY };
+    EGLSurface surface{ EGL_NO_SURFACE };
+    EGLContext context{ EGL_NO_CONTEXT };
+};
+
+static unsigned char frameColour(int frame, int channel)
+{
+    return (unsigned char) (frame * 16 + channel * 64);
+}
+
+static void checkFrame(const CapturedFrame& frame, int index, Renderer::PixelFormat format)
+{
+    INFO("Frame " << index);
+    REQUIRE(frame.width == Width);
+    REQUIRE(frame.height == Height);
+    REQUIRE(frame.format == format);
+    REQUIRE(frame.rowStride >= Width * frame.bytesPerPixel());
+    REQUIRE(frame.rowStride % 4 == 0);
+    REQUIRE(frame.pixels.size() == (size_t) frame.rowStride * Height);
+
+    for (int y = 0; y < Height; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            const unsigned char* pixel = &frame.pixels[y * frame.rowStride + x * frame.bytesPerPixel()];
+            for (int c = 0; c < frame.bytesPerPixel(); c++)
+                REQUIRE((int) pixel[c] == (int) frameColour(index, c));
+        }
+    }
+}
+
+TEST_CASE("Frame read back", "[Capture]")
+{
+    PbufferContext context;
+    REQUIRE(gl::init());
+    Renderer renderer;
+
+    // Synchronous reads, then reads through the pixel buffer ring
+    for (unsigned int latency : { 0u, 1u, 3u })
+    {
+        for (auto format : { Renderer::PixelFormat::RGB, Renderer::PixelFormat::RGBA })
+        {
+            INFO("Latency " << latency << ", " << (format == Renderer::PixelFormat::RGB ? "RGB" : "RGBA"));
+            FrameReadback readback(&renderer, latency);
+            constexpr int NFrames = 12;
+            int nRetrieved = 0;
+            CapturedFrame frame;
+            for (int i = 0; i < NFrames; i++)
+            {
+                glClearColor(frameColour(i, 0) / 255.0f, frameColour(i, 1) / 255.0f,
+                             frameColour(i, 2) / 255.0f, frameColour(i, 3) / 255.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                REQUIRE(readback.read(0, 0, Width, Height, format, true));
+
+                // Frames become ready latency frames later, in order
+                REQUIRE(readback.hasReadyFrame() == (i >= (int) latency));
+                while (readback.hasReadyFrame())
+                {
+                    REQUIRE(readback.retrieve(frame));
+                    checkFrame(frame, nRetrieved++, format);
+                }
+            }
+
+            while (readback.hasPendingFrame())
+            {
+                REQUIRE(readback.retrieve(frame));
+                checkFrame(frame, nRetrieved++, format);
+            }
+            REQUIRE(nRetrieved == NFrames);
+            REQUIRE(!readback.retrieve(frame));
+            REQUIRE(glGetError() == GL_NO_ERROR);
+        }
+    }
+}
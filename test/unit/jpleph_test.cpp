@@ -0,0 +1,195 @@
+#include <celephem/jpleph.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const unsigned int RecordSize = 1018;
+constexpr const unsigned int NRecords = 10;
+constexpr const unsigned int NCoeffs = 6;
+constexpr const unsigned int NGranules = 2;
+constexpr const double StartDate = 2451536.5;
+constexpr const double DaysPerInterval = 32.0;
+constexpr const double EarthMoonMassRatio = 81.3;
+
+static const char* const FileName = "jpleph_test.dat";
+
+static void putUint(std::string& s, size_t offset, uint32_t x)
+{
+    for (int i = 0; i < 4; i++)
+        s[offset + i] = (char) (x >> (24 - 8 * i));
+}
+
+static void putDouble(std::string& s, size_t offset, double d)
+{
+    uint64_t x;
+    std::memcpy(&x, &d, sizeof(x));
+    for (int i = 0; i < 8; i++)
+        s[offset + i] = (char) (x >> (56 - 8 * i));
+}
+
+// A DE405 format file with random coefficients; all the items have
+// NCoeffs coefficients in NGranules granules.
+static std::string makeEphemeris(unsigned int deNumber,
+                                 std::vector<std::vector<double>>& coeffs)
+{
+    std::string data((NRecords + 2) * RecordSize * 8, '\0');
+    size_t p = 84 * 3 + 400 * 6;
+    putDouble(data, p, StartDate);
+    putDouble(data, p + 8, StartDate + NRecords * DaysPerInterval);
+    putDouble(data, p + 16, DaysPerInterval);
+    putUint(data, p + 24, 0);
+    putDouble(data, p + 28, 149597870.691);
+    putDouble(data, p + 36, EarthMoonMassRatio);
+    p += 44;
+    for (unsigned int i = 0; i < 12; i++, p += 12)
+    {
+        putUint(data, p, 3 + i * NCoeffs * NGranules * 3);
+        putUint(data, p + 4, NCoeffs);
+        putUint(data, p + 8, NGranules);
+    }
+    putUint(data, p, deNumber);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> coeff(-1.0e6, 1.0e6);
+    coeffs.clear();
+    for (unsigned int r = 0; r < NRecords; r++)
+    {
+        size_t recordStart = (r + 2) * RecordSize * 8;
+        putDouble(data, recordStart, StartDate + r * DaysPerInterval);
+        putDouble(data, recordStart + 8, StartDate + (r + 1) * DaysPerInterval);
+        coeffs.emplace_back();
+        for (unsigned int i = 0; i < RecordSize - 2; i++)
+        {
+            coeffs.back().push_back(coeff(rng));
+            putDouble(data, recordStart + (i + 2) * 8, coeffs.back().back());
+        }
+    }
+
+    return data;
+}
+
+// Reference evaluation of the position of an item from the coefficients
+static Vector3d evaluate(const std::vector<std::vector<double>>& coeffs,
+                         unsigned int item, double tjd)
+{
+    auto record = (unsigned int) ((tjd - StartDate) / DaysPerInterval);
+    double t0 = StartDate + record * DaysPerInterval;
+    double granuleDays = DaysPerInterval / NGranules;
+    auto granule = (unsigned int) ((tjd - t0) / granuleDays);
+    double u = 2.0 * (tjd - (t0 + granule * granuleDays)) / granuleDays - 1.0;
+
+    const double* c = coeffs[record].data() + (item * NGranules + granule) * NCoeffs * 3;
+    Vector3d position;
+    for (int i = 0; i < 3; i++)
+    {
+        position[i] = 0.0;
+        for (unsigned int j = 0; j < NCoeffs; j++)
+            position[i] += c[i * NCoeffs + j] * std::cos(j * std::acos(u));
+    }
+    return position;
+}
+
+TEST_CASE("JPL ephemeris", "[JPLEphemeris]")
+{
+    std::vector<std::vector<double>> coeffs;
+    std::string data = makeEphemeris(405, coeffs);
+    {
+        std::ofstream out(FileName, std::ios::out | std::ios::binary);
+        out.write(data.data(), data.size());
+    }
+
+    std::unique_ptr<JPLEphemeris> eph(JPLEphemeris::open(FileName));
+    REQUIRE(eph != nullptr);
+    REQUIRE(eph->getDENumber() == 405);
+    REQUIRE(eph->getStartDate() == StartDate);
+    REQUIRE(eph->getEndDate() == StartDate + NRecords * DaysPerInterval);
+
+    std::vector<double> times;
+    for (double t = StartDate + 0.1; t < eph->getEndDate(); t += 1.37)
+        times.push_back(t);
+
+    SECTION("Positions are evaluated from the coefficients")
+    {
+        for (double t : times)
+        {
+            for (unsigned int item = JPLEph_Mercury; item <= JPLEph_Sun; item++)
+            {
+                Vector3d expected = evaluate(coeffs, item, t);
+                Vector3d position = eph->getPlanetPosition((JPLEphemItem) item, t);
+                REQUIRE((position - expected).norm() < 1.0e-8 * expected.norm());
+            }
+
+            Vector3d earth = evaluate(coeffs, JPLEph_EarthMoonBary, t) -
+                             evaluate(coeffs, JPLEph_Moon, t) / (EarthMoonMassRatio + 1.0);
+            REQUIRE((eph->getPlanetPosition(JPLEph_Earth, t) - earth).norm() < 1.0e-8 * earth.norm());
+            REQUIRE(eph->getPlanetPosition(JPLEph_SSB, t) == Vector3d::Zero());
+        }
+    }
+
+    SECTION("Times outside of the ephemeris are clamped")
+    {
+        REQUIRE(eph->getPlanetPosition(JPLEph_Mars, StartDate - 100.0) ==
+                eph->getPlanetPosition(JPLEph_Mars, StartDate));
+        REQUIRE(eph->getPlanetPosition(JPLEph_Mars, eph->getEndDate() + 100.0) ==
+                eph->getPlanetPosition(JPLEph_Mars, eph->getEndDate()));
+    }
+
+    SECTION("Records are only decoded when they're used")
+    {
+        REQUIRE(eph->getDecodedRecordCount() == 0);
+        eph->getPlanetPosition(JPLEph_Venus, StartDate + 1.0);
+        eph->getPlanetPosition(JPLEph_Venus, StartDate + 2.0);
+        eph->getPlanetPosition(JPLEph_Jupiter, StartDate + 3.0);
+        REQUIRE(eph->getDecodedRecordCount() == 1);
+        eph->getPlanetPosition(JPLEph_Venus, StartDate + 5.5 * DaysPerInterval);
+        REQUIRE(eph->getDecodedRecordCount() == 2);
+    }
+
+    SECTION("Batches give the same results as single evaluations")
+    {
+        std::vector<JPLEphemItem> items = { JPLEph_Sun, JPLEph_Earth, JPLEph_Moon, JPLEph_SSB, JPLEph_Neptune };
+        std::vector<Vector3d> positions;
+        eph->getPlanetPositions(items, times, positions);
+        REQUIRE(positions.size() == items.size() * times.size());
+        for (size_t i = 0; i < times.size(); i++)
+        {
+            for (size_t j = 0; j < items.size(); j++)
+                REQUIRE(positions[i * items.size() + j] == eph->getPlanetPosition(items[j], times[i]));
+        }
+    }
+
+    SECTION("Streams are read like files")
+    {
+        std::istringstream in(data);
+        std::unique_ptr<JPLEphemeris> streamEph(JPLEphemeris::load(in));
+        REQUIRE(streamEph != nullptr);
+        for (double t : times)
+            REQUIRE(streamEph->getPlanetPosition(JPLEph_Saturn, t) == eph->getPlanetPosition(JPLEph_Saturn, t));
+    }
+
+    SECTION("Invalid files are rejected")
+    {
+        std::istringstream truncated(data.substr(0, data.size() - 8));
+        REQUIRE(JPLEphemeris::load(truncated) == nullptr);
+
+        std::string unknownVersion = makeEphemeris(999, coeffs);
+        std::istringstream in(unknownVersion);
+        REQUIRE(JPLEphemeris::load(in) == nullptr);
+
+        REQUIRE(JPLEphemeris::open("nonexistent.dat") == nullptr);
+    }
+
+    eph.reset();
+    std::remove(FileName);
+}
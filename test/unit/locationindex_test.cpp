@@ -0,0 +1,189 @@
+#include <celengine/location.h>
+#include <celengine/locationindex.h>
+#include <celmath/intersect.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace Eigen;
+using namespace celmath;
+
+constexpr const int NLocations = 5000;
+
+struct Surface
+{
+    Vector3d semiAxes;
+    std::vector<std::unique_ptr<Location>> locations;
+    std::vector<Location*> locationList;
+};
+
+// Locations scattered over an ellipsoid, some of them raised above it as
+// mountains are, with sizes from a kilometre to the size of a continent.
+static void addLocations(Surface& surface, std::mt19937& gen)
+{
+    std::normal_distribution<double> normal;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for (int i = 0; i < NLocations; i++)
+    {
+        Vector3d direction(normal(gen), normal(gen), normal(gen));
+        Vector3d position = direction / direction.cwiseQuotient(surface.semiAxes).norm();
+        position *= 1.0 + 0.02 * uniform(gen) * uniform(gen);
+
+        auto* location = new Location();
+        location->setPosition(position.cast<float>());
+        location->setSize((float) std::pow(10.0, uniform(gen) * 3.3));
+        if (i % 7 == 0)
+            location->setImportance((float) std::pow(10.0, uniform(gen) * 3.0));
+        location->setFeatureType((Location::FeatureType) (1ull << (gen() % 24)));
+        surface.locations.emplace_back(location);
+        surface.locationList.push_back(location);
+    }
+}
+
+// The tests made on every location before the renderer had an index: the
+// size on screen, the side of the camera, and whether the body is in the
+// way of the label.
+static bool isLabelled(const Surface& surface, const Location& location,
+                       const LocationIndex::Query& query)
+{
+    if ((location.getFeatureType() & query.featureFilter) == 0)
+        return false;
+
+    Vector3d position = location.getPosition().cast<double>();
+    Vector3d toLocation = position - query.cameraPosition;
+    float effSize = location.getImportance();
+    if (effSize < 0.0f)
+        effSize = location.getSize();
+    float pixSize = effSize / (float) (toLocation.norm() * query.pixelSize);
+    if (pixSize <= query.minFeatureSize || toLocation.dot(query.viewNormal) <= 0.0)
+        return false;
+
+    Vector3d labelPosition = position * (1.0 + query.labelOffset);
+    Ray3d ray(query.cameraPosition, labelPosition - query.cameraPosition);
+    double t = 0.0;
+    return !testIntersection(ray, Ellipsoidd(surface.semiAxes), t) || t >= 1.0;
+}
+
+
+TEST_CASE("Location index", "[LocationIndex]")
+{
+    std::mt19937 gen(7);
+    std::normal_distribution<double> normal;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    // A sphere, then an oblate body which only hides the labels behind
+    // its smallest inscribed sphere
+    for (const auto& semiAxes : { Vector3d(1737.0, 1737.0, 1737.0),
+                                  Vector3d(6378.0, 6357.0, 6378.0) })
+    {
+        INFO("Semi-axes " << semiAxes.transpose());
+        Surface surface;
+        surface.semiAxes = semiAxes;
+        addLocations(surface, gen);
+        LocationIndex index(surface.locationList);
+        double boundingRadius = semiAxes.maxCoeff();
+
+        size_t nLabelled = 0;
+        size_t nFound = 0;
+        size_t nChecked = 0;
+        for (int i = 0; i < 500; i++)
+        {
+            // Cameras inside the body, near the surface and far away,
+            // looking anywhere or roughly towards the body
+            Vector3d toCamera = Vector3d(normal(gen), normal(gen), normal(gen)).normalized();
+            double distance = boundingRadius * (i % 10 == 0 ? 0.5 + 0.5 * uniform(gen)
+                                                            : 1.0 + std::pow(uniform(gen), 3.0) * 30.0);
+            Vector3d viewNormal = Vector3d(normal(gen), normal(gen), normal(gen)).normalized();
+            if (i % 2 == 0)
+                viewNormal = (viewNormal * 0.5 - toCamera).normalized();
+
+            LocationIndex::Query query;
+            query.cameraPosition = toCamera * distance;
+            query.viewNormal = viewNormal;
+            query.pixelSize = (45.0 / 1080.0) * M_PI / 180.0;
+            const float minFeatureSizes[] = { 0.0f, 1.0f, 20.0f, 150.0f };
+            query.minFeatureSize = minFeatureSizes[gen() % 4];
+            const uint64_t filters[] = { ~0ull, Location::City | Location::Crater,
+                                         gen() & 0xffffff, 1ull << 40 };
+            query.featureFilter = filters[gen() % 4];
+            query.labelOffset = 0.0001;
+            query.occluderRadius = distance > boundingRadius ? semiAxes.minCoeff() : 0.0;
+
+            INFO("Camera " << query.cameraPosition.transpose() << ", view " << viewNormal.transpose()
+                 << ", min size " << query.minFeatureSize << ", filter " << query.featureFilter);
+
+            std::vector<Location*> found;
+            index.findVisible(query, found);
+            std::sort(found.begin(), found.end());
+            REQUIRE(std::adjacent_find(found.begin(), found.end()) == found.end());
+
+            for (const auto& location : surface.locations)
+            {
+                if (isLabelled(surface, *location, query))
+                {
+                    INFO("Location at " << location->getPosition().transpose());
+                    REQUIRE(std::binary_search(found.begin(), found.end(), location.get()));
+                    nLabelled++;
+                }
+            }
+            nFound += found.size();
+            nChecked += surface.locations.size();
+        }
+
+        // The queries must label some locations and leave out most of the
+        // others, or the test proves nothing
+        REQUIRE(nLabelled > 1000);
+        REQUIRE(nFound < nChecked / 3);
+    }
+}
+
+
+TEST_CASE("Location index culling", "[LocationIndex]")
+{
+    std::mt19937 gen(11);
+    Surface surface;
+    surface.semiAxes = Vector3d::Constant(1000.0);
+    addLocations(surface, gen);
+    LocationIndex index(surface.locationList);
+
+    LocationIndex::Query query;
+    query.pixelSize = 1.0e-3;
+    query.minFeatureSize = 0.0f;
+    query.featureFilter = ~0ull;
+    query.occluderRadius = 0.0;
+    query.labelOffset = 0.0001;
+
+    SECTION("Locations behind the camera")
+    {
+        // Above the highest mountains, looking away from the body
+        query.cameraPosition = Vector3d(0.0, 0.0, 1100.0);
+        query.viewNormal = Vector3d::UnitZ();
+        std::vector<Location*> found;
+        index.findVisible(query, found);
+        REQUIRE(found.size() < (size_t) NLocations / 100);
+    }
+
+    SECTION("Locations on the far side of the occluding sphere")
+    {
+        query.cameraPosition = Vector3d(0.0, 0.0, 3000.0);
+        query.viewNormal = -Vector3d::UnitZ();
+        query.occluderRadius = 1000.0;
+        std::vector<Location*> found;
+        index.findVisible(query, found);
+
+        size_t nFarSide = std::count_if(surface.locations.begin(), surface.locations.end(),
+                                        [](const std::unique_ptr<Location>& location)
+                                        { return location->getPosition().z() < -500.0f; });
+        size_t nFoundFarSide = std::count_if(found.begin(), found.end(),
+                                             [](const Location* location)
+                                             { return location->getPosition().z() < -500.0f; });
+        REQUIRE(nFarSide > 0);
+        REQUIRE(nFoundFarSide < nFarSide / 10);
+    }
+}
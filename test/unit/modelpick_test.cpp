@@ -0,0 +1,161 @@
+#include <celmodel/model.h>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace cmod;
+using namespace Eigen;
+
+// Reference intersection of a ray with a triangle (Moller-Trumbore)
+static bool intersectTriangle(const Vector3d& v0, const Vector3d& v1, const Vector3d& v2,
+                              const Vector3d& origin, const Vector3d& direction,
+                              double& distance)
+{
+    Vector3d e0 = v1 - v0;
+    Vector3d e1 = v2 - v0;
+    Vector3d p = direction.cross(e1);
+    double det = e0.dot(p);
+    if (det == 0.0)
+        return false;
+
+    Vector3d s = origin - v0;
+    double u = s.dot(p) / det;
+    Vector3d q = s.cross(e0);
+    double v = direction.dot(q) / det;
+    if (u < 0.0 || v < 0.0 || u + v > 1.0)
+        return false;
+
+    double t = e1.dot(q) / det;
+    if (t <= 0.0)
+        return false;
+
+    distance = t;
+    return true;
+}
+
+static Mesh* makeMesh(const std::vector<Vector3f>& positions)
+{
+    Mesh::VertexAttribute attributes[] = { Mesh::VertexAttribute(Mesh::Position, Mesh::Float3, 0) };
+    auto* vertexData = new char[positions.size() * sizeof(Vector3f)];
+    std::memcpy(vertexData, positions.data(), positions.size() * sizeof(Vector3f));
+
+    auto* mesh = new Mesh();
+    mesh->setVertexDescription(Mesh::VertexDescription(sizeof(Vector3f), 1, attributes));
+    mesh->setVertices((unsigned int) positions.size(), vertexData);
+    return mesh;
+}
+
+TEST_CASE("Model picking", "[Model]")
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
+    auto randomPoint = [&] { return Vector3f(coord(rng), coord(rng), coord(rng)); };
+
+    // Index lists aren't owned by the meshes, so they must outlive them
+    std::vector<std::vector<Mesh::index32>> indexLists;
+    std::vector<Vector3f> triangles;
+    Model model;
+
+    // Meshes of small random triangles in lists, strips and fans
+    const Mesh::PrimitiveGroupType types[] = { Mesh::TriList, Mesh::TriStrip, Mesh::TriFan };
+    for (int m = 0; m < 6; m++)
+    {
+        Mesh::PrimitiveGroupType type = types[m % 3];
+        Vector3f center = randomPoint();
+        std::vector<Vector3f> positions;
+        for (int i = 0; i < 300; i++)
+            positions.push_back(center + randomPoint() * 0.2f);
+
+        Mesh* mesh = makeMesh(positions);
+        indexLists.emplace_back();
+        auto& indices = indexLists.back();
+        for (unsigned int i = 0; i < positions.size(); i++)
+            indices.push_back(i);
+        mesh->addGroup(type, 0, (unsigned int) indices.size(), indices.data());
+        model.addMesh(mesh);
+
+        for (unsigned int i = 2; i < positions.size(); i += (type == Mesh::TriList ? 3 : 1))
+        {
+            if (type == Mesh::TriList)
+                triangles.insert(triangles.end(), { positions[i - 2], positions[i - 1], positions[i] });
+            else if (type == Mesh::TriStrip)
+                triangles.insert(triangles.end(), { positions[i - 2], positions[i - 1], positions[i] });
+            else
+                triangles.insert(triangles.end(), { positions[0], positions[i - 1], positions[i] });
+        }
+    }
+
+    std::vector<Vector3d> origins;
+    std::vector<Vector3d> directions;
+    for (int i = 0; i < 500; i++)
+    {
+        Vector3d origin = randomPoint().cast<double>().normalized() * 3.0;
+        Vector3d target = randomPoint().cast<double>() * 0.5;
+        origins.push_back(origin);
+        directions.push_back(target - origin);
+    }
+
+    SECTION("Closest intersections are the same as with brute force")
+    {
+        int hits = 0;
+        for (size_t i = 0; i < origins.size(); i++)
+        {
+            double expected = -1.0;
+            for (size_t j = 0; j < triangles.size(); j += 3)
+            {
+                double t;
+                if (intersectTriangle(triangles[j].cast<double>(),
+                                      triangles[j + 1].cast<double>(),
+                                      triangles[j + 2].cast<double>(),
+                                      origins[i], directions[i], t) &&
+                    (expected < 0.0 || t < expected))
+                {
+                    expected = t;
+                }
+            }
+
+            double distance = -1.0;
+            bool hit = model.pick(origins[i], directions[i], distance);
+            REQUIRE(hit == (expected >= 0.0));
+            if (hit)
+            {
+                REQUIRE(distance == Approx(expected));
+                hits++;
+            }
+        }
+        REQUIRE(hits > 0);
+    }
+
+    SECTION("Batches give the same results as single rays")
+    {
+        std::vector<double> distances;
+        unsigned int hits = model.pick(origins, directions, distances);
+        REQUIRE(distances.size() == origins.size());
+
+        unsigned int expectedHits = 0;
+        for (size_t i = 0; i < origins.size(); i++)
+        {
+            double distance = -1.0;
+            if (model.pick(origins[i], directions[i], distance))
+                expectedHits++;
+            REQUIRE(distances[i] == distance);
+        }
+        REQUIRE(hits == expectedHits);
+    }
+
+    SECTION("Hierarchies are rebuilt when the model is transformed")
+    {
+        double before = -1.0;
+        size_t i = 0;
+        while (!model.pick(origins[i], directions[i], before))
+            i++;
+
+        model.transform(Vector3f::Zero(), 0.5f);
+        double after = -1.0;
+        REQUIRE(model.pick(origins[i] * 0.5, directions[i] * 0.5, after));
+        REQUIRE(after == Approx(before));
+    }
+}
@@ -0,0 +1,153 @@
+#include <celengine/name.h>
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+// REQUIRE binds its operands to references, which would need a definition
+// of the static member
+static const AstroCatalog::IndexNumber InvalidIndex = AstroCatalog::InvalidIndex;
+
+static std::vector<std::string> names(const NameDatabase& db, AstroCatalog::IndexNumber catalogNumber)
+{
+    return db.getNamesByCatalogNumber(catalogNumber, 100);
+}
+
+TEST_CASE("Frozen name database", "[NameDatabase]")
+{
+    NameDatabase db;
+    db.add(32349, "Sirius");
+    db.add(32349, "ALF CMa");
+    db.add(32349, "HD 48915");
+    db.add(71683, "Rigil Kentaurus");
+    db.add(71683, "ALF1 Cen");
+    db.add(91262, "Vega");
+    db.add(91262, "vega");
+
+    for (bool frozen : { false, true })
+    {
+        if (frozen)
+            db.freeze();
+
+        SECTION(frozen ? "Lookups in the tables" : "Lookups in the maps")
+        {
+            REQUIRE(db.getNameCount() == 6);
+            REQUIRE(db.getCatalogNumberByName("Sirius") == 32349);
+            REQUIRE(db.getCatalogNumberByName("SIRIUS") == 32349);
+            REQUIRE(db.getCatalogNumberByName("hd 48915") == 32349);
+            REQUIRE(db.getCatalogNumberByName("ALF CMa") == 32349);
+            REQUIRE(db.getCatalogNumberByName("α CMa") == 32349);
+            REQUIRE(db.getCatalogNumberByName("ALF1 CEN") == 71683);
+            REQUIRE(db.getCatalogNumberByName("VEGA") == 91262);
+            REQUIRE(db.getCatalogNumberByName("Siriu") == InvalidIndex);
+            REQUIRE(db.getCatalogNumberByName("") == InvalidIndex);
+
+            REQUIRE(db.getNameByCatalogNumber(32349) == "Sirius");
+            REQUIRE(names(db, 32349) == std::vector<std::string>{ "Sirius", "α CMa", "HD 48915" });
+            REQUIRE(names(db, 91262) == std::vector<std::string>{ "Vega", "vega" });
+            REQUIRE(db.getNamesByCatalogNumber(32349, 2) == std::vector<std::string>{ "Sirius", "α CMa" });
+            REQUIRE(std::string(db.getFirstName(71683)) == "Rigil Kentaurus");
+            REQUIRE(db.getFirstName(1) == nullptr);
+            REQUIRE(db.getNameByCatalogNumber(1).empty());
+        }
+
+        SECTION(frozen ? "Changes to the tables" : "Changes to the maps")
+        {
+            db.erase(32349);
+            db.add(32349, "Alhabor");
+            db.add(11767, "Polaris");
+
+            for (int i = 0; i < 2; i++)
+            {
+                REQUIRE(names(db, 32349) == std::vector<std::string>{ "Alhabor" });
+                REQUIRE(names(db, 11767) == std::vector<std::string>{ "Polaris" });
+                REQUIRE(db.getCatalogNumberByName("alhabor") == 32349);
+                REQUIRE(db.getCatalogNumberByName("Polaris") == 11767);
+                // Like with the maps, erased names are still found
+                REQUIRE(db.getCatalogNumberByName("Sirius") == 32349);
+                REQUIRE(db.getNameCount() == 8);
+                REQUIRE(db.getCompletion("pol") == std::vector<std::string>{ "Polaris" });
+                REQUIRE(db.getCompletion("v") == std::vector<std::string>{ "Vega" });
+
+                db.freeze();
+            }
+        }
+    }
+}
+
+TEST_CASE("Random frozen name database", "[NameDatabase]")
+{
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> letter(0, 25);
+    std::uniform_int_distribution<int> length(1, 10);
+    std::uniform_int_distribution<AstroCatalog::IndexNumber> number(0, 2000);
+
+    NameDatabase db;
+    NameDatabase frozen;
+    std::vector<std::string> added;
+    for (int i = 0; i < 10000; i++)
+    {
+        std::string name;
+        for (int n = length(rng); n > 0; n--)
+            name += (char) ((n & 1 ? 'a' : 'A') + letter(rng));
+        AstroCatalog::IndexNumber catalogNumber = number(rng);
+        db.add(catalogNumber, name);
+        frozen.add(catalogNumber, name);
+        added.push_back(name);
+    }
+    frozen.freeze();
+
+    REQUIRE(frozen.getNameCount() == db.getNameCount());
+    for (auto name : added)
+    {
+        REQUIRE(frozen.getCatalogNumberByName(name) == db.getCatalogNumberByName(name));
+        for (auto& c : name)
+            c = (char) toupper(c);
+        REQUIRE(frozen.getCatalogNumberByName(name) == db.getCatalogNumberByName(name));
+        name += "x";
+        REQUIRE(frozen.getCatalogNumberByName(name) == db.getCatalogNumberByName(name));
+    }
+    for (AstroCatalog::IndexNumber i = 0; i <= 2001; i++)
+        REQUIRE(names(frozen, i) == names(db, i));
+}
+
+TEST_CASE("Name lookup speed", "[!benchmark]")
+{
+    NameDatabase db;
+    NameDatabase frozen;
+    std::vector<std::string> added;
+    for (int i = 1; i <= 2000000; i++)
+    {
+        std::string name = "TYC " + std::to_string(i / 200 + 1) + "-" + std::to_string(i % 200 + 1) + "-1";
+        db.add(i, name);
+        frozen.add(i, name);
+        if (i % 1000 == 0)
+            added.push_back(name);
+    }
+    frozen.freeze();
+
+    size_t i = 0;
+    BENCHMARK("Name lookups in the maps")
+    {
+        return db.getCatalogNumberByName(added[i++ % added.size()]);
+    };
+
+    BENCHMARK("Name lookups in the tables")
+    {
+        return frozen.getCatalogNumberByName(added[i++ % added.size()]);
+    };
+
+    BENCHMARK("Number lookups in the maps")
+    {
+        return db.getFirstName((AstroCatalog::IndexNumber) (i++ * 997 % 2000000));
+    };
+
+    BENCHMARK("Number lookups in the tables")
+    {
+        return frozen.getFirstName((AstroCatalog::IndexNumber) (i++ * 997 % 2000000));
+    };
+}
@@ -0,0 +1,113 @@
+#include <celengine/staroctree.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace Eigen;
+
+// Per object work small enough that the cost of handing the candidates
+// over dominates
+class StarCounter : public StarHandler
+{
+ public:
+    void process(const Star& star, float distance, float appMag) override
+    {
+        count++;
+        sum += distance + appMag + star.getAbsoluteMagnitude();
+    }
+
+    size_t count{ 0 };
+    float sum{ 0.0f };
+};
+
+// Same work, but every candidate of a node goes through one virtual call
+class BatchStarCounter : public StarCounter
+{
+ public:
+    void processBatch(const Candidate* candidates, size_t n) override
+    {
+        for (size_t i = 0; i < n; i++)
+            StarCounter::process(*candidates[i].obj, candidates[i].distance, candidates[i].appMag);
+    }
+};
+
+
+static std::vector<Star> CreateStars(size_t nStars)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> absMag(-5.0f, 15.0f);
+    std::vector<Star> stars(nStars);
+    for (auto& star : stars)
+    {
+        star.setPosition(position(gen), position(gen), position(gen));
+        star.setAbsoluteMagnitude(absMag(gen));
+    }
+    return stars;
+}
+
+// Planes which don't cull anything
+static void InfiniteFrustum(Hyperplane<float, 3>* planes)
+{
+    for (int i = 0; i < 5; i++)
+        planes[i] = Hyperplane<float, 3>(Vector3f::UnitZ(), 1.0e9f);
+}
+
+
+TEST_CASE("Octree batches", "[Octree]")
+{
+    std::vector<Star> stars = CreateStars(1000);
+    StarOctree octree(Vector3f::Zero(), 1000.0f, stars.data(), (unsigned int) stars.size());
+    Hyperplane<float, 3> frustum[5];
+    InfiniteFrustum(frustum);
+
+    // With the observer inside the node and no limit on the magnitude,
+    // every star is a candidate, whichever way it's handed over.
+    StarCounter counter;
+    BatchStarCounter batchCounter;
+    octree.processVisibleObjects(counter, Vector3f::Zero(), frustum, 100.0f, 1000.0f);
+    octree.processVisibleObjects(batchCounter, Vector3f::Zero(), frustum, 100.0f, 1000.0f);
+    REQUIRE(counter.count == stars.size());
+    REQUIRE(batchCounter.count == stars.size());
+    REQUIRE(batchCounter.sum == counter.sum);
+}
+
+
+TEST_CASE("Octree candidate overhead", "[!benchmark]")
+{
+    // One node of stars, with one virtual call per star through the
+    // default processBatch(), as before the candidates were batched, and
+    // one per node with an override.
+    std::vector<Star> stars = CreateStars(100000);
+    StarOctree octree(Vector3f::Zero(), 1000.0f, stars.data(), (unsigned int) stars.size());
+    Hyperplane<float, 3> frustum[5];
+    InfiniteFrustum(frustum);
+
+    // The counters are picked at run time, as the renderer's handlers are,
+    // so that the compiler can't turn the virtual calls into direct ones.
+    std::vector<std::unique_ptr<StarCounter>> counters;
+    counters.emplace_back(new StarCounter());
+    counters.emplace_back(new BatchStarCounter());
+    volatile size_t perStar = 0;
+    volatile size_t perBatch = 1;
+
+    BENCHMARK("Call per star")
+    {
+        StarCounter& counter = *counters[perStar];
+        counter.sum = 0.0f;
+        octree.processVisibleObjects(counter, Vector3f::Zero(), frustum, 100.0f, 1000.0f);
+        return counter.sum;
+    };
+
+    BENCHMARK("Call per batch")
+    {
+        StarCounter& counter = *counters[perBatch];
+        counter.sum = 0.0f;
+        octree.processVisibleObjects(counter, Vector3f::Zero(), frustum, 100.0f, 1000.0f);
+        return counter.sum;
+    };
+}
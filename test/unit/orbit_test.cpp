@@ -0,0 +1,354 @@
+#include <celephem/chebyshevorbit.h>
+#include <celephem/customorbit.h>
+#include <celephem/customrotation.h>
+#include <celephem/orbit.h>
+#include <celephem/rotation.h>
+#include <celephem/samporbit.h>
+#include <celephem/xyzvbinary.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <Eigen/Geometry>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const int NThreads = 8;
+constexpr const int NTimes = 2000;
+constexpr const double StartTime = 2451545.0;
+
+struct OrbitState
+{
+    Vector3d position;
+    Vector3d velocity;
+};
+
+static double sampleTime(int i)
+{
+    // Unevenly spaced times, so that the sampled orbit is evaluated both
+    // within and across sample intervals
+    return StartTime + i * 0.37 + 0.1 * std::sin(i * 1.7);
+}
+
+static OrbitState evaluate(const Orbit* orbit, double t)
+{
+    // Ask for the velocity first at every other time, to exercise both
+    // orders of cache updates
+    OrbitState s;
+    if ((int) t % 2 == 0)
+    {
+        s.velocity = orbit->velocityAtTime(t);
+        s.position = orbit->positionAtTime(t);
+    }
+    else
+    {
+        s.position = orbit->positionAtTime(t);
+        s.velocity = orbit->velocityAtTime(t);
+    }
+    return s;
+}
+
+// Removes a file written by a test, even when a check fails
+struct TemporaryFile
+{
+    ~TemporaryFile() { std::remove(name); }
+    const char* name;
+};
+
+static bool writeTrajectory(const char* filename, bool withVelocity)
+{
+    std::ofstream out(filename);
+    if (!out.good())
+        return false;
+
+    out.precision(17);
+    for (int i = 0; i < 1000; i++)
+    {
+        double t = StartTime - 10.0 + i * 1.01;
+        out << t << ' ' << 7000.0 * std::cos(t * 0.3) << ' ' << 7000.0 * std::sin(t * 0.3) << ' '
+            << 100.0 * std::sin(t * 0.05);
+        if (withVelocity)
+        {
+            out << ' ' << -2100.0 * std::sin(t * 0.3) / 86400.0 << ' '
+                << 2100.0 * std::cos(t * 0.3) / 86400.0 << ' ' << 5.0 * std::cos(t * 0.05) / 86400.0;
+        }
+        out << '\n';
+    }
+
+    return out.good();
+}
+
+TEST_CASE("Concurrent orbit evaluation", "[Orbit]")
+{
+    const char* xyzvFile = "orbit_test.xyzv";
+    const char* xyzFile = "orbit_test.xyz";
+    TemporaryFile files[] = { { xyzvFile }, { xyzFile } };
+    REQUIRE(writeTrajectory(xyzvFile, true));
+    REQUIRE(writeTrajectory(xyzFile, false));
+
+    std::vector<std::unique_ptr<Orbit>> orbits;
+    for (const char* name : { "vsop87-earth", "vsop87-jupiter", "moon", "io", "titan" })
+    {
+        Orbit* orbit = GetCustomOrbit(name);
+        REQUIRE(orbit != nullptr);
+        orbits.emplace_back(orbit);
+    }
+    orbits.emplace_back(LoadXYZVTrajectoryDoublePrec(xyzvFile, TrajectoryInterpolationCubic));
+    orbits.emplace_back(LoadXYZVTrajectoryDoublePrec(xyzvFile, TrajectoryInterpolationLinear));
+    orbits.emplace_back(LoadSampledTrajectoryDoublePrec(xyzFile, TrajectoryInterpolationCubic));
+    orbits.emplace_back(LoadSampledTrajectorySinglePrec(xyzFile, TrajectoryInterpolationLinear));
+
+    std::vector<const RotationModel*> rotations;
+    for (const char* name : { "iau-earth", "earth-p03lp", "iau-jupiter" })
+    {
+        const RotationModel* rotation = GetCustomRotationModel(name);
+        REQUIRE(rotation != nullptr);
+        rotations.push_back(rotation);
+    }
+
+    size_t nOrbits = orbits.size();
+    size_t nRotations = rotations.size();
+
+    // Results computed serially, evaluating each model over all times
+    std::vector<OrbitState> orbitStates(nOrbits * NTimes);
+    std::vector<Quaterniond> orientations(nRotations * NTimes);
+    std::vector<Vector3d> angularVelocities(nRotations * NTimes);
+    for (size_t j = 0; j < nOrbits; j++)
+    {
+        REQUIRE(orbits[j] != nullptr);
+        for (int i = 0; i < NTimes; i++)
+            orbitStates[j * NTimes + i] = evaluate(orbits[j].get(), sampleTime(i));
+    }
+    for (size_t j = 0; j < nRotations; j++)
+    {
+        for (int i = 0; i < NTimes; i++)
+        {
+            orientations[j * NTimes + i] = rotations[j]->orientationAtTime(sampleTime(i));
+            angularVelocities[j * NTimes + i] = rotations[j]->angularVelocityAtTime(sampleTime(i));
+        }
+    }
+
+    // Every thread evaluates all models, interleaved and starting at a
+    // different time, so that they share the models but not their order.
+    std::atomic<int> mismatches{ 0 };
+    std::vector<std::thread> threads;
+    for (int k = 0; k < NThreads; k++)
+    {
+        threads.emplace_back([&, k]
+        {
+            for (int n = 0; n < NTimes; n++)
+            {
+                int i = (n * 7 + k * 251) % NTimes;
+                double t = sampleTime(i);
+                for (size_t j = 0; j < nOrbits; j++)
+                {
+                    OrbitState s = evaluate(orbits[j].get(), t);
+                    const OrbitState& expected = orbitStates[j * NTimes + i];
+                    if (s.position != expected.position || s.velocity != expected.velocity)
+                        mismatches++;
+                }
+                for (size_t j = 0; j < nRotations; j++)
+                {
+                    Quaterniond q = rotations[j]->orientationAtTime(t);
+                    Vector3d w = rotations[j]->angularVelocityAtTime(t);
+                    if (q.coeffs() != orientations[j * NTimes + i].coeffs() ||
+                        w != angularVelocities[j * NTimes + i])
+                    {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(mismatches == 0);
+}
+
+
+TEST_CASE("Orbit cache speed", "[!benchmark]")
+{
+    // As many orbits as in a catalog with the major moons and some of the
+    // minor bodies, each evaluated several times per frame
+    constexpr const int NOrbits = 2000;
+    const char* names[] = { "vsop87-earth", "vsop87-jupiter", "moon", "io", "titan" };
+    std::vector<std::unique_ptr<Orbit>> orbits;
+    for (int i = 0; i < NOrbits; i++)
+        orbits.emplace_back(GetCustomOrbit(names[i % 5], false));
+
+    double t = StartTime;
+    BENCHMARK("Three evaluations per orbit")
+    {
+        t += 1.0;
+        Vector3d sum = Vector3d::Zero();
+        for (int pass = 0; pass < 3; pass++)
+        {
+            for (const auto& orbit : orbits)
+                sum += orbit->positionAtTime(t);
+        }
+        return sum;
+    };
+
+    BENCHMARK("One evaluation per orbit")
+    {
+        t += 1.0;
+        Vector3d sum = Vector3d::Zero();
+        for (const auto& orbit : orbits)
+            sum += orbit->positionAtTime(t);
+        return sum;
+    };
+}
+
+
+TEST_CASE("Chebyshev ephemeris", "[Orbit]")
+{
+    constexpr double Tolerance = 1.0;
+    constexpr double EndTime = StartTime + 100.0;
+
+    for (const char* name : { "moon", "io", "vsop87-mars" })
+    {
+        INFO("Orbit " << name);
+        std::unique_ptr<Orbit> orbit(GetCustomOrbit(name, false));
+        REQUIRE(orbit != nullptr);
+
+        std::unique_ptr<ChebyshevEphemeris> fitted(ChebyshevEphemeris::fit(*orbit, StartTime, EndTime, Tolerance));
+        REQUIRE(fitted != nullptr);
+
+        // The ephemeris read back from a file gives the same results
+        std::stringstream file;
+        REQUIRE(fitted->save(file));
+        ChebyshevEphemeris* loaded = ChebyshevEphemeris::load(file);
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getSegmentCount() == fitted->getSegmentCount());
+
+        ChebyshevOrbit chebyshevOrbit(GetCustomOrbit(name, false), loaded);
+        for (int i = 0; i < NTimes; i++)
+        {
+            double t = StartTime + (EndTime - StartTime) * i / (NTimes - 1);
+            Vector3d position = orbit->positionAtTime(t);
+            Vector3d velocity = orbit->velocityAtTime(t);
+            REQUIRE(chebyshevOrbit.positionAtTime(t) == fitted->position(t));
+            REQUIRE((chebyshevOrbit.positionAtTime(t) - position).norm() <= Tolerance);
+            REQUIRE((chebyshevOrbit.velocityAtTime(t) - velocity).norm() <= velocity.norm() * 1.0e-2);
+        }
+
+        // Outside the span of the ephemeris, the orbit is computed as usual
+        for (double t : { StartTime - 10.0, EndTime + 10.0 })
+            REQUIRE(chebyshevOrbit.positionAtTime(t) == orbit->positionAtTime(t));
+    }
+
+    SECTION("Truncated files are rejected")
+    {
+        std::unique_ptr<Orbit> orbit(GetCustomOrbit("io", false));
+        std::unique_ptr<ChebyshevEphemeris> fitted(ChebyshevEphemeris::fit(*orbit, StartTime, EndTime, Tolerance));
+        std::stringstream file;
+        REQUIRE(fitted->save(file));
+        std::string contents = file.str();
+        std::stringstream truncated(contents.substr(0, contents.size() - 8));
+        REQUIRE(ChebyshevEphemeris::load(truncated) == nullptr);
+    }
+
+    SECTION("Corrupt segment counts are rejected")
+    {
+        std::unique_ptr<Orbit> orbit(GetCustomOrbit("io", false));
+        std::unique_ptr<ChebyshevEphemeris> fitted(ChebyshevEphemeris::fit(*orbit, StartTime, EndTime, Tolerance));
+        std::stringstream file;
+        REQUIRE(fitted->save(file));
+        std::string contents = file.str();
+
+        // The little-endian segment count follows the header, the version
+        // and the number of coefficients.
+        for (uint32_t nSegments : { fitted->getSegmentCount() + 1, 0x10000000u, 0xffffffffu })
+        {
+            for (int i = 0; i < 4; i++)
+                contents[16 + i] = (char) (nSegments >> (i * 8));
+            std::stringstream corrupt(contents);
+            REQUIRE(ChebyshevEphemeris::load(corrupt) == nullptr);
+        }
+    }
+}
+
+// Write an indexed trajectory of nSamples samples one day apart, in
+// buckets of two days, with the index modified by corrupt.
+template<typename F> static bool writeIndexedTrajectory(const char* filename, uint64_t nSamples, F corrupt)
+{
+    XYZVIndexedHeader header;
+    std::memcpy(header.magic, "CELXYZI", 8);
+    header.byteOrder = __BYTE_ORDER__;
+    header.digits = std::numeric_limits<double>::digits;
+    header.reserved = 0;
+    header.count = nSamples;
+    header.bucketCount = (nSamples + 1) / 2;
+    header.startTime = StartTime;
+    header.bucketWidth = 2.0;
+    header.boundingRadius = 8000.0;
+
+    std::vector<uint64_t> index;
+    for (uint64_t i = 0; i <= header.bucketCount; i++)
+        index.push_back(std::min(i * 2, nSamples));
+    std::vector<XYZVBinaryData> samples(nSamples);
+    for (uint64_t i = 0; i < nSamples; i++)
+        samples[i] = { StartTime + i, { 7000.0, (double) i, 0.0 }, { 0.0, 1.0 / 86400.0, 0.0 } };
+    corrupt(header, index);
+
+    std::ofstream out(filename, std::ios::out | std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(XYZVBinaryData));
+    return out.good();
+}
+
+TEST_CASE("Corrupt indexed trajectories", "[Orbit]")
+{
+    // The indexed file, the trajectory file name followed by idx, is
+    // always tried first. The trajectory file itself doesn't exist, so a
+    // rejected index makes the load fail rather than fall back to it.
+    const char* xyzvFile = "orbit_test_idx.xyzv";
+    const char* idxFile = "orbit_test_idx.xyzvidx";
+    TemporaryFile file{ idxFile };
+    using Index = std::vector<uint64_t>;
+    auto load = [&]() { return std::unique_ptr<Orbit>(LoadXYZVTrajectoryDoublePrec(xyzvFile, TrajectoryInterpolationLinear)); };
+
+    REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader&, Index&) {}));
+    std::unique_ptr<Orbit> orbit = load();
+    REQUIRE(orbit != nullptr);
+    REQUIRE(orbit->positionAtTime(StartTime + 10.5).isApprox(Vector3d(7000.0, 0.0, -10.5)));
+
+    SECTION("Index entries out of order")
+    {
+        REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader&, Index& index) { std::swap(index[10], index[20]); }));
+        REQUIRE(load() == nullptr);
+    }
+
+    SECTION("Index entries past the samples")
+    {
+        REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader&, Index& index) { index[25] = 1000; }));
+        REQUIRE(load() == nullptr);
+    }
+
+    SECTION("Counts overflowing the size check")
+    {
+        REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader& header, Index&) { header.count += 1ull << 58; }));
+        REQUIRE(load() == nullptr);
+        REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader& header, Index&) { header.bucketCount = ~0ull; }));
+        REQUIRE(load() == nullptr);
+    }
+
+    SECTION("Truncated file")
+    {
+        REQUIRE(writeIndexedTrajectory(idxFile, 100, [](XYZVIndexedHeader& header, Index&) { header.count = 101; }));
+        REQUIRE(load() == nullptr);
+    }
+}
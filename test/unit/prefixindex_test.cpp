@@ -0,0 +1,182 @@
+#include <celengine/name.h>
+#include <celutil/prefixindex.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+TEST_CASE("Prefix index", "[PrefixIndex]")
+{
+    PrefixIndex index;
+    std::vector<std::string> names = { "Sirius", "SIRIUS B", "Sirrah", "Sol", "Spica", "sirius a" };
+    for (size_t i = 0; i < names.size(); i++)
+        index.add(names[i], (PrefixIndex::Value) i);
+    index.build();
+
+    SECTION("Matches ignore case and are ranked by length")
+    {
+        std::vector<PrefixIndex::Value> values;
+        index.find({ "sir" }, values);
+        REQUIRE(values == std::vector<PrefixIndex::Value>{ 0, 2, 5, 1 });
+
+        values.clear();
+        index.find({ "SIRIUS" }, values);
+        REQUIRE(values == std::vector<PrefixIndex::Value>{ 0, 5, 1 });
+    }
+
+    SECTION("Results are limited to the best matches")
+    {
+        std::vector<PrefixIndex::Value> values;
+        index.find({ "s" }, values, 2);
+        REQUIRE(values == std::vector<PrefixIndex::Value>{ 3, 4 });
+    }
+
+    SECTION("Overlapping prefixes don't give duplicates")
+    {
+        std::vector<PrefixIndex::Value> values;
+        index.find({ "sirius", "sp", "si" }, values);
+        REQUIRE(values == std::vector<PrefixIndex::Value>{ 4, 0, 2, 5, 1 });
+    }
+
+    SECTION("Missing prefixes give no results")
+    {
+        std::vector<PrefixIndex::Value> values;
+        index.find({ "Vega" }, values);
+        index.find({ "Sirius C" }, values);
+        REQUIRE(values.empty());
+    }
+}
+
+TEST_CASE("Name completion", "[NameDatabase]")
+{
+    NameDatabase db;
+    db.add(1, "ALF Cen");
+    db.add(2, "Alkaid");
+    db.add(3, "Alhena");
+    db.add(4, "Mizar");
+    db.add(5, "Al");
+
+    SECTION("Indexed completion is the same as searching all the names")
+    {
+        std::vector<std::string> prefixes = { "al", "AL", "alp", "Alf C", "Miz", "x", "" };
+        std::vector<std::vector<std::string>> expected;
+        for (const auto& prefix : prefixes)
+            expected.push_back(db.getCompletion(prefix));
+
+        db.freeze();
+        for (size_t i = 0; i < prefixes.size(); i++)
+            REQUIRE(db.getCompletion(prefixes[i]) == expected[i]);
+    }
+
+    SECTION("Greek letter abbreviations are completed")
+    {
+        db.freeze();
+        REQUIRE(db.getCompletion("alp") == std::vector<std::string>{ "α Cen" });
+        REQUIRE(db.getCompletion("alf c") == std::vector<std::string>{ "α Cen" });
+        REQUIRE(db.getCompletion("alp", false).empty());
+    }
+
+    SECTION("Exact matches are ranked first")
+    {
+        db.freeze();
+        REQUIRE(db.getCompletion("al", false) == std::vector<std::string>{ "Al", "Alhena", "Alkaid" });
+        REQUIRE(db.getCompletion("al", false, 2) == std::vector<std::string>{ "Al", "Alhena" });
+        REQUIRE(db.getCompletion("al") == std::vector<std::string>{ "Al", "Alhena", "Alkaid", "α Cen" });
+    }
+
+    SECTION("Names added after indexing are completed")
+    {
+        db.freeze();
+        db.add(6, "Alcor");
+        REQUIRE(db.getCompletion("alc") == std::vector<std::string>{ "Alcor" });
+        db.freeze();
+        REQUIRE(db.getCompletion("alc") == std::vector<std::string>{ "Alcor" });
+    }
+
+    SECTION("Ranked completions are in the order of the index")
+    {
+        std::vector<std::string> completion = { "Alkaid", "Al", "alhena", "α Cen", "Alcor" };
+        RankCompletion(completion);
+        REQUIRE(completion == std::vector<std::string>{ "Al", "Alcor", "alhena", "Alkaid", "α Cen" });
+        RankCompletion(completion, 1);
+        REQUIRE(completion == std::vector<std::string>{ "Al" });
+    }
+}
+
+TEST_CASE("Random name completion", "[NameDatabase]")
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> letter(0, 5);
+    std::uniform_int_distribution<int> length(1, 8);
+
+    NameDatabase db;
+    for (AstroCatalog::IndexNumber i = 0; i < 5000; i++)
+    {
+        std::string name;
+        for (int n = length(rng); n > 0; n--)
+            name += (char) ((i & 1 ? 'a' : 'A') + letter(rng));
+        db.add(i, name);
+    }
+
+    std::vector<std::string> prefixes = { "", "a", "Ab", "bcd", "FEDC", "aaaa", "fffffffff" };
+    std::vector<std::vector<std::string>> expected;
+    std::vector<std::vector<std::string>> expectedLimited;
+    for (const auto& prefix : prefixes)
+    {
+        expected.push_back(db.getCompletion(prefix, false));
+        expectedLimited.push_back(db.getCompletion(prefix, false, 100));
+    }
+
+    db.freeze();
+    for (size_t i = 0; i < prefixes.size(); i++)
+    {
+        REQUIRE(db.getCompletion(prefixes[i], false) == expected[i]);
+        REQUIRE(db.getCompletion(prefixes[i], false, 100) == expectedLimited[i]);
+    }
+}
+
+TEST_CASE("Name completion speed", "[!benchmark]")
+{
+    // Cross-index designations in the style of the HIP, TYC and Gaia
+    // catalogs, in one database searched without an index and another one
+    // with the index.
+    NameDatabase db;
+    NameDatabase indexed;
+    AstroCatalog::IndexNumber n = 0;
+    auto add = [&](const std::string& name)
+    {
+        db.add(n, name);
+        indexed.add(n, name);
+        n++;
+    };
+    for (int i = 1; i <= 120000; i++)
+        add("HIP " + std::to_string(i));
+    for (int i = 1; i <= 9500; i++)
+        for (int j = 1; j <= 150; j++)
+            add("TYC " + std::to_string(i) + "-" + std::to_string(j) + "-1");
+    for (int i = 0; i < 500000; i++)
+        add("Gaia DR2 " + std::to_string(4000000000000000000ull + i * 7919ull));
+
+    // Indexing is done once per catalog, so it's only timed once
+    auto start = std::chrono::steady_clock::now();
+    indexed.freeze();
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    WARN("Indexed " << indexed.getNameCount() << " names in " << duration.count() << " ms");
+
+    for (const char* prefix : { "T", "TYC 12", "hip 4711", "Gaia DR2 40000000000001" })
+    {
+        BENCHMARK(std::string("Indexed completion of ") + prefix)
+        {
+            return indexed.getCompletion(prefix, true, 1000);
+        };
+
+        BENCHMARK(std::string("Searched completion of ") + prefix)
+        {
+            return db.getCompletion(prefix, true, 1000);
+        };
+    }
+}
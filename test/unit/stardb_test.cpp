@@ -0,0 +1,221 @@
+#include <celengine/stardb.h>
+#include <celengine/stellarclass.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const char* OctreeFileName = "stardb_test.stoct";
+
+// Removes a file written by a test, even when a check fails
+struct TemporaryFile
+{
+    ~TemporaryFile() { std::remove(name); }
+    const char* name;
+};
+
+template<typename T> static void writeLE(std::string& out, T value)
+{
+    for (size_t i = 0; i < sizeof value; i++)
+        out += (char) (value >> (i * 8));
+}
+
+static void writeLE(std::string& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    writeLE(out, bits);
+}
+
+// A binary star database of stars scattered within a few hundred light
+// years of the Sun. Each star is written copies times, so that queries
+// have to choose between stars with equal keys.
+static std::string createStarFile(uint32_t nStars, uint32_t copies = 1)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_int_distribution<int> absMag(-5 * 256, 15 * 256);
+    uint16_t spectralType = StellarClass(StellarClass::NormalStar, StellarClass::Spectral_G, 2,
+                                         StellarClass::Lum_V).packV1();
+
+    std::string data("CELSTARS");
+    writeLE(data, (uint16_t) 0x0100);
+    writeLE(data, nStars * copies);
+    for (uint32_t i = 0; i < nStars; i++)
+    {
+        float x = position(gen);
+        float y = position(gen);
+        float z = position(gen);
+        auto mag = (uint16_t) (int16_t) absMag(gen);
+        for (uint32_t j = 0; j < copies; j++)
+        {
+            writeLE(data, i * copies + j + 1);
+            writeLE(data, x);
+            writeLE(data, y);
+            writeLE(data, z);
+            writeLE(data, mag);
+            writeLE(data, spectralType);
+        }
+    }
+    return data;
+}
+
+static void writeOctreeFile(const std::string& stars)
+{
+    std::istringstream in(stars);
+    std::ofstream out(OctreeFileName, std::ios::out | std::ios::binary);
+    REQUIRE(StarDatabase::writeOctreeBinary(in, out));
+}
+
+// Check the nearest stars found through the octree against all the stars
+static void checkNearestStars(const StarDatabase& starDB, const Vector3f& position)
+{
+    std::vector<const Star*> nearStars;
+    starDB.findNearestStars(position, 20, nearStars);
+
+    std::vector<float> expected;
+    for (uint32_t i = 0; i < starDB.size(); i++)
+        expected.push_back((starDB.getStar(i)->getPosition() - position).squaredNorm());
+    std::sort(expected.begin(), expected.end());
+    expected.resize(20);
+
+    REQUIRE(nearStars.size() == expected.size());
+    for (size_t i = 0; i < nearStars.size(); i++)
+        REQUIRE((nearStars[i]->getPosition() - position).squaredNorm() == expected[i]);
+}
+
+
+TEST_CASE("Prebuilt star octree", "[StarDatabase]")
+{
+    constexpr uint32_t NStars = 5000;
+    TemporaryFile file{ OctreeFileName };
+    writeOctreeFile(createStarFile(NStars));
+
+    // Offset of the root node, after the header, the star records and the
+    // catalog number index
+    constexpr size_t RootOffset = 20 + NStars * 24;
+
+    SECTION("Octrees built with the current parameters are used")
+    {
+        StarDatabase starDB;
+        REQUIRE(starDB.loadOctreeBinary(OctreeFileName));
+        starDB.finish();
+        REQUIRE(starDB.size() == NStars);
+        REQUIRE(starDB.find(1) != nullptr);
+        checkNearestStars(starDB, Vector3f(10.0f, -20.0f, 30.0f));
+    }
+
+    SECTION("Octrees built with other parameters are rebuilt")
+    {
+        // The root scale, then the root exclusion factor
+        for (size_t offset : { RootOffset + 16, RootOffset + 12 })
+        {
+            INFO("Offset " << offset);
+            writeOctreeFile(createStarFile(NStars));
+            {
+                std::fstream f(OctreeFileName, std::ios::in | std::ios::out | std::ios::binary);
+                std::string value;
+                writeLE(value, 2.0e9f);
+                f.seekp(offset);
+                f.write(value.data(), value.size());
+                REQUIRE(f.good());
+            }
+
+            StarDatabase starDB;
+            REQUIRE(starDB.loadOctreeBinary(OctreeFileName));
+            starDB.finish();
+            REQUIRE(starDB.size() == NStars);
+            REQUIRE(starDB.find(NStars) != nullptr);
+            checkNearestStars(starDB, Vector3f(10.0f, -20.0f, 30.0f));
+            checkNearestStars(starDB, Vector3f(400.0f, 400.0f, -400.0f));
+        }
+    }
+}
+
+
+typedef std::function<float(const Star&)> StarKey;
+
+// Check the stars selected by a query against a full sort of the stars
+// accepted by the filter. Stars with equal keys may be chosen either way,
+// so only the keys are compared.
+static void checkBestStars(const StarDatabase& starDB, unsigned int maxStars,
+                           const StarDatabase::StarFilter& filter, const StarKey& key,
+                           const std::vector<const Star*>& bestStars)
+{
+    std::vector<float> expected;
+    for (uint32_t i = 0; i < starDB.size(); i++)
+    {
+        const Star* star = starDB.getStar(i);
+        if (!filter || filter(*star))
+            expected.push_back(key(*star));
+    }
+    std::sort(expected.begin(), expected.end());
+    if (expected.size() > maxStars)
+        expected.resize(maxStars);
+
+    REQUIRE(bestStars.size() == expected.size());
+    for (size_t i = 0; i < bestStars.size(); i++)
+    {
+        INFO("Star " << i);
+        REQUIRE((!filter || filter(*bestStars[i])));
+        REQUIRE(key(*bestStars[i]) == expected[i]);
+    }
+}
+
+
+TEST_CASE("Best star queries", "[StarDatabase]")
+{
+    // Every position holds three stars
+    constexpr uint32_t NStars = 2000;
+    constexpr uint32_t Copies = 3;
+    std::istringstream in(createStarFile(NStars, Copies));
+    StarDatabase starDB;
+    REQUIRE(starDB.loadBinary(in));
+    starDB.finish();
+    REQUIRE(starDB.size() == NStars * Copies);
+
+    // One star in a hundred, so that some queries ask for more stars than
+    // there are candidates
+    StarDatabase::StarFilter sparse = [](const Star& star) { return star.getIndex() % 100 == 0; };
+
+    for (const auto& position : { Vector3f(0.0f, 0.0f, 0.0f),
+                                  Vector3f(123.0f, -45.0f, 300.0f),
+                                  Vector3f(5000.0f, 0.0f, 0.0f) })
+    {
+        INFO("Position " << position.transpose());
+        StarKey distance = [&position](const Star& star)
+        {
+            return (star.getPosition() - position).squaredNorm();
+        };
+        StarKey appMag = [&position](const Star& star)
+        {
+            return star.getApparentMagnitude((star.getPosition() - position).norm());
+        };
+
+        for (unsigned int maxStars : { 0u, 1u, 2u, 10u, 100u, 1000u, NStars * Copies + 10 })
+        {
+            for (const auto& filter : { StarDatabase::StarFilter(), sparse })
+            {
+                INFO("maxStars " << maxStars << (filter ? ", filtered" : ""));
+
+                std::vector<const Star*> nearStars;
+                starDB.findNearestStars(position, maxStars, nearStars, filter);
+                checkBestStars(starDB, maxStars, filter, distance, nearStars);
+
+                std::vector<const Star*> brightStars;
+                starDB.findBrighterStars(position, maxStars, brightStars, filter);
+                checkBestStars(starDB, maxStars, filter, appMag, brightStars);
+            }
+        }
+    }
+}
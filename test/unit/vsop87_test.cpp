@@ -0,0 +1,130 @@
+#include <celephem/orbit.h>
+#include <celephem/vsop87.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace Eigen;
+
+constexpr const double J2000 = 2451545.0;
+constexpr const double DaysPerYear = 365.25;
+
+static const char* const OrbitNames[] =
+{
+    "vsop87-mercury",
+    "vsop87-venus",
+    "vsop87-earth",
+    "vsop87-mars",
+    "vsop87-jupiter",
+    "vsop87-saturn",
+    "vsop87-uranus",
+    "vsop87-neptune",
+    "vsop87-sun",
+};
+
+struct Sample
+{
+    double t;
+    Vector3d position;
+    Vector3d velocity;
+};
+
+class SampleList : public OrbitSampleProc
+{
+ public:
+    void sample(double t, const Vector3d& position, const Vector3d& velocity) override
+    {
+        samples.push_back({ t, position, velocity });
+    }
+
+    std::vector<Sample> samples;
+};
+
+TEST_CASE("VSOP87 vectorized evaluation", "[VSOP87]")
+{
+    for (const char* name : OrbitNames)
+    {
+        std::unique_ptr<Orbit> vectorized(CreateVSOP87Orbit(name, true));
+        std::unique_ptr<Orbit> scalar(CreateVSOP87Orbit(name, false));
+        REQUIRE(vectorized != nullptr);
+        REQUIRE(scalar != nullptr);
+
+        SECTION(std::string("Positions are the same as with scalar evaluation for ") + name)
+        {
+            // Every 29.3 days from 3000 years before J2000 to the year 4000,
+            // after which the orbits are extrapolated from their state at
+            // the end of the range. The mean longitudes grow by up to 26000
+            // radians per millenium, so rounding differences of a few ulps
+            // are a few meters.
+            for (double t = J2000 - 3000 * DaysPerYear; t < J2000 + 1998 * DaysPerYear; t += 29.3)
+            {
+                Vector3d expected = scalar->positionAtTime(t);
+                Vector3d position = vectorized->positionAtTime(t);
+                REQUIRE((position - expected).norm() < 1.0e-2);
+            }
+        }
+
+        // The Sun's orbit isn't periodic and doesn't have its own sampling
+        if (scalar->getPeriod() == 0.0)
+            continue;
+
+        SECTION(std::string("Sampled trajectories are the same as with scalar evaluation for ") + name)
+        {
+            double start = J2000 - 200 * DaysPerYear;
+            double end = start + scalar->getPeriod() * 1.1;
+            SampleList expected;
+            SampleList samples;
+            scalar->sample(start, end, expected);
+            vectorized->sample(start, end, samples);
+
+            REQUIRE(samples.samples.size() == expected.samples.size());
+            REQUIRE(samples.samples.back().t == end);
+            for (size_t i = 0; i < samples.samples.size(); i++)
+            {
+                const Sample& s = samples.samples[i];
+                const Sample& e = expected.samples[i];
+                REQUIRE(s.t == Approx(e.t).epsilon(1.0e-12));
+                REQUIRE((s.position - e.position).norm() < 1.0e-2);
+                REQUIRE((s.velocity - e.velocity).norm() < 1.0e-6 * e.velocity.norm() + 10.0);
+            }
+        }
+    }
+}
+
+TEST_CASE("VSOP87 evaluation speed", "[!benchmark]")
+{
+    std::unique_ptr<Orbit> vectorized(CreateVSOP87Orbit("vsop87-earth", true));
+    std::unique_ptr<Orbit> scalar(CreateVSOP87Orbit("vsop87-earth", false));
+
+    // Distinct times for each call, so that the position caches don't hit
+    double t = J2000;
+    BENCHMARK("Scalar")
+    {
+        t += 1.0;
+        return scalar->positionAtTime(t);
+    };
+
+    BENCHMARK("Vectorized")
+    {
+        t += 1.0;
+        return vectorized->positionAtTime(t);
+    };
+
+    BENCHMARK("Scalar sampling")
+    {
+        SampleList samples;
+        scalar->sample(J2000, J2000 + DaysPerYear, samples);
+        return samples.samples.size();
+    };
+
+    BENCHMARK("Vectorized sampling")
+    {
+        SampleList samples;
+        vectorized->sample(J2000, J2000 + DaysPerYear, samples);
+        return samples.samples.size();
+    };
+}